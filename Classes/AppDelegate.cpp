@@ -1,5 +1,6 @@
 #include "AppDelegate.h"
 #include "PaintLayer.h"
+#include "SyntheticStylus.h"
 
 USING_NS_CC;
 
@@ -27,6 +28,15 @@ bool AppDelegate::applicationDidFinishLaunching() {
     // create a scene. it's an autorelease object
     CCScene *pScene = PaintLayer::scene();
 
+#if (CC_TARGET_PLATFORM == CC_PLATFORM_LINUX)
+    // no pen on the desktop, PAINTING_SYNTHETIC_STYLUS=1 draws generated pen strokes instead
+    if (getenv("PAINTING_SYNTHETIC_STYLUS") != NULL)
+    {
+        PaintLayer *layer = (PaintLayer *)pScene->getChildByTag(kPaintLayerTag);
+        SyntheticStylus::create(layer)->start();
+    }
+#endif
+
     // run
     pDirector->runWithScene(pScene);
 
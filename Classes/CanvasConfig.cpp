@@ -0,0 +1,111 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "CanvasConfig.h"
+#include <vector>
+
+static unsigned int bytesPerPixel(CCTexture2DPixelFormat pixelFormat)
+{
+    switch (pixelFormat)
+    {
+        case kCCTexture2DPixelFormat_RGB565:
+        case kCCTexture2DPixelFormat_RGBA4444:
+        case kCCTexture2DPixelFormat_RGB5A1:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+unsigned int CanvasConfigMemoryUsage(const CanvasConfig &config, const CCSize &size)
+{
+    float scale = CC_CONTENT_SCALE_FACTOR() * config.resolutionScale;
+    unsigned int pixels = (unsigned int)ceilf(size.width * scale) * (unsigned int)ceilf(size.height * scale);
+    
+    //! the packed depth stencil buffer costs another 4 bytes per pixel
+    return pixels * (bytesPerPixel(config.pixelFormat) + 4);
+}
+
+CanvasConfig CanvasConfigForMemoryBudget(const CCSize &size, unsigned int budgetBytes, bool monochromeInk)
+{
+    //! best first, full resolution beats colour depth as long as the ink has colour
+    static const CanvasConfig colourConfigs[] = {
+        { kCCTexture2DPixelFormat_RGBA8888, 1.0f },
+        { kCCTexture2DPixelFormat_RGB565, 1.0f },
+        { kCCTexture2DPixelFormat_RGBA8888, 0.75f },
+        { kCCTexture2DPixelFormat_RGB565, 0.75f },
+        { kCCTexture2DPixelFormat_RGB565, 0.5f }
+    };
+    static const CanvasConfig monochromeConfigs[] = {
+        { kCCTexture2DPixelFormat_RGB565, 1.0f },
+        { kCCTexture2DPixelFormat_RGB565, 0.75f },
+        { kCCTexture2DPixelFormat_RGB565, 0.5f }
+    };
+    
+    const CanvasConfig *configs = monochromeInk ? monochromeConfigs : colourConfigs;
+    unsigned int count = monochromeInk ? sizeof(monochromeConfigs) / sizeof(CanvasConfig) : sizeof(colourConfigs) / sizeof(CanvasConfig);
+    
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        if (CanvasConfigMemoryUsage(configs[i], size) <= budgetBytes)
+        {
+            return configs[i];
+        }
+    }
+    
+    CCLOG("canvas needs %u bytes even at the lowest quality, budget is %u", CanvasConfigMemoryUsage(configs[count - 1], size), budgetBytes);
+    return configs[count - 1];
+}
+
+float CanvasConfigOverdraw(const CanvasConfig &config, float overdraw)
+{
+    float pixel = 1.0f / (CC_CONTENT_SCALE_FACTOR() * config.resolutionScale);
+    return MAX(overdraw, pixel);
+}
+
+void CanvasConfigUploadPixels(CCTexture2D *texture, const unsigned char *pixels, unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+    ccGLBindTexture2D(texture->getName());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    CCTexture2DPixelFormat pixelFormat = texture->getPixelFormat();
+    if (pixelFormat == kCCTexture2DPixelFormat_RGB565 || pixelFormat == kCCTexture2DPixelFormat_RGBA4444)
+    {
+        std::vector<GLushort> converted(width * height);
+        for (unsigned int i = 0; i < converted.size(); ++i)
+        {
+            const unsigned char *pixel = pixels + i * 4;
+            converted[i] = pixelFormat == kCCTexture2DPixelFormat_RGB565
+                ? (GLushort)(((pixel[0] >> 3) << 11) | ((pixel[1] >> 2) << 5) | (pixel[2] >> 3))
+                : (GLushort)(((pixel[0] >> 4) << 12) | ((pixel[1] >> 4) << 8) | ((pixel[2] >> 4) << 4) | (pixel[3] >> 4));
+        }
+        GLenum format = pixelFormat == kCCTexture2DPixelFormat_RGB565 ? GL_RGB : GL_RGBA;
+        GLenum type = pixelFormat == kCCTexture2DPixelFormat_RGB565 ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_SHORT_4_4_4_4;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (GLint)x, (GLint)y, (GLsizei)width, (GLsizei)height, format, type, &converted[0]);
+    }
+    else
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (GLint)x, (GLint)y, (GLsizei)width, (GLsizei)height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+}
@@ -0,0 +1,68 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _CANVAS_CONFIG_H_
+#define _CANVAS_CONFIG_H_
+
+#include "cocos2d.h"
+
+USING_NS_CC;
+
+//! canvas memory used when nothing else is asked for, fits a full quality retina iPad canvas
+#define kCanvasDefaultMemoryBudget (32 * 1024 * 1024)
+
+/**
+ Storage of the canvas render texture.
+
+ The canvas is opaque, so RGB565 loses nothing but colour depth and is what monochrome
+ ink gets: GLES2 can't render into luminance or palette textures, 16 bit is the
+ smallest colour attachment there is. RGBA4444 is only worth it for canvases that
+ need alpha.
+ */
+typedef struct _CanvasConfig
+{
+    CCTexture2DPixelFormat pixelFormat;
+    //! canvas pixels per screen pixel, below 1 the canvas is stretched over the screen
+    float resolutionScale;
+} CanvasConfig;
+
+static inline CanvasConfig CanvasConfigMake(CCTexture2DPixelFormat pixelFormat, float resolutionScale)
+{
+    CanvasConfig config;
+    config.pixelFormat = pixelFormat;
+    config.resolutionScale = resolutionScale;
+    return config;
+}
+
+//! bytes of colour and depth stencil buffer a canvas of size points needs
+unsigned int CanvasConfigMemoryUsage(const CanvasConfig &config, const CCSize &size);
+//! best looking config within budgetBytes, the smallest one if none fits
+CanvasConfig CanvasConfigForMemoryBudget(const CCSize &size, unsigned int budgetBytes, bool monochromeInk);
+//! anti aliasing fringe for the config, never narrower than a canvas pixel so thin lines don't break up
+float CanvasConfigOverdraw(const CanvasConfig &config, float overdraw);
+//! copies RGBA8 pixels, bottom row first, into a rect of a canvas texture, converted to its 16 bit format if it has one
+void CanvasConfigUploadPixels(CCTexture2D *texture, const unsigned char *pixels, unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+
+#endif // _CANVAS_CONFIG_H_
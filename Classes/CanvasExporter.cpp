@@ -0,0 +1,294 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "CanvasExporter.h"
+#include "PngStreamWriter.h"
+
+//! strips waiting for the encoder before readback pauses, bounds the memory in flight
+#define kMaxQueuedStrips 8
+
+CanvasExporter::CanvasExporter()
+: rowsPerStrip(64)
+, snapshot(NULL)
+, format(kCanvasExportPNG)
+, width(0)
+, height(0)
+, rowsRead(0)
+, readbackDone(false)
+, encodeDone(false)
+, succeeded(false)
+, running(false)
+, finished(false)
+, updateScheduled(false)
+, callbackTarget(NULL)
+, callbackSelector(NULL)
+{
+    pthread_mutex_init(&queueMutex, NULL);
+    pthread_cond_init(&queueCondition, NULL);
+}
+
+CanvasExporter::~CanvasExporter()
+{
+    CC_SAFE_RELEASE(snapshot);
+    CC_SAFE_RELEASE(callbackTarget);
+    for (unsigned int i = 0; i < strips.size(); ++i)
+    {
+        delete strips[i];
+    }
+    pthread_cond_destroy(&queueCondition);
+    pthread_mutex_destroy(&queueMutex);
+}
+
+CanvasExporter *CanvasExporter::create(CCRenderTexture *canvas, const char *aPath, CanvasExportFormat aFormat)
+{
+    CanvasExporter *pRet = new CanvasExporter();
+    if (pRet && pRet->initWithCanvas(canvas, aPath, aFormat))
+    {
+        pRet->autorelease();
+        return pRet;
+    }
+    CC_SAFE_DELETE(pRet);
+    return NULL;
+}
+
+bool CanvasExporter::initWithCanvas(CCRenderTexture *canvas, const char *aPath, CanvasExportFormat aFormat)
+{
+    if (canvas == NULL || aPath == NULL)
+    {
+        return false;
+    }
+
+    path = aPath;
+    format = aFormat;
+
+    CCSize size = canvas->getSprite()->getTexture()->getContentSize();
+    snapshot = CCRenderTexture::create(size.width, size.height, kCCTexture2DPixelFormat_RGBA8888);
+    if (snapshot == NULL)
+    {
+        return false;
+    }
+    snapshot->retain();
+
+    //! copied pixel for pixel, a canvas below screen resolution is exported at its own size
+    CCPoint position = canvas->getPosition();
+    float scale = canvas->getScale();
+    canvas->setPosition(size.width / 2, size.height / 2);
+    canvas->setScale(1.0f);
+
+    //! GPU side copy, the canvas may change while rows are read back over the next frames
+    snapshot->beginWithClear(0, 0, 0, 0);
+    canvas->visit();
+    snapshot->end();
+
+    canvas->setPosition(position);
+    canvas->setScale(scale);
+
+    const CCSize &pixelSize = snapshot->getSprite()->getTexture()->getContentSizeInPixels();
+    width = (unsigned int)pixelSize.width;
+    height = (unsigned int)pixelSize.height;
+    return true;
+}
+
+void CanvasExporter::setCompletionCallback(CCObject *target, SEL_CallFuncO selector)
+{
+    CC_SAFE_RETAIN(target);
+    CC_SAFE_RELEASE(callbackTarget);
+    callbackTarget = target;
+    callbackSelector = selector;
+}
+
+bool CanvasExporter::startEncoder()
+{
+    if (running || finished)
+    {
+        return false;
+    }
+
+    if (pthread_create(&encodeThread, NULL, &CanvasExporter::encodeThreadEntry, this) != 0)
+    {
+        CCLOG("CanvasExporter: could not start encoder thread");
+        return false;
+    }
+
+    running = true;
+    retain();
+    return true;
+}
+
+void CanvasExporter::start()
+{
+    if (startEncoder())
+    {
+        updateScheduled = true;
+        CCDirector::sharedDirector()->getScheduler()->scheduleUpdateForTarget(this, 0, false);
+    }
+}
+
+void CanvasExporter::start(FrameScheduler *scheduler)
+{
+    if (startEncoder())
+    {
+        scheduler->addTask(this, frametask_selector(CanvasExporter::readStep), kFrameTaskExport);
+    }
+}
+
+bool CanvasExporter::isFinished() const
+{
+    return finished;
+}
+
+bool CanvasExporter::isSucceeded() const
+{
+    return succeeded;
+}
+
+const std::string &CanvasExporter::getPath() const
+{
+    return path;
+}
+
+float CanvasExporter::getProgress() const
+{
+    return height > 0 ? (float)rowsRead / height : 1.0f;
+}
+
+void CanvasExporter::readNextStrip()
+{
+    Strip *strip = new Strip();
+    strip->rowCount = MIN(rowsPerStrip, height - rowsRead);
+    strip->pixels.resize(width * 4 * strip->rowCount);
+
+    //! PNG wants the top row first, GL counts from the bottom
+    GLint y = (GLint)(height - rowsRead - strip->rowCount);
+    snapshot->begin();
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, y, (GLsizei)width, (GLsizei)strip->rowCount, GL_RGBA, GL_UNSIGNED_BYTE, &strip->pixels[0]);
+    snapshot->end();
+    rowsRead += strip->rowCount;
+
+    pthread_mutex_lock(&queueMutex);
+    strips.push_back(strip);
+    readbackDone = rowsRead >= height;
+    pthread_cond_signal(&queueCondition);
+    pthread_mutex_unlock(&queueMutex);
+}
+
+void CanvasExporter::update(float dt)
+{
+    readStep();
+}
+
+FrameTaskStatus CanvasExporter::readStep()
+{
+    bool queueFull = false;
+    if (!readbackDone)
+    {
+        pthread_mutex_lock(&queueMutex);
+        queueFull = strips.size() >= kMaxQueuedStrips;
+        pthread_mutex_unlock(&queueMutex);
+
+        if (!queueFull)
+        {
+            readNextStrip();
+        }
+        if (readbackDone)
+        {
+            CC_SAFE_RELEASE_NULL(snapshot);
+        }
+    }
+
+    pthread_mutex_lock(&queueMutex);
+    bool done = encodeDone;
+    pthread_mutex_unlock(&queueMutex);
+    if (!done)
+    {
+        //! nothing to read until the encoder catches up, or only the encoder left to wait for
+        return (queueFull || readbackDone) ? kFrameTaskWait : kFrameTaskContinue;
+    }
+
+    pthread_join(encodeThread, NULL);
+    if (updateScheduled)
+    {
+        CCDirector::sharedDirector()->getScheduler()->unscheduleUpdateForTarget(this);
+    }
+    running = false;
+    finished = true;
+
+    if (callbackTarget && callbackSelector)
+    {
+        (callbackTarget->*callbackSelector)(this);
+    }
+    release();
+    return kFrameTaskDone;
+}
+
+void *CanvasExporter::encodeThreadEntry(void *exporter)
+{
+    ((CanvasExporter *)exporter)->encode();
+    return NULL;
+}
+
+void CanvasExporter::encode()
+{
+    PngStreamWriter pngWriter;
+    FILE *rawFile = NULL;
+    bool ok = format == kCanvasExportPNG ? pngWriter.open(path.c_str(), width, height) : (rawFile = fopen(path.c_str(), "wb")) != NULL;
+
+    unsigned int rowsWritten = 0;
+    unsigned int rowLength = width * 4;
+    while (rowsWritten < height)
+    {
+        pthread_mutex_lock(&queueMutex);
+        while (strips.empty())
+        {
+            pthread_cond_wait(&queueCondition, &queueMutex);
+        }
+        Strip *strip = strips.front();
+        strips.pop_front();
+        pthread_mutex_unlock(&queueMutex);
+
+        //! strips still have to be drained after a failure, the main thread waits for all rows
+        for (int row = (int)strip->rowCount - 1; row >= 0 && ok; --row)
+        {
+            const unsigned char *pixels = &strip->pixels[row * rowLength];
+            ok = rawFile != NULL ? fwrite(pixels, 1, rowLength, rawFile) == rowLength : pngWriter.writeRow(pixels);
+        }
+        rowsWritten += strip->rowCount;
+        delete strip;
+    }
+
+    if (rawFile != NULL)
+    {
+        ok = fclose(rawFile) == 0 && ok;
+    }
+    else if (pngWriter.isOpen())
+    {
+        ok = pngWriter.close() && ok;
+    }
+
+    pthread_mutex_lock(&queueMutex);
+    succeeded = ok;
+    encodeDone = true;
+    pthread_mutex_unlock(&queueMutex);
+}
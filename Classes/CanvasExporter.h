@@ -0,0 +1,117 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _CANVAS_EXPORTER_H_
+#define _CANVAS_EXPORTER_H_
+
+#include "cocos2d.h"
+#include "FrameScheduler.h"
+#include <pthread.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+USING_NS_CC;
+
+typedef enum {
+    kCanvasExportPNG,
+    //! RGBA8888 rows, top to bottom, no header
+    kCanvasExportRaw
+} CanvasExportFormat;
+
+/**
+ Saves a canvas without stalling drawing.
+
+ start() copies the canvas into a snapshot texture on the GPU, so drawing can go on
+ right away. The snapshot is then read back a strip of rows at a time, one per frame or
+ as many as a FrameScheduler's budget allows, and handed to a background thread which
+ streams them into the file. The completion callback runs on
+ the main thread, the exporter keeps itself alive until then.
+ */
+class CanvasExporter : public CCObject
+{
+public:
+    CanvasExporter();
+    virtual ~CanvasExporter();
+
+    static CanvasExporter *create(CCRenderTexture *canvas, const char *aPath, CanvasExportFormat aFormat);
+    bool initWithCanvas(CCRenderTexture *canvas, const char *aPath, CanvasExportFormat aFormat);
+
+    //! selector is called with this exporter once the file is complete or failed
+    void setCompletionCallback(CCObject *target, SEL_CallFuncO selector);
+    //! reads one strip per frame
+    void start();
+    //! reads strips as export tasks of scheduler
+    void start(FrameScheduler *scheduler);
+
+    virtual void update(float dt);
+    //! reads the next strip if the encoder keeps up, finishes once the file is written
+    FrameTaskStatus readStep();
+
+    bool isFinished() const;
+    bool isSucceeded() const;
+    const std::string &getPath() const;
+    //! fraction of rows read back from the GPU
+    float getProgress() const;
+
+    //! rows read back at once, each strip costs a small glReadPixels
+    unsigned int rowsPerStrip;
+
+private:
+    static void *encodeThreadEntry(void *exporter);
+    void encode();
+    void readNextStrip();
+    bool startEncoder();
+
+    typedef struct _Strip {
+        unsigned int rowCount;
+        //! bottom row first, as glReadPixels returns them
+        std::vector<unsigned char> pixels;
+    } Strip;
+
+    CCRenderTexture *snapshot;
+    std::string path;
+    CanvasExportFormat format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int rowsRead;
+
+    pthread_t encodeThread;
+    pthread_mutex_t queueMutex;
+    pthread_cond_t queueCondition;
+    std::deque<Strip *> strips;
+    bool readbackDone;
+    bool encodeDone;
+    bool succeeded;
+    bool running;
+    bool finished;
+    //! the director's scheduler calls update() instead of a FrameScheduler calling readStep()
+    bool updateScheduled;
+
+    CCObject *callbackTarget;
+    SEL_CallFuncO callbackSelector;
+};
+
+#endif // _CANVAS_EXPORTER_H_
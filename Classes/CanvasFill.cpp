@@ -0,0 +1,360 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "CanvasFill.h"
+#include <algorithm>
+#include <string.h>
+
+//! mask values, unvisited pixels are 0
+#define kFillMaskFilled 1
+#define kFillMaskFeathered 2
+
+//! bit 8 of both 16 bit lanes, and the low byte of both
+#define kFillLaneCarry 0x01000100u
+#define kFillLaneByte 0x00ff00ffu
+
+//! channel bounds of region pixels, channels 0 and 2 in the lanes of the even words, 1 and 3 in the odd ones
+typedef struct _FillRange {
+    unsigned int lowEven;
+    unsigned int highEven;
+    unsigned int lowOdd;
+    unsigned int highOdd;
+} FillRange;
+
+static inline unsigned int pixelAt(const unsigned char *pixels, unsigned int index)
+{
+    unsigned int pixel;
+    memcpy(&pixel, pixels + index * 4, 4);
+    return pixel;
+}
+
+static FillRange fillRangeMake(unsigned int seed, GLubyte tolerance)
+{
+    FillRange range = { 0, 0, 0, 0 };
+    for (unsigned int channel = 0; channel < 4; ++channel)
+    {
+        int value = (seed >> (channel * 8)) & 0xff;
+        unsigned int low = (unsigned int)MAX(value - tolerance, 0);
+        unsigned int high = (unsigned int)MIN(value + tolerance, 255);
+        unsigned int shift = (channel / 2) * 16;
+        if (channel % 2 == 0)
+        {
+            range.lowEven |= low << shift;
+            range.highEven |= high << shift;
+        }
+        else
+        {
+            range.lowOdd |= low << shift;
+            range.highOdd |= high << shift;
+        }
+    }
+    return range;
+}
+
+static inline bool pixelInRange(unsigned int pixel, const FillRange &range)
+{
+    //! in a 16 bit lane (v | 0x100) - low keeps bit 8 exactly when v >= low, and never borrows from the next lane
+    unsigned int even = pixel & kFillLaneByte;
+    unsigned int odd = (pixel >> 8) & kFillLaneByte;
+    unsigned int result = ((even | kFillLaneCarry) - range.lowEven) & ((range.highEven | kFillLaneCarry) - even)
+                        & ((odd | kFillLaneCarry) - range.lowOdd) & ((range.highOdd | kFillLaneCarry) - odd);
+    return (result & kFillLaneCarry) == kFillLaneCarry;
+}
+
+//! largest channel difference
+static inline int pixelDeviation(unsigned int pixel, unsigned int seed)
+{
+    int deviation = 0;
+    for (unsigned int channel = 0; channel < 32; channel += 8)
+    {
+        int difference = (int)((pixel >> channel) & 0xff) - (int)((seed >> channel) & 0xff);
+        deviation = MAX(deviation, difference < 0 ? -difference : difference);
+    }
+    return deviation;
+}
+
+static inline CanvasFillSpan fillSpanMake(unsigned int y, unsigned int x0, unsigned int x1, GLubyte coverage)
+{
+    CanvasFillSpan span;
+    span.y = (GLushort)y;
+    span.x0 = (GLushort)x0;
+    span.x1 = (GLushort)x1;
+    span.coverage = coverage;
+    return span;
+}
+
+static inline unsigned int fillNeighbours(unsigned int index, unsigned int width, unsigned int height, unsigned int *neighbours)
+{
+    unsigned int x = index % width, y = index / width;
+    unsigned int count = 0;
+    if (x > 0) neighbours[count++] = index - 1;
+    if (x + 1 < width) neighbours[count++] = index + 1;
+    if (y > 0) neighbours[count++] = index - width;
+    if (y + 1 < height) neighbours[count++] = index + width;
+    return count;
+}
+
+static inline void markFringe(std::vector<unsigned char> &mask, unsigned int index, std::vector<unsigned int> &ring)
+{
+    if (mask[index] == 0)
+    {
+        mask[index] = kFillMaskFeathered;
+        ring.push_back(index);
+    }
+}
+
+static bool spanOrder(const CanvasFillSpan &a, const CanvasFillSpan &b)
+{
+    return a.y != b.y ? a.y < b.y : a.x0 < b.x0;
+}
+
+void CanvasFill::fill(const unsigned char *pixels, unsigned int width, unsigned int height, unsigned int x, unsigned int y,
+                      GLubyte tolerance, unsigned int featherWidth, std::vector<CanvasFillSpan> &spans, ccColor4B &seedColor)
+{
+    spans.clear();
+    if (x >= width || y >= height)
+    {
+        return;
+    }
+
+    unsigned int seed = pixelAt(pixels, y * width + x);
+    const unsigned char *seedPixel = pixels + (y * width + x) * 4;
+    seedColor = ccc4(seedPixel[0], seedPixel[1], seedPixel[2], seedPixel[3]);
+    FillRange range = fillRangeMake(seed, tolerance);
+    std::vector<unsigned char> mask(width * height, 0);
+
+    //! first fringe ring: pixels next to the region that failed the range test, collected while filling
+    bool feathered = featherWidth > 0;
+    featherWidth = MIN(featherWidth, 255u - kFillMaskFeathered);
+    std::vector<std::vector<unsigned int> > rings(1);
+
+    //! runs of region pixels still to fill, a span grows from its run so the run isn't tested twice
+    std::vector<CanvasFillSpan> seeds;
+    seeds.push_back(fillSpanMake(y, x, x + 1, 255));
+    while (!seeds.empty())
+    {
+        CanvasFillSpan seedRun = seeds.back();
+        seeds.pop_back();
+        unsigned int row = seedRun.y * width;
+        if (mask[row + seedRun.x0] != 0)
+        {
+            //! spans are maximal, one that reached the run covers all of it
+            continue;
+        }
+
+        unsigned int x0 = seedRun.x0, x1 = seedRun.x1;
+        while (x0 > 0 && mask[row + x0 - 1] == 0 && pixelInRange(pixelAt(pixels, row + x0 - 1), range))
+        {
+            --x0;
+        }
+        while (x1 < width && mask[row + x1] == 0 && pixelInRange(pixelAt(pixels, row + x1), range))
+        {
+            ++x1;
+        }
+        memset(&mask[row + x0], kFillMaskFilled, x1 - x0);
+        spans.push_back(fillSpanMake(seedRun.y, x0, x1, 255));
+        if (feathered)
+        {
+            if (x0 > 0) markFringe(mask, row + x0 - 1, rings[0]);
+            if (x1 < width) markFringe(mask, row + x1, rings[0]);
+        }
+
+        //! one seed for every run of region pixels next to the span
+        for (int dy = -1; dy <= 1; dy += 2)
+        {
+            int neighbourY = (int)seedRun.y + dy;
+            if (neighbourY < 0 || neighbourY >= (int)height)
+            {
+                continue;
+            }
+            unsigned int neighbourRow = neighbourY * width;
+            unsigned int runStart = x0;
+            bool inRun = false;
+            for (unsigned int neighbourX = x0; neighbourX <= x1; ++neighbourX)
+            {
+                unsigned int index = neighbourRow + neighbourX;
+                bool open = false;
+                if (neighbourX < x1 && mask[index] == 0)
+                {
+                    open = pixelInRange(pixelAt(pixels, index), range);
+                    if (!open && feathered)
+                    {
+                        markFringe(mask, index, rings[0]);
+                    }
+                }
+                if (open && !inRun)
+                {
+                    runStart = neighbourX;
+                }
+                else if (!open && inRun)
+                {
+                    seeds.push_back(fillSpanMake(neighbourY, runStart, neighbourX, 255));
+                }
+                inRun = open;
+            }
+        }
+    }
+
+    if (feathered)
+    {
+        //! further rings only while the color keeps moving away from the seed, the fringe of the ink
+        while (rings.size() < featherWidth && !rings.back().empty())
+        {
+            unsigned char ringMask = (unsigned char)(kFillMaskFeathered + rings.size());
+            rings.push_back(std::vector<unsigned int>());
+            const std::vector<unsigned int> &ring = rings[rings.size() - 2];
+            for (unsigned int i = 0; i < ring.size(); ++i)
+            {
+                unsigned int index = ring[i];
+                int deviation = pixelDeviation(pixelAt(pixels, index), seed);
+                unsigned int neighbours[4];
+                unsigned int count = fillNeighbours(index, width, height, neighbours);
+                for (unsigned int n = 0; n < count; ++n)
+                {
+                    if (mask[neighbours[n]] == 0 && pixelDeviation(pixelAt(pixels, neighbours[n]), seed) >= deviation)
+                    {
+                        mask[neighbours[n]] = ringMask;
+                        rings.back().push_back(neighbours[n]);
+                    }
+                }
+            }
+        }
+
+        //! seed share of a fringe pixel compared to the most distinct ink further out, outermost ring first
+        std::vector<unsigned char> ink(width * height);
+        for (int r = (int)rings.size() - 1; r >= 0; --r)
+        {
+            const std::vector<unsigned int> &ring = rings[r];
+            for (unsigned int i = 0; i < ring.size(); ++i)
+            {
+                unsigned int index = ring[i];
+                int deviation = pixelDeviation(pixelAt(pixels, index), seed);
+                int inkDeviation = deviation;
+                unsigned int neighbours[4];
+                unsigned int count = fillNeighbours(index, width, height, neighbours);
+                for (unsigned int n = 0; n < count; ++n)
+                {
+                    unsigned char neighbourMask = mask[neighbours[n]];
+                    if (neighbourMask == 0)
+                    {
+                        inkDeviation = MAX(inkDeviation, pixelDeviation(pixelAt(pixels, neighbours[n]), seed));
+                    }
+                    else if (neighbourMask > mask[index])
+                    {
+                        inkDeviation = MAX(inkDeviation, (int)ink[neighbours[n]]);
+                    }
+                }
+                ink[index] = (unsigned char)inkDeviation;
+
+                int coverage = inkDeviation > deviation ? (inkDeviation - deviation) * 255 / inkDeviation : 0;
+                if (coverage > 0)
+                {
+                    spans.push_back(fillSpanMake(index / width, index % width, index % width + 1, (GLubyte)coverage));
+                }
+            }
+        }
+    }
+
+    std::sort(spans.begin(), spans.end(), spanOrder);
+}
+
+void CanvasFill::shiftForColor(ccColor4B seed, ccColor4B ink, StrokeBlendMode blendMode, int *shift)
+{
+    //! what the batch state of a stroke with this ink would leave on the seed, minus the seed
+    GLubyte seedChannels[4] = { seed.r, seed.g, seed.b, seed.a };
+    GLubyte inkChannels[4] = { ink.r, ink.g, ink.b, ink.a };
+    for (unsigned int channel = 0; channel < 4; ++channel)
+    {
+        int remaining = (seedChannels[channel] * (255 - ink.a) + 127) / 255;
+        int target;
+        if (blendMode == kStrokeBlendMultiply)
+        {
+            target = channel < 3 ? (seedChannels[channel] * inkChannels[channel] + 127) / 255 + remaining : seedChannels[channel];
+        }
+        else if (blendMode == kStrokeBlendEraser)
+        {
+            target = remaining;
+        }
+        else
+        {
+            target = inkChannels[channel] + remaining;
+        }
+        shift[channel] = MIN(target, 255) - seedChannels[channel];
+    }
+}
+
+void CanvasFill::shiftForStyle(ccColor4B seed, const StrokeStyle &style, const StrokeBatch &batch, int *shift)
+{
+    ccColor4F ink = batch.inkColorForStyle(style);
+    ccColor4B inkBytes = ccc4((GLubyte)(clampf(ink.r, 0.0f, 1.0f) * 255.0f + 0.5f), (GLubyte)(clampf(ink.g, 0.0f, 1.0f) * 255.0f + 0.5f),
+                              (GLubyte)(clampf(ink.b, 0.0f, 1.0f) * 255.0f + 0.5f), (GLubyte)(clampf(ink.a, 0.0f, 1.0f) * 255.0f + 0.5f));
+    shiftForColor(seed, inkBytes, batch.stateForStyle(style, 0).blendMode, shift);
+}
+
+GLubyte CanvasFill::shiftForCoverage(int shift, GLubyte coverage)
+{
+    return (GLubyte)(((shift < 0 ? -shift : shift) * coverage + 127) / 255);
+}
+
+void CanvasFill::apply(unsigned char *pixels, unsigned int width, const std::vector<CanvasFillSpan> &spans, const int *shift,
+                       unsigned int &firstRow, unsigned int &lastRow)
+{
+    firstRow = 0xffffffff;
+    lastRow = 0;
+    for (unsigned int i = 0; i < spans.size(); ++i)
+    {
+        //! rounded like the vertex colors the fill is drawn again with
+        const CanvasFillSpan &span = spans[i];
+        int spanShift[4];
+        for (unsigned int channel = 0; channel < 4; ++channel)
+        {
+            int magnitude = shiftForCoverage(shift[channel], span.coverage);
+            spanShift[channel] = shift[channel] < 0 ? -magnitude : magnitude;
+        }
+        unsigned char *pixel = pixels + (span.y * width + span.x0) * 4;
+        for (unsigned int x = span.x0; x < span.x1; ++x, pixel += 4)
+        {
+            for (unsigned int channel = 0; channel < 4; ++channel)
+            {
+                int value = pixel[channel] + spanShift[channel];
+                pixel[channel] = (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+            }
+        }
+        firstRow = MIN(firstRow, (unsigned int)span.y);
+        lastRow = MAX(lastRow, (unsigned int)span.y);
+    }
+}
+
+bool CanvasFill::spansContain(const std::vector<CanvasFillSpan> &spans, unsigned int x, unsigned int y)
+{
+    //! last span starting at or before x in row y
+    CanvasFillSpan key = fillSpanMake(y, x + 1, x + 1, 0);
+    std::vector<CanvasFillSpan>::const_iterator after = std::lower_bound(spans.begin(), spans.end(), key, spanOrder);
+    if (after == spans.begin())
+    {
+        return false;
+    }
+    const CanvasFillSpan &span = *(after - 1);
+    return span.y == y && span.x0 <= x && x < span.x1;
+}
@@ -0,0 +1,79 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _CANVAS_FILL_H_
+#define _CANVAS_FILL_H_
+
+#include "cocos2d.h"
+#include "StrokeBatch.h"
+#include <vector>
+
+USING_NS_CC;
+
+//! pixels x0 up to x1 of canvas row y, bottom row first as GL counts them
+typedef struct _CanvasFillSpan {
+    GLushort y;
+    GLushort x0;
+    GLushort x1;
+    //! 255 inside the region, less on its feathered edge
+    GLubyte coverage;
+} CanvasFillSpan;
+
+/**
+ Paint bucket on RGBA8 canvas pixels.
+
+ The region is found with a scanline fill that compares all four channels of a pixel at
+ once, in 16 bit lanes of 32 bit words. A pixel belongs to it if no channel is further
+ than tolerance from the seed pixel.
+
+ Stroke edges are antialiased, a hard region border would leave a halo of seed color
+ mixed into the fringe. Up to featherWidth pixels beyond the border are feathered
+ instead: while the color keeps moving away from the seed, the share of seed color in a
+ pixel is estimated from how far it is from the seed compared to the ink further out.
+
+ Filling shifts every pixel by the difference between the seed and the fill drawn over
+ it, scaled by the pixel's coverage, so the fringe keeps its ink and only its seed share
+ changes color. GL draws the same with an adding and a subtracting pass.
+ */
+class CanvasFill
+{
+public:
+    //! spans of the region around x, y sorted by row and column and its color, no spans if x, y is outside
+    static void fill(const unsigned char *pixels, unsigned int width, unsigned int height, unsigned int x, unsigned int y,
+                     GLubyte tolerance, unsigned int featherWidth, std::vector<CanvasFillSpan> &spans, ccColor4B &seedColor);
+    //! per channel change of a fully covered pixel, ink is premultiplied and drawn like a stroke in a batch state of blendMode
+    static void shiftForColor(ccColor4B seed, ccColor4B ink, StrokeBlendMode blendMode, int *shift);
+    //! shift of a fill with style, drawn into the batch's paper like a stroke would be
+    static void shiftForStyle(ccColor4B seed, const StrokeStyle &style, const StrokeBatch &batch, int *shift);
+    //! magnitude of a channel shift at coverage, as a vertex color
+    static GLubyte shiftForCoverage(int shift, GLubyte coverage);
+    //! shifts the pixels of spans, reports the rows touched
+    static void apply(unsigned char *pixels, unsigned int width, const std::vector<CanvasFillSpan> &spans, const int *shift,
+                      unsigned int &firstRow, unsigned int &lastRow);
+    //! true if pixel x, y is in the spans
+    static bool spansContain(const std::vector<CanvasFillSpan> &spans, unsigned int x, unsigned int y);
+};
+
+#endif // _CANVAS_FILL_H_
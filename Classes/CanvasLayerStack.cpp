@@ -0,0 +1,498 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "CanvasLayerStack.h"
+
+CanvasLayer *CanvasLayer::create(unsigned int layerID, bool opaque)
+{
+    CanvasLayer *pRet = new CanvasLayer();
+    pRet->layerID = layerID;
+    pRet->opaque = opaque;
+    pRet->autorelease();
+    return pRet;
+}
+
+CanvasLayer::CanvasLayer()
+: layerID(0)
+, opaque(false)
+, visible(true)
+, opacity(1.0f)
+, blendMode(kCanvasLayerBlendNormal)
+, canvas(NULL)
+, lastUsedFrame(0)
+{
+}
+
+CanvasLayer::~CanvasLayer()
+{
+    CC_SAFE_RELEASE(canvas);
+}
+
+CanvasLayerStack *CanvasLayerStack::create()
+{
+    CanvasLayerStack *pRet = new CanvasLayerStack();
+    if (pRet && pRet->init())
+    {
+        pRet->autorelease();
+        return pRet;
+    }
+    CC_SAFE_DELETE(pRet);
+    return NULL;
+}
+
+CanvasLayerStack::CanvasLayerStack()
+: activeIndex(0)
+, belowCache(NULL)
+, aboveCache(NULL)
+, compositeValid(false)
+, hasBelow(false)
+, hasAbove(false)
+{
+    layers = CCArray::create();
+    layers->retain();
+}
+
+CanvasLayerStack::~CanvasLayerStack()
+{
+    CC_SAFE_RELEASE(layers);
+    CC_SAFE_RELEASE(belowCache);
+    CC_SAFE_RELEASE(aboveCache);
+}
+
+CanvasLayer *CanvasLayerStack::addLayer(unsigned int layerID, bool opaque)
+{
+    CanvasLayer *layer = CanvasLayer::create(layerID, opaque);
+    layers->addObject(layer);
+    invalidateComposite();
+    return layer;
+}
+
+void CanvasLayerStack::removeLayerAtIndex(unsigned int index)
+{
+    CCAssert(layers->count() > 1, "the last layer can't be removed");
+    layers->removeObjectAtIndex(index);
+    if (index < activeIndex || activeIndex >= layers->count())
+    {
+        --activeIndex;
+    }
+    invalidateComposite();
+}
+
+void CanvasLayerStack::moveLayer(unsigned int fromIndex, unsigned int toIndex)
+{
+    CanvasLayer *active = getActiveLayer();
+    CanvasLayer *layer = getLayer(fromIndex);
+    layer->retain();
+    layers->removeObjectAtIndex(fromIndex);
+    layers->insertObject(layer, toIndex);
+    layer->release();
+    activeIndex = layers->indexOfObject(active);
+    invalidateComposite();
+}
+
+unsigned int CanvasLayerStack::getLayerCount() const
+{
+    return layers->count();
+}
+
+CanvasLayer *CanvasLayerStack::getLayer(unsigned int index) const
+{
+    return (CanvasLayer *)layers->objectAtIndex(index);
+}
+
+CanvasLayer *CanvasLayerStack::layerForID(unsigned int layerID) const
+{
+    for (unsigned int i = 0; i < layers->count(); ++i)
+    {
+        if (getLayer(i)->layerID == layerID)
+        {
+            return getLayer(i);
+        }
+    }
+    return NULL;
+}
+
+void CanvasLayerStack::setActiveIndex(unsigned int index)
+{
+    if (index != activeIndex)
+    {
+        activeIndex = index;
+        invalidateComposite();
+    }
+}
+
+unsigned int CanvasLayerStack::getActiveIndex() const
+{
+    return activeIndex;
+}
+
+CanvasLayer *CanvasLayerStack::getActiveLayer() const
+{
+    return layers->count() > 0 ? getLayer(activeIndex) : NULL;
+}
+
+void CanvasLayerStack::setLayerVisible(unsigned int index, bool visible)
+{
+    getLayer(index)->visible = visible;
+    invalidateComposite();
+}
+
+void CanvasLayerStack::setLayerOpacity(unsigned int index, float opacity)
+{
+    getLayer(index)->opacity = clampf(opacity, 0.0f, 1.0f);
+    invalidateComposite();
+}
+
+void CanvasLayerStack::setLayerBlendMode(unsigned int index, CanvasLayerBlendMode blendMode)
+{
+    getLayer(index)->blendMode = blendMode;
+    invalidateComposite();
+}
+
+void CanvasLayerStack::setCanvas(CanvasLayer *layer, CCRenderTexture *canvas)
+{
+    CC_SAFE_RETAIN(canvas);
+    CC_SAFE_RELEASE(layer->canvas);
+    layer->canvas = canvas;
+    //! new canvases have their stencil cleared
+    layer->stencil.reset();
+    layer->lastUsedFrame = CCDirector::sharedDirector()->getTotalFrames();
+}
+
+void CanvasLayerStack::invalidateComposite()
+{
+    compositeValid = false;
+}
+
+bool CanvasLayerStack::isCompositeValid() const
+{
+    return compositeValid;
+}
+
+void CanvasLayerStack::layersNeededForComposite(std::vector<CanvasLayer *> &needed) const
+{
+    needed.clear();
+    for (unsigned int i = 0; i < layers->count(); ++i)
+    {
+        CanvasLayer *layer = getLayer(i);
+        if (layer->canvas == NULL && (layer->visible || i == activeIndex))
+        {
+            needed.push_back(layer);
+        }
+    }
+}
+
+bool CanvasLayerStack::aboveIsCachable() const
+{
+    for (unsigned int i = activeIndex + 1; i < layers->count(); ++i)
+    {
+        CanvasLayer *layer = getLayer(i);
+        if (layer->visible && layer->blendMode != kCanvasLayerBlendNormal)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CanvasLayerStack::layerIsCached(unsigned int index) const
+{
+    if (!compositeValid || index == activeIndex)
+    {
+        return false;
+    }
+    return index < activeIndex || aboveCache != NULL;
+}
+
+CCRenderTexture *CanvasLayerStack::createCache(CCRenderTexture *model)
+{
+    //! same size and placement as the canvases, composites keep alpha whatever format those use
+    CCSize size = model->getSprite()->getTexture()->getContentSize();
+    CCRenderTexture *cache = CCRenderTexture::create(size.width, size.height, kCCTexture2DPixelFormat_RGBA8888);
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+    cache->setPosition(model->getPosition());
+    cache->setScale(model->getScale());
+    if (model->getScale() != 1.0f)
+    {
+        cache->getSprite()->getTexture()->setAntiAliasTexParameters();
+    }
+    ccBlendFunc blend = { GL_ONE, GL_ONE_MINUS_SRC_ALPHA };
+    cache->getSprite()->setBlendFunc(blend);
+    cache->retain();
+    return cache;
+}
+
+void CanvasLayerStack::applyAppearance(CanvasLayer *layer)
+{
+    //! canvases hold premultiplied colors, opacity scales all four channels
+    CCSprite *sprite = layer->canvas->getSprite();
+    sprite->setOpacityModifyRGB(true);
+    sprite->setOpacity((GLubyte)(layer->opacity * 255.0f + 0.5f));
+    ccBlendFunc normal = { GL_ONE, GL_ONE_MINUS_SRC_ALPHA };
+    //! result = ink * destination + destination * (1 - ink alpha), exact over an opaque destination
+    ccBlendFunc multiply = { GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA };
+    sprite->setBlendFunc(layer->blendMode == kCanvasLayerBlendMultiply ? multiply : normal);
+}
+
+void CanvasLayerStack::drawLayer(CanvasLayer *layer)
+{
+    if (!layer->visible || layer->canvas == NULL)
+    {
+        return;
+    }
+    applyAppearance(layer);
+    layer->canvas->visit();
+    layer->lastUsedFrame = CCDirector::sharedDirector()->getTotalFrames();
+}
+
+void CanvasLayerStack::compositeInto(CCRenderTexture *target, unsigned int first, unsigned int last)
+{
+    target->beginWithClear(0, 0, 0, 0);
+    for (unsigned int i = first; i <= last; ++i)
+    {
+        CanvasLayer *layer = getLayer(i);
+        if (!layer->visible || layer->canvas == NULL)
+        {
+            continue;
+        }
+
+        //! pixel for pixel, like CanvasExporter copies the canvas
+        CCRenderTexture *canvas = layer->canvas;
+        CCSize size = canvas->getSprite()->getTexture()->getContentSize();
+        CCPoint position = canvas->getPosition();
+        float scale = canvas->getScale();
+        canvas->setPosition(size.width / 2, size.height / 2);
+        canvas->setScale(1.0f);
+        drawLayer(layer);
+        canvas->setPosition(position);
+        canvas->setScale(scale);
+    }
+    target->end();
+}
+
+void CanvasLayerStack::rebuildComposite()
+{
+    CanvasLayer *active = getActiveLayer();
+    if (active == NULL || active->canvas == NULL)
+    {
+        return;
+    }
+
+    hasBelow = false;
+    for (unsigned int i = 0; i < activeIndex; ++i)
+    {
+        hasBelow = hasBelow || getLayer(i)->visible;
+    }
+    hasAbove = false;
+    for (unsigned int i = activeIndex + 1; i < layers->count(); ++i)
+    {
+        hasAbove = hasAbove || getLayer(i)->visible;
+    }
+
+    if (hasBelow)
+    {
+        if (belowCache == NULL)
+        {
+            belowCache = createCache(active->canvas);
+        }
+        if (belowCache != NULL)
+        {
+            compositeInto(belowCache, 0, activeIndex - 1);
+        }
+    }
+    else
+    {
+        CC_SAFE_RELEASE_NULL(belowCache);
+    }
+
+    if (hasAbove && aboveIsCachable())
+    {
+        if (aboveCache == NULL)
+        {
+            aboveCache = createCache(active->canvas);
+        }
+        if (aboveCache != NULL)
+        {
+            compositeInto(aboveCache, activeIndex + 1, layers->count() - 1);
+        }
+    }
+    else
+    {
+        CC_SAFE_RELEASE_NULL(aboveCache);
+    }
+
+    //! a cache that couldn't be made leaves its layers to be drawn one by one
+    compositeValid = belowCache != NULL || !hasBelow;
+}
+
+CCRenderTexture *CanvasLayerStack::createFlattened()
+{
+    CanvasLayer *active = getActiveLayer();
+    if (active == NULL || active->canvas == NULL)
+    {
+        return NULL;
+    }
+    CCRenderTexture *flattened = createCache(active->canvas);
+    if (flattened != NULL)
+    {
+        compositeInto(flattened, 0, layers->count() - 1);
+        flattened->autorelease();
+    }
+    return flattened;
+}
+
+void CanvasLayerStack::releaseComposite()
+{
+    CC_SAFE_RELEASE_NULL(belowCache);
+    CC_SAFE_RELEASE_NULL(aboveCache);
+    compositeValid = false;
+}
+
+unsigned int CanvasLayerStack::bytesOfCanvas(CCRenderTexture *canvas)
+{
+    //! color plus the packed depth stencil buffer every canvas has
+    CCTexture2D *texture = canvas->getSprite()->getTexture();
+    return texture->getPixelsWide() * texture->getPixelsHigh() * (texture->bitsPerPixelForFormat() / 8 + 4);
+}
+
+unsigned int CanvasLayerStack::getIdleBytes() const
+{
+    unsigned int bytes = 0;
+    for (unsigned int i = 0; i < layers->count(); ++i)
+    {
+        CanvasLayer *layer = getLayer(i);
+        if (i != activeIndex && layer->canvas != NULL)
+        {
+            bytes += bytesOfCanvas(layer->canvas);
+        }
+    }
+    return bytes;
+}
+
+CanvasLayer *CanvasLayerStack::evictionCandidate(unsigned int budgetBytes) const
+{
+    if (getIdleBytes() <= budgetBytes)
+    {
+        return NULL;
+    }
+    
+    //! hidden layers and those whose pixels are in a cache, least recently used first
+    CanvasLayer *victim = NULL;
+    for (unsigned int i = 0; i < layers->count(); ++i)
+    {
+        CanvasLayer *layer = getLayer(i);
+        if (layer->canvas != NULL && i != activeIndex && (!layer->visible || layerIsCached(i))
+            && (victim == NULL || layer->lastUsedFrame < victim->lastUsedFrame))
+        {
+            victim = layer;
+        }
+    }
+    return victim;
+}
+
+void CanvasLayerStack::evictToBudget(unsigned int budgetBytes, bool keepPixels)
+{
+    CanvasLayer *victim = evictionCandidate(budgetBytes);
+    while (victim != NULL)
+    {
+        //! mostly paper and flat ink, restoring it is an upload instead of drawing every stroke again
+        if (keepPixels && !victim->storedTiles.isStored())
+        {
+            return;
+        }
+        setCanvas(victim, NULL);
+        victim = evictionCandidate(budgetBytes);
+    }
+}
+
+unsigned int CanvasLayerStack::getStoredBytes() const
+{
+    unsigned int bytes = 0;
+    for (unsigned int i = 0; i < layers->count(); ++i)
+    {
+        bytes += getLayer(i)->storedTiles.getStoredBytes();
+    }
+    return bytes;
+}
+
+void CanvasLayerStack::releaseStoredTiles()
+{
+    for (unsigned int i = 0; i < layers->count(); ++i)
+    {
+        //! tiles a resident canvas doesn't hold yet are its only copy
+        CanvasLayer *layer = getLayer(i);
+        if (layer->canvas == NULL)
+        {
+            layer->storedTiles.clear();
+        }
+        else
+        {
+            layer->storedTiles.dropTilesOnCanvas();
+        }
+    }
+}
+
+void CanvasLayerStack::visit()
+{
+    if (!isVisible())
+    {
+        return;
+    }
+
+    kmGLPushMatrix();
+    transform();
+
+    if (compositeValid && belowCache != NULL)
+    {
+        belowCache->visit();
+    }
+    for (unsigned int i = 0; i < activeIndex && !compositeValid; ++i)
+    {
+        drawLayer(getLayer(i));
+    }
+
+    CanvasLayer *active = getActiveLayer();
+    if (active != NULL)
+    {
+        drawLayer(active);
+        active->lastUsedFrame = CCDirector::sharedDirector()->getTotalFrames();
+    }
+
+    if (compositeValid && aboveCache != NULL)
+    {
+        aboveCache->visit();
+    }
+    else
+    {
+        for (unsigned int i = activeIndex + 1; i < layers->count(); ++i)
+        {
+            drawLayer(getLayer(i));
+        }
+    }
+
+    kmGLPopMatrix();
+}
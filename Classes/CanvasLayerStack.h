@@ -0,0 +1,154 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _CANVAS_LAYER_STACK_H_
+#define _CANVAS_LAYER_STACK_H_
+
+#include "cocos2d.h"
+#include "CanvasTileStore.h"
+#include "StrokeBatch.h"
+#include <vector>
+
+USING_NS_CC;
+
+typedef enum {
+    kCanvasLayerBlendNormal,
+    kCanvasLayerBlendMultiply
+} CanvasLayerBlendMode;
+
+//! one canvas of the stack, its committed strokes carry its layerID
+class CanvasLayer : public CCObject
+{
+public:
+    static CanvasLayer *create(unsigned int layerID, bool opaque);
+    CanvasLayer();
+    virtual ~CanvasLayer();
+
+    unsigned int layerID;
+    //! the bottom layer is the paper, all others start out transparent
+    bool opaque;
+    bool visible;
+    float opacity;
+    CanvasLayerBlendMode blendMode;
+    //! NULL while evicted, its strokes in the stroke log draw it again
+    CCRenderTexture *canvas;
+    //! stencil values of strokes isolated on canvas, a new canvas starts with all of them free
+    StrokeStencil stencil;
+    //! pixels of the canvas compressed: while resident the tiles that stayed unchanged, once evicted all that weren't dropped
+    CanvasTileStore storedTiles;
+    //! frame the layer was last drawn on or composited, the least recently used is evicted first
+    unsigned int lastUsedFrame;
+};
+
+/**
+ Draws a stack of canvases as at most three textures per frame.
+
+ Visible layers below the active one are composited into one cache, those above it into
+ another, so drawing on the active layer never touches the others. Both caches are built
+ again only after invalidateComposite(). Multiply does not compose over transparency, if a
+ layer above the active one multiplies those layers are drawn one by one instead.
+
+ Layers the composite does not need, because they are hidden or already in a cache, can
+ be evicted to keep memory in budget. Their pixels can be kept compressed in RAM: the owner
+ stores the tiles of evictionCandidate() over a few frames, then evictToBudget() lets the
+ canvas go. The owner restores an evicted layer from its tiles or draws it again from its
+ strokes before it is needed, see layersNeededForComposite().
+
+ Canvases are positioned by their owner and drawn where they are, the stack is at the origin.
+ */
+class CanvasLayerStack : public CCNode
+{
+public:
+    static CanvasLayerStack *create();
+    CanvasLayerStack();
+    virtual ~CanvasLayerStack();
+
+    CanvasLayer *addLayer(unsigned int layerID, bool opaque);
+    void removeLayerAtIndex(unsigned int index);
+    void moveLayer(unsigned int fromIndex, unsigned int toIndex);
+    unsigned int getLayerCount() const;
+    CanvasLayer *getLayer(unsigned int index) const;
+    //! NULL if no layer has layerID
+    CanvasLayer *layerForID(unsigned int layerID) const;
+
+    void setActiveIndex(unsigned int index);
+    unsigned int getActiveIndex() const;
+    CanvasLayer *getActiveLayer() const;
+
+    void setLayerVisible(unsigned int index, bool visible);
+    void setLayerOpacity(unsigned int index, float opacity);
+    void setLayerBlendMode(unsigned int index, CanvasLayerBlendMode blendMode);
+
+    //! hands canvas to layer, NULL evicts it
+    void setCanvas(CanvasLayer *layer, CCRenderTexture *canvas);
+    //! call when anything but the ink of the active layer changed
+    void invalidateComposite();
+    bool isCompositeValid() const;
+    //! evicted layers rebuildComposite() and createFlattened() draw, the owner restores them first
+    void layersNeededForComposite(std::vector<CanvasLayer *> &needed) const;
+    //! draws the caches from the layers around the active one, they must not be evicted
+    void rebuildComposite();
+    //! all visible layers in a new canvas, for exporting
+    CCRenderTexture *createFlattened();
+    //! drops the caches, for example when the GL context is gone
+    void releaseComposite();
+
+    //! bytes of GL memory held by canvases of layers other than the active one
+    unsigned int getIdleBytes() const;
+    //! the layer evictToBudget() would evict next to fit budgetBytes, NULL if the idle canvases fit or none can go
+    CanvasLayer *evictionCandidate(unsigned int budgetBytes) const;
+    /**
+     evicts the least recently used layers the composite doesn't need until the idle ones fit. If
+     keepPixels it stops at the first whose tiles aren't all stored yet, it goes once they are
+     */
+    void evictToBudget(unsigned int budgetBytes, bool keepPixels);
+    //! bytes of RAM the compressed pixels of evicted layers take
+    unsigned int getStoredBytes() const;
+    //! drops the compressed pixels of evicted layers and those resident canvases hold, missing ones are drawn from the strokes
+    void releaseStoredTiles();
+
+    virtual void visit();
+
+private:
+    static unsigned int bytesOfCanvas(CCRenderTexture *canvas);
+    void applyAppearance(CanvasLayer *layer);
+    void drawLayer(CanvasLayer *layer);
+    //! visible layers first to last into target, which is cleared first
+    void compositeInto(CCRenderTexture *target, unsigned int first, unsigned int last);
+    CCRenderTexture *createCache(CCRenderTexture *model);
+    //! true if the layers above the active one can share a cache
+    bool aboveIsCachable() const;
+    bool layerIsCached(unsigned int index) const;
+
+    CCArray *layers;
+    unsigned int activeIndex;
+    CCRenderTexture *belowCache;
+    CCRenderTexture *aboveCache;
+    bool compositeValid;
+    bool hasBelow;
+    bool hasAbove;
+};
+
+#endif // _CANVAS_LAYER_STACK_H_
@@ -0,0 +1,315 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "CanvasMipPyramid.h"
+
+CanvasMipPyramid *CanvasMipPyramid::create(CCRenderTexture *model)
+{
+    CanvasMipPyramid *pRet = new CanvasMipPyramid();
+    if (pRet && pRet->initWithModel(model))
+    {
+        pRet->autorelease();
+        return pRet;
+    }
+    CC_SAFE_DELETE(pRet);
+    return NULL;
+}
+
+CanvasMipPyramid::CanvasMipPyramid()
+: modelScale(1.0f)
+{
+}
+
+CanvasMipPyramid::~CanvasMipPyramid()
+{
+    releaseLevels();
+}
+
+bool CanvasMipPyramid::initWithModel(CCRenderTexture *model)
+{
+    if (model == NULL)
+    {
+        return false;
+    }
+    modelSize = model->getSprite()->getTexture()->getContentSize();
+    modelPosition = model->getPosition();
+    modelScale = model->getScale();
+    createLevels();
+    return true;
+}
+
+void CanvasMipPyramid::createLevels()
+{
+    //! textures are drawn centered on their node, levels rounded up in size are moved to keep the bottom left corner
+    CCPoint origin = ccpSub(modelPosition, ccpMult(ccp(modelSize.width, modelSize.height), modelScale / 2));
+    CCSize size = modelSize;
+    float scale = modelScale;
+    while (MAX(size.width, size.height) * CC_CONTENT_SCALE_FACTOR() > kCanvasMipSmallestSide)
+    {
+        size = CCSizeMake(ceilf(size.width / 2), ceilf(size.height / 2));
+        scale *= 2;
+        CCRenderTexture *level = CCRenderTexture::create((int)size.width, (int)size.height, kCCTexture2DPixelFormat_RGBA8888);
+        if (level == NULL)
+        {
+            break;
+        }
+        level->setPosition(ccpAdd(origin, ccpMult(ccp(size.width, size.height), scale / 2)));
+        level->setScale(scale);
+        level->getSprite()->getTexture()->setAntiAliasTexParameters();
+        ccBlendFunc blend = { GL_ONE, GL_ONE_MINUS_SRC_ALPHA };
+        level->getSprite()->setBlendFunc(blend);
+#if CC_ENABLE_CACHE_TEXTURE_DATA
+        //! drawn again from the stack, no need for the engine's readback when going to background
+        CCNotificationCenter::sharedNotificationCenter()->removeObserver(level, EVENT_COME_TO_BACKGROUND);
+#endif
+        level->retain();
+        levels.push_back(level);
+    }
+    invalidateAll();
+}
+
+void CanvasMipPyramid::releaseLevels()
+{
+    for (unsigned int i = 0; i < levels.size(); ++i)
+    {
+        levels[i]->release();
+    }
+    levels.clear();
+}
+
+void CanvasMipPyramid::recreateLevels()
+{
+    releaseLevels();
+    createLevels();
+}
+
+unsigned int CanvasMipPyramid::getLevelCount() const
+{
+    return (unsigned int)levels.size() + 1;
+}
+
+CCRenderTexture *CanvasMipPyramid::getLevel(unsigned int level) const
+{
+    return level > 0 && level <= levels.size() ? levels[level - 1] : NULL;
+}
+
+CCSize CanvasMipPyramid::getLevelSizeInPixels(unsigned int level) const
+{
+    if (level == 0 || level > levels.size())
+    {
+        return CCSizeMake(modelSize.width * CC_CONTENT_SCALE_FACTOR(), modelSize.height * CC_CONTENT_SCALE_FACTOR());
+    }
+    return levels[level - 1]->getSprite()->getTexture()->getContentSizeInPixels();
+}
+
+unsigned int CanvasMipPyramid::levelForScale(float scale) const
+{
+    if (scale >= 1.0f)
+    {
+        return 0;
+    }
+    if (scale <= 0.0f)
+    {
+        return (unsigned int)levels.size();
+    }
+    //! level k has 1 / 2^k of the pixels per side, the last one at least as fine as the screen
+    unsigned int level = (unsigned int)floorf(-log2f(scale));
+    return MIN(level, (unsigned int)levels.size());
+}
+
+unsigned int CanvasMipPyramid::levelForSize(unsigned int maxSide) const
+{
+    CCSize size = getLevelSizeInPixels(0);
+    float longerSide = MAX(size.width, size.height);
+    if (maxSide == 0)
+    {
+        return (unsigned int)levels.size();
+    }
+    if (longerSide <= maxSide)
+    {
+        return 0;
+    }
+    unsigned int level = (unsigned int)floorf(log2f(longerSide / maxSide));
+    return MIN(level, (unsigned int)levels.size());
+}
+
+static CCRect rectUnion(const CCRect &a, const CCRect &b)
+{
+    float minX = MIN(a.getMinX(), b.getMinX());
+    float minY = MIN(a.getMinY(), b.getMinY());
+    return CCRectMake(minX, minY, MAX(a.getMaxX(), b.getMaxX()) - minX, MAX(a.getMaxY(), b.getMaxY()) - minY);
+}
+
+void CanvasMipPyramid::invalidateRect(const CCRect &rect)
+{
+    //! overlapping rects are drawn once, far apart ones each on their own
+    CCRect merged = rect;
+    for (int i = (int)dirtyRects.size() - 1; i >= 0; --i)
+    {
+        if (dirtyRects[i].intersectsRect(merged))
+        {
+            merged = rectUnion(merged, dirtyRects[i]);
+            dirtyRects.erase(dirtyRects.begin() + i);
+        }
+    }
+    dirtyRects.push_back(merged);
+
+    if (dirtyRects.size() > kCanvasMipMaxDirtyRects)
+    {
+        CCRect bounds = dirtyRects[0];
+        for (unsigned int i = 1; i < dirtyRects.size(); ++i)
+        {
+            bounds = rectUnion(bounds, dirtyRects[i]);
+        }
+        dirtyRects.assign(1, bounds);
+    }
+}
+
+void CanvasMipPyramid::invalidateAll()
+{
+    CCPoint origin = ccpSub(modelPosition, ccpMult(ccp(modelSize.width, modelSize.height), modelScale / 2));
+    dirtyRects.assign(1, CCRectMake(origin.x, origin.y, modelSize.width * modelScale, modelSize.height * modelScale));
+}
+
+bool CanvasMipPyramid::needsUpdate() const
+{
+    return !dirtyRects.empty() && !levels.empty();
+}
+
+void CanvasMipPyramid::drawHalved(CCRenderTexture *source)
+{
+    //! at half size every pixel samples the middle of four, linear filtering averages them
+    CCSprite *sprite = source->getSprite();
+    CCSize size = sprite->getTexture()->getContentSize();
+    CCPoint position = source->getPosition();
+    float scale = source->getScale();
+    ccBlendFunc blend = sprite->getBlendFunc();
+    ccBlendFunc replace = { GL_ONE, GL_ZERO };
+    source->setPosition(size.width / 4, size.height / 4);
+    source->setScale(0.5f);
+    sprite->setBlendFunc(replace);
+    source->visit();
+    sprite->setBlendFunc(blend);
+    source->setPosition(position);
+    source->setScale(scale);
+}
+
+void CanvasMipPyramid::update(CanvasLayerStack *stack)
+{
+    if (!needsUpdate())
+    {
+        dirtyRects.clear();
+        return;
+    }
+
+    CCPoint origin = ccpSub(modelPosition, ccpMult(ccp(modelSize.width, modelSize.height), modelScale / 2));
+    //! stack coordinates to pixels of level 1
+    float levelScale = 1.0f / (modelScale * 2);
+    float pixelsPerPoint = CC_CONTENT_SCALE_FACTOR() * levelScale;
+
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    glClearColor(0, 0, 0, 0);
+    for (unsigned int i = 0; i < dirtyRects.size(); ++i)
+    {
+        //! a pixel off on every side for the filtering, then each level covers the one before halved outwards
+        const CCRect &rect = dirtyRects[i];
+        float minX = floorf((rect.getMinX() - origin.x) * pixelsPerPoint) - 1;
+        float minY = floorf((rect.getMinY() - origin.y) * pixelsPerPoint) - 1;
+        float maxX = ceilf((rect.getMaxX() - origin.x) * pixelsPerPoint) + 1;
+        float maxY = ceilf((rect.getMaxY() - origin.y) * pixelsPerPoint) + 1;
+        for (unsigned int level = 0; level < levels.size(); ++level)
+        {
+            if (level > 0)
+            {
+                minX = floorf(minX / 2);
+                minY = floorf(minY / 2);
+                maxX = ceilf(maxX / 2);
+                maxY = ceilf(maxY / 2);
+            }
+            CCSize size = levels[level]->getSprite()->getTexture()->getContentSizeInPixels();
+            GLint x = (GLint)MAX(minX, 0.0f);
+            GLint y = (GLint)MAX(minY, 0.0f);
+            GLint width = (GLint)MIN(maxX, size.width) - x;
+            GLint height = (GLint)MIN(maxY, size.height) - y;
+            if (width <= 0 || height <= 0)
+            {
+                break;
+            }
+
+            //! begin() leaves the modelview at the camera, like for the canvases
+            levels[level]->begin();
+            kmGLMatrixMode(KM_GL_MODELVIEW);
+            kmGLPushMatrix();
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(x, y, width, height);
+            if (level == 0)
+            {
+                glClear(GL_COLOR_BUFFER_BIT);
+                kmGLScalef(levelScale, levelScale, 1.0f);
+                kmGLTranslatef(-origin.x, -origin.y, 0.0f);
+                stack->visit();
+            }
+            else
+            {
+                drawHalved(levels[level - 1]);
+            }
+            glDisable(GL_SCISSOR_TEST);
+            kmGLMatrixMode(KM_GL_MODELVIEW);
+            kmGLPopMatrix();
+            levels[level]->end();
+        }
+    }
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    dirtyRects.clear();
+}
+
+bool CanvasMipPyramid::readLevel(unsigned int level, std::vector<unsigned char> &pixels, unsigned int &width, unsigned int &height) const
+{
+    CCRenderTexture *texture = getLevel(level);
+    if (texture == NULL)
+    {
+        return false;
+    }
+    CCSize size = texture->getSprite()->getTexture()->getContentSizeInPixels();
+    width = (unsigned int)size.width;
+    height = (unsigned int)size.height;
+    pixels.resize(width * height * 4);
+
+    texture->begin();
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, (GLsizei)width, (GLsizei)height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+    texture->end();
+
+    //! GL counts rows from the bottom
+    unsigned int rowBytes = width * 4;
+    std::vector<unsigned char> row(rowBytes);
+    for (unsigned int top = 0, bottom = height - 1; top < bottom; ++top, --bottom)
+    {
+        memcpy(&row[0], &pixels[top * rowBytes], rowBytes);
+        memcpy(&pixels[top * rowBytes], &pixels[bottom * rowBytes], rowBytes);
+        memcpy(&pixels[bottom * rowBytes], &row[0], rowBytes);
+    }
+    return true;
+}
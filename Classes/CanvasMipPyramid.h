@@ -0,0 +1,97 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _CANVAS_MIP_PYRAMID_H_
+#define _CANVAS_MIP_PYRAMID_H_
+
+#include "cocos2d.h"
+#include "CanvasLayerStack.h"
+#include <vector>
+
+USING_NS_CC;
+
+//! levels are halved until neither side is longer than this
+#define kCanvasMipSmallestSide 32
+//! dirty rects kept apart, more are merged into their bounds
+#define kCanvasMipMaxDirtyRects 8
+
+/**
+ Half, quarter and smaller copies of what a CanvasLayerStack shows, for zoomed out views and thumbnails.
+
+ Level 0 is the canvas itself, level 1 the stack drawn at half its resolution and every further level
+ the one before halved with linear filtering, an exact 2x2 box filter. Only rects passed to
+ invalidateRect() are drawn again by update(), on every level, so a committed stroke costs its own
+ small area instead of a pass over the whole image.
+
+ The levels are placed and scaled like the canvas they were made for, visiting one draws it over the
+ canvas. The owner positions the stack's canvases, the stack must be at the origin.
+ */
+class CanvasMipPyramid : public CCObject
+{
+public:
+    //! levels for canvases of the size, placement and scale of model
+    static CanvasMipPyramid *create(CCRenderTexture *model);
+    CanvasMipPyramid();
+    virtual ~CanvasMipPyramid();
+    bool initWithModel(CCRenderTexture *model);
+
+    //! levels including level 0, the canvas
+    unsigned int getLevelCount() const;
+    //! NULL for level 0
+    CCRenderTexture *getLevel(unsigned int level) const;
+    CCSize getLevelSizeInPixels(unsigned int level) const;
+    //! most detailed level not finer than drawn at scale screen pixels per canvas pixel, 0 from scale 1 on
+    unsigned int levelForScale(float scale) const;
+    //! least detailed level whose longer side still has maxSide pixels, the last level if none
+    unsigned int levelForSize(unsigned int maxSide) const;
+
+    //! rect in the stack's coordinates changed, the levels are drawn there again by the next update()
+    void invalidateRect(const CCRect &rect);
+    void invalidateAll();
+    bool needsUpdate() const;
+    //! draws the invalidated rects of every level from stack, whose canvases the owner restored first
+    void update(CanvasLayerStack *stack);
+
+    //! RGBA pixels of level, top row first, only as many as the level has. False for level 0
+    bool readLevel(unsigned int level, std::vector<unsigned char> &pixels, unsigned int &width, unsigned int &height) const;
+
+    //! new levels after the GL context was lost, all of them are drawn again by the next update()
+    void recreateLevels();
+
+private:
+    void createLevels();
+    void releaseLevels();
+    //! source halved into the level bound, with its pixels replacing the level's
+    static void drawHalved(CCRenderTexture *source);
+
+    std::vector<CCRenderTexture *> levels;
+    //! in the stack's coordinates
+    std::vector<CCRect> dirtyRects;
+    CCSize modelSize;
+    CCPoint modelPosition;
+    float modelScale;
+};
+
+#endif // _CANVAS_MIP_PYRAMID_H_
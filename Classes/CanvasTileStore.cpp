@@ -0,0 +1,474 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "CanvasTileStore.h"
+#include "CanvasConfig.h"
+#include <limits.h>
+#include <string.h>
+
+//! control bytes from here on start a repeated pixel
+#define kTileRunFlag 128
+#define kTileMaxRun 128
+
+static inline unsigned int pixelAt(const unsigned char *pixels, unsigned int index)
+{
+    unsigned int pixel;
+    memcpy(&pixel, pixels + index * 4, 4);
+    return pixel;
+}
+
+static void appendPixel(std::vector<unsigned char> &data, unsigned int pixel)
+{
+    unsigned char bytes[4];
+    memcpy(bytes, &pixel, 4);
+    data.insert(data.end(), bytes, bytes + 4);
+}
+
+//! run length encodes count pixels
+static void encodePixels(const std::vector<unsigned int> &pixels, std::vector<unsigned char> &data)
+{
+    unsigned int count = (unsigned int)pixels.size();
+    unsigned int i = 0;
+    while (i < count)
+    {
+        unsigned int run = 1;
+        while (i + run < count && run < kTileMaxRun && pixels[i + run] == pixels[i])
+        {
+            ++run;
+        }
+        if (run > 1)
+        {
+            data.push_back((unsigned char)(kTileRunFlag + run - 1));
+            appendPixel(data, pixels[i]);
+            i += run;
+            continue;
+        }
+
+        //! literals up to the next pair of equal pixels
+        unsigned int literal = 1;
+        while (i + literal < count && literal < kTileMaxRun
+               && (i + literal + 1 >= count || pixels[i + literal] != pixels[i + literal + 1]))
+        {
+            ++literal;
+        }
+        data.push_back((unsigned char)(literal - 1));
+        for (unsigned int j = 0; j < literal; ++j)
+        {
+            appendPixel(data, pixels[i + j]);
+        }
+        i += literal;
+    }
+}
+
+CanvasTileStore::CanvasTileStore()
+: width(0)
+, height(0)
+, columns(0)
+, rows(0)
+{
+}
+
+CanvasTileStore::~CanvasTileStore()
+{
+}
+
+void CanvasTileStore::clear()
+{
+    std::vector<Tile>().swap(tiles);
+    width = height = columns = rows = 0;
+}
+
+bool CanvasTileStore::isEmpty() const
+{
+    return tiles.empty();
+}
+
+unsigned int CanvasTileStore::getWidth() const
+{
+    return width;
+}
+
+unsigned int CanvasTileStore::getHeight() const
+{
+    return height;
+}
+
+unsigned int CanvasTileStore::getStoredBytes() const
+{
+    unsigned int bytes = (unsigned int)(tiles.capacity() * sizeof(Tile));
+    for (unsigned int i = 0; i < tiles.size(); ++i)
+    {
+        bytes += (unsigned int)tiles[i].data.capacity();
+    }
+    return bytes;
+}
+
+void CanvasTileStore::reset(unsigned int aWidth, unsigned int aHeight)
+{
+    clear();
+    width = aWidth;
+    height = aHeight;
+    columns = (width + kCanvasTileSize - 1) / kCanvasTileSize;
+    rows = (height + kCanvasTileSize - 1) / kCanvasTileSize;
+    Tile empty;
+    empty.color = 0;
+    empty.stored = false;
+    empty.onCanvas = true;
+    empty.changedFrame = 0;
+    tiles.assign(columns * rows, empty);
+}
+
+void CanvasTileStore::tileRect(unsigned int column, unsigned int row, unsigned int &x, unsigned int &y,
+                               unsigned int &tileWidth, unsigned int &tileHeight) const
+{
+    x = column * kCanvasTileSize;
+    y = row * kCanvasTileSize;
+    tileWidth = MIN((unsigned int)kCanvasTileSize, width - x);
+    tileHeight = MIN((unsigned int)kCanvasTileSize, height - y);
+}
+
+bool CanvasTileStore::tileRange(const CCRect &rect, unsigned int &minColumn, unsigned int &minRow, unsigned int &maxColumn, unsigned int &maxRow) const
+{
+    if (tiles.empty() || rect.getMaxX() < 0 || rect.getMaxY() < 0 || rect.getMinX() >= width || rect.getMinY() >= height)
+    {
+        return false;
+    }
+    minColumn = (unsigned int)MAX(rect.getMinX(), 0.0f) / kCanvasTileSize;
+    minRow = (unsigned int)MAX(rect.getMinY(), 0.0f) / kCanvasTileSize;
+    maxColumn = MIN((unsigned int)rect.getMaxX() / kCanvasTileSize, columns - 1);
+    maxRow = MIN((unsigned int)rect.getMaxY() / kCanvasTileSize, rows - 1);
+    return true;
+}
+
+void CanvasTileStore::storeTile(unsigned int column, unsigned int row, const unsigned char *pixels, unsigned int stride, unsigned int originX)
+{
+    unsigned int x, y, tileWidth, tileHeight;
+    tileRect(column, row, x, y, tileWidth, tileHeight);
+
+    std::vector<unsigned int> tilePixels;
+    tilePixels.reserve(tileWidth * tileHeight);
+    bool flat = true;
+    unsigned int first = pixelAt(pixels, x - originX);
+    for (unsigned int tileY = 0; tileY < tileHeight; ++tileY)
+    {
+        const unsigned char *line = pixels + (tileY * stride + x - originX) * 4;
+        for (unsigned int tileX = 0; tileX < tileWidth; ++tileX)
+        {
+            unsigned int pixel = pixelAt(line, tileX);
+            flat = flat && pixel == first;
+            tilePixels.push_back(pixel);
+        }
+    }
+
+    Tile &tile = tiles[row * columns + column];
+    tile.stored = true;
+    tile.color = first;
+    tile.data.clear();
+    if (!flat)
+    {
+        encodePixels(tilePixels, tile.data);
+    }
+    //! exact size, many tiles stay around for a long time
+    std::vector<unsigned char>(tile.data).swap(tile.data);
+}
+
+void CanvasTileStore::store(const unsigned char *pixels, unsigned int aWidth, unsigned int aHeight)
+{
+    reset(aWidth, aHeight);
+    for (unsigned int row = 0; row < rows; ++row)
+    {
+        for (unsigned int column = 0; column < columns; ++column)
+        {
+            storeTile(column, row, pixels + row * kCanvasTileSize * width * 4, width, 0);
+        }
+    }
+}
+
+bool CanvasTileStore::tileNeedsStore(const Tile &tile, unsigned int changedBefore) const
+{
+    return tile.onCanvas && !tile.stored && tile.changedFrame < changedBefore;
+}
+
+bool CanvasTileStore::needsStore(unsigned int changedBefore) const
+{
+    for (unsigned int i = 0; i < tiles.size(); ++i)
+    {
+        if (tileNeedsStore(tiles[i], changedBefore))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CanvasTileStore::isStored() const
+{
+    return !needsStore(UINT_MAX);
+}
+
+bool CanvasTileStore::storeRow(CCRenderTexture *canvas, unsigned int changedBefore)
+{
+    for (unsigned int row = 0; row < rows; ++row)
+    {
+        unsigned int minColumn = columns, maxColumn = 0;
+        for (unsigned int column = 0; column < columns; ++column)
+        {
+            if (tileNeedsStore(tiles[row * columns + column], changedBefore))
+            {
+                minColumn = MIN(minColumn, column);
+                maxColumn = column;
+            }
+        }
+        if (minColumn == columns)
+        {
+            continue;
+        }
+
+        //! a strip as high as the row over only the columns to store, tiles between them that are stored already are skipped
+        unsigned int x, y, tileWidth, tileHeight, lastX, lastY, lastWidth;
+        tileRect(minColumn, row, x, y, tileWidth, tileHeight);
+        tileRect(maxColumn, row, lastX, lastY, lastWidth, tileHeight);
+        unsigned int stripWidth = lastX + lastWidth - x;
+        std::vector<unsigned char> strip(stripWidth * tileHeight * 4);
+        canvas->begin();
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels((GLint)x, (GLint)y, (GLsizei)stripWidth, (GLsizei)tileHeight, GL_RGBA, GL_UNSIGNED_BYTE, &strip[0]);
+        canvas->end();
+
+        for (unsigned int column = minColumn; column <= maxColumn; ++column)
+        {
+            if (tileNeedsStore(tiles[row * columns + column], changedBefore))
+            {
+                storeTile(column, row, &strip[0], stripWidth, x);
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+void CanvasTileStore::invalidateRect(const CCRect &rect, unsigned int frame)
+{
+    unsigned int minColumn, minRow, maxColumn, maxRow;
+    if (!tileRange(rect, minColumn, minRow, maxColumn, maxRow))
+    {
+        return;
+    }
+    for (unsigned int row = minRow; row <= maxRow; ++row)
+    {
+        for (unsigned int column = minColumn; column <= maxColumn; ++column)
+        {
+            Tile &tile = tiles[row * columns + column];
+            tile.stored = false;
+            tile.changedFrame = frame;
+            std::vector<unsigned char>().swap(tile.data);
+        }
+    }
+}
+
+void CanvasTileStore::dropTilesOnCanvas()
+{
+    for (unsigned int i = 0; i < tiles.size(); ++i)
+    {
+        if (tiles[i].onCanvas)
+        {
+            tiles[i].stored = false;
+            std::vector<unsigned char>().swap(tiles[i].data);
+        }
+    }
+}
+
+void CanvasTileStore::decodeTile(unsigned int column, unsigned int row, std::vector<unsigned char> &pixels) const
+{
+    unsigned int x, y, tileWidth, tileHeight;
+    tileRect(column, row, x, y, tileWidth, tileHeight);
+    unsigned int count = tileWidth * tileHeight;
+    pixels.resize(count * 4);
+
+    const Tile &tile = tiles[row * columns + column];
+    if (tile.data.empty())
+    {
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            memcpy(&pixels[i * 4], &tile.color, 4);
+        }
+        return;
+    }
+
+    unsigned int written = 0;
+    unsigned int offset = 0;
+    while (offset < tile.data.size() && written < count)
+    {
+        unsigned char control = tile.data[offset++];
+        if (control >= kTileRunFlag)
+        {
+            unsigned int run = MIN(control - kTileRunFlag + 1u, count - written);
+            for (unsigned int i = 0; i < run; ++i)
+            {
+                memcpy(&pixels[(written + i) * 4], &tile.data[offset], 4);
+            }
+            offset += 4;
+            written += run;
+        }
+        else
+        {
+            unsigned int literal = MIN(control + 1u, count - written);
+            memcpy(&pixels[written * 4], &tile.data[offset], literal * 4);
+            offset += literal * 4;
+            written += literal;
+        }
+    }
+}
+
+void CanvasTileStore::decode(unsigned char *pixels) const
+{
+    std::vector<unsigned char> tilePixels;
+    for (unsigned int row = 0; row < rows; ++row)
+    {
+        for (unsigned int column = 0; column < columns; ++column)
+        {
+            if (!tiles[row * columns + column].stored)
+            {
+                continue;
+            }
+            unsigned int x, y, tileWidth, tileHeight;
+            tileRect(column, row, x, y, tileWidth, tileHeight);
+            decodeTile(column, row, tilePixels);
+            for (unsigned int i = 0; i < tileHeight; ++i)
+            {
+                memcpy(&pixels[((y + i) * width + x) * 4], &tilePixels[i * tileWidth * 4], tileWidth * 4);
+            }
+        }
+    }
+}
+
+void CanvasTileStore::beginRestore()
+{
+    for (unsigned int i = 0; i < tiles.size(); ++i)
+    {
+        tiles[i].onCanvas = false;
+    }
+}
+
+bool CanvasTileStore::isRestored() const
+{
+    for (unsigned int i = 0; i < tiles.size(); ++i)
+    {
+        if (!tiles[i].onCanvas)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CanvasTileStore::restoreTiles(CCTexture2D *texture, unsigned int minColumn, unsigned int minRow, unsigned int maxColumn, unsigned int maxRow,
+                                   std::vector<CCRect> &missingRects)
+{
+    bool restored = false;
+    std::vector<unsigned char> pixels;
+    for (unsigned int row = minRow; row <= maxRow; ++row)
+    {
+        bool previousMissing = false;
+        for (unsigned int column = minColumn; column <= maxColumn; ++column)
+        {
+            Tile &tile = tiles[row * columns + column];
+            if (tile.onCanvas)
+            {
+                previousMissing = false;
+                continue;
+            }
+            tile.onCanvas = true;
+            restored = true;
+            
+            unsigned int x, y, tileWidth, tileHeight;
+            tileRect(column, row, x, y, tileWidth, tileHeight);
+            if (tile.stored)
+            {
+                decodeTile(column, row, pixels);
+                CanvasConfigUploadPixels(texture, &pixels[0], x, y, tileWidth, tileHeight);
+                previousMissing = false;
+            }
+            else if (previousMissing)
+            {
+                missingRects.back().size.width += tileWidth;
+            }
+            else
+            {
+                missingRects.push_back(CCRectMake(x, y, tileWidth, tileHeight));
+                previousMissing = true;
+            }
+        }
+        
+        //! a run spanning the same columns as one in the row below grows that one, a canvas drawn again is one rect
+        if (previousMissing && missingRects.size() > 1)
+        {
+            CCRect run = missingRects.back();
+            for (unsigned int i = 0; i + 1 < missingRects.size(); ++i)
+            {
+                CCRect &below = missingRects[i];
+                if (below.origin.x == run.origin.x && below.size.width == run.size.width && below.getMaxY() == run.origin.y)
+                {
+                    below.size.height += run.size.height;
+                    missingRects.pop_back();
+                    break;
+                }
+            }
+        }
+    }
+    return restored;
+}
+
+bool CanvasTileStore::restoreRect(CCTexture2D *texture, const CCRect &rect, std::vector<CCRect> &missingRects)
+{
+    unsigned int minColumn, minRow, maxColumn, maxRow;
+    if (!tileRange(rect, minColumn, minRow, maxColumn, maxRow))
+    {
+        return false;
+    }
+    return restoreTiles(texture, minColumn, minRow, maxColumn, maxRow, missingRects);
+}
+
+bool CanvasTileStore::restoreNextRow(CCTexture2D *texture, const CCRect &firstRect, std::vector<CCRect> &missingRects)
+{
+    unsigned int minColumn, minRow, maxColumn, maxRow;
+    if (tileRange(firstRect, minColumn, minRow, maxColumn, maxRow))
+    {
+        for (unsigned int row = minRow; row <= maxRow; ++row)
+        {
+            if (restoreTiles(texture, minColumn, row, maxColumn, row, missingRects))
+            {
+                return true;
+            }
+        }
+    }
+    for (unsigned int row = 0; row < rows; ++row)
+    {
+        if (restoreTiles(texture, 0, row, columns - 1, row, missingRects))
+        {
+            return true;
+        }
+    }
+    return false;
+}
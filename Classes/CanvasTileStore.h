@@ -0,0 +1,134 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _CANVAS_TILE_STORE_H_
+#define _CANVAS_TILE_STORE_H_
+
+#include "cocos2d.h"
+#include <vector>
+
+USING_NS_CC;
+
+//! edge of a stored tile in canvas pixels
+#define kCanvasTileSize 64
+//! frames a tile of a resident canvas stays unchanged before it is worth storing
+#define kCanvasTileIdleFrames 120
+
+/**
+ Pixels of a canvas kept compressed in RAM, tile by tile.
+
+ The canvas is cut into square tiles. A tile of one color is kept as that color, any
+ other one run length encoded by whole pixels: a control byte below 128 is followed by
+ that many plus one literal pixels, one of 128 or more by a single pixel repeated
+ that many minus 127 times. Paper, flat ink and transparency shrink to almost nothing,
+ only detailed ink costs about what it did uncompressed.
+
+ While the canvas is resident, storeRow() reads back and compresses a row of the tiles
+ that have stayed unchanged for a while, and invalidateRect() drops tiles again where ink
+ lands. Once every tile on the canvas is stored the canvas can go without a readback.
+ A new canvas starts with none of the tiles on it after beginRestore(), restoreRect()
+ brings back those under a stroke or the view when they are needed and restoreNextRow()
+ the rest. Dropped tiles are reported as missing, whoever restores the canvas draws
+ those from the strokes instead.
+ */
+class CanvasTileStore
+{
+public:
+    CanvasTileStore();
+    ~CanvasTileStore();
+
+    //! sized for a canvas of aWidth x aHeight pixels, with all tiles on it and none stored
+    void reset(unsigned int aWidth, unsigned int aHeight);
+    //! compresses RGBA8 pixels, bottom row first, replacing what was stored
+    void store(const unsigned char *pixels, unsigned int width, unsigned int height);
+    void clear();
+    bool isEmpty() const;
+    unsigned int getWidth() const;
+    unsigned int getHeight() const;
+    //! bytes the compressed tiles take
+    unsigned int getStoredBytes() const;
+
+    //! drops the tiles touching rect, in canvas pixels, whose pixels changed on frame
+    void invalidateRect(const CCRect &rect, unsigned int frame = 0);
+    //! drops the compressed pixels of the tiles on the canvas, keeps those it doesn't hold
+    void dropTilesOnCanvas();
+
+    //! true if a tile on the canvas that last changed before frame changedBefore isn't stored
+    bool needsStore(unsigned int changedBefore) const;
+    //! true if every tile on the canvas is stored, the canvas can go without reading anything back
+    bool isStored() const;
+    /**
+     reads back the tiles needsStore() is true for in the lowest tile row holding any, with one
+     glReadPixels over just those columns, and compresses them. False if there were none
+     */
+    bool storeRow(CCRenderTexture *canvas, unsigned int changedBefore);
+
+    //! the canvas was replaced by a new one of the stored size, none of the tiles are on it
+    void beginRestore();
+    //! true once every tile is back on the canvas
+    bool isRestored() const;
+    /**
+     uploads the stored tiles touching rect, in canvas pixels, that aren't on the canvas into
+     texture and collects the canvas pixel rects of dropped ones, neighbours merged. All of them
+     are on the canvas afterwards. False if none were missing from it
+     */
+    bool restoreRect(CCTexture2D *texture, const CCRect &rect, std::vector<CCRect> &missingRects);
+    //! restoreRect() over the tiles not on the canvas in one tile row, rows through firstRect first and only within it
+    bool restoreNextRow(CCTexture2D *texture, const CCRect &firstRect, std::vector<CCRect> &missingRects);
+    //! RGBA8 pixels of every stored tile into pixels of the stored size, bottom row first, dropped tiles left as they are
+    void decode(unsigned char *pixels) const;
+    //! RGBA8 pixels of a stored tile, bottom row first, as wide as the tile
+    void decodeTile(unsigned int column, unsigned int row, std::vector<unsigned char> &pixels) const;
+
+private:
+    typedef struct _Tile {
+        //! run length encoded pixels, empty for a tile of one color
+        std::vector<unsigned char> data;
+        unsigned int color;
+        //! false once dropped
+        bool stored;
+        //! the canvas holds the tile's pixels, false until restored on a new canvas
+        bool onCanvas;
+        //! frame its pixels last changed on
+        unsigned int changedFrame;
+    } Tile;
+
+    //! compresses a tile from pixels rows of stride pixels starting at canvas column originX
+    void storeTile(unsigned int column, unsigned int row, const unsigned char *pixels, unsigned int stride, unsigned int originX);
+    bool tileNeedsStore(const Tile &tile, unsigned int changedBefore) const;
+    void tileRect(unsigned int column, unsigned int row, unsigned int &x, unsigned int &y, unsigned int &tileWidth, unsigned int &tileHeight) const;
+    //! tiles touching rect, false if it misses the canvas
+    bool tileRange(const CCRect &rect, unsigned int &minColumn, unsigned int &minRow, unsigned int &maxColumn, unsigned int &maxRow) const;
+    bool restoreTiles(CCTexture2D *texture, unsigned int minColumn, unsigned int minRow, unsigned int maxColumn, unsigned int maxRow,
+                      std::vector<CCRect> &missingRects);
+
+    std::vector<Tile> tiles;
+    unsigned int width;
+    unsigned int height;
+    unsigned int columns;
+    unsigned int rows;
+};
+
+#endif // _CANVAS_TILE_STORE_H_
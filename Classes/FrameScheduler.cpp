@@ -0,0 +1,178 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "FrameScheduler.h"
+
+FrameScheduler::FrameScheduler()
+: frameBudget((float)(CCDirector::sharedDirector()->getAnimationInterval() * 1000.0 * 0.75))
+, lastFrameCost(0)
+{
+    CCTime::gettimeofdayCocos2d(&frameStart, NULL);
+}
+
+FrameScheduler::~FrameScheduler()
+{
+    for (unsigned int i = 0; i < tasks.size(); ++i)
+    {
+        tasks[i].target->release();
+    }
+}
+
+void FrameScheduler::setFrameBudget(float milliseconds)
+{
+    frameBudget = milliseconds;
+}
+
+float FrameScheduler::getFrameBudget() const
+{
+    return frameBudget;
+}
+
+void FrameScheduler::addTask(CCObject *target, SEL_FrameTask selector, FrameTaskPriority priority)
+{
+    if (hasTask(target, selector))
+    {
+        return;
+    }
+    
+    Task task;
+    task.target = target;
+    task.selector = selector;
+    task.priority = priority;
+    task.waiting = false;
+    target->retain();
+    
+    //! behind every task of the same or a more urgent priority
+    std::vector<Task>::iterator position = tasks.begin();
+    while (position != tasks.end() && position->priority <= priority)
+    {
+        ++position;
+    }
+    tasks.insert(position, task);
+}
+
+void FrameScheduler::removeTasksForTarget(CCObject *target)
+{
+    for (int i = (int)tasks.size() - 1; i >= 0; --i)
+    {
+        if (tasks[i].target == target)
+        {
+            tasks.erase(tasks.begin() + i);
+            target->release();
+        }
+    }
+}
+
+void FrameScheduler::removeTask(CCObject *target, SEL_FrameTask selector)
+{
+    for (unsigned int i = 0; i < tasks.size(); ++i)
+    {
+        if (tasks[i].target == target && tasks[i].selector == selector)
+        {
+            tasks.erase(tasks.begin() + i);
+            target->release();
+            return;
+        }
+    }
+}
+
+bool FrameScheduler::hasTask(CCObject *target, SEL_FrameTask selector) const
+{
+    for (unsigned int i = 0; i < tasks.size(); ++i)
+    {
+        if (tasks[i].target == target && tasks[i].selector == selector)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned int FrameScheduler::getTaskCount() const
+{
+    return (unsigned int)tasks.size();
+}
+
+float FrameScheduler::elapsed()
+{
+    struct cc_timeval now;
+    CCTime::gettimeofdayCocos2d(&now, NULL);
+    return (float)CCTime::timersubCocos2d(&frameStart, &now);
+}
+
+void FrameScheduler::beginFrame()
+{
+    CCTime::gettimeofdayCocos2d(&frameStart, NULL);
+    for (unsigned int i = 0; i < tasks.size(); ++i)
+    {
+        tasks[i].waiting = false;
+    }
+}
+
+void FrameScheduler::runTasks()
+{
+    bool ranUnit = false;
+    while (!ranUnit || elapsed() < frameBudget)
+    {
+        //! units may add or remove tasks, look the next one up every time
+        unsigned int next = 0;
+        while (next < tasks.size() && tasks[next].waiting)
+        {
+            ++next;
+        }
+        if (next == tasks.size())
+        {
+            break;
+        }
+        
+        Task task = tasks[next];
+        //! keeps the target alive even if the unit removes its own task
+        task.target->retain();
+        FrameTaskStatus status = (task.target->*task.selector)();
+        ranUnit = true;
+        
+        if (status == kFrameTaskDone)
+        {
+            removeTask(task.target, task.selector);
+        }
+        else if (status == kFrameTaskWait)
+        {
+            for (unsigned int i = 0; i < tasks.size(); ++i)
+            {
+                if (tasks[i].target == task.target && tasks[i].selector == task.selector)
+                {
+                    tasks[i].waiting = true;
+                }
+            }
+        }
+        task.target->release();
+    }
+    
+    lastFrameCost = elapsed();
+}
+
+float FrameScheduler::getLastFrameCost() const
+{
+    return lastFrameCost;
+}
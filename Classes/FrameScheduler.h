@@ -0,0 +1,103 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _FRAME_SCHEDULER_H_
+#define _FRAME_SCHEDULER_H_
+
+#include "cocos2d.h"
+#include <vector>
+
+USING_NS_CC;
+
+//! what a task reports after doing one unit of work
+typedef enum {
+    //! more to do, run again if the budget allows
+    kFrameTaskContinue,
+    //! blocked on something else, try again next frame
+    kFrameTaskWait,
+    kFrameTaskDone
+} FrameTaskStatus;
+
+//! most urgent first, tasks of one priority run in the order they were added
+typedef enum {
+    //! ink that belongs on the canvas already but was deferred to keep the frame short
+    kFrameTaskInk,
+    kFrameTaskRestore,
+    kFrameTaskCache,
+    kFrameTaskExport
+} FrameTaskPriority;
+
+typedef FrameTaskStatus (CCObject::*SEL_FrameTask)();
+#define frametask_selector(_SELECTOR) (SEL_FrameTask)(&_SELECTOR)
+
+/**
+ Runs deferrable work in small units within what is left of a frame's time budget.
+
+ beginFrame() marks the start of the frame, runTasks() is called once the frame's
+ critical work (the newest ink) is done and keeps calling task units, most urgent
+ first, until the time since beginFrame() exceeds the budget. At least one unit runs
+ per frame so the queue always drains.
+ */
+class FrameScheduler
+{
+public:
+    FrameScheduler();
+    ~FrameScheduler();
+
+    //! milliseconds a frame may take including the critical work, 3/4 of the animation interval by default
+    void setFrameBudget(float milliseconds);
+    float getFrameBudget() const;
+
+    //! target is retained while the task is queued, adding a queued task again does nothing
+    void addTask(CCObject *target, SEL_FrameTask selector, FrameTaskPriority priority);
+    void removeTasksForTarget(CCObject *target);
+    bool hasTask(CCObject *target, SEL_FrameTask selector) const;
+    unsigned int getTaskCount() const;
+
+    void beginFrame();
+    void runTasks();
+
+    //! milliseconds from beginFrame() to the end of runTasks() in the last frame
+    float getLastFrameCost() const;
+
+private:
+    typedef struct _Task {
+        CCObject *target;
+        SEL_FrameTask selector;
+        FrameTaskPriority priority;
+        //! reported kFrameTaskWait this frame
+        bool waiting;
+    } Task;
+
+    float elapsed();
+    void removeTask(CCObject *target, SEL_FrameTask selector);
+
+    std::vector<Task> tasks;
+    struct cc_timeval frameStart;
+    float frameBudget;
+    float lastFrameCost;
+};
+
+#endif // _FRAME_SCHEDULER_H_
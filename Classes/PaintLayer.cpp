@@ -23,46 +23,67 @@
  *
  */
 #include "PaintLayer.h"
+#include "CCEventType.h"
+#include "StrokeCurveFitter.h"
+#include <algorithm>
+#include <limits.h>
 
 #define visibleSize         CCDirector::sharedDirector()->getVisibleSize()
 
-LinePoint::LinePoint()
-{
-}
-
-LinePoint::~LinePoint()
-{
-}
-
 CCScene* PaintLayer::scene()
 {
     CCScene* scene = CCScene::create();
     CCLayer* layer = PaintLayer::create();
-    scene->addChild(layer);
+    scene->addChild(layer, 0, kPaintLayerTag);
     return scene;
 }
 
 PaintLayer::PaintLayer()
 {
     lineWidth = 20.0;
+    pressureWidth = 0.6f;
+    tiltWidth = 1.0f;
+    liveSpanLimit = 16;
+    liveDrawTime = 0;
+    liveVertexCount = 0;
+    idleLayerBudget = kCanvasDefaultMemoryBudget;
+    nextLayerID = 1;
+    paperColor = ccc4f(1.0, 1.0, 1.0, 1.0);
+    strokeStyle = StrokeStyleMake(ccc4f(0, 0, 1, 1), 1.0f, kStrokeBlendNormal);
+    symmetry = StrokeSymmetryNone();
+    overdraw = 3.0f;
+    qualityOverdraw = overdraw;
+    strokeQuality = StrokeQualityDefault();
+    mipPyramid = NULL;
     
-    points = CCArray::create();
-    velocities = CCArray::create();
-    circlesPoints = CCArray::create();
-    
-    points->retain();
-    velocities->retain();
-    circlesPoints->retain();
+    activeStrokes = CCArray::create();
+    activeStrokes->retain();
 }
 
 PaintLayer::~PaintLayer()
 {
-    CC_SAFE_RELEASE(points);
-    CC_SAFE_RELEASE(velocities);
-    CC_SAFE_RELEASE(circlesPoints);
+    CC_SAFE_RELEASE(activeStrokes);
+    CC_SAFE_RELEASE(mipPyramid);
+}
+
+PaintLayer *PaintLayer::createWithConfig(const CanvasConfig &config)
+{
+    PaintLayer *pRet = new PaintLayer();
+    if (pRet && pRet->initWithConfig(config))
+    {
+        pRet->autorelease();
+        return pRet;
+    }
+    CC_SAFE_DELETE(pRet);
+    return NULL;
 }
 
 bool PaintLayer::init()
+{
+    return initWithConfig(CanvasConfigForMemoryBudget(visibleSize, kCanvasDefaultMemoryBudget, false));
+}
+
+bool PaintLayer::initWithConfig(const CanvasConfig &config)
 {
     bool bRet = false;
     do
@@ -70,13 +91,25 @@ bool PaintLayer::init()
         CC_BREAK_IF(!CCLayer::init());
         
         setShaderProgram(CCShaderCache::sharedShaderCache()->programForKey(kCCShader_PositionColor));
-        overdraw = 3.0f;
+        canvasConfig = config;
+        overdraw = CanvasConfigOverdraw(canvasConfig, 3.0f);
+        applyQualityTier();
         
-        renderTexture = CCRenderTexture::create(visibleSize.width, visibleSize.height,kCCTexture2DPixelFormat_RGBA8888);
-        renderTexture->setPosition(visibleSize.width/2, visibleSize.height/2);
-        renderTexture->clear(1.0, 1.0, 1.0, 1.0);
+        batch.setPaperColor(paperColor);
+        //! ink outside the canvas is never seen, live strokes don't tessellate it
+        batch.setCullRect(CCRectMake(0, 0, visibleSize.width, visibleSize.height));
+        visibleRect = CCRectMake(0, 0, visibleSize.width, visibleSize.height);
         
-        addChild(renderTexture);
+        //! the bottom layer is the paper
+        layerStack = CanvasLayerStack::create();
+        addChild(layerStack);
+        CanvasLayer *paper = layerStack->addLayer(nextLayerID++, true);
+        setLayerCanvas(paper, false);
+        renderTexture = paper->canvas;
+        mipPyramid = CanvasMipPyramid::create(renderTexture);
+        CC_SAFE_RETAIN(mipPyramid);
+        
+        strokeIndex.initWithBounds(CCRectMake(0, 0, visibleSize.width, visibleSize.height), 64.0f);
         
         bRet = true;
     } while(0);
@@ -84,339 +117,1094 @@ bool PaintLayer::init()
     return bRet;
 }
 
-#pragma mark - Handling points
-void PaintLayer::startNewLineFrom(CCPoint newPoint, float aSize)
+CCRenderTexture *PaintLayer::createLayerCanvas(CanvasLayer *layer)
 {
-    connectingLine = false;
-    addPoint(newPoint, aSize);
+    //! layers above the paper need alpha, 16 bit canvases get the 16 bit format that has it
+    CCTexture2DPixelFormat pixelFormat = canvasConfig.pixelFormat;
+    if (!layer->opaque && pixelFormat == kCCTexture2DPixelFormat_RGB565)
+    {
+        pixelFormat = kCCTexture2DPixelFormat_RGBA4444;
+    }
+    
+    //! stencil keeps translucent strokes from blending over themselves
+    float scale = canvasConfig.resolutionScale;
+    CCRenderTexture *canvas = CCRenderTexture::create(ceilf(visibleSize.width * scale), ceilf(visibleSize.height * scale), pixelFormat, GL_DEPTH24_STENCIL8);
+    canvas->setPosition(visibleSize.width/2, visibleSize.height/2);
+    if (scale != 1.0f)
+    {
+        //! stretched over the screen, filter so strokes keep smooth edges instead of turning blocky
+        canvas->setScale(1.0f / scale);
+        canvas->getSprite()->getTexture()->setAntiAliasTexParameters();
+    }
+    
+#if CC_ENABLE_CACHE_TEXTURE_DATA
+    //! the stroke log restores the canvas, no need for the engine's full synchronous readback when going to background
+    CCNotificationCenter::sharedNotificationCenter()->removeObserver(canvas, EVENT_COME_TO_BACKGROUND);
+#endif
+    
+    ccColor4F paper = paperColorForLayer(layer);
+    canvas->beginWithClear(paper.r, paper.g, paper.b, paper.a, 1.0f, 0);
+    canvas->end();
+    return canvas;
 }
 
-void PaintLayer::endLineAt(CCPoint aEndPoint, float aSize)
+ccColor4F PaintLayer::paperColorForLayer(const CanvasLayer *layer) const
 {
-    addPoint(aEndPoint, aSize);
-    finishingLine = true;
+    return layer->opaque ? paperColor : ccc4f(0, 0, 0, 0);
 }
 
-void PaintLayer::addPoint(CCPoint newPoint, float size)
+void PaintLayer::beginCanvas(CanvasLayer *layer)
 {
-    LinePoint *point = new LinePoint();
-    point->pos = newPoint;
-    point->width = size;
-    point->autorelease();
-    points->addObject(point);
+    //! eraser strokes paint the paper of the layer they are drawn on, stencil values are the canvas's own
+    batch.setPaperColor(paperColorForLayer(layer));
+    batch.setStencil(&layer->stencil);
+    layer->canvas->begin();
+    
+    kmGLMatrixMode(KM_GL_MODELVIEW);
+    kmGLPushMatrix();
+    kmGLScalef(canvasConfig.resolutionScale, canvasConfig.resolutionScale, 1.0f);
 }
 
-#pragma mark - Drawing
+void PaintLayer::endCanvas(CanvasLayer *layer)
+{
+    kmGLMatrixMode(KM_GL_MODELVIEW);
+    kmGLPopMatrix();
+    
+    layer->canvas->end();
+    batch.setStencil(NULL);
+}
 
-#define ADD_TRIANGLE(A, B, C, Z) vertices[index].pos = A, vertices[index++].z = Z, vertices[index].pos = B, vertices[index++].z = Z, vertices[index].pos = C, vertices[index++].z = Z
+unsigned int PaintLayer::canvasDetailLevel()
+{
+    //! the levels' tolerances are in points, a canvas pixel is this many of them smaller
+    return StrokeSimplifier::levelForScale(CC_CONTENT_SCALE_FACTOR() * canvasConfig.resolutionScale);
+}
 
-void PaintLayer::drawLines(CCArray *linePoints, ccColor4F color)
+CanvasExporter *PaintLayer::exportCanvas(const char *path, CanvasExportFormat format, CCObject *target, SEL_CallFuncO selector)
 {
-    unsigned int numberOfVertices = (linePoints->count() - 1) * 18;
-    LineVertex *vertices = (LineVertex *)calloc(sizeof(LineVertex), numberOfVertices);
+    //! with more than one layer the exporter copies them flattened
+    CCRenderTexture *canvas = renderTexture;
+    if (layerStack->getLayerCount() > 1)
+    {
+        restoreLayersForComposite();
+        canvas = layerStack->createFlattened();
+    }
+    
+    CanvasExporter *exporter = CanvasExporter::create(canvas, path, format);
+    if (exporter != NULL)
+    {
+        exporter->setCompletionCallback(target, selector);
+        exporter->start(&frameScheduler);
+    }
+    return exporter;
+}
 
-    CCPoint prevPoint =  ((LinePoint *)linePoints->objectAtIndex(0))->pos;
-    float prevValue = ((LinePoint *)linePoints->objectAtIndex(0))->width;
-    float curValue;
-    int index = 0;
-    for (int i = 1; i < linePoints->count(); ++i)
+StrokeVectorExporter *PaintLayer::exportVector(const char *path, StrokeVectorFormat format, CCObject *target, SEL_CallFuncO selector)
+{
+    StrokeVectorExporter *exporter = StrokeVectorExporter::create(path, format, visibleSize, paperColor);
+    if (exporter != NULL)
     {
-        LinePoint *pointValue = (LinePoint *)linePoints->objectAtIndex(i);
-        CCPoint curPoint = pointValue->pos;
-        curValue = pointValue->width;
+        for (unsigned int i = 0; i < layerStack->getLayerCount(); ++i)
+        {
+            CanvasLayer *layer = layerStack->getLayer(i);
+            if (layer->visible)
+            {
+                exporter->addLayer(layer->layerID, layer->opacity, layer->blendMode);
+            }
+        }
+        exporter->setCompletionCallback(target, selector);
+        exporter->start(strokeIndex, &frameScheduler);
+    }
+    return exporter;
+}
+
+#pragma mark - GL context loss
 
-        //! equal points, skip them
-        if (ccpFuzzyEqual(curPoint, prevPoint, 0.0001f))
+void PaintLayer::onCanvasLost(CCObject *object)
+{
+    //! whatever is being drawn here goes into the stroke log, it is all that survives
+    releaseLiveStencilRefs();
+    for (int i = (int)activeStrokes->count() - 1; i >= 0; --i)
+    {
+        Stroke *stroke = (Stroke *)activeStrokes->objectAtIndex(i);
+        if (!stroke->isEnded() && stroke->peerID != 0)
         {
+            //! the peer goes on drawing it, it stays live and is drawn again once the canvas is back
             continue;
         }
+        if (!stroke->isEnded() && stroke->hasPoints())
+        {
+            LinePoint last = stroke->getLastPoint();
+            stroke->endLineAt(last);
+            strokeStream.strokeEnded(stroke, last);
+            commitStroke(stroke);
+        }
+        activeStrokes->removeObjectAtIndex(i);
+    }
+    strokeStream.flush();
+}
+
+void PaintLayer::onCanvasRecreated(CCObject *object)
+{
+    //! texture, FBO and stencil are gone with the old context, the tiles stored in RAM are not
+    layerStack->releaseComposite();
+    for (unsigned int i = 0; i < layerStack->getLayerCount(); ++i)
+    {
+        layerStack->setCanvas(layerStack->getLayer(i), NULL);
+    }
+    
+    //! the active layer comes back tile by tile, the others at once when the composite needs them
+    CanvasLayer *active = layerStack->getActiveLayer();
+    setLayerCanvas(active, true);
+    renderTexture = active->canvas;
+    //! live strokes draw from their start again, over tiles drawn from the committed strokes alone
+    for (unsigned int i = 0; i < activeStrokes->count(); ++i)
+    {
+        Stroke *stroke = (Stroke *)activeStrokes->objectAtIndex(i);
+        active->storedTiles.invalidateRect(canvasPixelRect(StrokeSymmetryBounds(stroke->symmetry, stroke->getBounds())));
+        stroke->rewind();
+    }
+    frameScheduler.addTask(this, frametask_selector(PaintLayer::restoreTilesStep), kFrameTaskRestore);
+    mipPyramid->recreateLevels();
+}
+
+FrameTaskStatus PaintLayer::restoreTilesStep()
+{
+    //! a layer that stopped being active meanwhile was restored at once
+    CanvasLayer *layer = layerStack->getActiveLayer();
+    if (layer->storedTiles.isRestored())
+    {
+        return kFrameTaskDone;
+    }
+    
+    //! what the view shows first, a tile row per step
+    std::vector<CCRect> missingRects;
+    layer->storedTiles.restoreNextRow(layer->canvas->getSprite()->getTexture(), canvasPixelRect(visibleRect), missingRects);
+    drawMissingTiles(layer, missingRects);
+    if (!layer->storedTiles.isRestored())
+    {
+        return kFrameTaskContinue;
+    }
+    //! the levels may have been drawn from a canvas still partly blank
+    mipPyramid->invalidateAll();
+    return kFrameTaskDone;
+}
 
-        CCPoint dir = ccpSub(curPoint, prevPoint);
-        CCPoint perpendicular = ccpNormalize(ccpPerp(dir));
-        CCPoint A = ccpAdd(prevPoint, ccpMult(perpendicular, prevValue / 2));
-        CCPoint B = ccpSub(prevPoint, ccpMult(perpendicular, prevValue / 2));
-        CCPoint C = ccpAdd(curPoint, ccpMult(perpendicular, curValue / 2));
-        CCPoint D = ccpSub(curPoint, ccpMult(perpendicular, curValue / 2));
+FrameTaskStatus PaintLayer::storeTilesStep()
+{
+    //! a layer waiting to be evicted needs all its tiles, the active one those that stayed unchanged a while
+    CanvasLayer *layer = layerStack->evictionCandidate(idleLayerBudget);
+    unsigned int changedBefore = UINT_MAX;
+    if (layer == NULL || layer->storedTiles.isStored())
+    {
+        unsigned int frame = CCDirector::sharedDirector()->getTotalFrames();
+        layer = layerStack->getActiveLayer();
+        changedBefore = frame > kCanvasTileIdleFrames ? frame - kCanvasTileIdleFrames : 0;
+    }
+    //! a small readback per step, GLES2 has no pixel buffers to read asynchronously
+    return layer->storedTiles.storeRow(layer->canvas, changedBefore) ? kFrameTaskContinue : kFrameTaskDone;
+}
 
-        //! continuing line
-        if (connectingLine || index > 0)
+FrameTaskStatus PaintLayer::drawBacklogStep()
+{
+    CCObject *object = NULL;
+    CCARRAY_FOREACH(activeStrokes, object)
+    {
+        Stroke *stroke = (Stroke *)object;
+        if (stroke->hasBacklog())
         {
-            A = prevC;
-            B = prevD;
+            CanvasLayer *layer = layerStack->getActiveLayer();
+            touchLayerRect(layer, StrokeSymmetryBounds(stroke->symmetry, stroke->getBounds()));
+            beginCanvas(layer);
+            stroke->tessellateBacklog(&batch);
+            batch.flush(getShaderProgram(), stroke->symmetry);
+            endCanvas(layer);
+            return kFrameTaskContinue;
         }
-        else if (index == 0)
+    }
+    return kFrameTaskDone;
+}
+
+FrameTaskStatus PaintLayer::buildCommittedStep()
+{
+    if (pendingCommitIDs.empty())
+    {
+        return kFrameTaskDone;
+    }
+    
+    //! erased in the meantime if it is gone
+    unsigned int strokeID = pendingCommitIDs.front();
+    StrokeRecord *record = strokeIndex.recordForID(strokeID);
+    if (record == NULL)
+    {
+        curveWorker.cancel(strokeID);
+    }
+    else if (curveWorker.takeResult(strokeID, record->curve, record->levels))
+    {
+        CanvasLayer *layer = layerStack->layerForID(record->layerID);
+        batch.setPaperColor(layer != NULL ? paperColorForLayer(layer) : paperColor);
+        //! the curve replaces the input points, unless the stroke was too short to fit
+        if (!record->curve.empty())
         {
-            //! circle at start of line, revert direction
-            circlesPoints->addObject(pointValue);
-            circlesPoints->addObject(linePoints->objectAtIndex(i-1));
+            std::vector<LinePoint>().swap(record->points);
         }
+        meshCache.meshForRecord(*record, canvasDetailLevel(), overdraw, batch);
+    }
+    else
+    {
+        return kFrameTaskWait;
+    }
+    pendingCommitIDs.pop_front();
+    return pendingCommitIDs.empty() ? kFrameTaskDone : kFrameTaskContinue;
+}
 
-        ADD_TRIANGLE(A, B, C, 1.0f);
-        ADD_TRIANGLE(B, C, D, 1.0f);
-
-        prevD = D;
-        prevC = C;
-        if (finishingLine && (i == linePoints->count() - 1))
+FrameTaskStatus PaintLayer::redrawReducedStep()
+{
+    //! once its mesh is built, and not under a stroke being drawn whose live ink the redraw would clear
+    for (unsigned int i = 0; i < reducedStrokeIDs.size(); ++i)
+    {
+        unsigned int strokeID = reducedStrokeIDs[i];
+        const StrokeRecord *record = strokeIndex.recordForID(strokeID);
+        if (record == NULL)
+        {
+            reducedStrokeIDs.erase(reducedStrokeIDs.begin() + i);
+            return reducedStrokeIDs.empty() ? kFrameTaskDone : kFrameTaskContinue;
+        }
+        if (std::find(pendingCommitIDs.begin(), pendingCommitIDs.end(), strokeID) != pendingCommitIDs.end())
+        {
+            continue;
+        }
+        
+        bool live = false;
+        CCObject *object = NULL;
+        CCARRAY_FOREACH(activeStrokes, object)
         {
-            circlesPoints->addObject(linePoints->objectAtIndex(i-1));
-            circlesPoints->addObject(pointValue);
-            finishingLine = false;
+            Stroke *stroke = (Stroke *)object;
+            live = live || (record->layerID == layerStack->getActiveLayer()->layerID
+                            && record->bounds.intersectsRect(StrokeSymmetryBounds(stroke->symmetry, stroke->getBounds())));
         }
-        prevPoint = curPoint;
-        prevValue = curValue;
+        if (live)
+        {
+            continue;
+        }
+        
+        CanvasLayer *layer = layerStack->layerForID(record->layerID);
+        CCRect bounds = record->bounds;
+        reducedStrokeIDs.erase(reducedStrokeIDs.begin() + i);
+        if (layer != NULL)
+        {
+            redrawLayerRect(layer, bounds);
+        }
+        return reducedStrokeIDs.empty() ? kFrameTaskDone : kFrameTaskContinue;
+    }
+    return reducedStrokeIDs.empty() ? kFrameTaskDone : kFrameTaskWait;
+}
 
-        //! Add overdraw
-        CCPoint F = ccpAdd(A, ccpMult(perpendicular, overdraw));
-        CCPoint G = ccpAdd(C, ccpMult(perpendicular, overdraw));
-        CCPoint H = ccpSub(B, ccpMult(perpendicular, overdraw));
-        CCPoint I = ccpSub(D, ccpMult(perpendicular, overdraw));
+bool PaintLayer::importStrokes(std::vector<StrokeImport> &strokes)
+{
+    if (bulkLoader.isLoading())
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < strokes.size(); ++i)
+    {
+        CanvasLayer *layer = layerStack->layerForID(strokes[i].layerID);
+        strokes[i].paperColor = layer != NULL ? paperColorForLayer(layer) : paperColor;
+    }
+    if (!bulkLoader.start(strokes, canvasDetailLevel(), overdraw, StrokeQualityDefault()))
+    {
+        return false;
+    }
+    frameScheduler.addTask(this, frametask_selector(PaintLayer::importStep), kFrameTaskRestore);
+    return true;
+}
 
-        //! end vertices of last line are the start of this one, also for the overdraw
-        if (connectingLine || index > 6)
+FrameTaskStatus PaintLayer::importStep()
+{
+    if (!bulkLoader.isLoading())
+    {
+        return kFrameTaskDone;
+    }
+    StrokeBulkChunk *chunk = bulkLoader.takeChunk();
+    if (chunk == NULL)
+    {
+        return kFrameTaskWait;
+    }
+    
+    //! strokes of a layer in a row are drawn with one begin of its canvas, equal neighbours share draw calls
+    CanvasLayer *drawingLayer = NULL;
+    for (unsigned int i = 0; i < chunk->strokes.size(); ++i)
+    {
+        StrokeBulkStroke &stroke = chunk->strokes[i];
+        CanvasLayer *layer = layerStack->layerForID(stroke.import.layerID);
+        if (layer == NULL)
         {
-            F = prevG;
-            H = prevI;
+            continue;
+        }
+        
+        unsigned int strokeID = strokeIndex.insert(layer->layerID, stroke.import.style, stroke.import.symmetry, stroke.import.points, overdraw);
+        StrokeRecord *record = strokeIndex.recordForID(strokeID);
+        mipPyramid->invalidateRect(record->bounds);
+        record->curve.swap(stroke.curve);
+        record->levels.swap(stroke.levels);
+        //! the curve replaces the input points, unless the stroke was too short to fit
+        if (!record->curve.empty())
+        {
+            std::vector<LinePoint>().swap(record->points);
+        }
+        
+        if (layer->canvas == NULL)
+        {
+            //! evicted, the stroke is drawn along with the others when the layer is restored
+            redrawLayerRect(layer, record->bounds);
+            continue;
+        }
+        if (!layer->storedTiles.isRestored())
+        {
+            //! tiles come back under the canvas begin of the drawing layer, get them all now
+            if (drawingLayer != NULL)
+            {
+                batch.flush(getShaderProgram());
+                endCanvas(drawingLayer);
+                drawingLayer = NULL;
+            }
+            finishRestore(layer);
         }
+        layer->storedTiles.invalidateRect(canvasPixelRect(record->bounds), CCDirector::sharedDirector()->getTotalFrames());
+        if (layer != drawingLayer)
+        {
+            if (drawingLayer != NULL)
+            {
+                batch.flush(getShaderProgram());
+                endCanvas(drawingLayer);
+            }
+            beginCanvas(layer);
+            drawingLayer = layer;
+            if (layer != layerStack->getActiveLayer())
+            {
+                layerStack->invalidateComposite();
+            }
+        }
+        if (stroke.vertexCount > 0)
+        {
+            GLint stencilRef = stroke.needsIsolation ? batch.nextStencilRef() : 0;
+            batch.appendMesh(&chunk->vertices[stroke.firstVertex], stroke.vertexCount, batch.stateForStyle(stroke.import.style, stencilRef));
+        }
+    }
+    if (drawingLayer != NULL)
+    {
+        batch.flush(getShaderProgram());
+        endCanvas(drawingLayer);
+    }
+    delete chunk;
+    return bulkLoader.isLoading() ? kFrameTaskContinue : kFrameTaskDone;
+}
 
-        prevG = G;
-        prevI = I;
+FrameTaskStatus PaintLayer::updateMipStep()
+{
+    //! tasks before this one may have changed layers the composite holds
+    updateComposite();
+    mipPyramid->update(layerStack);
+    return kFrameTaskDone;
+}
+
+void PaintLayer::update(float dt)
+{
+    frameScheduler.beginFrame();
+    
+    if (qualityGovernor.addFrame(dt * 1000.0f, liveDrawTime, liveVertexCount))
+    {
+        applyQualityTier();
+    }
+    liveDrawTime = 0;
+    liveVertexCount = 0;
+    
+    //! runs before the frame is drawn, remote ink shows up in the frame it arrived in
+    std::vector<Stroke *> endedStrokes;
+    strokeStream.receive(activeStrokes, endedStrokes);
+    for (unsigned int i = 0; i < endedStrokes.size(); ++i)
+    {
+        commitStroke(endedStrokes[i]);
+    }
+    strokeStream.flush();
+}
+
+#pragma mark - Drawing
+
+static bool strokeBatchOrder(const std::pair<StrokeBatchState, Stroke *> &a, const std::pair<StrokeBatchState, Stroke *> &b)
+{
+    return StrokeBatch::stateLess(a.first, b.first);
+}
+
+void PaintLayer::draw(void)
+{
+    //! the newest ink first, then deferred work as far as the frame budget allows
+    struct cc_timeval drawStart, drawEnd;
+    CCTime::gettimeofdayCocos2d(&drawStart, NULL);
+    drawLiveStrokes();
+    CCTime::gettimeofdayCocos2d(&drawEnd, NULL);
+    liveDrawTime += (float)CCTime::timersubCocos2d(&drawStart, &drawEnd);
+    updateComposite();
+    if (mipPyramid->needsUpdate())
+    {
+        frameScheduler.addTask(this, frametask_selector(PaintLayer::updateMipStep), kFrameTaskCache);
+    }
+    //! storing tiles waits for spare frame time, the canvas it reads must not change in between
+    CanvasLayer *candidate = layerStack->evictionCandidate(idleLayerBudget);
+    unsigned int frame = CCDirector::sharedDirector()->getTotalFrames();
+    if ((candidate != NULL && !candidate->storedTiles.isStored())
+        || (frame > kCanvasTileIdleFrames && layerStack->getActiveLayer()->storedTiles.needsStore(frame - kCanvasTileIdleFrames)))
+    {
+        frameScheduler.addTask(this, frametask_selector(PaintLayer::storeTilesStep), kFrameTaskCache);
+    }
+    frameScheduler.runTasks();
+}
 
-        ADD_TRIANGLE(F, A, G, 2.0f);
-        ADD_TRIANGLE(A, G, C, 2.0f);
-        ADD_TRIANGLE(B, H, D, 2.0f);
-        ADD_TRIANGLE(H, D, I, 2.0f);
+void PaintLayer::applyQualityTier()
+{
+    StrokeQualityTier tier = qualityGovernor.getTier();
+    strokeQuality = StrokeQualityGovernor::qualityForTier(tier);
+    switch (StrokeQualityGovernor::antialiasForTier(tier))
+    {
+        case kStrokeAntialiasNone:
+            qualityOverdraw = 0;
+            break;
+        case kStrokeAntialiasPixel:
+            qualityOverdraw = MIN(overdraw, CanvasConfigOverdraw(canvasConfig, 0));
+            break;
+        default:
+            qualityOverdraw = overdraw;
+            break;
     }
+}
+
+void PaintLayer::setQualityTier(StrokeQualityTier tier)
+{
+    qualityGovernor.setTier(tier);
+    applyQualityTier();
+}
 
-    this->fillLineTriangles(vertices, index, color);
+void PaintLayer::setAdaptiveQuality()
+{
+    qualityGovernor.setAdaptive(true);
+}
+
+void PaintLayer::updateComposite()
+{
+    if (!layerStack->isCompositeValid())
+    {
+        restoreLayersForComposite();
+        layerStack->rebuildComposite();
+        //! a layer was shown, hidden or restyled, the change may cover the whole canvas
+        mipPyramid->invalidateAll();
+    }
+    layerStack->evictToBudget(idleLayerBudget, true);
+}
 
-    if (index > 0)
+void PaintLayer::drawLiveStrokes()
+{
+    if (activeStrokes->count() == 0)
+    {
+        return;
+    }
+    
+    //! tiles under the strokes back on the canvas and dropped from the store, then bound, the states take
+    //! their stencil values from the canvas
+    CanvasLayer *layer = layerStack->getActiveLayer();
+    CCObject *object = NULL;
+    CCARRAY_FOREACH(activeStrokes, object)
+    {
+        Stroke *stroke = (Stroke *)object;
+        touchLayerRect(layer, StrokeSymmetryBounds(stroke->symmetry, stroke->getBounds()));
+    }
+    beginCanvas(layer);
+    
+    //! sorting by state lets differently styled strokes share draw calls, stable so equal ones keep their order
+    std::vector<std::pair<StrokeBatchState, Stroke *> > strokes;
+    strokes.reserve(activeStrokes->count());
+    CCARRAY_FOREACH(activeStrokes, object)
+    {
+        Stroke *stroke = (Stroke *)object;
+        strokes.push_back(std::make_pair(stroke->batchStateIn(&batch), stroke));
+    }
+    std::stable_sort(strokes.begin(), strokes.end(), strokeBatchOrder);
+    
+    //! one flush per symmetry, its copies reuse the vertices tessellated once
+    bool backlog = false;
+    std::vector<bool> drawn(strokes.size(), false);
+    for (unsigned int i = 0; i < strokes.size(); ++i)
+    {
+        if (drawn[i])
+        {
+            continue;
+        }
+        StrokeSymmetry flushSymmetry = strokes[i].second->symmetry;
+        for (unsigned int j = i; j < strokes.size(); ++j)
+        {
+            if (!drawn[j] && StrokeSymmetryEqual(strokes[j].second->symmetry, flushSymmetry))
+            {
+                strokes[j].second->tessellate(&batch, liveSpanLimit);
+                backlog = backlog || strokes[j].second->hasBacklog();
+                drawn[j] = true;
+            }
+        }
+        liveVertexCount += (unsigned int)batch.getVertices().size() * StrokeSymmetryCopyCount(flushSymmetry);
+        batch.flush(getShaderProgram(), flushSymmetry);
+    }
+    
+    endCanvas(layer);
+    
+    if (backlog)
+    {
+        frameScheduler.addTask(this, frametask_selector(PaintLayer::drawBacklogStep), kFrameTaskInk);
+    }
+    
+    for (int i = (int)activeStrokes->count() - 1; i >= 0; --i)
     {
-        connectingLine = true;
+        Stroke *stroke = (Stroke *)activeStrokes->objectAtIndex(i);
+        if (stroke->isFinished())
+        {
+            stroke->releaseStencilRef();
+            activeStrokes->removeObjectAtIndex(i);
+        }
     }
+}
 
-    free(vertices);
+void PaintLayer::releaseLiveStencilRefs()
+{
+    CCObject *object = NULL;
+    CCARRAY_FOREACH(activeStrokes, object)
+    {
+        ((Stroke *)object)->releaseStencilRef();
+    }
 }
 
-void PaintLayer::fillLineEndPointAt(CCPoint center, CCPoint aLineDir, float radius, ccColor4F color)
+#pragma mark - Committed strokes
+
+static bool strokeQualityIsDefault(const StrokeQuality &quality)
 {
-    int numberOfSegments = 32;
-    LineVertex *vertices = (LineVertex *)malloc(sizeof(LineVertex) * numberOfSegments * 9);
-    float anglePerSegment = (float)(M_PI / (numberOfSegments - 1));
+    StrokeQuality full = StrokeQualityDefault();
+    return quality.sampleSpacing == full.sampleSpacing && quality.minSpanSamples == full.minSpanSamples
+        && quality.maxSpanSamples == full.maxSpanSamples && quality.capDirections == full.capDirections;
+}
 
-    //! we need to cover M_PI from this, dot product of normalized vectors is equal to cos angle between them... and if you include rightVec dot you get to know the correct direction :)
-    CCPoint perpendicular = ccpPerp(aLineDir);
-    float angle = acosf(ccpDot(perpendicular, CCPointMake(0, 1)));
-    float rightDot = ccpDot(perpendicular, CCPointMake(1, 0));
-    if (rightDot < 0.0f)
+void PaintLayer::commitStroke(Stroke *stroke)
+{
+    //! indexed right away for picking and redraws, the worker fits it and tessellating waits for spare frame time
+    stroke->strokeID = strokeIndex.insert(layerStack->getActiveLayer()->layerID, stroke->style, stroke->symmetry, stroke->getInputPoints(), overdraw);
+    float pressureWeight = stroke->style.pressureOpacity > 0.0f ? kStrokeCurvePressureWeight : 0.0f;
+    curveWorker.addJob(stroke->strokeID, stroke->getInputPoints(), pressureWeight);
+    pendingCommitIDs.push_back(stroke->strokeID);
+    //! the live ink is on the canvas already, the levels and the stored tiles take it in with the committed stroke
+    const CCRect &bounds = strokeIndex.recordForID(stroke->strokeID)->bounds;
+    mipPyramid->invalidateRect(bounds);
+    layerStack->getActiveLayer()->storedTiles.invalidateRect(canvasPixelRect(bounds), CCDirector::sharedDirector()->getTotalFrames());
+    
+    //! live ink of a lower tier would stay on the canvas, it is drawn again at full quality
+    if (stroke->overdraw < overdraw || !strokeQualityIsDefault(stroke->quality))
     {
-        angle *= -1;
+        reducedStrokeIDs.push_back(stroke->strokeID);
+        frameScheduler.addTask(this, frametask_selector(PaintLayer::redrawReducedStep), kFrameTaskCache);
     }
+    frameScheduler.addTask(this, frametask_selector(PaintLayer::buildCommittedStep), kFrameTaskCache);
+}
 
-    CCPoint prevPoint = center;
-    CCPoint prevDir = ccp(sinf(0), cosf(0));
-    for (unsigned int i = 0; i < numberOfSegments; ++i)
+void PaintLayer::removeHiddenStrokes(std::vector<unsigned int> &strokeIDs) const
+{
+    //! ink the user can't see can't be picked or erased
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < strokeIDs.size(); ++i)
     {
-        CCPoint dir = ccp(sinf(angle), cosf(angle));
-        CCPoint curPoint = ccp(center.x + radius * dir.x, center.y + radius * dir.y);
-        vertices[i * 9 + 0].pos = center;
-        vertices[i * 9 + 1].pos = prevPoint;
-        vertices[i * 9 + 2].pos = curPoint;
+        const CanvasLayer *layer = layerStack->layerForID(strokeIndex.recordForID(strokeIDs[i])->layerID);
+        if (layer != NULL && layer->visible)
+        {
+            strokeIDs[kept++] = strokeIDs[i];
+        }
+    }
+    strokeIDs.resize(kept);
+}
+
+unsigned int PaintLayer::strokeAtPoint(CCPoint point, float tolerance)
+{
+    //! later strokes are drawn on top
+    std::vector<unsigned int> strokeIDs;
+    strokeIndex.hitTestAll(point, tolerance, strokeIDs);
+    removeHiddenStrokes(strokeIDs);
+    return strokeIDs.empty() ? 0 : strokeIDs.back();
+}
+
+void PaintLayer::strokesInLasso(const std::vector<CCPoint> &lasso, std::vector<unsigned int> &strokeIDs)
+{
+    strokeIndex.queryLasso(lasso, strokeIDs);
+    removeHiddenStrokes(strokeIDs);
+}
 
-        //! fill rest of vertex data
-        for (unsigned int j = 0; j < 9; ++j)
+void PaintLayer::eraseStrokes(const std::vector<unsigned int> &strokeIDs)
+{
+    std::vector<std::pair<unsigned int, CCRect> > dirtyRects;
+    for (unsigned int i = 0; i < strokeIDs.size(); ++i)
+    {
+        const StrokeRecord *record = strokeIndex.recordForID(strokeIDs[i]);
+        if (record != NULL)
+        {
+            dirtyRects.push_back(std::make_pair(record->layerID, record->bounds));
+            meshCache.invalidate(strokeIDs[i]);
+            strokeIndex.remove(strokeIDs[i]);
+        }
+    }
+    
+    for (unsigned int i = 0; i < dirtyRects.size(); ++i)
+    {
+        CanvasLayer *layer = layerStack->layerForID(dirtyRects[i].first);
+        if (layer != NULL)
         {
-            vertices[i * 9 + j].z = j < 3 ? 1.0f : 2.0f;
-            vertices[i * 9 + j].color = color;
+            redrawLayerRect(layer, dirtyRects[i].second);
         }
+    }
+}
 
-        //! add overdraw
-        vertices[i * 9 + 3].pos = ccpAdd(prevPoint, ccpMult(prevDir, overdraw));
-        vertices[i * 9 + 3].color.a = 0;
-        vertices[i * 9 + 4].pos = prevPoint;
-        vertices[i * 9 + 5].pos = ccpAdd(curPoint, ccpMult(dir, overdraw));
-        vertices[i * 9 + 5].color.a = 0;
+void PaintLayer::eraseStrokesAt(CCPoint point, float radius)
+{
+    std::vector<unsigned int> strokeIDs;
+    strokeIndex.hitTestAll(point, radius, strokeIDs);
+    removeHiddenStrokes(strokeIDs);
+    eraseStrokes(strokeIDs);
+}
 
-        vertices[i * 9 + 6].pos = prevPoint;
-        vertices[i * 9 + 7].pos = curPoint;
-        vertices[i * 9 + 8].pos = ccpAdd(curPoint, ccpMult(dir, overdraw));
-        vertices[i * 9 + 8].color.a = 0;
+void PaintLayer::redrawRect(const CCRect &rect)
+{
+    for (unsigned int i = 0; i < layerStack->getLayerCount(); ++i)
+    {
+        redrawLayerRect(layerStack->getLayer(i), rect);
+    }
+}
 
-        prevPoint = curPoint;
-        prevDir = dir;
-        angle += anglePerSegment;
+void PaintLayer::redrawLayerRect(CanvasLayer *layer, const CCRect &rect)
+{
+    //! an evicted layer is drawn completely when it is restored, or the stored tiles under rect are
+    mipPyramid->invalidateRect(rect);
+    if (layer->canvas == NULL)
+    {
+        layer->storedTiles.invalidateRect(canvasPixelRect(rect));
+        return;
+    }
+    if (layer != layerStack->getActiveLayer())
+    {
+        layerStack->invalidateComposite();
     }
+    touchLayerRect(layer, rect);
+    drawLayerRect(layer, rect, canvasPixelRect(rect));
+}
 
-    glVertexAttribPointer(kCCVertexAttrib_Position, 3, GL_FLOAT, GL_FALSE, sizeof(LineVertex), &vertices[0].pos);
-    glVertexAttribPointer(kCCVertexAttrib_Color, 4, GL_FLOAT, GL_FALSE, sizeof(LineVertex), &vertices[0].color);
-    glDrawArrays(GL_TRIANGLES, 0, numberOfSegments * 9);
+void PaintLayer::drawLayerRect(CanvasLayer *layer, const CCRect &rect, const CCRect &pixelRect)
+{
+    std::vector<unsigned int> strokeIDs;
+    strokeIndex.queryRect(rect, strokeIDs);
+    
+    beginCanvas(layer);
+    
+    glEnable(GL_SCISSOR_TEST);
+    glScissor((GLint)pixelRect.origin.x, (GLint)pixelRect.origin.y, (GLsizei)pixelRect.size.width, (GLsizei)pixelRect.size.height);
+    
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    ccColor4F paper = paperColorForLayer(layer);
+    glClearColor(paper.r, paper.g, paper.b, paper.a);
+    glClearStencil(0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    
+    //! ids are in drawing order and the batch keeps it, equal neighbours still share draw calls
+    unsigned int level = canvasDetailLevel();
+    for (unsigned int i = 0; i < strokeIDs.size(); ++i)
+    {
+        const StrokeRecord *record = strokeIndex.recordForID(strokeIDs[i]);
+        if (record->layerID == layer->layerID)
+        {
+            meshCache.drawRecord(*record, level, overdraw, &batch);
+        }
+    }
+    batch.flush(getShaderProgram());
+    
+    glDisable(GL_SCISSOR_TEST);
+    endCanvas(layer);
+}
 
-    free(vertices);
+CCRect PaintLayer::canvasPixelRect(const CCRect &rect) const
+{
+    float scale = CC_CONTENT_SCALE_FACTOR() * canvasConfig.resolutionScale;
+    return CCRectMake(floorf(rect.getMinX() * scale), floorf(rect.getMinY() * scale),
+                      ceilf(rect.size.width * scale) + 1, ceilf(rect.size.height * scale) + 1);
 }
 
-void PaintLayer::fillLineTriangles(LineVertex *vertices, int count, ccColor4F color)
+unsigned int PaintLayer::fillAt(CCPoint point, float tolerance)
 {
-    getShaderProgram()->use();
-    getShaderProgram()->setUniformsForBuiltins();
+    CCTexture2D *texture = renderTexture->getSprite()->getTexture();
+    const CCSize &pixelSize = texture->getContentSizeInPixels();
+    unsigned int width = (unsigned int)pixelSize.width;
+    unsigned int height = (unsigned int)pixelSize.height;
+    float pixelsPerPoint = CC_CONTENT_SCALE_FACTOR() * canvasConfig.resolutionScale;
+    CCPoint seedPixel = ccpMult(point, pixelsPerPoint);
+    if (seedPixel.x < 0 || seedPixel.y < 0 || seedPixel.x >= width || seedPixel.y >= height)
+    {
+        return 0;
+    }
+    
+    //! the region may reach anywhere, read the whole canvas with all its tiles back
+    CanvasLayer *layer = layerStack->getActiveLayer();
+    finishRestore(layer);
+    std::vector<unsigned char> pixels(width * height * 4);
+    beginCanvas(layer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, (GLsizei)width, (GLsizei)height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+    endCanvas(layer);
+    
+    //! the feathered edge reaches over the antialiased fringe strokes are drawn with
+    std::vector<CanvasFillSpan> spans;
+    ccColor4B seed;
+    unsigned int featherWidth = (unsigned int)ceilf(overdraw * pixelsPerPoint) + 1;
+    CanvasFill::fill(&pixels[0], width, height, (unsigned int)seedPixel.x, (unsigned int)seedPixel.y,
+                     (GLubyte)(clampf(tolerance, 0.0f, 1.0f) * 255.0f + 0.5f), featherWidth, spans, seed);
+    
+    //! shifted on the CPU and uploaded, only the rows the fill touched
+    int shift[4];
+    unsigned int firstRow, lastRow;
+    CanvasFill::shiftForStyle(seed, strokeStyle, batch, shift);
+    CanvasFill::apply(&pixels[0], width, spans, shift, firstRow, lastRow);
+    CanvasConfigUploadPixels(texture, &pixels[firstRow * width * 4], 0, firstRow, width, lastRow - firstRow + 1);
+    
+    //! redraws replay it from the spans, fills aren't streamed to collaborators
+    unsigned int fillID = strokeIndex.insertFill(layer->layerID, strokeStyle, spans, seed, pixelsPerPoint);
+    const CCRect &fillBounds = strokeIndex.recordForID(fillID)->bounds;
+    mipPyramid->invalidateRect(fillBounds);
+    layer->storedTiles.invalidateRect(canvasPixelRect(fillBounds), CCDirector::sharedDirector()->getTotalFrames());
+    return fillID;
+}
 
-    ccGLEnableVertexAttribs(kCCVertexAttribFlag_Position | kCCVertexAttribFlag_Color);
+#pragma mark - Layers
 
-    ccColor4F fullColor = color;
-    ccColor4F fadeOutColor = color;
-    fadeOutColor.a = 0;
+CanvasLayer *PaintLayer::addLayer()
+{
+    CanvasLayer *layer = layerStack->addLayer(nextLayerID++, false);
+    setLayerCanvas(layer, false);
+    return layer;
+}
 
-    for (int i = 0; i < count / 18; ++i)
+void PaintLayer::removeLayer(unsigned int index)
+{
+    //! the paper stays
+    if (index == 0 || index >= layerStack->getLayerCount())
+    {
+        return;
+    }
+    
+    //! its strokes go with it, pending ones are cancelled by buildCommittedStep
+    unsigned int layerID = layerStack->getLayer(index)->layerID;
+    for (unsigned int strokeID = 1; strokeID <= strokeIndex.getLastStrokeID(); ++strokeID)
     {
-        for (int j = 0; j < 6; ++j)
+        const StrokeRecord *record = strokeIndex.recordForID(strokeID);
+        if (record != NULL && record->layerID == layerID)
         {
-            vertices[i * 18 + j].color = color;
+            meshCache.invalidate(strokeID);
+            strokeIndex.remove(strokeID);
         }
+    }
+    
+    //! strokes being drawn hold values of its stencil, they take new ones on the layer that becomes active
+    if (index == layerStack->getActiveIndex())
+    {
+        releaseLiveStencilRefs();
+    }
+    layerStack->removeLayerAtIndex(index);
+    setActiveLayer(layerStack->getActiveIndex());
+}
 
-        //! FAG
-        vertices[i * 18 + 6].color = fadeOutColor;
-        vertices[i * 18 + 7].color = fullColor;
-        vertices[i * 18 + 8].color = fadeOutColor;
+void PaintLayer::setActiveLayer(unsigned int index)
+{
+    //! only the active layer may be partly restored, the composite takes the others as they are
+    CanvasLayer *layer = layerStack->getLayer(index);
+    CanvasLayer *previous = layerStack->getActiveLayer();
+    if (layer != previous)
+    {
+        releaseLiveStencilRefs();
+        if (previous->canvas != NULL)
+        {
+            finishRestore(previous);
+        }
+    }
+    if (layer->canvas == NULL)
+    {
+        //! its tiles come back under the strokes and the view first, the rest over the next frames
+        setLayerCanvas(layer, true);
+        frameScheduler.addTask(this, frametask_selector(PaintLayer::restoreTilesStep), kFrameTaskRestore);
+    }
+    layerStack->setActiveIndex(index);
+    renderTexture = layer->canvas;
+}
 
-        //! AGD
-        vertices[i * 18 + 9].color = fullColor;
-        vertices[i * 18 + 10].color = fadeOutColor;
-        vertices[i * 18 + 11].color = fullColor;
+void PaintLayer::purgeIdleLayers()
+{
+    layerStack->evictToBudget(0, false);
+    layerStack->releaseStoredTiles();
+}
 
-        //! BHC
-        vertices[i * 18 + 12].color = fullColor;
-        vertices[i * 18 + 13].color = fadeOutColor;
-        vertices[i * 18 + 14].color = fullColor;
+void PaintLayer::setVisibleRect(const CCRect &rect)
+{
+    visibleRect = rect;
+}
 
-        //! HCI
-        vertices[i * 18 + 15].color = fadeOutColor;
-        vertices[i * 18 + 16].color = fullColor;
-        vertices[i * 18 + 17].color = fadeOutColor;
+bool PaintLayer::readThumbnail(unsigned int maxSide, std::vector<unsigned char> &pixels, unsigned int &width, unsigned int &height)
+{
+    if (mipPyramid->needsUpdate())
+    {
+        updateComposite();
+        mipPyramid->update(layerStack);
     }
+    //! a canvas smaller than maxSide still gets level 1, export the canvas for full size
+    return mipPyramid->readLevel(MAX(1u, mipPyramid->levelForSize(maxSide)), pixels, width, height);
+}
 
-    glVertexAttribPointer(kCCVertexAttrib_Position, 3, GL_FLOAT, GL_FALSE, sizeof(LineVertex), &vertices[0].pos);
-    glVertexAttribPointer(kCCVertexAttrib_Color, 4, GL_FLOAT, GL_FALSE, sizeof(LineVertex), &vertices[0].color);
+void PaintLayer::setLayerCanvas(CanvasLayer *layer, bool restoreTiles)
+{
+    layerStack->setCanvas(layer, createLayerCanvas(layer));
+    
+    //! tiles stored for another canvas size are of no use, all are drawn from the strokes then
+    const CCSize &pixelSize = layer->canvas->getSprite()->getTexture()->getContentSizeInPixels();
+    CanvasTileStore &storedTiles = layer->storedTiles;
+    if (!restoreTiles || storedTiles.getWidth() != (unsigned int)pixelSize.width || storedTiles.getHeight() != (unsigned int)pixelSize.height)
+    {
+        storedTiles.reset((unsigned int)pixelSize.width, (unsigned int)pixelSize.height);
+    }
+    if (restoreTiles)
+    {
+        storedTiles.beginRestore();
+    }
+}
 
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)count);
+void PaintLayer::touchLayerRect(CanvasLayer *layer, const CCRect &rect)
+{
+    CCRect pixelRect = canvasPixelRect(rect);
+    restoreLayerTiles(layer, pixelRect);
+    layer->storedTiles.invalidateRect(pixelRect, CCDirector::sharedDirector()->getTotalFrames());
+}
 
-    for (unsigned int i = 0; i < circlesPoints->count() / 2;   ++i)
+void PaintLayer::restoreLayerTiles(CanvasLayer *layer, const CCRect &pixelRect)
+{
+    if (layer->storedTiles.isRestored())
     {
-        LinePoint *prevPoint = (LinePoint *)circlesPoints->objectAtIndex(i * 2);
-        LinePoint *curPoint = (LinePoint *)circlesPoints->objectAtIndex(i * 2 + 1);
-        CCPoint dirVector = ccpNormalize(ccpSub(curPoint->pos, prevPoint->pos));
+        return;
+    }
+    std::vector<CCRect> missingRects;
+    layer->storedTiles.restoreRect(layer->canvas->getSprite()->getTexture(), pixelRect, missingRects);
+    drawMissingTiles(layer, missingRects);
+}
 
-        this->fillLineEndPointAt(curPoint->pos, dirVector, curPoint->width * 0.4f, color);
+void PaintLayer::drawMissingTiles(CanvasLayer *layer, const std::vector<CCRect> &missingRects)
+{
+    float pointsPerPixel = 1.0f / (CC_CONTENT_SCALE_FACTOR() * canvasConfig.resolutionScale);
+    for (unsigned int i = 0; i < missingRects.size(); ++i)
+    {
+        const CCRect &pixelRect = missingRects[i];
+        drawLayerRect(layer, CCRectMake(pixelRect.origin.x * pointsPerPixel, pixelRect.origin.y * pointsPerPixel,
+                                        pixelRect.size.width * pointsPerPixel, pixelRect.size.height * pointsPerPixel), pixelRect);
     }
-    circlesPoints->removeAllObjects();
 }
 
-CCArray *PaintLayer::calculateSmoothLinePoints()
+void PaintLayer::finishRestore(CanvasLayer *layer)
 {
-    if (points->count() > 2)
+    CanvasTileStore &storedTiles = layer->storedTiles;
+    if (storedTiles.isRestored())
     {
-        CCArray *smoothedPoints = CCArray::create();
-        for (unsigned int i = 2; i < points->count(); ++i)
-        {
-            LinePoint *prev2 = (LinePoint *)points->objectAtIndex(i - 2);
-            LinePoint *prev1 = (LinePoint *)points->objectAtIndex(i - 1);
-            LinePoint *cur = (LinePoint *)points->objectAtIndex(i);
+        return;
+    }
+    CCTexture2D *texture = layer->canvas->getSprite()->getTexture();
+    CCRect canvasRect = CCRectMake(0, 0, storedTiles.getWidth(), storedTiles.getHeight());
+    while (!storedTiles.isRestored())
+    {
+        std::vector<CCRect> missingRects;
+        storedTiles.restoreNextRow(texture, canvasRect, missingRects);
+        drawMissingTiles(layer, missingRects);
+    }
+    mipPyramid->invalidateAll();
+    if (layer != layerStack->getActiveLayer())
+    {
+        layerStack->invalidateComposite();
+    }
+}
 
-            CCPoint midPoint1 = ccpMult(ccpAdd(prev1->pos, prev2->pos), 0.5f);
-            CCPoint midPoint2 = ccpMult(ccpAdd(cur->pos, prev1->pos), 0.5f);
+void PaintLayer::restoreLayer(CanvasLayer *layer)
+{
+    setLayerCanvas(layer, true);
+    finishRestore(layer);
+}
 
-            int segmentDistance = 2;
-            float distance = ccpDistance(midPoint1, midPoint2);
-            int numberOfSegments = MIN(128, MAX(floorf(distance / segmentDistance), 32));
+void PaintLayer::restoreLayersForComposite()
+{
+    std::vector<CanvasLayer *> needed;
+    layerStack->layersNeededForComposite(needed);
+    for (unsigned int i = 0; i < needed.size(); ++i)
+    {
+        restoreLayer(needed[i]);
+    }
+}
 
-            float t = 0.0f;
-            float step = 1.0f / numberOfSegments;
-            for (int j = 0; j < numberOfSegments; j++)
-            {
-                LinePoint *newPoint = new LinePoint;
-                newPoint->pos = ccpAdd(ccpAdd(ccpMult(midPoint1, powf(1 - t, 2)), ccpMult(prev1->pos, 2.0f * (1 - t) * t)), ccpMult(midPoint2, t * t));
-                newPoint->width = powf(1 - t, 2) * ((prev1->width + prev2->width) * 0.5f) + 2.0f * (1 - t) * t * prev1->width + t * t * ((cur->width + prev1->width) * 0.5f);
+#pragma mark - Touches
 
-                newPoint->autorelease();
-                smoothedPoints->addObject(newPoint);
-                t += step;
-            }
-            LinePoint *finalPoint = new LinePoint;
-            finalPoint->pos = midPoint2;
-            finalPoint->width = (cur->width + prev1->width) * 0.5f;
-            finalPoint->autorelease();
-            smoothedPoints->addObject(finalPoint);
-        }
-        
-        //! we need to leave last 2 points for next draw
-        while(points->count() > 2)
+Stroke *PaintLayer::activeStrokeForTouch(int touchID)
+{
+    CCObject *object = NULL;
+    CCARRAY_FOREACH(activeStrokes, object)
+    {
+        Stroke *stroke = (Stroke *)object;
+        if (stroke->peerID == 0 && stroke->touchID == touchID && !stroke->isEnded())
         {
-            points->removeObjectAtIndex(0);
+            return stroke;
         }
-        
-        return smoothedPoints;
     }
-    else
+    return NULL;
+}
+
+double PaintLayer::inputClock()
+{
+    return TouchTraceNow() / 1000000000.0;
+}
+
+bool PaintLayer::startRecording(const char *path)
+{
+    TouchTraceHeader header = TouchTrace::headerMake(getContentSize(), lineWidth, strokeStyle);
+    header.pressureWidth = pressureWidth;
+    header.tiltWidth = tiltWidth;
+    header.overdraw = overdraw;
+    header.startTime = TouchTraceNow();
+    return touchRecorder.start(path, header);
+}
+
+void PaintLayer::stopRecording()
+{
+    touchRecorder.stop();
+}
+
+StylusSample PaintLayer::sampleForTouch(CCTouch *touch)
+{
+    StylusSample sample;
+    sample.touchID = touch->getID();
+    sample.location = CCDirector::sharedDirector()->convertToGL(touch->getLocationInView());
+    sample.pressure = 1.0f;
+    sample.tilt = 0.0f;
+    sample.timestamp = inputClock();
+    return sample;
+}
+
+void PaintLayer::stylusBegan(const StylusSample &sample)
+{
+    touchRecorder.record(kTouchTraceBegan, sample);
+    
+    Stroke *stroke = Stroke::create(strokeStyle);
+    stroke->symmetry = symmetry;
+    stroke->touchID = sample.touchID;
+    stroke->overdraw = qualityOverdraw;
+    stroke->quality = strokeQuality;
+    stroke->startTime = sample.timestamp;
+    activeStrokes->addObject(stroke);
+    
+    LinePoint point = stroke->pointForSample(sample, lineWidth, pressureWidth, tiltWidth);
+    stroke->startNewLineFrom(point);
+    
+    stroke->addPoint(point);
+    strokeStream.strokeBegan(stroke, point);
+}
+
+void PaintLayer::stylusMoved(const StylusSample &sample)
+{
+    touchRecorder.record(kTouchTraceMoved, sample);
+    
+    Stroke *stroke = activeStrokeForTouch(sample.touchID);
+    if (stroke == NULL)
+    {
+        return;
+    }
+    
+    //! skip points that are too close
+    if (stroke->hasPoints() && ccpLength(ccpSub(stroke->getLastPosition(), sample.location)) < stroke->quality.minInputDistance)
     {
-        return NULL;
+        return;
     }
+    LinePoint point = stroke->pointForSample(sample, lineWidth, pressureWidth, tiltWidth);
+    stroke->addPoint(point);
+    strokeStream.strokeMoved(stroke, point);
 }
 
-void PaintLayer::draw(void)
+void PaintLayer::stylusEnded(const StylusSample &sample)
 {
-    ccColor4F color = {0, 0, 1, 1};
-    renderTexture->begin();
+    touchRecorder.record(kTouchTraceEnded, sample);
+    endStroke(sample);
+}
+
+void PaintLayer::stylusCancelled(const StylusSample &sample)
+{
+    touchRecorder.record(kTouchTraceCancelled, sample);
+    endStroke(sample);
+}
 
-    CCArray *smoothedPoints = this->calculateSmoothLinePoints();
-    if (smoothedPoints != NULL)
+void PaintLayer::endStroke(const StylusSample &sample)
+{
+    Stroke *stroke = activeStrokeForTouch(sample.touchID);
+    if (stroke == NULL)
     {
-        drawLines(smoothedPoints, color);
+        return;
     }
     
-    renderTexture->end();
+    LinePoint point = stroke->pointForSample(sample, lineWidth, pressureWidth, tiltWidth);
+    stroke->endLineAt(point);
+    strokeStream.strokeEnded(stroke, point);
+    commitStroke(stroke);
 }
 
 bool PaintLayer::ccTouchBegan(CCTouch *touch, CCEvent *event)
 {
-    const CCPoint point = CCDirector::sharedDirector()->convertToGL(touch->getLocationInView());
-    
-    points->removeAllObjects();
-    velocities->removeAllObjects();
-    
-    this->startNewLineFrom(point, lineWidth);
-    
-    this->addPoint(point, lineWidth);
-
+    stylusBegan(sampleForTouch(touch));
     return true;
 }
 
 void PaintLayer::ccTouchMoved(CCTouch* touch, CCEvent* event)
 {
-    const CCPoint point = CCDirector::sharedDirector()->convertToGL(touch->getLocationInView());
-
-    //! skip points that are too close
-    float eps = 1.5;
-    if (points->count() > 0)
-    {
-        float length = ccpLength(ccpSub(((LinePoint *)points->lastObject())->pos, point));
-
-        if (length < eps)
-        {
-            return;
-        }
-    }
-    this->addPoint(point, lineWidth);
+    stylusMoved(sampleForTouch(touch));
 }
 
 void PaintLayer::ccTouchEnded(CCTouch* touch, CCEvent* event)
 {
-    const CCPoint point = CCDirector::sharedDirector()->convertToGL(touch->getLocationInView());
-    
-    this->endLineAt(point, lineWidth);
+    stylusEnded(sampleForTouch(touch));
+}
+
+void PaintLayer::ccTouchCancelled(CCTouch* touch, CCEvent* event)
+{
+    stylusCancelled(sampleForTouch(touch));
 }
 
 void PaintLayer::onEnter()
 {
     CCLayer::onEnter();
+    
+    scheduleUpdate();
+    //! work left over from before onExit
+    if (!layerStack->getActiveLayer()->storedTiles.isRestored())
+    {
+        frameScheduler.addTask(this, frametask_selector(PaintLayer::restoreTilesStep), kFrameTaskRestore);
+    }
+    if (!pendingCommitIDs.empty())
+    {
+        frameScheduler.addTask(this, frametask_selector(PaintLayer::buildCommittedStep), kFrameTaskCache);
+    }
+    if (!reducedStrokeIDs.empty())
+    {
+        frameScheduler.addTask(this, frametask_selector(PaintLayer::redrawReducedStep), kFrameTaskCache);
+    }
+    if (bulkLoader.isLoading())
+    {
+        frameScheduler.addTask(this, frametask_selector(PaintLayer::importStep), kFrameTaskRestore);
+    }
+    CCNotificationCenter::sharedNotificationCenter()->addObserver(this, callfuncO_selector(PaintLayer::onCanvasLost), EVENT_COME_TO_BACKGROUND, NULL);
+    CCNotificationCenter::sharedNotificationCenter()->addObserver(this, callfuncO_selector(PaintLayer::onCanvasRecreated), EVENT_COME_TO_FOREGROUND, NULL);
 }
 
 void PaintLayer::onEnterTransitionDidFinish()
@@ -427,6 +1215,12 @@ void PaintLayer::onEnterTransitionDidFinish()
 
 void PaintLayer::onExit()
 {
+    CCNotificationCenter::sharedNotificationCenter()->removeObserver(this, EVENT_COME_TO_BACKGROUND);
+    CCNotificationCenter::sharedNotificationCenter()->removeObserver(this, EVENT_COME_TO_FOREGROUND);
+    unscheduleUpdate();
+    //! queued tasks retain the layer
+    frameScheduler.removeTasksForTarget(this);
+    
     CCLayer::onExit();
 }
 
@@ -23,68 +23,224 @@
  *
  */
 
+#ifndef _PAINT_LAYER_H_
+#define _PAINT_LAYER_H_
 
 #include "cocos2d.h"
+#include "Stroke.h"
+#include "StrokeBatch.h"
+#include "StrokeIndex.h"
+#include "StrokeSimplifier.h"
+#include "StrokeMeshCache.h"
+#include "StrokeQualityGovernor.h"
+#include "CanvasExporter.h"
+#include "StrokeVectorExporter.h"
+#include "CanvasConfig.h"
+#include "StrokeStream.h"
+#include "FrameScheduler.h"
+#include "TouchRecorder.h"
+#include "StrokeCurveWorker.h"
+#include "StrokeBulkLoader.h"
+#include "CanvasLayerStack.h"
+#include "CanvasMipPyramid.h"
+#include <deque>
 
 USING_NS_CC;
 
-typedef struct _LineVertex {
-    CCPoint pos;
-    float z;
-    ccColor4F color;
-} LineVertex;
-
-class LinePoint : public CCObject
-{
-public:
-    CCPoint pos;
-    float width;
-    
-    LinePoint();
-    virtual ~LinePoint();
-};
+//! tag of the PaintLayer in the scene made by PaintLayer::scene()
+#define kPaintLayerTag 1
 
 class PaintLayer : public CCLayer
 {
 private:
-    void fillLineTriangles(LineVertex *vertices, int count, ccColor4F color);
-    void startNewLineFrom(CCPoint newPoint, float aSize);
-    void endLineAt(CCPoint aEndPoint, float aSize);
-    void addPoint(CCPoint newPoint, float size);
-    void drawLines(CCArray *linePoints, ccColor4F color);
-    void fillLineEndPointAt(CCPoint center, CCPoint aLineDir, float radius, ccColor4F color);
-    CCArray *calculateSmoothLinePoints();
+    Stroke *activeStrokeForTouch(int touchID);
+    StylusSample sampleForTouch(CCTouch *touch);
+    void endStroke(const StylusSample &sample);
+    void drawLiveStrokes();
+    //! strokes being drawn hand back their stencil values, before the canvas they hold them on goes
+    void releaseLiveStencilRefs();
+    void commitStroke(Stroke *stroke);
+    //! keeps the strokes of visible layers
+    void removeHiddenStrokes(std::vector<unsigned int> &strokeIDs) const;
+    CCRenderTexture *createLayerCanvas(CanvasLayer *layer);
+    ccColor4F paperColorForLayer(const CanvasLayer *layer) const;
+    //! canvas begin/end of layer with the canvas resolution scale applied, draw in screen points in between
+    void beginCanvas(CanvasLayer *layer);
+    void endCanvas(CanvasLayer *layer);
+    void redrawLayerRect(CanvasLayer *layer, const CCRect &rect);
+    //! clears pixelRect of the canvas to paper and draws the committed strokes touching rect, in points, again
+    void drawLayerRect(CanvasLayer *layer, const CCRect &rect, const CCRect &pixelRect);
+    //! canvas pixels covering rect in points
+    CCRect canvasPixelRect(const CCRect &rect) const;
+    //! gives layer a new canvas, with restoreTiles its stored tiles are to be put back on it, else it starts blank
+    void setLayerCanvas(CanvasLayer *layer, bool restoreTiles);
+    //! puts the tiles under rect, in points, back on the canvas before it is drawn on and drops their stored copies
+    void touchLayerRect(CanvasLayer *layer, const CCRect &rect);
+    void restoreLayerTiles(CanvasLayer *layer, const CCRect &pixelRect);
+    //! draws tiles that weren't stored from the strokes, rects in canvas pixels
+    void drawMissingTiles(CanvasLayer *layer, const std::vector<CCRect> &missingRects);
+    //! puts all tiles left back on the canvas at once
+    void finishRestore(CanvasLayer *layer);
+    //! brings an evicted layer back from its stored tiles, or draws it again from its strokes
+    void restoreLayer(CanvasLayer *layer);
+    void restoreLayersForComposite();
+    void updateComposite();
+    //! sampling and fringe of new strokes for the governor's tier, committed strokes are always drawn at full quality
+    void applyQualityTier();
+    //! coarsest detail level of committed strokes within half a canvas pixel, the same at every zoom
+    unsigned int canvasDetailLevel();
+    FrameTaskStatus restoreTilesStep();
+    FrameTaskStatus storeTilesStep();
+    FrameTaskStatus drawBacklogStep();
+    FrameTaskStatus buildCommittedStep();
+    //! draws the area of a committed stroke again whose live ink was drawn below full quality
+    FrameTaskStatus redrawReducedStep();
+    FrameTaskStatus importStep();
+    FrameTaskStatus updateMipStep();
+    void onCanvasLost(CCObject *object);
+    void onCanvasRecreated(CCObject *object);
     
 public:
     virtual bool init();
+    virtual bool initWithConfig(const CanvasConfig &config);
     CREATE_FUNC(PaintLayer);
+    static PaintLayer *createWithConfig(const CanvasConfig &config);
     static cocos2d::CCScene* scene();
     
     PaintLayer();
     virtual ~PaintLayer();
     
     virtual void draw(void);
+    virtual void update(float dt);
+    
+    //! topmost committed stroke of a visible layer under point, 0 if none
+    unsigned int strokeAtPoint(CCPoint point, float tolerance);
+    //! committed strokes of visible layers lying completely inside lasso, in drawing order
+    void strokesInLasso(const std::vector<CCPoint> &lasso, std::vector<unsigned int> &strokeIDs);
+    //! removes committed strokes and rasterizes only the regions they covered again
+    void eraseStrokes(const std::vector<unsigned int> &strokeIDs);
+    //! erases the strokes of visible layers within radius of point
+    void eraseStrokesAt(CCPoint point, float radius);
+    //! clears rect to paper and draws the committed strokes touching it again, on every layer
+    void redrawRect(const CCRect &rect);
+    /**
+     adds the strokes of a saved document on top of the canvas in their order, strokes is emptied.
+     They are fitted and tessellated on all cores and drawn over the next frames, each goes into
+     the stroke index as it is drawn. Strokes of layers that are gone by then are dropped.
+     False while the previous import is still running.
+     */
+    bool importStrokes(std::vector<StrokeImport> &strokes);
+    //! paint bucket with strokeStyle on the active layer, tolerance is the largest channel difference (0 to 1)
+    //! from the color at point the region spreads over, returns the fill's id or 0 if point is off the canvas
+    unsigned int fillAt(CCPoint point, float tolerance);
+    
+    //! new transparent layer on top of the stack, the active one stays active
+    CanvasLayer *addLayer();
+    //! removes the layer and its strokes, the paper at index 0 can't be removed
+    void removeLayer(unsigned int index);
+    //! new strokes go to the active layer
+    void setActiveLayer(unsigned int index);
+    //! evicts every layer the composite doesn't need, for memory warnings
+    void purgeIdleLayers();
+    //! RGBA pixels of the flattened canvas, top row first, from the smallest mip level with maxSide pixels on its
+    //! longer side or the last one, at most half the canvas. Reads back only that level
+    bool readThumbnail(unsigned int maxSide, std::vector<unsigned char> &pixels, unsigned int &width, unsigned int &height);
+    //! part of the canvas in points the view shows, its tiles are restored first after the canvas was lost
+    void setVisibleRect(const CCRect &rect);
     
-    CCArray *points;
-    CCArray *velocities;
-    CCArray *circlesPoints;
+    //! draws with tier from now on instead of following the frame rate
+    void setQualityTier(StrokeQualityTier tier);
+    //! lets qualityGovernor pick the tier again, the default
+    void setAdaptiveQuality();
     
-    bool connectingLine;
-    CCPoint prevC;
-    CCPoint prevD;
-    CCPoint prevG;
-    CCPoint prevI;
+    //! input of one finger or pen, the touch handlers feed these as well
+    void stylusBegan(const StylusSample &sample);
+    void stylusMoved(const StylusSample &sample);
+    void stylusEnded(const StylusSample &sample);
+    void stylusCancelled(const StylusSample &sample);
+    //! TouchTraceNow() in seconds, the clock StylusSample::timestamp of touches is read from
+    static double inputClock();
+    
+    //! records all input from now on to a trace at path, with the current width and style in its header
+    bool startRecording(const char *path);
+    void stopRecording();
+    
+    //! writes the canvas to path over the next frames, selector is called with the exporter when done
+    CanvasExporter *exportCanvas(const char *path, CanvasExportFormat format, CCObject *target, SEL_CallFuncO selector);
+    //! writes the committed strokes of the visible layers to path as filled outlines, on worker threads
+    StrokeVectorExporter *exportVector(const char *path, StrokeVectorFormat format, CCObject *target, SEL_CallFuncO selector);
+    
+    //! strokes currently being drawn, one per touch and one per stroke streamed in by a collaborator
+    CCArray *activeStrokes;
+    StrokeBatch batch;
+    //! committed strokes, kept as vectors for picking and erasing
+    StrokeIndex strokeIndex;
+    //! tessellated committed strokes, redrawing them needs no smoothing
+    StrokeMeshCache meshCache;
+    //! shares local strokes while they are drawn and feeds in those of collaborators, set a transport to enable
+    StrokeStream strokeStream;
+    
+    StrokeStyle strokeStyle;
+    //! radial and mirror copies new strokes are drawn with
+    StrokeSymmetry symmetry;
+    //! anti aliasing fringe in points, initWithConfig widens it to a canvas pixel if needed
     float overdraw;
+    //! fringe new strokes are drawn with at the current quality tier, at most overdraw. Committed strokes keep overdraw
+    float qualityOverdraw;
+    //! sampling of new strokes at the current quality tier, committed meshes are sampled at StrokeQualityDefault()
+    StrokeQuality strokeQuality;
     float lineWidth;
+    //! part of lineWidth that follows the pen pressure, the rest is drawn at any pressure
+    float pressureWidth;
+    //! extra width of a pen lying flat, in multiples of lineWidth
+    float tiltWidth;
+    //! see setVisibleRect(), the whole canvas by default
+    CCRect visibleRect;
     
+    //! canvas of the active layer
     CCRenderTexture *renderTexture;
-    bool finishingLine;
+    //! canvases of all layers, visibility, opacity and blend mode are set through it
+    CanvasLayerStack *layerStack;
+    //! smaller copies of layerStack kept up to date stroke by stroke, a zoomed out view draws one of them over the
+    //! canvases, which always hold committed strokes at full detail
+    CanvasMipPyramid *mipPyramid;
+    //! GL memory the canvases of inactive layers may keep, the least recently used are evicted beyond it
+    unsigned int idleLayerBudget;
+    unsigned int nextLayerID;
+    //! color of the bottom layer, the others are transparent
+    ccColor4F paperColor;
+    //! storage and resolution of renderTexture, picked from kCanvasDefaultMemoryBudget by init()
+    CanvasConfig canvasConfig;
+    
+    //! runs everything but the newest ink in what is left of the frame budget
+    FrameScheduler frameScheduler;
+    //! spans of a live stroke drawn in one frame, older ones of a burst wait for the scheduler
+    unsigned int liveSpanLimit;
+    //! trades the fidelity of live strokes for frame rate, its tier and statistics tell how it's doing
+    StrokeQualityGovernor qualityGovernor;
+    //! milliseconds drawing the live strokes took in the last frame and the vertices they drew
+    float liveDrawTime;
+    unsigned int liveVertexCount;
+    //! committed strokes whose detail levels and mesh are still to be built
+    std::deque<unsigned int> pendingCommitIDs;
+    //! committed strokes whose live ink a lower quality tier drew, see redrawReducedStep()
+    std::vector<unsigned int> reducedStrokeIDs;
+    //! fits committed strokes to curves off the main thread
+    StrokeCurveWorker curveWorker;
+    //! fits and tessellates imported strokes on all cores
+    StrokeBulkLoader bulkLoader;
+    
+    //! captures the raw input stream, see startRecording()
+    TouchRecorder touchRecorder;
     
     virtual bool ccTouchBegan(CCTouch* touch, CCEvent* event);
     virtual void ccTouchMoved(CCTouch* touch, CCEvent* event);
     virtual void ccTouchEnded(CCTouch* touch, CCEvent* event);
+    virtual void ccTouchCancelled(CCTouch* touch, CCEvent* event);
     
     virtual void onEnter();
     virtual void onEnterTransitionDidFinish();
     virtual void onExit();
 };
+
+#endif // _PAINT_LAYER_H_
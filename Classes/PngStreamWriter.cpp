@@ -0,0 +1,197 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "PngStreamWriter.h"
+#include <string.h>
+
+//! IDAT chunks are flushed whenever this much compressed data piled up
+#define kPngChunkSize (64 * 1024)
+
+static void writeUInt32(unsigned char *target, unsigned int value)
+{
+    target[0] = (unsigned char)(value >> 24);
+    target[1] = (unsigned char)(value >> 16);
+    target[2] = (unsigned char)(value >> 8);
+    target[3] = (unsigned char)value;
+}
+
+PngStreamWriter::PngStreamWriter()
+: file(NULL)
+, streamReady(false)
+, failed(false)
+, width(0)
+, height(0)
+, rowsWritten(0)
+{
+    memset(&stream, 0, sizeof(stream));
+}
+
+PngStreamWriter::~PngStreamWriter()
+{
+    if (file != NULL)
+    {
+        close();
+    }
+}
+
+bool PngStreamWriter::isOpen() const
+{
+    return file != NULL;
+}
+
+bool PngStreamWriter::open(const char *path, unsigned int aWidth, unsigned int aHeight)
+{
+    file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    width = aWidth;
+    height = aHeight;
+    rowsWritten = 0;
+    failed = false;
+    filteredRow.resize(1 + width * 4);
+    compressed.resize(kPngChunkSize);
+
+    memset(&stream, 0, sizeof(stream));
+    streamReady = deflateInit(&stream, 5) == Z_OK;
+    failed = !streamReady;
+    stream.next_out = &compressed[0];
+    stream.avail_out = kPngChunkSize;
+
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    failed = failed || fwrite(signature, 1, sizeof(signature), file) != sizeof(signature);
+
+    unsigned char header[13];
+    writeUInt32(header, width);
+    writeUInt32(header + 4, height);
+    header[8] = 8;      //! bit depth
+    header[9] = 6;      //! RGBA
+    header[10] = 0;     //! deflate
+    header[11] = 0;     //! adaptive filtering
+    header[12] = 0;     //! no interlace
+    failed = failed || !writeChunk("IHDR", header, sizeof(header));
+
+    return !failed;
+}
+
+bool PngStreamWriter::writeChunk(const char *type, const unsigned char *data, unsigned int length)
+{
+    unsigned char buffer[4];
+    writeUInt32(buffer, length);
+    if (fwrite(buffer, 1, 4, file) != 4 || fwrite(type, 1, 4, file) != 4)
+    {
+        return false;
+    }
+    if (length > 0 && fwrite(data, 1, length, file) != length)
+    {
+        return false;
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef *)type, 4);
+    if (length > 0)
+    {
+        crc = crc32(crc, data, length);
+    }
+    writeUInt32(buffer, (unsigned int)crc);
+    return fwrite(buffer, 1, 4, file) == 4;
+}
+
+bool PngStreamWriter::deflateInput(int flush)
+{
+    int result = Z_OK;
+    do
+    {
+        result = deflate(&stream, flush);
+        if (result == Z_STREAM_ERROR)
+        {
+            return false;
+        }
+        if (stream.avail_out == 0 || (flush == Z_FINISH && stream.avail_out < kPngChunkSize))
+        {
+            if (!writeChunk("IDAT", &compressed[0], kPngChunkSize - stream.avail_out))
+            {
+                return false;
+            }
+            stream.next_out = &compressed[0];
+            stream.avail_out = kPngChunkSize;
+        }
+    } while (stream.avail_in > 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+    return true;
+}
+
+bool PngStreamWriter::writeRow(const unsigned char *rgba)
+{
+    if (file == NULL || failed || rowsWritten >= height)
+    {
+        return false;
+    }
+
+    //! Sub filter, every byte minus the same channel of the pixel to the left
+    unsigned char *row = &filteredRow[0];
+    unsigned int rowLength = width * 4;
+    row[0] = 1;
+    for (unsigned int i = 0; i < 4 && i < rowLength; ++i)
+    {
+        row[1 + i] = rgba[i];
+    }
+    for (unsigned int i = 4; i < rowLength; ++i)
+    {
+        row[1 + i] = (unsigned char)(rgba[i] - rgba[i - 4]);
+    }
+
+    stream.next_in = row;
+    stream.avail_in = rowLength + 1;
+    failed = !deflateInput(Z_NO_FLUSH);
+    ++rowsWritten;
+    return !failed;
+}
+
+bool PngStreamWriter::close()
+{
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    bool complete = !failed && rowsWritten == height;
+    if (streamReady)
+    {
+        if (complete)
+        {
+            stream.next_in = NULL;
+            stream.avail_in = 0;
+            complete = deflateInput(Z_FINISH);
+        }
+        deflateEnd(&stream);
+        streamReady = false;
+    }
+    complete = complete && writeChunk("IEND", NULL, 0);
+
+    complete = fclose(file) == 0 && complete;
+    file = NULL;
+    return complete;
+}
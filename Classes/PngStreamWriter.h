@@ -0,0 +1,67 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _PNG_STREAM_WRITER_H_
+#define _PNG_STREAM_WRITER_H_
+
+#include <stdio.h>
+#include <vector>
+#include <zlib.h>
+
+/**
+ Writes an 8 bit RGBA PNG row by row, only one row and the deflate window are in memory.
+
+ Rows go top to bottom. Every row is stored with the Sub filter, which suits large
+ flat areas of ink and paper well.
+ */
+class PngStreamWriter
+{
+public:
+    PngStreamWriter();
+    ~PngStreamWriter();
+
+    bool open(const char *path, unsigned int aWidth, unsigned int aHeight);
+    bool writeRow(const unsigned char *rgba);
+    //! finishes the image, false if anything failed on the way or rows are missing
+    bool close();
+
+    bool isOpen() const;
+
+private:
+    bool writeChunk(const char *type, const unsigned char *data, unsigned int length);
+    bool deflateInput(int flush);
+
+    FILE *file;
+    z_stream stream;
+    bool streamReady;
+    bool failed;
+    unsigned int width;
+    unsigned int height;
+    unsigned int rowsWritten;
+    std::vector<unsigned char> filteredRow;
+    std::vector<unsigned char> compressed;
+};
+
+#endif // _PNG_STREAM_WRITER_H_
@@ -0,0 +1,52 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_H_
+#define _STROKE_H_
+
+#include "cocos2d.h"
+#include "StrokeTessellator.h"
+
+USING_NS_CC;
+
+/**
+ A single line being drawn, as the scene keeps it: reference counted and tied to the
+ stroke index and the stroke stream by its ids. Its geometry is StrokeTessellator's.
+ */
+class Stroke : public CCObject, public StrokeTessellator
+{
+public:
+    Stroke();
+    virtual ~Stroke();
+
+    static Stroke *create(const StrokeStyle &aStyle);
+
+    //! collaborator the stroke was streamed from, 0 for local input
+    unsigned int peerID;
+    //! id in the stroke index once committed, 0 before
+    unsigned int strokeID;
+};
+
+#endif // _STROKE_H_
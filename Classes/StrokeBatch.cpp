@@ -0,0 +1,557 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeBatch.h"
+#include "StrokeRasterizer.h"
+
+StrokeStyle StrokeStyleMake(ccColor4F color, float opacity, StrokeBlendMode blendMode)
+{
+    StrokeStyle style;
+    style.color = color;
+    style.opacity = opacity;
+    style.blendMode = blendMode;
+    style.join = kStrokeJoinRound;
+    style.miterLimit = 4.0f;
+    style.pressureOpacity = 0.0f;
+    return style;
+}
+
+StrokeStencil::StrokeStencil()
+: counter(0)
+, clearPending(false)
+{
+    memset(states, kValueFree, sizeof(states));
+}
+
+void StrokeStencil::reset()
+{
+    for (GLint ref = 1; ref <= kStrokeStencilMaxRef; ++ref)
+    {
+        if (states[ref] != kValueHeld)
+        {
+            states[ref] = kValueFree;
+        }
+    }
+    counter = 0;
+    clearPending = false;
+}
+
+GLint StrokeStencil::take(ValueState state)
+{
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (GLint i = 0; i < kStrokeStencilMaxRef; ++i)
+        {
+            GLint ref = (counter + i) % kStrokeStencilMaxRef + 1;
+            if (states[ref] == kValueFree)
+            {
+                states[ref] = state;
+                counter = ref;
+                return ref;
+            }
+        }
+        
+        //! values with marks are reused, the marks have to go before that, those of held values stay
+        for (GLint ref = 1; ref <= kStrokeStencilMaxRef; ++ref)
+        {
+            if (states[ref] == kValueMarked)
+            {
+                states[ref] = kValueFree;
+                clearPending = true;
+            }
+        }
+    }
+    
+    //! more isolated strokes in one batch than values, a pending value is shared
+    if (state == kValuePending)
+    {
+        for (GLint i = 0; i < kStrokeStencilMaxRef; ++i)
+        {
+            GLint ref = (counter + i) % kStrokeStencilMaxRef + 1;
+            if (states[ref] == kValuePending)
+            {
+                counter = ref;
+                return ref;
+            }
+        }
+    }
+    return 0;
+}
+
+GLint StrokeStencil::nextRef()
+{
+    return take(kValuePending);
+}
+
+GLint StrokeStencil::acquireRef()
+{
+    return take(kValueHeld);
+}
+
+void StrokeStencil::releaseRef(GLint ref)
+{
+    if (ref > 0 && ref <= kStrokeStencilMaxRef && states[ref] == kValueHeld)
+    {
+        states[ref] = kValueMarked;
+    }
+}
+
+bool StrokeStencil::needsClear() const
+{
+    return clearPending;
+}
+
+void StrokeStencil::getHeldRefs(std::vector<GLint> &refs) const
+{
+    refs.clear();
+    for (GLint ref = 1; ref <= kStrokeStencilMaxRef; ++ref)
+    {
+        if (states[ref] == kValueHeld)
+        {
+            refs.push_back(ref);
+        }
+    }
+}
+
+void StrokeStencil::didClear()
+{
+    clearPending = false;
+}
+
+void StrokeStencil::didFlush()
+{
+    for (GLint ref = 1; ref <= kStrokeStencilMaxRef; ++ref)
+    {
+        if (states[ref] == kValuePending)
+        {
+            states[ref] = kValueMarked;
+        }
+    }
+}
+
+StrokeBatch::StrokeBatch()
+: runOpen(false)
+, culling(false)
+{
+    stencil = &ownStencil;
+    paperColor = ccc4f(1, 1, 1, 1);
+}
+
+StrokeBatch::~StrokeBatch()
+{
+}
+
+void StrokeBatch::setPaperColor(ccColor4F color)
+{
+    paperColor = color;
+}
+
+ccColor4F StrokeBatch::getPaperColor() const
+{
+    return paperColor;
+}
+
+void StrokeBatch::setCullRect(const CCRect &rect)
+{
+    cullRect = rect;
+    culling = true;
+}
+
+void StrokeBatch::removeCullRect()
+{
+    culling = false;
+}
+
+const CCRect *StrokeBatch::getCullRect() const
+{
+    return culling ? &cullRect : NULL;
+}
+
+ccColor4F StrokeBatch::inkColorForStyle(const StrokeStyle &style) const
+{
+    ccColor4F ink = style.color;
+    if (style.blendMode == kStrokeBlendEraser)
+    {
+        //! transparent paper has nothing to paint back, the alpha of black ink says how much to remove
+        ink = paperColor.a > 0.0f ? paperColor : ccc4f(0, 0, 0, 1);
+    }
+    float alpha = ink.a * style.opacity;
+    ink.r *= alpha;
+    ink.g *= alpha;
+    ink.b *= alpha;
+    ink.a = alpha;
+    return ink;
+}
+
+bool StrokeBatch::styleNeedsIsolation(const StrokeStyle &style) const
+{
+    //! multiply darkens on every pass, translucent ink would accumulate alpha, so would ink faded by pressure
+    return style.blendMode == kStrokeBlendMultiply || inkColorForStyle(style).a < 1.0f || style.pressureOpacity > 0.0f;
+}
+
+void StrokeBatch::setStencil(StrokeStencil *aStencil)
+{
+    stencil = aStencil != NULL ? aStencil : &ownStencil;
+}
+
+StrokeStencil *StrokeBatch::getStencil() const
+{
+    return stencil;
+}
+
+GLint StrokeBatch::nextStencilRef()
+{
+    return stencil->nextRef();
+}
+
+GLint StrokeBatch::acquireStencilRef()
+{
+    return stencil->acquireRef();
+}
+
+StrokeBatchState StrokeBatch::stateForStyle(const StrokeStyle &style, GLint stencilRef) const
+{
+    StrokeBatchState state;
+    //! eraser only differs by ink color on opaque paper, it shares blending with normal strokes there
+    state.blendMode = style.blendMode;
+    if (style.blendMode == kStrokeBlendEraser && paperColor.a > 0.0f)
+    {
+        state.blendMode = kStrokeBlendNormal;
+    }
+    state.stencilRef = stencilRef;
+    return state;
+}
+
+bool StrokeBatch::stateLess(const StrokeBatchState &a, const StrokeBatchState &b)
+{
+    if (a.blendMode != b.blendMode)
+    {
+        return a.blendMode < b.blendMode;
+    }
+    return a.stencilRef < b.stencilRef;
+}
+
+bool StrokeBatch::stateEqual(const StrokeBatchState &a, const StrokeBatchState &b)
+{
+    return a.blendMode == b.blendMode && a.stencilRef == b.stencilRef;
+}
+
+void StrokeBatch::beginRun(const StrokeBatchState &state)
+{
+    closeRun();
+    currentRun.state = state;
+    currentRun.first = (unsigned int)vertices.size();
+    currentRun.count = 0;
+    runOpen = true;
+}
+
+std::vector<LineVertex> &StrokeBatch::getVertices()
+{
+    return vertices;
+}
+
+void StrokeBatch::appendMesh(const StrokeMeshVertex *aMeshVertices, unsigned int count, const StrokeBatchState &state)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    unsigned int first = (unsigned int)meshVertices.size();
+    meshVertices.insert(meshVertices.end(), aMeshVertices, aMeshVertices + count);
+    appendRun(meshRuns, state, first, count);
+}
+
+bool StrokeBatch::isEmpty() const
+{
+    return vertices.empty() && meshVertices.empty();
+}
+
+void StrokeBatch::clear()
+{
+    vertices.clear();
+    runs.clear();
+    meshVertices.clear();
+    meshRuns.clear();
+    runOpen = false;
+}
+
+void StrokeBatch::appendRun(std::vector<Run> &runList, const StrokeBatchState &state, unsigned int first, unsigned int count)
+{
+    //! runs are contiguous, so an equal neighbour can simply grow
+    if (!runList.empty() && stateEqual(runList.back().state, state))
+    {
+        runList.back().count += count;
+    }
+    else
+    {
+        Run run;
+        run.state = state;
+        run.first = first;
+        run.count = count;
+        runList.push_back(run);
+    }
+}
+
+void StrokeBatch::closeRun()
+{
+    if (!runOpen)
+    {
+        return;
+    }
+    runOpen = false;
+
+    currentRun.count = (unsigned int)vertices.size() - currentRun.first;
+    if (currentRun.count > 0)
+    {
+        appendRun(runs, currentRun.state, currentRun.first, currentRun.count);
+    }
+}
+
+void StrokeBatch::applyState(const StrokeBatchState &state, const StrokeBatchState *previous)
+{
+    if (!previous || previous->blendMode != state.blendMode)
+    {
+        if (state.blendMode == kStrokeBlendMultiply)
+        {
+            glBlendFuncSeparate(GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE);
+        }
+        else if (state.blendMode == kStrokeBlendEraser)
+        {
+            glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        else if (state.blendMode == kStrokeBlendAdd || state.blendMode == kStrokeBlendSubtract)
+        {
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
+        else
+        {
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        }
+
+        if (state.blendMode == kStrokeBlendSubtract)
+        {
+            glBlendEquation(GL_FUNC_REVERSE_SUBTRACT);
+        }
+        else if (previous && previous->blendMode == kStrokeBlendSubtract)
+        {
+            glBlendEquation(GL_FUNC_ADD);
+        }
+    }
+
+    bool wasIsolated = previous && previous->stencilRef != 0;
+    if (state.stencilRef != 0)
+    {
+        if (!wasIsolated)
+        {
+            glEnable(GL_STENCIL_TEST);
+            glStencilMask(0xff);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+        }
+        //! every pixel is blended at most once per stroke
+        glStencilFunc(GL_NOTEQUAL, state.stencilRef, 0xff);
+    }
+    else if (wasIsolated)
+    {
+        glDisable(GL_STENCIL_TEST);
+    }
+}
+
+const StrokeBatchState *StrokeBatch::drawRuns(const std::vector<Run> &runList, const StrokeBatchState *previous)
+{
+    for (unsigned int i = 0; i < runList.size(); ++i)
+    {
+        applyState(runList[i].state, previous);
+        glDrawArrays(GL_TRIANGLES, (GLint)runList[i].first, (GLsizei)runList[i].count);
+        CC_INCREMENT_GL_DRAWS(1);
+        previous = &runList[i].state;
+    }
+    return previous;
+}
+
+void StrokeBatch::clearStencilIfNeeded(CCGLProgram *program)
+{
+    if (!stencil->needsClear())
+    {
+        return;
+    }
+    //! all of it, a scissored redraw must not leave old marks outside its rect
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    glDisable(GL_SCISSOR_TEST);
+    
+    std::vector<GLint> heldRefs;
+    stencil->getHeldRefs(heldRefs);
+    if (heldRefs.empty())
+    {
+        glStencilMask(0xff);
+        glClearStencil(0);
+        glClear(GL_STENCIL_BUFFER_BIT);
+    }
+    else
+    {
+        //! live strokes keep their marks: flag them in the top bit, zero whatever is unflagged, drop the flags
+        kmGLMatrixMode(KM_GL_PROJECTION);
+        kmGLPushMatrix();
+        kmGLLoadIdentity();
+        kmGLMatrixMode(KM_GL_MODELVIEW);
+        kmGLPushMatrix();
+        kmGLLoadIdentity();
+        program->setUniformsForBuiltins();
+        
+        ccColor4B none = ccc4(0, 0, 0, 0);
+        StrokeMeshVertex quad[4] = { { -1, -1, 0, none }, { 1, -1, 0, none }, { -1, 1, 0, none }, { 1, 1, 0, none } };
+        glVertexAttribPointer(kCCVertexAttrib_Position, 3, GL_FLOAT, GL_FALSE, sizeof(StrokeMeshVertex), &quad[0].x);
+        glVertexAttribPointer(kCCVertexAttrib_Color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(StrokeMeshVertex), &quad[0].color);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glEnable(GL_STENCIL_TEST);
+        
+        glStencilMask(kStrokeStencilHeldFlag);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+        for (unsigned int i = 0; i < heldRefs.size(); ++i)
+        {
+            glStencilFunc(GL_EQUAL, heldRefs[i] | kStrokeStencilHeldFlag, kStrokeStencilMaxRef);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+        glStencilMask(0xff);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+        glStencilFunc(GL_EQUAL, 0, kStrokeStencilHeldFlag);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glStencilMask(kStrokeStencilHeldFlag);
+        glStencilFunc(GL_ALWAYS, 0, 0xff);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        CC_INCREMENT_GL_DRAWS((unsigned int)heldRefs.size() + 2);
+        
+        glStencilMask(0xff);
+        glDisable(GL_STENCIL_TEST);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        kmGLMatrixMode(KM_GL_PROJECTION);
+        kmGLPopMatrix();
+        kmGLMatrixMode(KM_GL_MODELVIEW);
+        kmGLPopMatrix();
+        program->setUniformsForBuiltins();
+    }
+    
+    if (scissor)
+    {
+        glEnable(GL_SCISSOR_TEST);
+    }
+    stencil->didClear();
+}
+
+void StrokeBatch::flush(CCGLProgram *program)
+{
+    flush(program, StrokeSymmetryNone());
+}
+
+void StrokeBatch::flush(CCGLProgram *program, const StrokeSymmetry &symmetry)
+{
+    closeRun();
+    if (runs.empty() && meshRuns.empty())
+    {
+        stencil->didFlush();
+        clear();
+        return;
+    }
+
+    program->use();
+    program->setUniformsForBuiltins();
+
+    ccGLEnableVertexAttribs(kCCVertexAttribFlag_Position | kCCVertexAttribFlag_Color);
+
+    clearStencilIfNeeded(program);
+
+    //! copies share the stencil value of their stroke, where they overlap it is blended once
+    const StrokeBatchState *previous = NULL;
+    unsigned int copies = StrokeSymmetryCopyCount(symmetry);
+    for (unsigned int copy = 0; copy < copies; ++copy)
+    {
+        if (copy > 0)
+        {
+            CCAffineTransform transform = StrokeSymmetryTransform(symmetry, copy);
+            kmMat4 matrix;
+            CGAffineToGL(&transform, matrix.mat);
+            kmGLMatrixMode(KM_GL_MODELVIEW);
+            kmGLPushMatrix();
+            kmGLMultMatrix(&matrix);
+            program->setUniformsForBuiltins();
+        }
+
+        if (!meshRuns.empty())
+        {
+            glVertexAttribPointer(kCCVertexAttrib_Position, 3, GL_FLOAT, GL_FALSE, sizeof(StrokeMeshVertex), &meshVertices[0].x);
+            glVertexAttribPointer(kCCVertexAttrib_Color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(StrokeMeshVertex), &meshVertices[0].color);
+            previous = drawRuns(meshRuns, previous);
+        }
+        if (!runs.empty())
+        {
+            glVertexAttribPointer(kCCVertexAttrib_Position, 3, GL_FLOAT, GL_FALSE, sizeof(LineVertex), &vertices[0].pos);
+            glVertexAttribPointer(kCCVertexAttrib_Color, 4, GL_FLOAT, GL_FALSE, sizeof(LineVertex), &vertices[0].color);
+            previous = drawRuns(runs, previous);
+        }
+
+        if (copy > 0)
+        {
+            kmGLMatrixMode(KM_GL_MODELVIEW);
+            kmGLPopMatrix();
+        }
+    }
+
+    if (previous->stencilRef != 0)
+    {
+        glDisable(GL_STENCIL_TEST);
+    }
+    if (previous->blendMode == kStrokeBlendSubtract)
+    {
+        glBlendEquation(GL_FUNC_ADD);
+    }
+    ccGLBlendResetToCache();
+
+    stencil->didFlush();
+    clear();
+}
+
+void StrokeBatch::flush(StrokeRasterizer *rasterizer)
+{
+    closeRun();
+    if (stencil->needsClear())
+    {
+        std::vector<GLint> heldRefs;
+        stencil->getHeldRefs(heldRefs);
+        rasterizer->clearStencil(heldRefs);
+        stencil->didClear();
+    }
+    
+    for (unsigned int i = 0; i < meshRuns.size(); ++i)
+    {
+        rasterizer->setState(meshRuns[i].state);
+        rasterizer->drawTriangles(&meshVertices[meshRuns[i].first], meshRuns[i].count);
+    }
+    for (unsigned int i = 0; i < runs.size(); ++i)
+    {
+        rasterizer->setState(runs[i].state);
+        rasterizer->drawTriangles(&vertices[runs[i].first], runs[i].count);
+    }
+    
+    stencil->didFlush();
+    clear();
+}
@@ -0,0 +1,230 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_BATCH_H_
+#define _STROKE_BATCH_H_
+
+#include "cocos2d.h"
+#include "StrokeSymmetry.h"
+#include <vector>
+
+USING_NS_CC;
+
+class StrokeRasterizer;
+
+typedef struct _LineVertex {
+    CCPoint pos;
+    float z;
+    ccColor4F color;
+} LineVertex;
+
+//! compact vertex for cached geometry, same layout the shader reads with a normalized byte color
+typedef struct _StrokeMeshVertex {
+    GLfloat x;
+    GLfloat y;
+    GLfloat z;
+    ccColor4B color;
+} StrokeMeshVertex;
+
+typedef enum {
+    kStrokeBlendNormal,
+    kStrokeBlendMultiply,
+    //! paints the canvas paper color back, so it batches with normal strokes, on transparent paper it clears
+    kStrokeBlendEraser,
+    //! batch states of bucket fills, not stroke styles: the vertex color is added to or subtracted from the canvas
+    kStrokeBlendAdd,
+    kStrokeBlendSubtract
+} StrokeBlendMode;
+
+//! outer corner of turns too sharp for consecutive segments to share their corners
+typedef enum {
+    kStrokeJoinRound,
+    //! falls back to bevel beyond the style's miter limit
+    kStrokeJoinMiter,
+    kStrokeJoinBevel
+} StrokeJoin;
+
+typedef struct _StrokeStyle {
+    ccColor4F color;
+    float opacity;
+    StrokeBlendMode blendMode;
+    StrokeJoin join;
+    //! longest miter allowed, in multiples of half the line width
+    float miterLimit;
+    //! how much of the ink fades out as the pen pressure drops, 0 keeps it solid at any pressure
+    float pressureOpacity;
+} StrokeStyle;
+
+//! round joins with a miter limit of 4, opacity independent of pressure
+StrokeStyle StrokeStyleMake(ccColor4F color, float opacity, StrokeBlendMode blendMode);
+
+//! GL state a run of vertices is drawn with, strokes sharing it end up in one draw call
+typedef struct _StrokeBatchState {
+    StrokeBlendMode blendMode;
+    //! 0 when the stroke may blend over itself, otherwise stencil value isolating the stroke
+    GLint stencilRef;
+} StrokeBatchState;
+
+//! highest stencil value a stroke is isolated with, the top bit is left for clearing around held values
+#define kStrokeStencilMaxRef 0x7f
+#define kStrokeStencilHeldFlag 0x80
+
+/**
+ Stencil values the isolated strokes on one canvas are drawn with.
+
+ A value must not be handed out again while marks of it are left on the canvas, so every
+ canvas needs its own. Once all values are used they are reused after the canvas stencil
+ is cleared, which StrokeBatch does before it next draws into the canvas.
+
+ A live stroke is drawn over many frames and holds its value until it is finished, the
+ clears keep its marks so its new spans never blend over its old ones.
+ */
+class StrokeStencil
+{
+public:
+    StrokeStencil();
+
+    //! the canvas stencil was cleared, every value not held is free again
+    void reset();
+    //! value for a stroke drawn within one flush, no mark on the canvas has it
+    GLint nextRef();
+    //! value a live stroke keeps for all of its frames, 0 if none is left
+    GLint acquireRef();
+    //! the live stroke holding ref is finished, its marks stay until the next clear
+    void releaseRef(GLint ref);
+    //! values are about to be reused, the canvas stencil has to be cleared before drawing
+    bool needsClear() const;
+    //! values whose marks the pending clear has to keep
+    void getHeldRefs(std::vector<GLint> &refs) const;
+    //! the pending clear was done, values handed out since stay in use
+    void didClear();
+    //! the batch drew what it was handed values for, those now have marks on the canvas
+    void didFlush();
+
+private:
+    typedef enum {
+        kValueFree,
+        //! handed out for the batch being collected, nothing drawn with it yet
+        kValuePending,
+        kValueMarked,
+        kValueHeld
+    } ValueState;
+
+    GLint take(ValueState state);
+
+    unsigned char states[kStrokeStencilMaxRef + 1];
+    //! last value handed out, the search for a free one goes on after it
+    GLint counter;
+    bool clearPending;
+};
+
+/**
+ Collects tessellated stroke triangles from any number of strokes and submits them
+ with as few state changes and draw calls as possible.
+
+ Vertex colors are premultiplied. Consecutive runs with an equal state are merged,
+ so callers should append strokes sorted by state (see stateLess).
+
+ Cached meshes are kept in a separate compact stream which is drawn before the freshly
+ tessellated vertices, they always hold older, committed strokes.
+ */
+class StrokeBatch
+{
+public:
+    StrokeBatch();
+    ~StrokeBatch();
+
+    //! color of the empty canvas, used as ink by eraser strokes, transparent for layers above the paper
+    void setPaperColor(ccColor4F color);
+    ccColor4F getPaperColor() const;
+
+    //! strokes skip tessellating what lies outside rect, in the coordinates they emit vertices in
+    void setCullRect(const CCRect &rect);
+    void removeCullRect();
+    //! NULL when nothing is culled
+    const CCRect *getCullRect() const;
+
+    //! premultiplied vertex color for a stroke drawn with style
+    ccColor4F inkColorForStyle(const StrokeStyle &style) const;
+    //! translucent and multiply strokes must not blend over themselves where segments overlap
+    bool styleNeedsIsolation(const StrokeStyle &style) const;
+    //! stencil of the canvas the next flushes draw into, NULL for one of the batch's own
+    void setStencil(StrokeStencil *aStencil);
+    StrokeStencil *getStencil() const;
+    //! hands out a stencil value for an isolated stroke from the current stencil
+    GLint nextStencilRef();
+    //! the same for a live stroke, which holds it until it is finished
+    GLint acquireStencilRef();
+    //! state a stroke drawn with style is batched under
+    StrokeBatchState stateForStyle(const StrokeStyle &style, GLint stencilRef) const;
+
+    //! starts (or continues) the run all following vertices are drawn with
+    void beginRun(const StrokeBatchState &state);
+    std::vector<LineVertex> &getVertices();
+    //! copies already tessellated geometry into the batch
+    void appendMesh(const StrokeMeshVertex *meshVertices, unsigned int count, const StrokeBatchState &state);
+
+    bool isEmpty() const;
+    void clear();
+
+    //! draws everything collected so far into the currently bound framebuffer and clears the batch
+    void flush(CCGLProgram *program);
+    //! the same, submitted again under the modelview transform of every further copy of symmetry
+    void flush(CCGLProgram *program, const StrokeSymmetry &symmetry);
+    //! the same without GL, fills the triangles into rasterizer on the CPU
+    void flush(StrokeRasterizer *rasterizer);
+
+    static bool stateLess(const StrokeBatchState &a, const StrokeBatchState &b);
+    static bool stateEqual(const StrokeBatchState &a, const StrokeBatchState &b);
+
+private:
+    typedef struct _Run {
+        StrokeBatchState state;
+        unsigned int first;
+        unsigned int count;
+    } Run;
+
+    static void appendRun(std::vector<Run> &runList, const StrokeBatchState &state, unsigned int first, unsigned int count);
+    void closeRun();
+    void applyState(const StrokeBatchState &state, const StrokeBatchState *previous);
+    //! clears the stencil of the bound framebuffer if its values are about to be reused
+    void clearStencilIfNeeded(CCGLProgram *program);
+    const StrokeBatchState *drawRuns(const std::vector<Run> &runList, const StrokeBatchState *previous);
+
+    std::vector<LineVertex> vertices;
+    std::vector<Run> runs;
+    std::vector<StrokeMeshVertex> meshVertices;
+    std::vector<Run> meshRuns;
+    bool runOpen;
+    Run currentRun;
+
+    ccColor4F paperColor;
+    CCRect cullRect;
+    bool culling;
+    StrokeStencil ownStencil;
+    StrokeStencil *stencil;
+};
+
+#endif // _STROKE_BATCH_H_
@@ -0,0 +1,307 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeBulkLoader.h"
+#include "StrokeCurveFitter.h"
+#include "StrokeIndex.h"
+#include "StrokeMeshCache.h"
+#include "StrokeSimplifier.h"
+#include <unistd.h>
+
+//! chunks past the next one taken a thread may build, times the number of threads
+#define kMaxChunksAheadPerWorker 4
+
+//! claimChunk() results other than a chunk index
+#define kNoChunkInReach -1
+#define kNoChunkLeft -2
+
+StrokeBulkLoader::StrokeBulkLoader()
+: threadCount(1)
+, strokesPerChunk(64)
+, takenChunks(0)
+, strokeCount(0)
+, chunkSize(1)
+, level(0)
+, overdraw(3.0f)
+, quality(StrokeQualityDefault())
+, loading(false)
+, stopping(false)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount = cores > 0 ? (unsigned int)cores : 1;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&condition, NULL);
+}
+
+StrokeBulkLoader::~StrokeBulkLoader()
+{
+    stop();
+    pthread_cond_destroy(&condition);
+    pthread_mutex_destroy(&mutex);
+}
+
+bool StrokeBulkLoader::start(std::vector<StrokeImport> &strokes, unsigned int aLevel, float aOverdraw, const StrokeQuality &aQuality)
+{
+    if (loading)
+    {
+        return false;
+    }
+
+    imports.clear();
+    imports.swap(strokes);
+    level = aLevel;
+    overdraw = aOverdraw;
+    quality = aQuality;
+    strokeCount = (unsigned int)imports.size();
+    chunkSize = MAX(strokesPerChunk, 1u);
+    takenChunks = 0;
+    stopping = false;
+    chunks.assign((strokeCount + chunkSize - 1) / chunkSize, (StrokeBulkChunk *)NULL);
+    if (chunks.empty())
+    {
+        return true;
+    }
+
+    //! dealt round robin, every queue starts with one of the first chunks the main thread waits for
+    unsigned int workerCount = MIN(MAX(threadCount, 1u), (unsigned int)chunks.size());
+    for (unsigned int i = 0; i < workerCount; ++i)
+    {
+        Worker *worker = new Worker();
+        worker->loader = this;
+        worker->index = i;
+        worker->started = false;
+        pthread_mutex_init(&worker->lock, NULL);
+        workers.push_back(worker);
+    }
+    for (unsigned int i = 0; i < chunks.size(); ++i)
+    {
+        workers[i % workerCount]->queue.push_back(i);
+    }
+
+    //! the queue of a thread that didn't start is stolen by the others
+    bool anyStarted = false;
+    for (unsigned int i = 0; i < workerCount; ++i)
+    {
+        workers[i]->started = pthread_create(&workers[i]->thread, NULL, &StrokeBulkLoader::workerEntry, workers[i]) == 0;
+        anyStarted = anyStarted || workers[i]->started;
+    }
+    loading = true;
+    if (!anyStarted)
+    {
+        CCLOG("StrokeBulkLoader: could not start worker threads");
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void StrokeBulkLoader::cancel()
+{
+    stop();
+}
+
+bool StrokeBulkLoader::isLoading() const
+{
+    return loading;
+}
+
+unsigned int StrokeBulkLoader::getTakenCount() const
+{
+    pthread_mutex_lock(&mutex);
+    unsigned int taken = MIN(takenChunks * chunkSize, strokeCount);
+    pthread_mutex_unlock(&mutex);
+    return taken;
+}
+
+unsigned int StrokeBulkLoader::getStrokeCount() const
+{
+    return strokeCount;
+}
+
+StrokeBulkChunk *StrokeBulkLoader::takeChunk()
+{
+    if (!loading)
+    {
+        return NULL;
+    }
+
+    StrokeBulkChunk *chunk = NULL;
+    pthread_mutex_lock(&mutex);
+    if (takenChunks < chunks.size() && chunks[takenChunks] != NULL)
+    {
+        chunk = chunks[takenChunks];
+        chunks[takenChunks] = NULL;
+        ++takenChunks;
+        //! threads waiting for room to work ahead get it
+        pthread_cond_broadcast(&condition);
+    }
+    bool done = takenChunks == chunks.size();
+    pthread_mutex_unlock(&mutex);
+
+    if (done)
+    {
+        stop();
+    }
+    return chunk;
+}
+
+void StrokeBulkLoader::stop()
+{
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&condition);
+    pthread_mutex_unlock(&mutex);
+
+    for (unsigned int i = 0; i < workers.size(); ++i)
+    {
+        if (workers[i]->started)
+        {
+            pthread_join(workers[i]->thread, NULL);
+        }
+        pthread_mutex_destroy(&workers[i]->lock);
+        delete workers[i];
+    }
+    workers.clear();
+    for (unsigned int i = 0; i < chunks.size(); ++i)
+    {
+        delete chunks[i];
+    }
+    chunks.clear();
+    std::vector<StrokeImport>().swap(imports);
+    loading = false;
+}
+
+void *StrokeBulkLoader::workerEntry(void *worker)
+{
+    ((Worker *)worker)->loader->work((Worker *)worker);
+    return NULL;
+}
+
+int StrokeBulkLoader::popFront(Worker *worker, unsigned int limit)
+{
+    int chunkIndex = kNoChunkLeft;
+    pthread_mutex_lock(&worker->lock);
+    if (!worker->queue.empty())
+    {
+        chunkIndex = kNoChunkInReach;
+        if (worker->queue.front() < limit)
+        {
+            chunkIndex = (int)worker->queue.front();
+            worker->queue.pop_front();
+        }
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return chunkIndex;
+}
+
+int StrokeBulkLoader::claimChunk(Worker *worker, unsigned int taken)
+{
+    unsigned int limit = taken + kMaxChunksAheadPerWorker * (unsigned int)workers.size();
+    int result = kNoChunkLeft;
+    //! own queue first, then the others in turn, always the front: the chunk the main thread needs soonest
+    for (unsigned int i = 0; i < workers.size(); ++i)
+    {
+        int chunkIndex = popFront(workers[(worker->index + i) % workers.size()], limit);
+        if (chunkIndex >= 0)
+        {
+            return chunkIndex;
+        }
+        result = MAX(result, chunkIndex);
+    }
+    return result;
+}
+
+void StrokeBulkLoader::work(Worker *worker)
+{
+    pthread_mutex_lock(&mutex);
+    while (!stopping)
+    {
+        unsigned int taken = takenChunks;
+        pthread_mutex_unlock(&mutex);
+
+        int chunkIndex = claimChunk(worker, taken);
+        if (chunkIndex == kNoChunkLeft)
+        {
+            pthread_mutex_lock(&mutex);
+            break;
+        }
+        if (chunkIndex >= 0)
+        {
+            StrokeBulkChunk *chunk = buildChunk((unsigned int)chunkIndex, worker);
+            pthread_mutex_lock(&mutex);
+            chunks[chunkIndex] = chunk;
+            continue;
+        }
+
+        //! everything within reach is claimed, more comes in reach once the main thread takes a chunk
+        pthread_mutex_lock(&mutex);
+        while (!stopping && takenChunks == taken)
+        {
+            pthread_cond_wait(&condition, &mutex);
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+StrokeBulkChunk *StrokeBulkLoader::buildChunk(unsigned int chunkIndex, Worker *worker)
+{
+    //! the chunk's imports are only ever touched by the thread that claimed it
+    unsigned int first = chunkIndex * chunkSize;
+    unsigned int end = MIN(first + chunkSize, strokeCount);
+    StrokeBulkChunk *chunk = new StrokeBulkChunk();
+    chunk->strokes.resize(end - first);
+
+    StrokeRecord record;
+    std::vector<LinePoint> smoothed;
+    for (unsigned int i = first; i < end; ++i)
+    {
+        StrokeBulkStroke &stroke = chunk->strokes[i - first];
+        StrokeImport &import = imports[i];
+        stroke.import.layerID = import.layerID;
+        stroke.import.style = import.style;
+        stroke.import.symmetry = import.symmetry;
+        stroke.import.paperColor = import.paperColor;
+        stroke.import.points.swap(import.points);
+
+        //! what StrokeCurveWorker makes of a committed stroke
+        StrokeTessellator::smoothPolyline(stroke.import.points, smoothed);
+        float pressureWeight = stroke.import.style.pressureOpacity > 0.0f ? kStrokeCurvePressureWeight : 0.0f;
+        StrokeCurveFitter::fit(smoothed, kStrokeCurveTolerance, pressureWeight, stroke.curve);
+        StrokeSimplifier::buildLevelsFromCurve(stroke.curve, stroke.levels);
+
+        //! lent to the record for tessellating and given back
+        record.style = stroke.import.style;
+        record.symmetry = stroke.import.symmetry;
+        record.points.swap(stroke.import.points);
+        record.levels.swap(stroke.levels);
+        worker->scratch.setPaperColor(stroke.import.paperColor);
+        stroke.needsIsolation = worker->scratch.styleNeedsIsolation(record.style);
+        stroke.firstVertex = (unsigned int)chunk->vertices.size();
+        StrokeMeshCache::tessellateStroke(record, level, overdraw, quality, worker->scratch, chunk->vertices);
+        stroke.vertexCount = (unsigned int)chunk->vertices.size() - stroke.firstVertex;
+        record.points.swap(stroke.import.points);
+        record.levels.swap(stroke.levels);
+    }
+    return chunk;
+}
@@ -0,0 +1,141 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_BULK_LOADER_H_
+#define _STROKE_BULK_LOADER_H_
+
+#include "cocos2d.h"
+#include "StrokeTessellator.h"
+#include "StrokeBatch.h"
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+USING_NS_CC;
+
+//! one stroke of a saved document, as StrokeIndex::insert() takes it
+typedef struct _StrokeImport {
+    unsigned int layerID;
+    StrokeStyle style;
+    StrokeSymmetry symmetry;
+    //! input points, as StrokeTessellator::getInputPoints() had them
+    std::vector<LinePoint> points;
+    //! color of the canvas the stroke is drawn on, the ink of the eraser
+    ccColor4F paperColor;
+} StrokeImport;
+
+//! an imported stroke fitted and tessellated, ready for the stroke index and the canvas
+typedef struct _StrokeBulkStroke {
+    StrokeImport import;
+    std::vector<LinePoint> curve;
+    std::vector<std::vector<LinePoint> > levels;
+    //! mesh vertices of the stroke in the chunk, symmetry copies included
+    unsigned int firstVertex;
+    unsigned int vertexCount;
+    bool needsIsolation;
+} StrokeBulkStroke;
+
+//! consecutive imported strokes and their meshes packed in one block
+typedef struct _StrokeBulkChunk {
+    std::vector<StrokeBulkStroke> strokes;
+    std::vector<StrokeMeshVertex> vertices;
+} StrokeBulkChunk;
+
+/**
+ Fits and tessellates many strokes at once on a pool of threads, for opening documents.
+
+ The strokes are cut into chunks in drawing order and dealt round robin to the threads'
+ queues. Each thread works through its own queue front first and, once that is empty,
+ steals the front chunk of another queue, so one slow chunk never leaves the others idle.
+ Every thread tessellates into a scratch batch of its own and packs a chunk's meshes into
+ one vertex block, the main thread takes finished chunks in order with takeChunk() and
+ submits each block in a few large draws. Threads work at most a few chunks ahead of the
+ next one taken, so memory stays bounded however large the document is.
+ */
+class StrokeBulkLoader
+{
+public:
+    StrokeBulkLoader();
+    ~StrokeBulkLoader();
+
+    /**
+     starts on threadCount threads, the points of strokes are swapped out. Meshes are built for
+     detail level with overdraw and quality as StrokeMeshCache would. False while a load is running.
+     */
+    bool start(std::vector<StrokeImport> &strokes, unsigned int level, float overdraw, const StrokeQuality &quality);
+    //! stops the threads and drops what wasn't taken
+    void cancel();
+    //! true from start() until the last chunk is taken
+    bool isLoading() const;
+
+    //! next chunk in drawing order, NULL while it is still being built, delete it when done
+    StrokeBulkChunk *takeChunk();
+    //! strokes taken so far and in total
+    unsigned int getTakenCount() const;
+    unsigned int getStrokeCount() const;
+
+    //! threads of the next start(), the number of cores by default
+    unsigned int threadCount;
+    unsigned int strokesPerChunk;
+
+private:
+    typedef struct _Worker {
+        StrokeBulkLoader *loader;
+        pthread_t thread;
+        //! chunk indices dealt to this thread and not claimed yet, guarded by lock
+        std::deque<unsigned int> queue;
+        pthread_mutex_t lock;
+        //! tessellation arena, reused for every stroke
+        StrokeBatch scratch;
+        unsigned int index;
+        bool started;
+    } Worker;
+
+    static void *workerEntry(void *worker);
+    void work(Worker *worker);
+    //! next chunk for worker, own queue first, then stolen, -1 if none is within reach, -2 if all are claimed
+    int claimChunk(Worker *worker, unsigned int takenChunks);
+    static int popFront(Worker *worker, unsigned int limit);
+    StrokeBulkChunk *buildChunk(unsigned int chunkIndex, Worker *worker);
+    void stop();
+
+    std::vector<StrokeImport> imports;
+    std::vector<Worker *> workers;
+    //! finished chunks by index, NULL until built and after taken
+    std::vector<StrokeBulkChunk *> chunks;
+    unsigned int takenChunks;
+    unsigned int strokeCount;
+    unsigned int chunkSize;
+    unsigned int level;
+    float overdraw;
+    StrokeQuality quality;
+    bool loading;
+    bool stopping;
+    //! guards chunks, takenChunks and stopping
+    mutable pthread_mutex_t mutex;
+    pthread_cond_t condition;
+};
+
+#endif // _STROKE_BULK_LOADER_H_
@@ -0,0 +1,392 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeCurveFitter.h"
+
+//! Newton steps tried before a segment that is almost good enough gets split
+#define kStrokeCurveReparameterizeSteps 4
+//! subdivisions per segment when flattening, 4096 pieces are more than any curve needs
+#define kStrokeCurveMaxFlattenDepth 12
+
+//! a smoothed sample as the fit sees it, pressure premultiplied with its weight
+typedef struct _CurveVector {
+    float x;
+    float y;
+    float w;
+    float p;
+} CurveVector;
+
+static inline CurveVector curveVector(float x, float y, float w, float p)
+{
+    CurveVector v = { x, y, w, p };
+    return v;
+}
+
+static inline CurveVector add(const CurveVector &a, const CurveVector &b)
+{
+    return curveVector(a.x + b.x, a.y + b.y, a.w + b.w, a.p + b.p);
+}
+
+static inline CurveVector sub(const CurveVector &a, const CurveVector &b)
+{
+    return curveVector(a.x - b.x, a.y - b.y, a.w - b.w, a.p - b.p);
+}
+
+static inline CurveVector scale(const CurveVector &a, float s)
+{
+    return curveVector(a.x * s, a.y * s, a.w * s, a.p * s);
+}
+
+static inline float dot(const CurveVector &a, const CurveVector &b)
+{
+    return a.x * b.x + a.y * b.y + a.w * b.w + a.p * b.p;
+}
+
+static inline float length(const CurveVector &a)
+{
+    return sqrtf(dot(a, a));
+}
+
+static inline CurveVector normalize(const CurveVector &a)
+{
+    float l = length(a);
+    return l > 0.0f ? scale(a, 1.0f / l) : a;
+}
+
+//! how far q is off p, measured like the simplifier measures it
+static inline float curveError(const CurveVector &p, const CurveVector &q)
+{
+    return sqrtf((p.x - q.x) * (p.x - q.x) + (p.y - q.y) * (p.y - q.y)) + fabsf(p.w - q.w) * 0.5f + fabsf(p.p - q.p);
+}
+
+static CurveVector bezierPoint(const CurveVector *bezier, int degree, float t)
+{
+    CurveVector points[4];
+    for (int i = 0; i <= degree; ++i)
+    {
+        points[i] = bezier[i];
+    }
+    for (int level = 1; level <= degree; ++level)
+    {
+        for (int i = 0; i <= degree - level; ++i)
+        {
+            points[i] = add(scale(points[i], 1.0f - t), scale(points[i + 1], t));
+        }
+    }
+    return points[0];
+}
+
+typedef struct _FitContext {
+    const std::vector<CurveVector> *samples;
+    float tolerance;
+    //! two control points and the index of the sample ending it per segment
+    std::vector<CurveVector> controls;
+    std::vector<unsigned int> ends;
+} FitContext;
+
+static void chordLengthParameterize(const std::vector<CurveVector> &d, int first, int last, std::vector<float> &u)
+{
+    u.resize(last - first + 1);
+    u[0] = 0.0f;
+    for (int i = first + 1; i <= last; ++i)
+    {
+        u[i - first] = u[i - first - 1] + length(sub(d[i], d[i - 1]));
+    }
+    for (int i = first + 1; i <= last; ++i)
+    {
+        u[i - first] /= u[last - first];
+    }
+}
+
+static void generateBezier(const std::vector<CurveVector> &d, int first, int last, const std::vector<float> &u,
+                           const CurveVector &tHat1, const CurveVector &tHat2, CurveVector *bezier)
+{
+    //! least squares for the distances of the control points along the end tangents
+    float c[2][2] = { { 0, 0 }, { 0, 0 } };
+    float x[2] = { 0, 0 };
+    for (int i = 0; i <= last - first; ++i)
+    {
+        float t = u[i], s = 1.0f - t;
+        float b0 = s * s * s, b1 = 3 * t * s * s, b2 = 3 * t * t * s, b3 = t * t * t;
+        CurveVector a0 = scale(tHat1, b1);
+        CurveVector a1 = scale(tHat2, b2);
+        c[0][0] += dot(a0, a0);
+        c[0][1] += dot(a0, a1);
+        c[1][1] += dot(a1, a1);
+        CurveVector rest = sub(d[first + i], add(scale(d[first], b0 + b1), scale(d[last], b2 + b3)));
+        x[0] += dot(a0, rest);
+        x[1] += dot(a1, rest);
+    }
+    c[1][0] = c[0][1];
+
+    float det = c[0][0] * c[1][1] - c[1][0] * c[0][1];
+    float alpha1 = det != 0.0f ? (x[0] * c[1][1] - x[1] * c[0][1]) / det : 0.0f;
+    float alpha2 = det != 0.0f ? (c[0][0] * x[1] - c[1][0] * x[0]) / det : 0.0f;
+
+    //! no usable solution, fall back to a third of the chord
+    float segmentLength = length(sub(d[last], d[first]));
+    float epsilon = 1.0e-6f * segmentLength;
+    if (alpha1 < epsilon || alpha2 < epsilon)
+    {
+        alpha1 = alpha2 = segmentLength / 3.0f;
+    }
+
+    bezier[0] = d[first];
+    bezier[1] = add(d[first], scale(tHat1, alpha1));
+    bezier[2] = add(d[last], scale(tHat2, alpha2));
+    bezier[3] = d[last];
+}
+
+static float computeMaxError(const std::vector<CurveVector> &d, int first, int last, const CurveVector *bezier,
+                             const std::vector<float> &u, int &split)
+{
+    split = (last - first + 1) / 2 + first;
+    float maxError = 0.0f;
+    for (int i = first + 1; i < last; ++i)
+    {
+        float error = curveError(bezierPoint(bezier, 3, u[i - first]), d[i]);
+        if (error >= maxError)
+        {
+            maxError = error;
+            split = i;
+        }
+    }
+    return maxError;
+}
+
+static void reparameterize(const std::vector<CurveVector> &d, int first, int last, std::vector<float> &u, const CurveVector *bezier)
+{
+    CurveVector firstDerivative[3], secondDerivative[2];
+    for (int i = 0; i < 3; ++i)
+    {
+        firstDerivative[i] = scale(sub(bezier[i + 1], bezier[i]), 3.0f);
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        secondDerivative[i] = scale(sub(firstDerivative[i + 1], firstDerivative[i]), 2.0f);
+    }
+
+    //! one Newton step towards the closest point on the curve
+    for (int i = first; i <= last; ++i)
+    {
+        float t = u[i - first];
+        CurveVector offset = sub(bezierPoint(bezier, 3, t), d[i]);
+        CurveVector q1 = bezierPoint(firstDerivative, 2, t);
+        CurveVector q2 = bezierPoint(secondDerivative, 1, t);
+        float denominator = dot(q1, q1) + dot(offset, q2);
+        if (denominator != 0.0f)
+        {
+            u[i - first] = clampf(t - dot(offset, q1) / denominator, 0.0f, 1.0f);
+        }
+    }
+}
+
+static void emitSegment(FitContext &context, const CurveVector *bezier, int last)
+{
+    context.controls.push_back(bezier[1]);
+    context.controls.push_back(bezier[2]);
+    context.ends.push_back((unsigned int)last);
+}
+
+static void fitCubic(FitContext &context, int first, int last, const CurveVector &tHat1, const CurveVector &tHat2)
+{
+    const std::vector<CurveVector> &d = *context.samples;
+    CurveVector bezier[4];
+    if (last - first == 1)
+    {
+        float third = length(sub(d[last], d[first])) / 3.0f;
+        bezier[1] = add(d[first], scale(tHat1, third));
+        bezier[2] = add(d[last], scale(tHat2, third));
+        emitSegment(context, bezier, last);
+        return;
+    }
+
+    std::vector<float> u;
+    chordLengthParameterize(d, first, last, u);
+    generateBezier(d, first, last, u, tHat1, tHat2, bezier);
+    int split;
+    float maxError = computeMaxError(d, first, last, bezier, u, split);
+    if (maxError <= context.tolerance)
+    {
+        emitSegment(context, bezier, last);
+        return;
+    }
+
+    //! close, a better parameterization may be all it takes
+    if (maxError <= context.tolerance * 4)
+    {
+        for (int i = 0; i < kStrokeCurveReparameterizeSteps; ++i)
+        {
+            reparameterize(d, first, last, u, bezier);
+            generateBezier(d, first, last, u, tHat1, tHat2, bezier);
+            maxError = computeMaxError(d, first, last, bezier, u, split);
+            if (maxError <= context.tolerance)
+            {
+                emitSegment(context, bezier, last);
+                return;
+            }
+        }
+    }
+
+    CurveVector tHatCenter = normalize(sub(d[split - 1], d[split + 1]));
+    fitCubic(context, first, split, tHat1, tHatCenter);
+    fitCubic(context, split, last, scale(tHatCenter, -1.0f), tHat2);
+}
+
+static LinePoint lerpPoint(const LinePoint &a, const LinePoint &b, float t)
+{
+    LinePoint point;
+    point.pos = ccpLerp(a.pos, b.pos, t);
+    point.width = a.width + (b.width - a.width) * t;
+    point.pressure = (GLubyte)(a.pressure + (b.pressure - a.pressure) * t + 0.5f);
+    point.tilt = (GLubyte)(a.tilt + (b.tilt - a.tilt) * t + 0.5f);
+    point.time = (GLushort)(a.time + (b.time - a.time) * t + 0.5f);
+    return point;
+}
+
+//! control point of the fit back as a LinePoint, channels left out of the fit a third of the way along
+static LinePoint controlPoint(const CurveVector &control, const LinePoint &from, const LinePoint &to, float t, float pressureWeight)
+{
+    LinePoint point = lerpPoint(from, to, t);
+    point.pos = ccp(control.x, control.y);
+    point.width = MAX(0.0f, control.w);
+    if (pressureWeight > 0.0f)
+    {
+        point.pressure = (GLubyte)clampf(control.p / pressureWeight + 0.5f, 0.0f, 255.0f);
+    }
+    return point;
+}
+
+void StrokeCurveFitter::fit(const std::vector<LinePoint> &smoothed, float tolerance, float pressureWeight, std::vector<LinePoint> &knots)
+{
+    knots.clear();
+    
+    //! spans meet in duplicated points, those would give the fit zero length tangents
+    std::vector<CurveVector> samples;
+    std::vector<unsigned int> sampleIndices;
+    samples.reserve(smoothed.size());
+    for (unsigned int i = 0; i < smoothed.size(); ++i)
+    {
+        const LinePoint &point = smoothed[i];
+        CurveVector sample = curveVector(point.pos.x, point.pos.y, point.width, point.pressure * pressureWeight);
+        if (samples.empty() || length(sub(sample, samples.back())) > 0.0001f)
+        {
+            samples.push_back(sample);
+            sampleIndices.push_back(i);
+        }
+    }
+    if (samples.empty())
+    {
+        return;
+    }
+    
+    knots.push_back(smoothed[sampleIndices[0]]);
+    if (samples.size() < 2)
+    {
+        return;
+    }
+    
+    FitContext context;
+    context.samples = &samples;
+    context.tolerance = tolerance;
+    int last = (int)samples.size() - 1;
+    fitCubic(context, 0, last, normalize(sub(samples[1], samples[0])), normalize(sub(samples[last - 1], samples[last])));
+    
+    //! ends are the smoothed points themselves, every channel exact
+    for (unsigned int i = 0; i < context.ends.size(); ++i)
+    {
+        const LinePoint &from = knots.back();
+        const LinePoint &to = smoothed[sampleIndices[context.ends[i]]];
+        LinePoint first = controlPoint(context.controls[i * 2], from, to, 1.0f / 3, pressureWeight);
+        LinePoint second = controlPoint(context.controls[i * 2 + 1], from, to, 2.0f / 3, pressureWeight);
+        knots.push_back(first);
+        knots.push_back(second);
+        knots.push_back(to);
+    }
+}
+
+LinePoint StrokeCurveFitter::evaluate(const LinePoint *segment, float t)
+{
+    LinePoint points[4] = { segment[0], segment[1], segment[2], segment[3] };
+    for (int level = 1; level <= 3; ++level)
+    {
+        for (int i = 0; i <= 3 - level; ++i)
+        {
+            points[i] = lerpPoint(points[i], points[i + 1], t);
+        }
+    }
+    return points[0];
+}
+
+//! how far the control points stray from the chord, the curve stays within their hull
+static float segmentFlatness(const LinePoint *segment)
+{
+    CCPoint chord = ccpSub(segment[3].pos, segment[0].pos);
+    float lengthSQ = ccpLengthSQ(chord);
+    float flatness = 0.0f;
+    for (int i = 1; i <= 2; ++i)
+    {
+        float t = lengthSQ > 0.0f ? clampf(ccpDot(ccpSub(segment[i].pos, segment[0].pos), chord) / lengthSQ, 0.0f, 1.0f) : 0.0f;
+        float distance = ccpDistance(segment[i].pos, ccpAdd(segment[0].pos, ccpMult(chord, t)));
+        float widthError = fabsf(segment[i].width - (segment[0].width + (segment[3].width - segment[0].width) * i / 3.0f)) * 0.5f;
+        flatness = MAX(flatness, distance + widthError);
+    }
+    return flatness;
+}
+
+static void flattenSegment(const LinePoint *segment, float tolerance, int depth, std::vector<LinePoint> &polyline)
+{
+    if (depth >= kStrokeCurveMaxFlattenDepth || segmentFlatness(segment) <= tolerance)
+    {
+        polyline.push_back(segment[3]);
+        return;
+    }
+    
+    //! de Casteljau at the middle
+    LinePoint ab = lerpPoint(segment[0], segment[1], 0.5f);
+    LinePoint bc = lerpPoint(segment[1], segment[2], 0.5f);
+    LinePoint cd = lerpPoint(segment[2], segment[3], 0.5f);
+    LinePoint abc = lerpPoint(ab, bc, 0.5f);
+    LinePoint bcd = lerpPoint(bc, cd, 0.5f);
+    LinePoint middle = lerpPoint(abc, bcd, 0.5f);
+    
+    LinePoint left[4] = { segment[0], ab, abc, middle };
+    LinePoint right[4] = { middle, bcd, cd, segment[3] };
+    flattenSegment(left, tolerance, depth + 1, polyline);
+    flattenSegment(right, tolerance, depth + 1, polyline);
+}
+
+void StrokeCurveFitter::flatten(const std::vector<LinePoint> &knots, float tolerance, std::vector<LinePoint> &polyline)
+{
+    polyline.clear();
+    if (knots.empty())
+    {
+        return;
+    }
+    polyline.push_back(knots[0]);
+    for (unsigned int i = 0; i + 3 < knots.size(); i += 3)
+    {
+        flattenSegment(&knots[i], tolerance, 0, polyline);
+    }
+}
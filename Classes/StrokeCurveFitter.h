@@ -0,0 +1,62 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_CURVE_FITTER_H_
+#define _STROKE_CURVE_FITTER_H_
+
+#include "cocos2d.h"
+#include "StrokeTessellator.h"
+#include <vector>
+
+USING_NS_CC;
+
+//! deviation of a fitted curve from the smoothed stroke allowed, half of level 0's simplification tolerance
+#define kStrokeCurveTolerance 0.125f
+//! points of deviation one step of pressure counts as when it is fitted
+#define kStrokeCurvePressureWeight (1.0f / 32)
+
+/**
+ Fits smoothed strokes with piecewise cubic Béziers (Schneider, Graphics Gems 1990).
+
+ Width is fitted as a third coordinate next to x and y, pressure as a fourth one when
+ the stroke's ink depends on it. A curve is stored as knots: the start point, then two
+ control points and an end point per segment, so n segments take 3n + 1 LinePoints.
+ Tilt and time are not drawn and only interpolated linearly between segment ends.
+
+ The error of a point is measured like StrokeSimplifier does it, distance plus half of
+ the width difference, plus the weighted pressure difference. Every smoothed sample
+ lies within tolerance of the curve at its parameter, segments are split until so.
+ */
+class StrokeCurveFitter
+{
+public:
+    //! pressureWeight 0 leaves pressure out of the fit
+    static void fit(const std::vector<LinePoint> &smoothed, float tolerance, float pressureWeight, std::vector<LinePoint> &knots);
+    //! polyline within tolerance of the curve, end points of the segments included
+    static void flatten(const std::vector<LinePoint> &knots, float tolerance, std::vector<LinePoint> &polyline);
+    static LinePoint evaluate(const LinePoint *segment, float t);
+};
+
+#endif // _STROKE_CURVE_FITTER_H_
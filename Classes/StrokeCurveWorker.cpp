@@ -0,0 +1,183 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeCurveWorker.h"
+#include "StrokeCurveFitter.h"
+#include "StrokeSimplifier.h"
+
+StrokeCurveWorker::StrokeCurveWorker()
+: runningID(0)
+, runningCancelled(false)
+, started(false)
+, stopping(false)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&condition, NULL);
+}
+
+StrokeCurveWorker::~StrokeCurveWorker()
+{
+    if (started)
+    {
+        pthread_mutex_lock(&mutex);
+        stopping = true;
+        pthread_cond_signal(&condition);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(thread, NULL);
+    }
+
+    for (unsigned int i = 0; i < jobs.size(); ++i)
+    {
+        delete jobs[i];
+    }
+    for (std::map<unsigned int, Result *>::iterator it = results.begin(); it != results.end(); ++it)
+    {
+        delete it->second;
+    }
+    pthread_cond_destroy(&condition);
+    pthread_mutex_destroy(&mutex);
+}
+
+void StrokeCurveWorker::addJob(unsigned int strokeID, const std::vector<LinePoint> &inputPoints, float pressureWeight)
+{
+    Job *job = new Job();
+    job->strokeID = strokeID;
+    job->inputPoints = inputPoints;
+    job->pressureWeight = pressureWeight;
+
+    pthread_mutex_lock(&mutex);
+    jobs.push_back(job);
+    if (!started)
+    {
+        started = pthread_create(&thread, NULL, &StrokeCurveWorker::threadEntry, this) == 0;
+        if (!started)
+        {
+            CCLOG("StrokeCurveWorker: could not start thread");
+        }
+    }
+    pthread_cond_signal(&condition);
+    pthread_mutex_unlock(&mutex);
+
+    //! without a thread the caller would wait forever, do the work right here
+    if (!started)
+    {
+        run(false);
+    }
+}
+
+bool StrokeCurveWorker::takeResult(unsigned int strokeID, std::vector<LinePoint> &curve, std::vector<std::vector<LinePoint> > &levels)
+{
+    pthread_mutex_lock(&mutex);
+    std::map<unsigned int, Result *>::iterator found = results.find(strokeID);
+    Result *result = NULL;
+    if (found != results.end())
+    {
+        result = found->second;
+        results.erase(found);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (result == NULL)
+    {
+        return false;
+    }
+    curve.swap(result->curve);
+    levels.swap(result->levels);
+    delete result;
+    return true;
+}
+
+void StrokeCurveWorker::cancel(unsigned int strokeID)
+{
+    pthread_mutex_lock(&mutex);
+    for (std::deque<Job *>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+    {
+        if ((*it)->strokeID == strokeID)
+        {
+            delete *it;
+            jobs.erase(it);
+            break;
+        }
+    }
+    if (runningID == strokeID)
+    {
+        runningCancelled = true;
+    }
+    std::map<unsigned int, Result *>::iterator found = results.find(strokeID);
+    if (found != results.end())
+    {
+        delete found->second;
+        results.erase(found);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void *StrokeCurveWorker::threadEntry(void *worker)
+{
+    ((StrokeCurveWorker *)worker)->run(true);
+    return NULL;
+}
+
+void StrokeCurveWorker::run(bool onThread)
+{
+    //! on the thread this loops until the destructor stops it, called directly it returns once the queue is empty
+    pthread_mutex_lock(&mutex);
+    while (!stopping)
+    {
+        if (jobs.empty())
+        {
+            if (!onThread)
+            {
+                break;
+            }
+            pthread_cond_wait(&condition, &mutex);
+            continue;
+        }
+
+        Job *job = jobs.front();
+        jobs.pop_front();
+        runningID = job->strokeID;
+        runningCancelled = false;
+        pthread_mutex_unlock(&mutex);
+
+        std::vector<LinePoint> smoothed;
+        StrokeTessellator::smoothPolyline(job->inputPoints, smoothed);
+        Result *result = new Result();
+        StrokeCurveFitter::fit(smoothed, kStrokeCurveTolerance, job->pressureWeight, result->curve);
+        StrokeSimplifier::buildLevelsFromCurve(result->curve, result->levels);
+
+        pthread_mutex_lock(&mutex);
+        if (runningCancelled)
+        {
+            delete result;
+        }
+        else
+        {
+            results[job->strokeID] = result;
+        }
+        runningID = 0;
+        delete job;
+    }
+    pthread_mutex_unlock(&mutex);
+}
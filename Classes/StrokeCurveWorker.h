@@ -0,0 +1,84 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_CURVE_WORKER_H_
+#define _STROKE_CURVE_WORKER_H_
+
+#include "cocos2d.h"
+#include "StrokeTessellator.h"
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+USING_NS_CC;
+
+/**
+ Fits committed strokes to curves and builds their detail levels on a background thread.
+
+ Jobs run in the order they were added, results wait until the main thread takes them.
+ The thread is started with the first job and joined by the destructor.
+ */
+class StrokeCurveWorker
+{
+public:
+    StrokeCurveWorker();
+    ~StrokeCurveWorker();
+
+    //! smooths and fits inputPoints, pressureWeight as in StrokeCurveFitter::fit
+    void addJob(unsigned int strokeID, const std::vector<LinePoint> &inputPoints, float pressureWeight);
+    //! false while the job is queued or running, otherwise hands over the result
+    bool takeResult(unsigned int strokeID, std::vector<LinePoint> &curve, std::vector<std::vector<LinePoint> > &levels);
+    //! forgets the job of an erased stroke, whether it ran already or not
+    void cancel(unsigned int strokeID);
+
+private:
+    typedef struct _Job {
+        unsigned int strokeID;
+        std::vector<LinePoint> inputPoints;
+        float pressureWeight;
+    } Job;
+
+    typedef struct _Result {
+        std::vector<LinePoint> curve;
+        std::vector<std::vector<LinePoint> > levels;
+    } Result;
+
+    static void *threadEntry(void *worker);
+    void run(bool onThread);
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    std::deque<Job *> jobs;
+    std::map<unsigned int, Result *> results;
+    //! job taken off the queue by the thread, 0 if idle
+    unsigned int runningID;
+    bool runningCancelled;
+    bool started;
+    bool stopping;
+};
+
+#endif // _STROKE_CURVE_WORKER_H_
@@ -0,0 +1,101 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeGeometry.h"
+
+//! offsets are checked on a line this wide, about the widest the app draws
+#define kSelfCheckHalfWidth 20.0f
+
+static float pointError(const CCPoint &a, const CCPoint &b)
+{
+    return MAX(fabsf(a.x - b.x), fabsf(a.y - b.y));
+}
+
+bool StrokeGeometrySelfCheck(StrokeGeometryErrors &errors)
+{
+    typedef StrokeGeometry<FloatGeometryPolicy> Reference;
+    
+    static const float lengths[] = { 0.01f, 0.5f, 2.0f, 37.0f, 1500.0f };
+    float perpendicularError = 0.0f;
+    float capError = 0.0f;
+    CCPoint directions[32];
+    for (unsigned int degrees = 0; degrees < 360; ++degrees)
+    {
+        float angle = CC_DEGREES_TO_RADIANS(degrees + 0.37f);
+        for (unsigned int i = 0; i < sizeof(lengths) / sizeof(float); ++i)
+        {
+            CCPoint from = ccp(512.25f, 384.75f);
+            CCPoint to = ccpAdd(from, ccp(cosf(angle) * lengths[i], sinf(angle) * lengths[i]));
+            CCPoint offset = ccpMult(StrokeGeometryCore::perpendicular(from, to), kSelfCheckHalfWidth);
+            CCPoint referenceOffset = ccpMult(Reference::perpendicular(from, to), kSelfCheckHalfWidth);
+            perpendicularError = MAX(perpendicularError, pointError(offset, referenceOffset));
+        }
+        
+        //! caps against the sin and cos of every angle, which is what they used to be built from
+        CCPoint lineDir = ccp(cosf(angle), sinf(angle));
+        StrokeGeometryCore::capDirections(lineDir, 32, directions);
+        float capAngle = angle + (float)M_PI_2;
+        for (unsigned int i = 0; i < 32; ++i)
+        {
+            float turned = capAngle - i * (float)(M_PI / 31);
+            CCPoint referenceDir = ccp(cosf(turned), sinf(turned));
+            capError = MAX(capError, pointError(ccpMult(directions[i], kSelfCheckHalfWidth), ccpMult(referenceDir, kSelfCheckHalfWidth)));
+        }
+    }
+    
+    float curveError = 0.0f;
+    std::vector<LinePoint> samples, referenceSamples;
+    unsigned int seed = 12345;
+    for (unsigned int span = 0; span < 256; ++span)
+    {
+        //! spans anywhere on a 2048 x 1536 canvas, up to 256 points long
+        LinePoint linePoints[3];
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            linePoints[i] = LinePointMake(CCPointZero, 0);
+            //! small LCG, the sweep has to be the same on every run
+            seed = seed * 1103515245 + 12345;
+            linePoints[i].pos.x = (i == 0 ? (seed >> 8) % 179200 : linePoints[0].pos.x * 100 + (seed >> 8) % 25600) / 100.0f;
+            seed = seed * 1103515245 + 12345;
+            linePoints[i].pos.y = (i == 0 ? (seed >> 8) % 128000 : linePoints[0].pos.y * 100 + (seed >> 8) % 25600) / 100.0f;
+            seed = seed * 1103515245 + 12345;
+            linePoints[i].width = (seed >> 8) % 4000 / 100.0f;
+        }
+        int count = 32 + span % 97;
+        samples.clear();
+        referenceSamples.clear();
+        StrokeGeometryCore::sampleQuadratic(linePoints[0], linePoints[1], linePoints[2], count, samples);
+        Reference::sampleQuadratic(linePoints[0], linePoints[1], linePoints[2], count, referenceSamples);
+        for (unsigned int i = 0; i < samples.size(); ++i)
+        {
+            curveError = MAX(curveError, pointError(samples[i].pos, referenceSamples[i].pos));
+            curveError = MAX(curveError, fabsf(samples[i].width - referenceSamples[i].width));
+        }
+    }
+    
+    errors.perpendicular = perpendicularError;
+    errors.cap = capError;
+    errors.curve = curveError;
+    return perpendicularError <= kStrokeGeometryTolerance && capError <= kStrokeGeometryTolerance && curveError <= kStrokeGeometryTolerance;
+}
@@ -0,0 +1,209 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_GEOMETRY_H_
+#define _STROKE_GEOMETRY_H_
+
+#include "cocos2d.h"
+#include "StrokeTessellator.h"
+#include <stdint.h>
+#include <vector>
+
+USING_NS_CC;
+
+//! values for STROKE_GEOMETRY_POLICY
+#define kStrokeGeometryFloat    0
+#define kStrokeGeometryFast     1
+
+//! arithmetic the stroke geometry runs in, define it for the whole build to switch
+#ifndef STROKE_GEOMETRY_POLICY
+#define STROKE_GEOMETRY_POLICY kStrokeGeometryFloat
+#endif
+
+/**
+ Scalar arithmetic policies for StrokeGeometry.
+
+ Each provides the Scalar type, conversion from and to float, multiplication and
+ normalization of a 2D vector, the only place a square root is needed. Addition and
+ subtraction are the plain operators for all of them.
+ */
+struct FloatGeometryPolicy
+{
+    typedef float Scalar;
+
+    static inline Scalar fromFloat(float value) { return value; }
+    static inline float toFloat(Scalar value) { return value; }
+    static inline Scalar mul(Scalar a, Scalar b) { return a * b; }
+
+    static inline void normalize(Scalar &x, Scalar &y)
+    {
+        float length = sqrtf(x * x + y * y);
+        if (length > 0.0f)
+        {
+            x /= length;
+            y /= length;
+        }
+    }
+};
+
+//! float with an approximate reciprocal square root, relative error below 0.2%
+struct FastGeometryPolicy : public FloatGeometryPolicy
+{
+    static inline float rsqrt(float value)
+    {
+        union { float f; uint32_t i; } bits;
+        bits.f = value;
+        bits.i = 0x5f3759df - (bits.i >> 1);
+        //! one Newton step on the bit level guess
+        return bits.f * (1.5f - 0.5f * value * bits.f * bits.f);
+    }
+
+    static inline void normalize(Scalar &x, Scalar &y)
+    {
+        float lengthSquared = x * x + y * y;
+        if (lengthSquared > 0.0f)
+        {
+            float scale = rsqrt(lengthSquared);
+            x *= scale;
+            y *= scale;
+        }
+    }
+};
+
+/**
+ The per segment math of stroke tessellation: unit perpendiculars, cap directions and
+ quadratic curve sampling, templated on the arithmetic policy. Inputs and outputs are
+ float, only the computation in between runs in the policy's Scalar.
+ */
+template <typename P>
+class StrokeGeometry
+{
+public:
+    typedef typename P::Scalar Scalar;
+
+    //! unit vector along to - from
+    static CCPoint direction(const CCPoint &from, const CCPoint &to)
+    {
+        Scalar x = P::fromFloat(to.x - from.x);
+        Scalar y = P::fromFloat(to.y - from.y);
+        P::normalize(x, y);
+        return ccp(P::toFloat(x), P::toFloat(y));
+    }
+
+    //! unit vector to the left of to - from, same as ccpNormalize(ccpPerp(to - from))
+    static CCPoint perpendicular(const CCPoint &from, const CCPoint &to)
+    {
+        Scalar x = P::fromFloat(from.y - to.y);
+        Scalar y = P::fromFloat(to.x - from.x);
+        P::normalize(x, y);
+        return ccp(P::toFloat(x), P::toFloat(y));
+    }
+
+    /**
+     count unit vectors turning clockwise over half a circle, starting at the perpendicular
+     of lineDir. Each one is the previous rotated by a fixed angle, so there is no trig per
+     vector.
+     */
+    static void capDirections(const CCPoint &lineDir, unsigned int count, CCPoint *directions)
+    {
+        float step = (float)(M_PI / (count - 1));
+        const Scalar cosStep = P::fromFloat(cosf(step));
+        const Scalar sinStep = P::fromFloat(sinf(step));
+
+        Scalar x = P::fromFloat(-lineDir.y);
+        Scalar y = P::fromFloat(lineDir.x);
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            directions[i] = ccp(P::toFloat(x), P::toFloat(y));
+
+            Scalar rotatedX = P::mul(x, cosStep) + P::mul(y, sinStep);
+            y = P::mul(y, cosStep) - P::mul(x, sinStep);
+            x = rotatedX;
+        }
+    }
+
+    //! start + b * (control - start) + c * (end - start) rounded, kept within 0..maximum
+    static float quadraticChannel(float start, float control, float end, float b, float c, float maximum)
+    {
+        return clampf(floorf(start + b * (control - start) + c * (end - start) + 0.5f), 0.0f, maximum);
+    }
+
+    //! count samples of the quadratic from start over control to end, end itself excluded
+    static void sampleQuadratic(const LinePoint &start, const LinePoint &control, const LinePoint &end, int count, std::vector<LinePoint> &samples)
+    {
+        //! relative to start, keeps the products small and precise far out on the canvas
+        const Scalar one = P::fromFloat(1.0f);
+        const Scalar controlX = P::fromFloat(control.pos.x - start.pos.x), controlY = P::fromFloat(control.pos.y - start.pos.y);
+        const Scalar controlWidth = P::fromFloat(control.width - start.width);
+        const Scalar endX = P::fromFloat(end.pos.x - start.pos.x), endY = P::fromFloat(end.pos.y - start.pos.y);
+        const Scalar endWidth = P::fromFloat(end.width - start.width);
+
+        for (int j = 0; j < count; j++)
+        {
+            //! from j every time, summing up the step drifts off
+            Scalar t = P::fromFloat((float)j / count);
+            Scalar u = one - t;
+            Scalar b = 2 * P::mul(u, t);
+            Scalar c = P::mul(t, t);
+
+            LinePoint sample;
+            sample.pos = ccp(start.pos.x + P::toFloat(P::mul(controlX, b) + P::mul(endX, c)),
+                             start.pos.y + P::toFloat(P::mul(controlY, b) + P::mul(endY, c)));
+            sample.width = start.width + P::toFloat(P::mul(controlWidth, b) + P::mul(endWidth, c));
+            //! input channels take no part in the geometry, float is precise enough for 8 and 16 bits
+            float bf = P::toFloat(b), cf = P::toFloat(c);
+            sample.pressure = (GLubyte)quadraticChannel(start.pressure, control.pressure, end.pressure, bf, cf, 0xff);
+            sample.tilt = (GLubyte)quadraticChannel(start.tilt, control.tilt, end.tilt, bf, cf, 0xff);
+            sample.time = (GLushort)quadraticChannel(start.time, control.time, end.time, bf, cf, 0xffff);
+            samples.push_back(sample);
+        }
+    }
+};
+
+#if STROKE_GEOMETRY_POLICY == kStrokeGeometryFast
+typedef StrokeGeometry<FastGeometryPolicy> StrokeGeometryCore;
+#else
+typedef StrokeGeometry<FloatGeometryPolicy> StrokeGeometryCore;
+#endif
+
+//! worst deviation of StrokeGeometryCore from the float path allowed, in points
+#define kStrokeGeometryTolerance 0.0625f
+
+//! worst deviations StrokeGeometrySelfCheck found, in points
+typedef struct _StrokeGeometryErrors
+{
+    float perpendicular;
+    float cap;
+    float curve;
+} StrokeGeometryErrors;
+
+/**
+ Compares StrokeGeometryCore against the float policy over a sweep of directions,
+ lengths and curves. Returns false if any worst error is above kStrokeGeometryTolerance.
+ The sweep is exhaustive, it belongs in tools, not in the app's startup.
+ */
+bool StrokeGeometrySelfCheck(StrokeGeometryErrors &errors);
+
+#endif // _STROKE_GEOMETRY_H_
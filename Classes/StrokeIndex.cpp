@@ -0,0 +1,398 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeIndex.h"
+#include "StrokeGeometry.h"
+#include <algorithm>
+
+static float distanceToSegmentSQ(CCPoint point, CCPoint a, CCPoint b)
+{
+    CCPoint ab = ccpSub(b, a);
+    float lengthSQ = ccpLengthSQ(ab);
+    float t = lengthSQ > 0.0f ? clampf(ccpDot(ccpSub(point, a), ab) / lengthSQ, 0.0f, 1.0f) : 0.0f;
+    return ccpDistanceSQ(point, ccpAdd(a, ccpMult(ab, t)));
+}
+
+static bool polygonContainsPoint(const std::vector<CCPoint> &polygon, CCPoint point)
+{
+    bool inside = false;
+    for (unsigned int i = 0, j = (unsigned int)polygon.size() - 1; i < polygon.size(); j = i++)
+    {
+        const CCPoint &a = polygon[i];
+        const CCPoint &b = polygon[j];
+        if ((a.y > point.y) != (b.y > point.y) && point.x < (b.x - a.x) * (point.y - a.y) / (b.y - a.y) + a.x)
+        {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+StrokeIndex::StrokeIndex()
+: cellSize(0)
+, columns(0)
+, rows(0)
+, recordCount(0)
+, queryCounter(0)
+{
+}
+
+StrokeIndex::~StrokeIndex()
+{
+    removeAll();
+}
+
+void StrokeIndex::initWithBounds(const CCRect &aCanvasBounds, float aCellSize)
+{
+    removeAll();
+    canvasBounds = aCanvasBounds;
+    cellSize = aCellSize;
+    columns = MAX(1, (int)ceilf(canvasBounds.size.width / cellSize));
+    rows = MAX(1, (int)ceilf(canvasBounds.size.height / cellSize));
+    cells.clear();
+    cells.resize(columns * rows);
+}
+
+unsigned int StrokeIndex::insert(unsigned int layerID, const StrokeStyle &style, const StrokeSymmetry &symmetry, const std::vector<LinePoint> &points,
+                                 float overdraw)
+{
+    CCAssert(!points.empty(), "stroke without points");
+    CCAssert(!cells.empty(), "index used before initWithBounds");
+
+    StrokeRecord *record = new StrokeRecord();
+    record->strokeID = (unsigned int)records.size() + 1;
+    record->layerID = layerID;
+    record->style = style;
+    record->symmetry = symmetry;
+    record->points = points;
+    record->fillScale = 1.0f;
+    record->queryMark = 0;
+
+    float minX = points[0].pos.x, maxX = minX;
+    float minY = points[0].pos.y, maxY = minY;
+    float maxWidth = 0;
+    for (unsigned int i = 0; i < points.size(); ++i)
+    {
+        minX = MIN(minX, points[i].pos.x);
+        maxX = MAX(maxX, points[i].pos.x);
+        minY = MIN(minY, points[i].pos.y);
+        maxY = MAX(maxY, points[i].pos.y);
+        maxWidth = MAX(maxWidth, points[i].width);
+    }
+    //! the same margin the stroke culls and bounds its ink with, miter tips reach furthest
+    float margin = StrokeInkMargin(style, maxWidth, overdraw);
+    record->bounds = StrokeSymmetryBounds(symmetry, CCRectMake(minX - margin, minY - margin, maxX - minX + margin * 2, maxY - minY + margin * 2));
+    return add(record);
+}
+
+unsigned int StrokeIndex::insertFill(unsigned int layerID, const StrokeStyle &style, const std::vector<CanvasFillSpan> &spans, ccColor4B seed,
+                                     float pixelsPerPoint)
+{
+    CCAssert(!spans.empty(), "fill without spans");
+    CCAssert(!cells.empty(), "index used before initWithBounds");
+
+    StrokeRecord *record = new StrokeRecord();
+    record->strokeID = (unsigned int)records.size() + 1;
+    record->layerID = layerID;
+    record->style = style;
+    record->symmetry = StrokeSymmetryNone();
+    record->fill = spans;
+    record->fillSeed = seed;
+    record->fillScale = pixelsPerPoint;
+    record->queryMark = 0;
+
+    //! spans are sorted by row
+    unsigned int minX = spans[0].x0, maxX = spans[0].x1;
+    for (unsigned int i = 1; i < spans.size(); ++i)
+    {
+        minX = MIN(minX, (unsigned int)spans[i].x0);
+        maxX = MAX(maxX, (unsigned int)spans[i].x1);
+    }
+    unsigned int minY = spans.front().y, maxY = spans.back().y + 1;
+    record->bounds = CCRectMake(minX / pixelsPerPoint, minY / pixelsPerPoint, (maxX - minX) / pixelsPerPoint, (maxY - minY) / pixelsPerPoint);
+    return add(record);
+}
+
+unsigned int StrokeIndex::add(StrokeRecord *record)
+{
+    records.push_back(record);
+    ++recordCount;
+
+    int cellMinX, cellMinY, cellMaxX, cellMaxY;
+    cellRangeForRect(record->bounds, cellMinX, cellMinY, cellMaxX, cellMaxY);
+    for (int y = cellMinY; y <= cellMaxY; ++y)
+    {
+        for (int x = cellMinX; x <= cellMaxX; ++x)
+        {
+            cells[y * columns + x].push_back(record->strokeID);
+        }
+    }
+    return record->strokeID;
+}
+
+void StrokeIndex::remove(unsigned int strokeID)
+{
+    if (strokeID == 0 || strokeID > records.size() || records[strokeID - 1] == NULL)
+    {
+        return;
+    }
+
+    StrokeRecord *record = records[strokeID - 1];
+    int cellMinX, cellMinY, cellMaxX, cellMaxY;
+    cellRangeForRect(record->bounds, cellMinX, cellMinY, cellMaxX, cellMaxY);
+    for (int y = cellMinY; y <= cellMaxY; ++y)
+    {
+        for (int x = cellMinX; x <= cellMaxX; ++x)
+        {
+            std::vector<unsigned int> &cell = cells[y * columns + x];
+            cell.erase(std::remove(cell.begin(), cell.end(), strokeID), cell.end());
+        }
+    }
+
+    delete record;
+    records[strokeID - 1] = NULL;
+    --recordCount;
+}
+
+void StrokeIndex::removeAll()
+{
+    for (unsigned int i = 0; i < records.size(); ++i)
+    {
+        delete records[i];
+    }
+    records.clear();
+    for (unsigned int i = 0; i < cells.size(); ++i)
+    {
+        cells[i].clear();
+    }
+    recordCount = 0;
+}
+
+const StrokeRecord *StrokeIndex::recordForID(unsigned int strokeID) const
+{
+    if (strokeID == 0 || strokeID > records.size())
+    {
+        return NULL;
+    }
+    return records[strokeID - 1];
+}
+
+StrokeRecord *StrokeIndex::recordForID(unsigned int strokeID)
+{
+    if (strokeID == 0 || strokeID > records.size())
+    {
+        return NULL;
+    }
+    return records[strokeID - 1];
+}
+
+unsigned int StrokeIndex::count() const
+{
+    return recordCount;
+}
+
+unsigned int StrokeIndex::getLastStrokeID() const
+{
+    return (unsigned int)records.size();
+}
+
+void StrokeIndex::cellRangeForRect(const CCRect &rect, int &minX, int &minY, int &maxX, int &maxY) const
+{
+    minX = (int)floorf((rect.getMinX() - canvasBounds.getMinX()) / cellSize);
+    minY = (int)floorf((rect.getMinY() - canvasBounds.getMinY()) / cellSize);
+    maxX = (int)floorf((rect.getMaxX() - canvasBounds.getMinX()) / cellSize);
+    maxY = (int)floorf((rect.getMaxY() - canvasBounds.getMinY()) / cellSize);
+
+    minX = MIN(MAX(minX, 0), columns - 1);
+    minY = MIN(MAX(minY, 0), rows - 1);
+    maxX = MIN(MAX(maxX, 0), columns - 1);
+    maxY = MIN(MAX(maxY, 0), rows - 1);
+}
+
+void StrokeIndex::collect(const CCRect &rect, std::vector<unsigned int> &result) const
+{
+    result.clear();
+    if (cells.empty())
+    {
+        return;
+    }
+
+    unsigned int mark = ++queryCounter;
+    int cellMinX, cellMinY, cellMaxX, cellMaxY;
+    cellRangeForRect(rect, cellMinX, cellMinY, cellMaxX, cellMaxY);
+    for (int y = cellMinY; y <= cellMaxY; ++y)
+    {
+        for (int x = cellMinX; x <= cellMaxX; ++x)
+        {
+            const std::vector<unsigned int> &cell = cells[y * columns + x];
+            for (unsigned int i = 0; i < cell.size(); ++i)
+            {
+                const StrokeRecord *record = records[cell[i] - 1];
+                if (record->queryMark != mark && record->bounds.intersectsRect(rect))
+                {
+                    record->queryMark = mark;
+                    result.push_back(record->strokeID);
+                }
+            }
+        }
+    }
+    std::sort(result.begin(), result.end());
+}
+
+//! tip of the miter join the tessellator puts at the corner b between a and c, false if it puts none
+static bool miterTip(const StrokeStyle &style, const LinePoint &a, const LinePoint &b, const LinePoint &c, CCPoint &tip)
+{
+    float shorterLengthSQ = MIN(ccpDistanceSQ(a.pos, b.pos), ccpDistanceSQ(b.pos, c.pos));
+    if (shorterLengthSQ <= 0.0f)
+    {
+        return false;
+    }
+    CCPoint fromPerpendicular = StrokeGeometryCore::perpendicular(a.pos, b.pos);
+    CCPoint toPerpendicular = StrokeGeometryCore::perpendicular(b.pos, c.pos);
+    float halfWidth = b.width / 2;
+    if (!StrokeIsSharpTurn(fromPerpendicular, toPerpendicular, halfWidth, shorterLengthSQ))
+    {
+        return false;
+    }
+    
+    //! on the outer side, along the bisector, beyond the limit it is beveled off
+    float side = ccpCross(fromPerpendicular, toPerpendicular) > 0.0f ? -1.0f : 1.0f;
+    CCPoint fromDir = ccpMult(fromPerpendicular, side);
+    CCPoint bisector = StrokeGeometryCore::direction(CCPointZero, ccpAdd(fromDir, ccpMult(toPerpendicular, side)));
+    float cosHalfTurn = ccpDot(bisector, fromDir);
+    if (cosHalfTurn * style.miterLimit < 1.0f)
+    {
+        return false;
+    }
+    tip = ccpAdd(b.pos, ccpMult(bisector, halfWidth / cosHalfTurn));
+    return true;
+}
+
+static bool recordPassesNear(const StrokeRecord *record, CCPoint point, float tolerance)
+{
+    if (!record->fill.empty())
+    {
+        CCPoint pixel = ccpMult(point, record->fillScale);
+        return pixel.x >= 0 && pixel.y >= 0 && CanvasFill::spansContain(record->fill, (unsigned int)pixel.x, (unsigned int)pixel.y);
+    }
+
+    //! a copy passes near point where the stroke itself passes near point mapped back
+    const std::vector<LinePoint> &points = StrokeRecordOutline(*record);
+    for (unsigned int copy = 0; copy < StrokeSymmetryCopyCount(record->symmetry); ++copy)
+    {
+        CCPoint strokePoint = copy == 0 ? point : CCPointApplyAffineTransform(point, CCAffineTransformInvert(StrokeSymmetryTransform(record->symmetry, copy)));
+        for (unsigned int j = 0; j < points.size(); ++j)
+        {
+            const LinePoint &a = points[j];
+            const LinePoint &b = points[j + 1 < points.size() ? j + 1 : j];
+            float reach = MAX(a.width, b.width) * 0.5f + tolerance;
+            if (distanceToSegmentSQ(strokePoint, a.pos, b.pos) <= reach * reach)
+            {
+                return true;
+            }
+            //! miter tips reach past the half width, the spine from the corner to the tip covers them
+            CCPoint tip;
+            if (record->style.join == kStrokeJoinMiter && j > 0 && j + 1 < points.size()
+                && miterTip(record->style, points[j - 1], a, b, tip) && distanceToSegmentSQ(strokePoint, a.pos, tip) <= tolerance * tolerance)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void StrokeIndex::hitTestAll(CCPoint point, float tolerance, std::vector<unsigned int> &result) const
+{
+    std::vector<unsigned int> candidates;
+    collect(CCRectMake(point.x - tolerance, point.y - tolerance, tolerance * 2, tolerance * 2), candidates);
+
+    result.clear();
+    for (unsigned int i = 0; i < candidates.size(); ++i)
+    {
+        const StrokeRecord *record = records[candidates[i] - 1];
+        if (recordPassesNear(record, point, tolerance))
+        {
+            result.push_back(record->strokeID);
+        }
+    }
+}
+
+void StrokeIndex::queryRect(const CCRect &rect, std::vector<unsigned int> &result) const
+{
+    collect(rect, result);
+}
+
+void StrokeIndex::queryLasso(const std::vector<CCPoint> &lasso, std::vector<unsigned int> &result) const
+{
+    result.clear();
+    if (lasso.size() < 3)
+    {
+        return;
+    }
+
+    float minX = lasso[0].x, maxX = minX;
+    float minY = lasso[0].y, maxY = minY;
+    for (unsigned int i = 1; i < lasso.size(); ++i)
+    {
+        minX = MIN(minX, lasso[i].x);
+        maxX = MAX(maxX, lasso[i].x);
+        minY = MIN(minY, lasso[i].y);
+        maxY = MAX(maxY, lasso[i].y);
+    }
+    CCRect lassoBounds = CCRectMake(minX, minY, maxX - minX, maxY - minY);
+
+    std::vector<unsigned int> candidates;
+    collect(lassoBounds, candidates);
+    for (unsigned int i = 0; i < candidates.size(); ++i)
+    {
+        const StrokeRecord *record = records[candidates[i] - 1];
+        const std::vector<LinePoint> &points = StrokeRecordOutline(*record);
+        bool inside = true;
+        for (unsigned int copy = 0; copy < StrokeSymmetryCopyCount(record->symmetry) && inside; ++copy)
+        {
+            CCAffineTransform transform = StrokeSymmetryTransform(record->symmetry, copy);
+            for (unsigned int j = 0; j < points.size() && inside; ++j)
+            {
+                CCPoint position = CCPointApplyAffineTransform(points[j].pos, transform);
+                inside = lassoBounds.containsPoint(position) && polygonContainsPoint(lasso, position);
+            }
+        }
+        if (!record->fill.empty())
+        {
+            //! a fill is taken when its bounds are
+            const CCRect &bounds = record->bounds;
+            CCPoint corners[4] = { ccp(bounds.getMinX(), bounds.getMinY()), ccp(bounds.getMaxX(), bounds.getMinY()),
+                                   ccp(bounds.getMaxX(), bounds.getMaxY()), ccp(bounds.getMinX(), bounds.getMaxY()) };
+            for (unsigned int j = 0; j < 4 && inside; ++j)
+            {
+                inside = polygonContainsPoint(lasso, corners[j]);
+            }
+        }
+        if (inside)
+        {
+            result.push_back(record->strokeID);
+        }
+    }
+}
@@ -0,0 +1,119 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_INDEX_H_
+#define _STROKE_INDEX_H_
+
+#include "cocos2d.h"
+#include "StrokeTessellator.h"
+#include "CanvasFill.h"
+#include <vector>
+
+USING_NS_CC;
+
+//! a committed stroke kept as vector data, enough to rasterize it again
+typedef struct _StrokeRecord {
+    unsigned int strokeID;
+    //! canvas layer the stroke was drawn on
+    unsigned int layerID;
+    StrokeStyle style;
+    //! copies drawn along with the stroke, none for fills
+    StrokeSymmetry symmetry;
+    //! every point the stroke was fed with, in order, released once the curve is fitted
+    std::vector<LinePoint> points;
+    //! smoothed stroke fitted by StrokeCurveFitter, empty until the fit is done
+    std::vector<LinePoint> curve;
+    //! simplified smoothed polylines, index with StrokeSimplifier::levelForScale
+    std::vector<std::vector<LinePoint> > levels;
+    //! pixels of a bucket fill, a record with spans is a fill and has no points
+    std::vector<CanvasFillSpan> fill;
+    //! canvas color the fill replaced
+    ccColor4B fillSeed;
+    //! canvas pixels per point the spans were found at
+    float fillScale;
+    //! covers the ink including caps, overdraw and copies
+    CCRect bounds;
+    //! last query that reported this record, avoids duplicates from multiple cells
+    mutable unsigned int queryMark;
+} StrokeRecord;
+
+//! polyline that follows the ink of record, level 0 once built and the input points before
+inline const std::vector<LinePoint> &StrokeRecordOutline(const StrokeRecord &record)
+{
+    return record.levels.empty() || record.levels[0].empty() ? record.points : record.levels[0];
+}
+
+/**
+ Committed strokes bucketed into a uniform grid over the canvas.
+
+ Stroke ids grow with every insert, so ids sorted ascending are in drawing order.
+ Geometry outside the canvas is clamped into the border cells.
+ */
+class StrokeIndex
+{
+public:
+    StrokeIndex();
+    ~StrokeIndex();
+
+    void initWithBounds(const CCRect &canvasBounds, float aCellSize);
+
+    //! stores a finished stroke, returns its new id
+    unsigned int insert(unsigned int layerID, const StrokeStyle &style, const StrokeSymmetry &symmetry, const std::vector<LinePoint> &points,
+                        float overdraw);
+    //! stores a bucket fill of the canvas pixels in spans, returns its new id
+    unsigned int insertFill(unsigned int layerID, const StrokeStyle &style, const std::vector<CanvasFillSpan> &spans, ccColor4B seed,
+                            float pixelsPerPoint);
+    void remove(unsigned int strokeID);
+    void removeAll();
+
+    const StrokeRecord *recordForID(unsigned int strokeID) const;
+    StrokeRecord *recordForID(unsigned int strokeID);
+    unsigned int count() const;
+    //! highest id handed out so far, ids of removed strokes are not reused
+    unsigned int getLastStrokeID() const;
+
+    //! every stroke or fill whose ink passes within tolerance of point, in drawing order
+    void hitTestAll(CCPoint point, float tolerance, std::vector<unsigned int> &result) const;
+    //! strokes whose bounds intersect rect, in drawing order
+    void queryRect(const CCRect &rect, std::vector<unsigned int> &result) const;
+    //! strokes lying completely inside the closed polygon lasso, in drawing order
+    void queryLasso(const std::vector<CCPoint> &lasso, std::vector<unsigned int> &result) const;
+
+private:
+    unsigned int add(StrokeRecord *record);
+    void cellRangeForRect(const CCRect &rect, int &minX, int &minY, int &maxX, int &maxY) const;
+    void collect(const CCRect &rect, std::vector<unsigned int> &result) const;
+
+    std::vector<StrokeRecord *> records;
+    std::vector<std::vector<unsigned int> > cells;
+    CCRect canvasBounds;
+    float cellSize;
+    int columns;
+    int rows;
+    unsigned int recordCount;
+    mutable unsigned int queryCounter;
+};
+
+#endif // _STROKE_INDEX_H_
@@ -0,0 +1,267 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeMeshCache.h"
+#include "StrokeTessellator.h"
+
+static inline GLubyte colorComponentToByte(float component)
+{
+    return (GLubyte)(clampf(component, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+StrokeMeshCache::StrokeMeshCache()
+: memoryBudget(16 * 1024 * 1024)
+, memoryUsed(0)
+{
+}
+
+StrokeMeshCache::~StrokeMeshCache()
+{
+    removeAll();
+}
+
+void StrokeMeshCache::setMemoryBudget(unsigned int bytes)
+{
+    memoryBudget = bytes;
+    evictToBudget();
+}
+
+unsigned int StrokeMeshCache::getMemoryBudget() const
+{
+    return memoryBudget;
+}
+
+unsigned int StrokeMeshCache::getMemoryUsed() const
+{
+    return memoryUsed;
+}
+
+unsigned int StrokeMeshCache::sizeOfMesh(const StrokeMesh *mesh)
+{
+    return (unsigned int)(sizeof(StrokeMesh) + mesh->vertices.capacity() * sizeof(StrokeMeshVertex));
+}
+
+static void appendFillQuad(std::vector<StrokeMeshVertex> &vertices, const CanvasFillSpan &span, float pointsPerPixel, ccColor4B color)
+{
+    GLfloat x0 = span.x0 * pointsPerPixel, x1 = span.x1 * pointsPerPixel;
+    GLfloat y0 = span.y * pointsPerPixel, y1 = (span.y + 1) * pointsPerPixel;
+    StrokeMeshVertex corners[4] = { { x0, y0, 0, color }, { x1, y0, 0, color }, { x0, y1, 0, color }, { x1, y1, 0, color } };
+    vertices.push_back(corners[0]);
+    vertices.push_back(corners[1]);
+    vertices.push_back(corners[2]);
+    vertices.push_back(corners[1]);
+    vertices.push_back(corners[3]);
+    vertices.push_back(corners[2]);
+}
+
+StrokeMesh *StrokeMeshCache::buildFillMesh(const StrokeRecord &record, const StrokeBatch &batch)
+{
+    int shift[4];
+    CanvasFill::shiftForStyle(record.fillSeed, record.style, batch, shift);
+
+    //! channels moving up are added, those moving down subtracted in a second pass
+    std::vector<StrokeMeshVertex> subtracted;
+    StrokeMesh *mesh = new StrokeMesh();
+    mesh->style = record.style;
+    mesh->style.blendMode = kStrokeBlendAdd;
+    mesh->needsIsolation = false;
+    float pointsPerPixel = 1.0f / record.fillScale;
+    for (unsigned int i = 0; i < record.fill.size(); ++i)
+    {
+        const CanvasFillSpan &span = record.fill[i];
+        GLubyte added[4], removed[4];
+        for (unsigned int channel = 0; channel < 4; ++channel)
+        {
+            GLubyte magnitude = CanvasFill::shiftForCoverage(shift[channel], span.coverage);
+            added[channel] = shift[channel] > 0 ? magnitude : 0;
+            removed[channel] = shift[channel] < 0 ? magnitude : 0;
+        }
+        if (added[0] | added[1] | added[2] | added[3])
+        {
+            appendFillQuad(mesh->vertices, span, pointsPerPixel, ccc4(added[0], added[1], added[2], added[3]));
+        }
+        if (removed[0] | removed[1] | removed[2] | removed[3])
+        {
+            appendFillQuad(subtracted, span, pointsPerPixel, ccc4(removed[0], removed[1], removed[2], removed[3]));
+        }
+    }
+    mesh->subtractFirst = (unsigned int)mesh->vertices.size();
+    mesh->vertices.insert(mesh->vertices.end(), subtracted.begin(), subtracted.end());
+    return mesh;
+}
+
+void StrokeMeshCache::tessellateStroke(const StrokeRecord &record, unsigned int level, float overdraw, const StrokeQuality &quality,
+                                       StrokeBatch &scratch, std::vector<StrokeMeshVertex> &vertices)
+{
+    scratch.clear();
+
+    //! a plain tessellator, no reference counting on the threads of the bulk loader
+    StrokeTessellator stroke;
+    if (level < record.levels.size())
+    {
+        stroke.initWithStyle(record.style);
+        stroke.overdraw = overdraw;
+        stroke.quality = quality;
+        stroke.tessellateSmoothed(record.levels[level], &scratch);
+    }
+    else
+    {
+        stroke.initWithPoints(record.style, record.points);
+        stroke.overdraw = overdraw;
+        stroke.quality = quality;
+        stroke.tessellate(&scratch);
+    }
+
+    const std::vector<LineVertex> &lineVertices = scratch.getVertices();
+    unsigned int copies = StrokeSymmetryCopyCount(record.symmetry);
+    unsigned int strokeFirst = (unsigned int)vertices.size();
+    unsigned int needed = strokeFirst + (unsigned int)lineVertices.size() * copies;
+    if (vertices.capacity() < needed)
+    {
+        vertices.reserve(MAX(needed, (unsigned int)vertices.capacity() * 2));
+    }
+    vertices.resize(strokeFirst + lineVertices.size());
+    for (unsigned int i = 0; i < lineVertices.size(); ++i)
+    {
+        const LineVertex &source = lineVertices[i];
+        StrokeMeshVertex &target = vertices[strokeFirst + i];
+        target.x = source.pos.x;
+        target.y = source.pos.y;
+        target.z = source.z;
+        target.color = ccc4(colorComponentToByte(source.color.r), colorComponentToByte(source.color.g),
+                            colorComponentToByte(source.color.b), colorComponentToByte(source.color.a));
+    }
+    //! tessellated once, the copies are the same vertices transformed
+    unsigned int strokeVertexCount = (unsigned int)lineVertices.size();
+    for (unsigned int copy = 1; copy < copies; ++copy)
+    {
+        CCAffineTransform transform = StrokeSymmetryTransform(record.symmetry, copy);
+        for (unsigned int i = 0; i < strokeVertexCount; ++i)
+        {
+            StrokeMeshVertex vertex = vertices[strokeFirst + i];
+            CCPoint position = CCPointApplyAffineTransform(ccp(vertex.x, vertex.y), transform);
+            vertex.x = position.x;
+            vertex.y = position.y;
+            vertices.push_back(vertex);
+        }
+    }
+    scratch.clear();
+}
+
+StrokeMesh *StrokeMeshCache::buildMesh(const StrokeRecord &record, unsigned int level, float overdraw, const StrokeBatch &batch)
+{
+    if (!record.fill.empty())
+    {
+        return buildFillMesh(record, batch);
+    }
+
+    StrokeMesh *mesh = new StrokeMesh();
+    mesh->style = record.style;
+    mesh->needsIsolation = batch.styleNeedsIsolation(record.style);
+    scratchBatch.setPaperColor(batch.getPaperColor());
+    tessellateStroke(record, level, overdraw, StrokeQualityDefault(), scratchBatch, mesh->vertices);
+    mesh->subtractFirst = (unsigned int)mesh->vertices.size();
+    return mesh;
+}
+
+const StrokeMesh *StrokeMeshCache::meshForRecord(const StrokeRecord &record, unsigned int level, float overdraw, const StrokeBatch &batch)
+{
+    Key key(record.strokeID, record.fill.empty() ? level : 0);
+    std::map<Key, Entry>::iterator found = entries.find(key);
+    if (found != entries.end())
+    {
+        usage.splice(usage.begin(), usage, found->second.usage);
+        return found->second.mesh;
+    }
+
+    Entry entry;
+    entry.mesh = buildMesh(record, level, overdraw, batch);
+    usage.push_front(key);
+    entry.usage = usage.begin();
+    entries[key] = entry;
+    memoryUsed += sizeOfMesh(entry.mesh);
+
+    //! the mesh just built stays even if it alone exceeds the budget, the caller is about to use it
+    evictToBudget();
+    return entry.mesh;
+}
+
+void StrokeMeshCache::drawRecord(const StrokeRecord &record, unsigned int level, float overdraw, StrokeBatch *batch)
+{
+    const StrokeMesh *mesh = meshForRecord(record, level, overdraw, *batch);
+    if (mesh->vertices.empty())
+    {
+        return;
+    }
+    GLint stencilRef = mesh->needsIsolation ? batch->nextStencilRef() : 0;
+    if (mesh->subtractFirst > 0)
+    {
+        batch->appendMesh(&mesh->vertices[0], mesh->subtractFirst, batch->stateForStyle(mesh->style, stencilRef));
+    }
+    if (mesh->subtractFirst < mesh->vertices.size())
+    {
+        StrokeBatchState subtract = { kStrokeBlendSubtract, 0 };
+        batch->appendMesh(&mesh->vertices[mesh->subtractFirst], (unsigned int)mesh->vertices.size() - mesh->subtractFirst, subtract);
+    }
+}
+
+bool StrokeMeshCache::contains(unsigned int strokeID, unsigned int level) const
+{
+    return entries.find(Key(strokeID, level)) != entries.end();
+}
+
+void StrokeMeshCache::invalidate(unsigned int strokeID)
+{
+    std::map<Key, Entry>::iterator it = entries.lower_bound(Key(strokeID, 0));
+    while (it != entries.end() && it->first.first == strokeID)
+    {
+        memoryUsed -= sizeOfMesh(it->second.mesh);
+        delete it->second.mesh;
+        usage.erase(it->second.usage);
+        entries.erase(it++);
+    }
+}
+
+void StrokeMeshCache::removeAll()
+{
+    for (std::map<Key, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        delete it->second.mesh;
+    }
+    entries.clear();
+    usage.clear();
+    memoryUsed = 0;
+}
+
+void StrokeMeshCache::evictToBudget()
+{
+    while (memoryUsed > memoryBudget && usage.size() > 1)
+    {
+        std::map<Key, Entry>::iterator it = entries.find(usage.back());
+        memoryUsed -= sizeOfMesh(it->second.mesh);
+        delete it->second.mesh;
+        entries.erase(it);
+        usage.pop_back();
+    }
+}
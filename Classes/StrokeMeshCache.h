@@ -0,0 +1,103 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_MESH_CACHE_H_
+#define _STROKE_MESH_CACHE_H_
+
+#include "cocos2d.h"
+#include "StrokeBatch.h"
+#include "StrokeIndex.h"
+#include <list>
+#include <map>
+#include <vector>
+
+USING_NS_CC;
+
+//! tessellated triangles of one committed stroke at one detail level
+typedef struct _StrokeMesh {
+    std::vector<StrokeMeshVertex> vertices;
+    StrokeStyle style;
+    bool needsIsolation;
+    //! vertices from here on are subtracted from the canvas, the end of vertices for strokes
+    unsigned int subtractFirst;
+} StrokeMesh;
+
+/**
+ Keeps the tessellation of committed strokes so drawing them again is a copy into the
+ batch instead of smoothing and tessellating.
+
+ Meshes are keyed by stroke id and detail level (which follows from the canvas resolution)
+ and evicted least recently used first once the byte budget is exceeded. They are always
+ sampled at StrokeQualityDefault(), what they draw stays on the canvas at any quality tier.
+ */
+class StrokeMeshCache
+{
+public:
+    StrokeMeshCache();
+    ~StrokeMeshCache();
+
+    void setMemoryBudget(unsigned int bytes);
+    unsigned int getMemoryBudget() const;
+    unsigned int getMemoryUsed() const;
+
+    //! cached mesh, tessellated with the paper color and overdraw of batch on a miss
+    const StrokeMesh *meshForRecord(const StrokeRecord &record, unsigned int level, float overdraw, const StrokeBatch &batch);
+    //! appends the mesh for record to batch, allocating a stencil value when the stroke needs one
+    void drawRecord(const StrokeRecord &record, unsigned int level, float overdraw, StrokeBatch *batch);
+
+    /**
+     tessellates the stroke of record into scratch, whose paper color must be that of the canvas it
+     is drawn on, and appends the mesh vertices with all symmetry copies to vertices. Uses nothing
+     but its arguments, worker threads can call it with a scratch batch of their own.
+     */
+    static void tessellateStroke(const StrokeRecord &record, unsigned int level, float overdraw, const StrokeQuality &quality,
+                                 StrokeBatch &scratch, std::vector<StrokeMeshVertex> &vertices);
+
+    bool contains(unsigned int strokeID, unsigned int level) const;
+    void invalidate(unsigned int strokeID);
+    void removeAll();
+
+private:
+    typedef std::pair<unsigned int, unsigned int> Key;
+    typedef struct _Entry {
+        StrokeMesh *mesh;
+        std::list<Key>::iterator usage;
+    } Entry;
+
+    StrokeMesh *buildMesh(const StrokeRecord &record, unsigned int level, float overdraw, const StrokeBatch &batch);
+    //! quads over the spans shifting the canvas from the seed color to the fill, same for every level
+    StrokeMesh *buildFillMesh(const StrokeRecord &record, const StrokeBatch &batch);
+    static unsigned int sizeOfMesh(const StrokeMesh *mesh);
+    void evictToBudget();
+
+    std::map<Key, Entry> entries;
+    //! most recently used first
+    std::list<Key> usage;
+    unsigned int memoryBudget;
+    unsigned int memoryUsed;
+    StrokeBatch scratchBatch;
+};
+
+#endif // _STROKE_MESH_CACHE_H_
@@ -0,0 +1,335 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeOutline.h"
+#include "StrokeGeometry.h"
+#include <algorithm>
+
+//! coverage from which a feathered fill pixel counts as inside, the outline runs through the middle of the edge
+#define kStrokeOutlineFillCoverage 128
+
+static bool fillSpanColumnOrder(const CanvasFillSpan &a, const CanvasFillSpan &b)
+{
+    if (a.x0 != b.x0)
+    {
+        return a.x0 < b.x0;
+    }
+    if (a.x1 != b.x1)
+    {
+        return a.x1 < b.x1;
+    }
+    return a.y < b.y;
+}
+
+//! quad a, c, d, b turning clockwise at every corner, its outline then covers what triangles abc and bcd do
+static bool isConvexClockwise(const CCPoint &a, const CCPoint &b, const CCPoint &c, const CCPoint &d)
+{
+    const CCPoint corners[4] = { a, c, d, b };
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        const CCPoint &from = corners[i];
+        const CCPoint &corner = corners[(i + 1) % 4];
+        const CCPoint &to = corners[(i + 2) % 4];
+        if (ccpCross(ccpSub(corner, from), ccpSub(to, corner)) > 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StrokeOutline::addStroke(const std::vector<LinePoint> &linePoints, const StrokeStyle &style, StrokeOutlinePath &path)
+{
+    if (linePoints.size() < 2)
+    {
+        return;
+    }
+    
+    //! the same walk as drawLines for a line that neither continues nor is continued
+    std::vector<CCPoint> left;
+    std::vector<CCPoint> right;
+    LinePoint startCap;
+    CCPoint startDir;
+    bool hasStartCap = false;
+    bool continuing = false;
+    CCPoint prevPoint = linePoints[0].pos;
+    float prevValue = linePoints[0].width;
+    CCPoint prevPerpendicular;
+    float prevSegmentLengthSQ = 0;
+    for (unsigned int i = 1; i < linePoints.size(); ++i)
+    {
+        const LinePoint &pointValue = linePoints[i];
+        CCPoint curPoint = pointValue.pos;
+        float curValue = pointValue.width;
+        
+        float segmentLengthSQ = ccpLengthSQ(ccpSub(curPoint, prevPoint));
+        if (segmentLengthSQ < 0.0001f * 0.0001f
+            || (segmentLengthSQ < kStrokeMinSegmentLength * kStrokeMinSegmentLength && i < linePoints.size() - 1))
+        {
+            continue;
+        }
+        
+        CCPoint perpendicular = StrokeGeometryCore::perpendicular(prevPoint, curPoint);
+        CCPoint A = ccpAdd(prevPoint, ccpMult(perpendicular, prevValue / 2));
+        CCPoint B = ccpSub(prevPoint, ccpMult(perpendicular, prevValue / 2));
+        CCPoint C = ccpAdd(curPoint, ccpMult(perpendicular, curValue / 2));
+        CCPoint D = ccpSub(curPoint, ccpMult(perpendicular, curValue / 2));
+        
+        bool sharpTurn = continuing && StrokeIsSharpTurn(prevPerpendicular, perpendicular, prevValue / 2, MIN(segmentLengthSQ, prevSegmentLengthSQ));
+        if (sharpTurn)
+        {
+            addRun(left, right, hasStartCap ? &startCap : NULL, startDir, NULL, startDir, path);
+            addJoin(prevPoint, prevValue / 2, prevPerpendicular, perpendicular, style, path);
+            hasStartCap = false;
+            left.clear();
+            right.clear();
+        }
+        else if (continuing)
+        {
+            A = left.back();
+            B = right.back();
+        }
+        else
+        {
+            startCap = linePoints[i - 1];
+            startDir = StrokeGeometryCore::direction(pointValue.pos, linePoints[i - 1].pos);
+            hasStartCap = true;
+        }
+        continuing = true;
+        prevPerpendicular = perpendicular;
+        prevSegmentLengthSQ = segmentLengthSQ;
+        prevPoint = curPoint;
+        prevValue = curValue;
+        
+        //! a run outlines the sum of its quads, one folded over its neighbours would cancel their ink out
+        if (isConvexClockwise(A, B, C, D))
+        {
+            if (left.empty())
+            {
+                left.push_back(A);
+                right.push_back(B);
+            }
+            left.push_back(C);
+            right.push_back(D);
+        }
+        else
+        {
+            if (left.empty())
+            {
+                left.push_back(A);
+                right.push_back(B);
+            }
+            addRun(left, right, hasStartCap ? &startCap : NULL, startDir, NULL, startDir, path);
+            hasStartCap = false;
+            
+            const CCPoint triangles[6] = { A, B, C, B, C, D };
+            for (unsigned int j = 0; j < 6; j += 3)
+            {
+                unsigned int first = (unsigned int)path.points.size();
+                path.points.insert(path.points.end(), triangles + j, triangles + j + 3);
+                closeContour(first, path);
+            }
+            left.assign(1, C);
+            right.assign(1, D);
+        }
+        
+        if (i == linePoints.size() - 1)
+        {
+            CCPoint endDir = StrokeGeometryCore::direction(linePoints[i - 1].pos, pointValue.pos);
+            addRun(left, right, hasStartCap ? &startCap : NULL, startDir, &pointValue, endDir, path);
+            left.clear();
+        }
+    }
+    //! the last points were too close to draw, drawLines leaves the end without a cap then
+    if (!left.empty())
+    {
+        addRun(left, right, hasStartCap ? &startCap : NULL, startDir, NULL, startDir, path);
+    }
+}
+
+void StrokeOutline::addRun(const std::vector<CCPoint> &left, const std::vector<CCPoint> &right, const LinePoint *startCap, const CCPoint &startDir,
+                           const LinePoint *endCap, const CCPoint &endDir, StrokeOutlinePath &path)
+{
+    unsigned int first = (unsigned int)path.points.size();
+    path.points.insert(path.points.end(), left.begin(), left.end());
+    //! a cap turns clockwise from the left of its direction, from the left side over the end to the right one
+    if (endCap != NULL)
+    {
+        addCap(*endCap, endDir, path.points);
+    }
+    path.points.insert(path.points.end(), right.rbegin(), right.rend());
+    //! pointing backwards, its left is the right side
+    if (startCap != NULL)
+    {
+        addCap(*startCap, startDir, path.points);
+    }
+    closeContour(first, path);
+}
+
+void StrokeOutline::addCap(const LinePoint &center, const CCPoint &lineDir, std::vector<CCPoint> &points)
+{
+    CCPoint directions[kStrokeCapDirections];
+    StrokeGeometryCore::capDirections(lineDir, kStrokeCapDirections, directions);
+    float radius = center.width * kStrokeCapRadius;
+    for (unsigned int i = 0; i < kStrokeCapDirections; ++i)
+    {
+        points.push_back(ccpAdd(center.pos, ccpMult(directions[i], radius)));
+    }
+}
+
+void StrokeOutline::addJoin(CCPoint center, float halfWidth, CCPoint fromPerpendicular, CCPoint toPerpendicular, const StrokeStyle &style,
+                            StrokeOutlinePath &path)
+{
+    float cross = ccpCross(fromPerpendicular, toPerpendicular);
+    float side = cross > 0.0f ? -1.0f : 1.0f;
+    CCPoint fromDir = ccpMult(fromPerpendicular, side);
+    CCPoint toDir = ccpMult(toPerpendicular, side);
+    
+    StrokeJoin join = style.join;
+    CCPoint miter;
+    if (join == kStrokeJoinMiter)
+    {
+        CCPoint bisector = StrokeGeometryCore::direction(CCPointZero, ccpAdd(fromDir, toDir));
+        float cosHalfTurn = ccpDot(bisector, fromDir);
+        if (cosHalfTurn * style.miterLimit < 1.0f)
+        {
+            join = kStrokeJoinBevel;
+        }
+        else
+        {
+            miter = ccpAdd(center, ccpMult(bisector, halfWidth / cosHalfTurn));
+        }
+    }
+    if (join == kStrokeJoinBevel && fabsf(cross) < 0.001f)
+    {
+        return;
+    }
+    
+    unsigned int first = (unsigned int)path.points.size();
+    path.points.push_back(center);
+    path.points.push_back(ccpAdd(center, ccpMult(fromDir, halfWidth)));
+    if (join == kStrokeJoinMiter)
+    {
+        path.points.push_back(miter);
+    }
+    else if (join == kStrokeJoinRound)
+    {
+        float turn = acosf(clampf(ccpDot(fromDir, toDir), -1.0f, 1.0f));
+        int steps = MIN(kStrokeMaxJoinTriangles, MAX(1, (int)ceilf(turn / kStrokeRoundJoinStep)));
+        float stepAngle = (cross > 0.0f ? turn : -turn) / steps;
+        float cosStep = cosf(stepAngle);
+        float sinStep = sinf(stepAngle);
+        CCPoint dir = fromDir;
+        for (int i = 1; i < steps; ++i)
+        {
+            dir = ccp(dir.x * cosStep - dir.y * sinStep, dir.x * sinStep + dir.y * cosStep);
+            path.points.push_back(ccpAdd(center, ccpMult(dir, halfWidth)));
+        }
+    }
+    path.points.push_back(ccpAdd(center, ccpMult(toDir, halfWidth)));
+    closeContour(first, path);
+}
+
+void StrokeOutline::addFill(const std::vector<CanvasFillSpan> &spans, float scale, StrokeOutlinePath &path)
+{
+    //! spans of the same columns in neighbouring rows become one rectangle
+    std::vector<CanvasFillSpan> inside;
+    inside.reserve(spans.size());
+    for (unsigned int i = 0; i < spans.size(); ++i)
+    {
+        if (spans[i].coverage >= kStrokeOutlineFillCoverage)
+        {
+            inside.push_back(spans[i]);
+        }
+    }
+    std::sort(inside.begin(), inside.end(), fillSpanColumnOrder);
+    
+    float pointsPerPixel = 1.0f / scale;
+    for (unsigned int i = 0; i < inside.size(); )
+    {
+        const CanvasFillSpan &span = inside[i];
+        unsigned int end = i + 1;
+        while (end < inside.size() && inside[end].x0 == span.x0 && inside[end].x1 == span.x1 && inside[end].y == inside[end - 1].y + 1)
+        {
+            ++end;
+        }
+        float minX = span.x0 * pointsPerPixel;
+        float maxX = span.x1 * pointsPerPixel;
+        float minY = span.y * pointsPerPixel;
+        float maxY = (inside[end - 1].y + 1) * pointsPerPixel;
+        
+        unsigned int first = (unsigned int)path.points.size();
+        path.points.push_back(ccp(minX, minY));
+        path.points.push_back(ccp(minX, maxY));
+        path.points.push_back(ccp(maxX, maxY));
+        path.points.push_back(ccp(maxX, minY));
+        closeContour(first, path);
+        i = end;
+    }
+}
+
+void StrokeOutline::addSymmetryCopies(const StrokeSymmetry &symmetry, StrokeOutlinePath &path)
+{
+    unsigned int copies = StrokeSymmetryCopyCount(symmetry);
+    unsigned int pointCount = (unsigned int)path.points.size();
+    unsigned int contourCount = (unsigned int)path.contourStarts.size();
+    path.points.reserve(pointCount * copies);
+    for (unsigned int copy = 1; copy < copies; ++copy)
+    {
+        CCAffineTransform transform = StrokeSymmetryTransform(symmetry, copy);
+        for (unsigned int contour = 0; contour < contourCount; ++contour)
+        {
+            unsigned int end = contour + 1 < contourCount ? path.contourStarts[contour + 1] : pointCount;
+            unsigned int first = (unsigned int)path.points.size();
+            for (unsigned int i = path.contourStarts[contour]; i < end; ++i)
+            {
+                path.points.push_back(CCPointApplyAffineTransform(path.points[i], transform));
+            }
+            //! mirrored copies turn the other way
+            closeContour(first, path);
+        }
+    }
+}
+
+void StrokeOutline::closeContour(unsigned int first, StrokeOutlinePath &path)
+{
+    std::vector<CCPoint> &points = path.points;
+    float area = 0;
+    for (unsigned int i = first; i < points.size(); ++i)
+    {
+        const CCPoint &next = i + 1 < points.size() ? points[i + 1] : points[first];
+        area += ccpCross(points[i], next);
+    }
+    if (points.size() - first < 3 || area == 0.0f)
+    {
+        points.resize(first);
+        return;
+    }
+    //! positive area turns counterclockwise with y up
+    if (area > 0.0f)
+    {
+        std::reverse(points.begin() + first, points.end());
+    }
+    path.contourStarts.push_back(first);
+}
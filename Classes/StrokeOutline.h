@@ -0,0 +1,76 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_OUTLINE_H_
+#define _STROKE_OUTLINE_H_
+
+#include "cocos2d.h"
+#include "StrokeTessellator.h"
+#include "StrokeSymmetry.h"
+#include "CanvasFill.h"
+#include <vector>
+
+USING_NS_CC;
+
+//! closed polygons in canvas points, all turning clockwise, whose union is the ink
+typedef struct _StrokeOutlinePath {
+    std::vector<CCPoint> points;
+    //! index of the first point of each contour, a contour ends where the next one starts
+    std::vector<unsigned int> contourStarts;
+} StrokeOutlinePath;
+
+/**
+ The ink of committed strokes as filled outlines, for vector export.
+
+ A smoothed polyline becomes what StrokeTessellator::drawLines() tessellates, without the overdraw
+ fringe: the A/B/C/D ribbon walked forward along its left side and back along its right
+ one, with the round caps of fillLineEndPointAt() spliced in at both ends. Where drawLines
+ starts new corners at a sharp turn the ribbon is split and the join is a contour of its
+ own. Every contour turns the same way, so filled with the nonzero rule the overlaps of
+ contours, copies and self intersecting strokes are covered once, like the stencil does.
+ */
+class StrokeOutline
+{
+public:
+    //! linePoints drawn with style as one line with both caps, see StrokeTessellator::tessellateSmoothed
+    static void addStroke(const std::vector<LinePoint> &linePoints, const StrokeStyle &style, StrokeOutlinePath &path);
+    //! rectangles of the fill spans at least half covered, scale canvas pixels per point
+    static void addFill(const std::vector<CanvasFillSpan> &spans, float scale, StrokeOutlinePath &path);
+    //! adds every further copy of symmetry of what path holds
+    static void addSymmetryCopies(const StrokeSymmetry &symmetry, StrokeOutlinePath &path);
+
+private:
+    //! one ribbon between sharp turns, with the caps at its ends if given
+    static void addRun(const std::vector<CCPoint> &left, const std::vector<CCPoint> &right, const LinePoint *startCap, const CCPoint &startDir,
+                       const LinePoint *endCap, const CCPoint &endDir, StrokeOutlinePath &path);
+    //! the outer side of a sharp turn, see StrokeTessellator::addJoin
+    static void addJoin(CCPoint center, float halfWidth, CCPoint fromPerpendicular, CCPoint toPerpendicular, const StrokeStyle &style,
+                        StrokeOutlinePath &path);
+    static void addCap(const LinePoint &center, const CCPoint &lineDir, std::vector<CCPoint> &points);
+    //! ends the contour begun at first, turned clockwise, or drops it if it has no area
+    static void closeContour(unsigned int first, StrokeOutlinePath &path);
+};
+
+#endif // _STROKE_OUTLINE_H_
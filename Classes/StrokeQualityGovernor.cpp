@@ -0,0 +1,215 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeQualityGovernor.h"
+
+//! the tier drops while the average frame takes this much longer than the target
+#define kStrokeQualitySlowFactor 1.2f
+//! and may rise again while it is within this much of the target
+#define kStrokeQualityFastFactor 1.05f
+//! part of the target frame the ink of a higher tier may take
+#define kStrokeQualityDrawShare 0.5f
+//! weight of the newest frame in the running averages
+#define kStrokeQualityAverageWeight 0.1f
+//! measured frames after a change before the tier may drop again
+#define kStrokeQualitySettleFrames 30
+#define kStrokeQualityMinRiseFrames 120
+#define kStrokeQualityMaxRiseFrames 1920
+
+static inline float runningAverage(float average, float value, bool first)
+{
+    return first ? value : average + (value - average) * kStrokeQualityAverageWeight;
+}
+
+StrokeQualityGovernor::StrokeQualityGovernor()
+: tier(kStrokeQualityHigh)
+, adaptive(true)
+, targetFrameTime((float)(CCDirector::sharedDirector()->getAnimationInterval() * 1000.0))
+, settledFrames(0)
+, riseDelay(kStrokeQualityMinRiseFrames)
+, lastChangeWasRise(false)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void StrokeQualityGovernor::setTargetFrameTime(float milliseconds)
+{
+    targetFrameTime = milliseconds;
+}
+
+float StrokeQualityGovernor::getTargetFrameTime() const
+{
+    return targetFrameTime;
+}
+
+void StrokeQualityGovernor::setTier(StrokeQualityTier aTier)
+{
+    adaptive = false;
+    if (aTier != tier)
+    {
+        changeTier(aTier);
+    }
+}
+
+StrokeQualityTier StrokeQualityGovernor::getTier() const
+{
+    return tier;
+}
+
+void StrokeQualityGovernor::setAdaptive(bool isAdaptive)
+{
+    adaptive = isAdaptive;
+    settledFrames = 0;
+}
+
+bool StrokeQualityGovernor::isAdaptive() const
+{
+    return adaptive;
+}
+
+const StrokeQualityStats &StrokeQualityGovernor::getStats() const
+{
+    return stats;
+}
+
+void StrokeQualityGovernor::changeTier(StrokeQualityTier aTier)
+{
+    tier = aTier;
+    ++stats.tierChanges;
+    //! the averages so far were measured at the old tier
+    settledFrames = 0;
+}
+
+bool StrokeQualityGovernor::addFrame(float frameMilliseconds, float drawMilliseconds, unsigned int vertices)
+{
+    //! an idle canvas says nothing about how fast ink is drawn
+    if (vertices == 0)
+    {
+        return false;
+    }
+
+    bool first = settledFrames == 0;
+    stats.averageFrameTime = runningAverage(stats.averageFrameTime, frameMilliseconds, first);
+    stats.averageDrawTime = runningAverage(stats.averageDrawTime, drawMilliseconds, first);
+    stats.averageVertices = runningAverage(stats.averageVertices, (float)vertices, first);
+    if (drawMilliseconds > 0.0f)
+    {
+        stats.vertexRate = runningAverage(stats.vertexRate, vertices / drawMilliseconds, first || stats.vertexRate <= 0.0f);
+    }
+    ++stats.measuredFrames;
+    ++settledFrames;
+
+    if (!adaptive)
+    {
+        return false;
+    }
+
+    if (tier > kStrokeQualityLow && settledFrames >= kStrokeQualitySettleFrames
+        && stats.averageFrameTime > targetFrameTime * kStrokeQualitySlowFactor)
+    {
+        //! the last rise didn't hold, the next one waits longer
+        if (lastChangeWasRise)
+        {
+            riseDelay = MIN(riseDelay * 2, (unsigned int)kStrokeQualityMaxRiseFrames);
+        }
+        lastChangeWasRise = false;
+        changeTier((StrokeQualityTier)(tier - 1));
+        return true;
+    }
+
+    if (tier < kStrokeQualityUltra && settledFrames >= riseDelay && stats.vertexRate > 0.0f
+        && stats.averageFrameTime < targetFrameTime * kStrokeQualityFastFactor)
+    {
+        StrokeQualityTier next = (StrokeQualityTier)(tier + 1);
+        float nextVertices = stats.averageVertices * vertexScaleForTier(next) / vertexScaleForTier(tier);
+        if (nextVertices / stats.vertexRate < targetFrameTime * kStrokeQualityDrawShare)
+        {
+            lastChangeWasRise = true;
+            changeTier(next);
+            return true;
+        }
+    }
+    return false;
+}
+
+StrokeQuality StrokeQualityGovernor::qualityForTier(StrokeQualityTier aTier)
+{
+    StrokeQuality quality = StrokeQualityDefault();
+    switch (aTier)
+    {
+        case kStrokeQualityLow:
+            quality.sampleSpacing = 6.0f;
+            quality.minSpanSamples = 8;
+            quality.maxSpanSamples = 32;
+            quality.capDirections = 8;
+            quality.minInputDistance = 3.0f;
+            break;
+        case kStrokeQualityMedium:
+            quality.sampleSpacing = 4.0f;
+            quality.minSpanSamples = 16;
+            quality.maxSpanSamples = 64;
+            quality.capDirections = 16;
+            quality.minInputDistance = 2.0f;
+            break;
+        case kStrokeQualityUltra:
+            quality.sampleSpacing = 1.0f;
+            quality.minSpanSamples = 48;
+            quality.maxSpanSamples = 256;
+            quality.minInputDistance = 1.0f;
+            break;
+        default:
+            break;
+    }
+    return quality;
+}
+
+StrokeAntialias StrokeQualityGovernor::antialiasForTier(StrokeQualityTier aTier)
+{
+    switch (aTier)
+    {
+        case kStrokeQualityLow:
+            return kStrokeAntialiasNone;
+        case kStrokeQualityMedium:
+            return kStrokeAntialiasPixel;
+        default:
+            return kStrokeAntialiasFringe;
+    }
+}
+
+float StrokeQualityGovernor::vertexScaleForTier(StrokeQualityTier aTier)
+{
+    //! spans mostly get their minimum samples, wider input spacing means fewer spans,
+    //! and without a fringe a segment has 6 vertices instead of 18
+    switch (aTier)
+    {
+        case kStrokeQualityLow:
+            return 0.05f;
+        case kStrokeQualityMedium:
+            return 0.4f;
+        case kStrokeQualityUltra:
+            return 2.25f;
+        default:
+            return 1.0f;
+    }
+}
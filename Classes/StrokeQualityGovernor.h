@@ -0,0 +1,114 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_QUALITY_GOVERNOR_H_
+#define _STROKE_QUALITY_GOVERNOR_H_
+
+#include "cocos2d.h"
+#include "StrokeTessellator.h"
+
+USING_NS_CC;
+
+//! cheapest first, kStrokeQualityHigh is what strokes are drawn with by default
+typedef enum {
+    kStrokeQualityLow,
+    kStrokeQualityMedium,
+    kStrokeQualityHigh,
+    kStrokeQualityUltra,
+    kStrokeQualityTierCount
+} StrokeQualityTier;
+
+//! how the edges of a stroke are smoothed
+typedef enum {
+    //! no fringe, aliased edges
+    kStrokeAntialiasNone,
+    //! a fringe one canvas pixel wide
+    kStrokeAntialiasPixel,
+    //! the full fading fringe of PaintLayer::overdraw
+    kStrokeAntialiasFringe
+} StrokeAntialias;
+
+//! averages over the frames ink was drawn in, idle frames don't count
+typedef struct _StrokeQualityStats {
+    //! milliseconds between frames
+    float averageFrameTime;
+    //! milliseconds tessellating and drawing live ink
+    float averageDrawTime;
+    float averageVertices;
+    //! vertices tessellated and drawn per millisecond
+    float vertexRate;
+    unsigned int measuredFrames;
+    unsigned int tierChanges;
+} StrokeQualityStats;
+
+/**
+ Steps the drawing quality of live strokes down while frames take too long and back up
+ once they are fast with room to spare.
+
+ Only frames that drew ink are measured. The tier drops when the average frame time stays
+ above the target, and rises when it is below it and the average draw time, scaled by
+ how many more vertices the next tier emits, still fits in half the target. Each change
+ waits for the averages to settle, and a rise that was taken back makes the next rise
+ wait twice as long, so a device on the edge between two tiers doesn't flip between them.
+ */
+class StrokeQualityGovernor
+{
+public:
+    StrokeQualityGovernor();
+
+    //! frame interval to keep, the animation interval by default
+    void setTargetFrameTime(float milliseconds);
+    float getTargetFrameTime() const;
+
+    //! fixes the tier, until setAdaptive(true)
+    void setTier(StrokeQualityTier aTier);
+    StrokeQualityTier getTier() const;
+    void setAdaptive(bool isAdaptive);
+    bool isAdaptive() const;
+
+    //! one frame: its interval, the time drawing live ink took and the vertices it drew, true if the tier changed
+    bool addFrame(float frameMilliseconds, float drawMilliseconds, unsigned int vertices);
+    const StrokeQualityStats &getStats() const;
+
+    static StrokeQuality qualityForTier(StrokeQualityTier aTier);
+    static StrokeAntialias antialiasForTier(StrokeQualityTier aTier);
+    //! vertices a stroke of the tier emits roughly, relative to kStrokeQualityHigh
+    static float vertexScaleForTier(StrokeQualityTier aTier);
+
+private:
+    void changeTier(StrokeQualityTier aTier);
+
+    StrokeQualityTier tier;
+    bool adaptive;
+    float targetFrameTime;
+    StrokeQualityStats stats;
+    //! measured frames since the last change
+    unsigned int settledFrames;
+    //! measured frames a rise waits for, doubled whenever a rise is followed by a drop
+    unsigned int riseDelay;
+    bool lastChangeWasRise;
+};
+
+#endif // _STROKE_QUALITY_GOVERNOR_H_
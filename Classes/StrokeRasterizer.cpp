@@ -0,0 +1,270 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeRasterizer.h"
+
+StrokeRasterizer::StrokeRasterizer()
+: width(0)
+, height(0)
+, scale(1.0f)
+{
+    state.blendMode = kStrokeBlendNormal;
+    state.stencilRef = 0;
+}
+
+StrokeRasterizer::~StrokeRasterizer()
+{
+}
+
+bool StrokeRasterizer::init(const CCSize &size, float aScale)
+{
+    if (size.width <= 0 || size.height <= 0 || aScale <= 0)
+    {
+        return false;
+    }
+    scale = aScale;
+    width = (unsigned int)ceilf(size.width * scale);
+    height = (unsigned int)ceilf(size.height * scale);
+    pixels.assign(width * height * 4, 0);
+    stencil.assign(width * height, 0);
+    return true;
+}
+
+unsigned int StrokeRasterizer::getWidth() const
+{
+    return width;
+}
+
+unsigned int StrokeRasterizer::getHeight() const
+{
+    return height;
+}
+
+float StrokeRasterizer::getScale() const
+{
+    return scale;
+}
+
+void StrokeRasterizer::clear(ccColor4F color)
+{
+    unsigned char rgba[4] = {
+        (unsigned char)(color.r * 255.0f + 0.5f), (unsigned char)(color.g * 255.0f + 0.5f),
+        (unsigned char)(color.b * 255.0f + 0.5f), (unsigned char)(color.a * 255.0f + 0.5f)
+    };
+    for (unsigned int i = 0; i < pixels.size(); i += 4)
+    {
+        pixels[i] = rgba[0];
+        pixels[i + 1] = rgba[1];
+        pixels[i + 2] = rgba[2];
+        pixels[i + 3] = rgba[3];
+    }
+    clearStencil();
+}
+
+void StrokeRasterizer::clearStencil()
+{
+    stencil.assign(stencil.size(), 0);
+}
+
+void StrokeRasterizer::clearStencil(const std::vector<GLint> &keptRefs)
+{
+    bool kept[256] = { false };
+    for (unsigned int i = 0; i < keptRefs.size(); ++i)
+    {
+        kept[keptRefs[i] & 0xff] = true;
+    }
+    for (unsigned int i = 0; i < stencil.size(); ++i)
+    {
+        if (!kept[stencil[i]])
+        {
+            stencil[i] = 0;
+        }
+    }
+}
+
+void StrokeRasterizer::setState(const StrokeBatchState &aState)
+{
+    state = aState;
+}
+
+const unsigned char *StrokeRasterizer::rowFromTop(unsigned int y) const
+{
+    return &pixels[(height - 1 - y) * width * 4];
+}
+
+unsigned char *StrokeRasterizer::getPixels()
+{
+    return &pixels[0];
+}
+
+const unsigned char *StrokeRasterizer::getPixels() const
+{
+    return &pixels[0];
+}
+
+void StrokeRasterizer::drawTriangles(const LineVertex *vertices, unsigned int count)
+{
+    CCPoint corners[3];
+    ccColor4F colors[3];
+    for (unsigned int i = 0; i + 2 < count; i += 3)
+    {
+        for (unsigned int j = 0; j < 3; ++j)
+        {
+            corners[j] = ccpMult(vertices[i + j].pos, scale);
+            colors[j] = vertices[i + j].color;
+        }
+        fillTriangle(corners, colors);
+    }
+}
+
+void StrokeRasterizer::drawTriangles(const StrokeMeshVertex *vertices, unsigned int count)
+{
+    CCPoint corners[3];
+    ccColor4F colors[3];
+    for (unsigned int i = 0; i + 2 < count; i += 3)
+    {
+        for (unsigned int j = 0; j < 3; ++j)
+        {
+            const StrokeMeshVertex &vertex = vertices[i + j];
+            corners[j] = ccp(vertex.x * scale, vertex.y * scale);
+            colors[j] = ccc4FFromccc4B(vertex.color);
+        }
+        fillTriangle(corners, colors);
+    }
+}
+
+//! the edge from a to b takes pixel centers exactly on it, see the top left rule
+static inline bool edgeOwnsBoundary(const CCPoint &a, const CCPoint &b)
+{
+    //! counter clockwise with y up: left edges run downwards, top edges run to the left
+    return b.y < a.y || (b.y == a.y && b.x < a.x);
+}
+
+//! twice the signed area of a, b, p, positive with p left of a to b
+static inline float edgeFunction(const CCPoint &a, const CCPoint &b, float x, float y)
+{
+    return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+void StrokeRasterizer::fillTriangle(const CCPoint *corners, const ccColor4F *colors)
+{
+    float area = edgeFunction(corners[0], corners[1], corners[2].x, corners[2].y);
+    if (fabsf(area) < 1e-6f)
+    {
+        return;
+    }
+    //! counter clockwise from here on
+    int second = area > 0 ? 1 : 2;
+    int third = area > 0 ? 2 : 1;
+    const CCPoint v[3] = { corners[0], corners[second], corners[third] };
+    const ccColor4F c[3] = { colors[0], colors[second], colors[third] };
+    area = fabsf(area);
+
+    //! pixel centers sit at half coordinates
+    int minX = MAX(0, (int)ceilf(MIN(v[0].x, MIN(v[1].x, v[2].x)) - 0.5f));
+    int maxX = MIN((int)width - 1, (int)floorf(MAX(v[0].x, MAX(v[1].x, v[2].x)) - 0.5f));
+    int minY = MAX(0, (int)ceilf(MIN(v[0].y, MIN(v[1].y, v[2].y)) - 0.5f));
+    int maxY = MIN((int)height - 1, (int)floorf(MAX(v[0].y, MAX(v[1].y, v[2].y)) - 0.5f));
+    if (minX > maxX || minY > maxY)
+    {
+        return;
+    }
+
+    //! edge k is opposite corner k, its function over the area is the weight of that corner
+    const CCPoint *from[3] = { &v[1], &v[2], &v[0] };
+    const CCPoint *to[3] = { &v[2], &v[0], &v[1] };
+    bool owns[3];
+    float stepX[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        owns[k] = edgeOwnsBoundary(*from[k], *to[k]);
+        stepX[k] = -(to[k]->y - from[k]->y);
+    }
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float centerY = y + 0.5f;
+        float edge[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            edge[k] = edgeFunction(*from[k], *to[k], minX + 0.5f, centerY);
+        }
+        unsigned int index = y * width + minX;
+        for (int x = minX; x <= maxX; ++x, ++index)
+        {
+            bool inside = true;
+            for (int k = 0; k < 3 && inside; ++k)
+            {
+                inside = edge[k] > 0 || (edge[k] == 0 && owns[k]);
+            }
+            if (inside)
+            {
+                float w0 = edge[0] / area, w1 = edge[1] / area, w2 = edge[2] / area;
+                ccColor4F color = ccc4f(c[0].r * w0 + c[1].r * w1 + c[2].r * w2,
+                                        c[0].g * w0 + c[1].g * w1 + c[2].g * w2,
+                                        c[0].b * w0 + c[1].b * w1 + c[2].b * w2,
+                                        c[0].a * w0 + c[1].a * w1 + c[2].a * w2);
+                blendPixel(index, color);
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                edge[k] += stepX[k];
+            }
+        }
+    }
+}
+
+void StrokeRasterizer::blendPixel(unsigned int index, const ccColor4F &color)
+{
+    //! GL_NOTEQUAL with GL_REPLACE, every pixel is blended at most once per isolated stroke
+    if (state.stencilRef != 0)
+    {
+        if (stencil[index] == (unsigned char)state.stencilRef)
+        {
+            return;
+        }
+        stencil[index] = (unsigned char)state.stencilRef;
+    }
+
+    unsigned char *pixel = &pixels[index * 4];
+    float source[4] = { color.r, color.g, color.b, color.a };
+    float remaining = 1.0f - color.a;
+    //! premultiplied source over, multiply keeps the destination alpha as its blend function does, eraser only removes,
+    //! fills shift the destination either way
+    int channels = state.blendMode == kStrokeBlendMultiply ? 3 : 4;
+    for (int i = 0; i < channels; ++i)
+    {
+        float destination = pixel[i] / 255.0f;
+        float blended;
+        switch (state.blendMode)
+        {
+            case kStrokeBlendMultiply: blended = destination * (source[i] + remaining); break;
+            case kStrokeBlendEraser: blended = destination * remaining; break;
+            case kStrokeBlendAdd: blended = destination + source[i]; break;
+            case kStrokeBlendSubtract: blended = destination - source[i]; break;
+            default: blended = source[i] + destination * remaining; break;
+        }
+        pixel[i] = (unsigned char)(clampf(blended, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_RASTERIZER_H_
+#define _STROKE_RASTERIZER_H_
+
+#include "cocos2d.h"
+#include "StrokeBatch.h"
+#include <vector>
+
+USING_NS_CC;
+
+/**
+ CPU stand in for the canvas framebuffer, for rendering without a GL context.
+
+ Holds RGBA8888 color and an 8 bit stencil, both bottom row first like GL. Triangles
+ are filled over pixel centers with the top left rule, so neighbours sharing an edge
+ never cover a pixel twice, and colors are interpolated like GL does. Blending and the
+ stencil test follow StrokeBatch's GL state for each StrokeBatchState.
+ */
+class StrokeRasterizer
+{
+public:
+    StrokeRasterizer();
+    ~StrokeRasterizer();
+
+    //! a canvas of size points, scale pixels per point
+    bool init(const CCSize &size, float aScale);
+    unsigned int getWidth() const;
+    unsigned int getHeight() const;
+    float getScale() const;
+
+    //! fills color and clears the stencil
+    void clear(ccColor4F color);
+    void clearStencil();
+    //! the same but for the marks of keptRefs, see StrokeStencil
+    void clearStencil(const std::vector<GLint> &keptRefs);
+
+    void setState(const StrokeBatchState &state);
+    void drawTriangles(const LineVertex *vertices, unsigned int count);
+    void drawTriangles(const StrokeMeshVertex *vertices, unsigned int count);
+
+    //! RGBA row y counted from the top, as image files store them
+    const unsigned char *rowFromTop(unsigned int y) const;
+    //! RGBA rows bottom first, width * height * 4 bytes
+    unsigned char *getPixels();
+    const unsigned char *getPixels() const;
+
+private:
+    void fillTriangle(const CCPoint *corners, const ccColor4F *colors);
+    void blendPixel(unsigned int index, const ccColor4F &color);
+
+    unsigned int width;
+    unsigned int height;
+    float scale;
+    std::vector<unsigned char> pixels;
+    std::vector<unsigned char> stencil;
+    StrokeBatchState state;
+};
+
+#endif // _STROKE_RASTERIZER_H_
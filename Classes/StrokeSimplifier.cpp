@@ -0,0 +1,130 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeSimplifier.h"
+#include "StrokeCurveFitter.h"
+
+static float deviationFromChord(const LinePoint &point, const LinePoint &first, const LinePoint &last)
+{
+    CCPoint chord = ccpSub(last.pos, first.pos);
+    float lengthSQ = ccpLengthSQ(chord);
+    float t = lengthSQ > 0.0f ? clampf(ccpDot(ccpSub(point.pos, first.pos), chord) / lengthSQ, 0.0f, 1.0f) : 0.0f;
+    float distance = ccpDistance(point.pos, ccpAdd(first.pos, ccpMult(chord, t)));
+    //! each edge moves by half of the width difference
+    float widthError = fabsf(point.width - (first.width + (last.width - first.width) * t)) * 0.5f;
+    return distance + widthError;
+}
+
+float StrokeSimplifier::toleranceForLevel(unsigned int level)
+{
+    return 0.25f * (float)(1 << level);
+}
+
+float StrokeSimplifier::errorBoundForLevel(unsigned int level)
+{
+    return 0.25f * (float)((2 << level) - 1);
+}
+
+unsigned int StrokeSimplifier::levelForScale(float scale)
+{
+    unsigned int level = 0;
+    while (level + 1 < kStrokeLevelCount && errorBoundForLevel(level + 1) * scale <= 0.5f)
+    {
+        ++level;
+    }
+    return level;
+}
+
+void StrokeSimplifier::simplify(const std::vector<LinePoint> &input, float tolerance, std::vector<LinePoint> &output)
+{
+    output.clear();
+    if (input.size() < 3)
+    {
+        output = input;
+        return;
+    }
+
+    std::vector<char> keep(input.size(), 0);
+    keep.front() = 1;
+    keep.back() = 1;
+
+    std::vector<std::pair<unsigned int, unsigned int> > ranges;
+    ranges.push_back(std::make_pair(0u, (unsigned int)input.size() - 1));
+    while (!ranges.empty())
+    {
+        unsigned int first = ranges.back().first;
+        unsigned int last = ranges.back().second;
+        ranges.pop_back();
+
+        float maxDeviation = 0;
+        unsigned int farthest = first;
+        for (unsigned int i = first + 1; i < last; ++i)
+        {
+            float deviation = deviationFromChord(input[i], input[first], input[last]);
+            if (deviation > maxDeviation)
+            {
+                maxDeviation = deviation;
+                farthest = i;
+            }
+        }
+
+        if (maxDeviation > tolerance)
+        {
+            keep[farthest] = 1;
+            ranges.push_back(std::make_pair(first, farthest));
+            ranges.push_back(std::make_pair(farthest, last));
+        }
+    }
+
+    for (unsigned int i = 0; i < input.size(); ++i)
+    {
+        if (keep[i])
+        {
+            output.push_back(input[i]);
+        }
+    }
+}
+
+void StrokeSimplifier::buildLevels(const std::vector<LinePoint> &inputPoints, std::vector<std::vector<LinePoint> > &levels)
+{
+    std::vector<LinePoint> smoothed;
+    StrokeTessellator::smoothPolyline(inputPoints, smoothed);
+
+    levels.resize(kStrokeLevelCount);
+    simplify(smoothed, toleranceForLevel(0), levels[0]);
+    for (unsigned int level = 1; level < kStrokeLevelCount; ++level)
+    {
+        simplify(levels[level - 1], toleranceForLevel(level), levels[level]);
+    }
+}
+
+void StrokeSimplifier::buildLevelsFromCurve(const std::vector<LinePoint> &curve, std::vector<std::vector<LinePoint> > &levels)
+{
+    levels.resize(kStrokeLevelCount);
+    StrokeCurveFitter::flatten(curve, toleranceForLevel(0) - kStrokeCurveTolerance, levels[0]);
+    for (unsigned int level = 1; level < kStrokeLevelCount; ++level)
+    {
+        simplify(levels[level - 1], toleranceForLevel(level), levels[level]);
+    }
+}
@@ -0,0 +1,61 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_SIMPLIFIER_H_
+#define _STROKE_SIMPLIFIER_H_
+
+#include "cocos2d.h"
+#include "StrokeTessellator.h"
+#include <vector>
+
+USING_NS_CC;
+
+//! number of detail levels kept for every committed stroke, level 1 is the coarsest a canvas of half a pixel per point uses
+#define kStrokeLevelCount 2
+
+/**
+ Douglas-Peucker simplification of smoothed stroke polylines.
+
+ Level 0 is simplified from the smoothed stroke with a quarter point tolerance, every
+ next level from the previous one with twice the tolerance. Width is treated as
+ a third dimension, a point is only dropped if the edges stay within the tolerance.
+ */
+class StrokeSimplifier
+{
+public:
+    static float toleranceForLevel(unsigned int level);
+    //! deviation from the smoothed stroke, the tolerances of all levels up to this one add up
+    static float errorBoundForLevel(unsigned int level);
+    //! coarsest level whose error stays below half a pixel when drawn at scale pixels per point
+    static unsigned int levelForScale(float scale);
+
+    static void simplify(const std::vector<LinePoint> &input, float tolerance, std::vector<LinePoint> &output);
+    //! smooths inputPoints like the live stroke does, then simplifies each level from the previous one
+    static void buildLevels(const std::vector<LinePoint> &inputPoints, std::vector<std::vector<LinePoint> > &levels);
+    //! level 0 flattened from the curve knots of StrokeCurveFitter, fitting and flattening stay within its tolerance
+    static void buildLevelsFromCurve(const std::vector<LinePoint> &curve, std::vector<std::vector<LinePoint> > &levels);
+};
+
+#endif // _STROKE_SIMPLIFIER_H_
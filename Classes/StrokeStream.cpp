@@ -0,0 +1,535 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeStream.h"
+
+//! message flags
+#define kStrokeStreamBegin      1
+#define kStrokeStreamEnd        2
+//! the begin message carries the stroke's symmetry
+#define kStrokeStreamSymmetric  4
+
+//! quantization steps per point
+#define kStrokeStreamPositionSteps  8.0f
+#define kStrokeStreamWidthSteps     16.0f
+
+#pragma mark - LoopbackTransport
+
+LoopbackTransport::LoopbackTransport()
+: peer(NULL)
+{
+    pthread_mutex_init(&inboxMutex, NULL);
+}
+
+LoopbackTransport::~LoopbackTransport()
+{
+    disconnect();
+    pthread_mutex_destroy(&inboxMutex);
+}
+
+void LoopbackTransport::connect(LoopbackTransport *a, LoopbackTransport *b)
+{
+    //! an old peer left pointing at a or b would go on sending to them
+    a->disconnect();
+    b->disconnect();
+    a->peer = b;
+    b->peer = a;
+}
+
+void LoopbackTransport::disconnect()
+{
+    if (peer != NULL && peer != this)
+    {
+        peer->peer = NULL;
+    }
+    peer = NULL;
+}
+
+void LoopbackTransport::send(const std::vector<unsigned char> &message)
+{
+    if (peer == NULL)
+    {
+        return;
+    }
+    
+    pthread_mutex_lock(&peer->inboxMutex);
+    peer->inbox.push_back(message);
+    pthread_mutex_unlock(&peer->inboxMutex);
+}
+
+bool LoopbackTransport::receive(std::vector<unsigned char> &message)
+{
+    bool received = false;
+    pthread_mutex_lock(&inboxMutex);
+    if (!inbox.empty())
+    {
+        message.swap(inbox.front());
+        inbox.pop_front();
+        received = true;
+    }
+    pthread_mutex_unlock(&inboxMutex);
+    return received;
+}
+
+#pragma mark - StrokeStream
+
+StrokeStream::StrokeStream()
+: transport(NULL)
+, peerID(1)
+, nextKey(1)
+, bytesSent(0)
+, pointsSent(0)
+{
+}
+
+StrokeStream::~StrokeStream()
+{
+    for (std::map<Stroke *, OutgoingStroke>::iterator it = outgoing.begin(); it != outgoing.end(); ++it)
+    {
+        it->first->release();
+    }
+    for (std::map<RemoteKey, IncomingStroke>::iterator it = incoming.begin(); it != incoming.end(); ++it)
+    {
+        it->second.stroke->release();
+    }
+}
+
+void StrokeStream::setTransport(StrokeTransport *aTransport)
+{
+    //! peers behind another transport never got the begin of strokes queued for this one
+    if (aTransport != transport)
+    {
+        for (std::map<Stroke *, OutgoingStroke>::iterator it = outgoing.begin(); it != outgoing.end(); ++it)
+        {
+            it->first->release();
+        }
+        outgoing.clear();
+    }
+    transport = aTransport;
+}
+
+StrokeTransport *StrokeStream::getTransport() const
+{
+    return transport;
+}
+
+void StrokeStream::setPeerID(unsigned int aPeerID)
+{
+    CCAssert(aPeerID != 0, "peer id 0 marks local strokes");
+    peerID = aPeerID;
+}
+
+unsigned int StrokeStream::getPeerID() const
+{
+    return peerID;
+}
+
+unsigned int StrokeStream::getBytesSent() const
+{
+    return bytesSent;
+}
+
+unsigned int StrokeStream::getPointsSent() const
+{
+    return pointsSent;
+}
+
+StrokeStream::QuantizedPoint StrokeStream::quantize(const LinePoint &point)
+{
+    QuantizedPoint quantized;
+    quantized.x = (int)floorf(point.pos.x * kStrokeStreamPositionSteps + 0.5f);
+    quantized.y = (int)floorf(point.pos.y * kStrokeStreamPositionSteps + 0.5f);
+    quantized.width = (int)floorf(point.width * kStrokeStreamWidthSteps + 0.5f);
+    //! already integers in the point record
+    quantized.pressure = point.pressure;
+    quantized.tilt = point.tilt;
+    quantized.time = point.time;
+    return quantized;
+}
+
+LinePoint StrokeStream::linePointOf(const QuantizedPoint &point)
+{
+    LinePoint linePoint = LinePointMake(ccp(point.x / kStrokeStreamPositionSteps, point.y / kStrokeStreamPositionSteps), point.width / kStrokeStreamWidthSteps);
+    //! clamped, a malformed message must not wrap around
+    linePoint.pressure = (GLubyte)MAX(0, MIN(point.pressure, 0xff));
+    linePoint.tilt = (GLubyte)MAX(0, MIN(point.tilt, 0xff));
+    linePoint.time = (GLushort)MAX(0, MIN(point.time, 0xffff));
+    return linePoint;
+}
+
+#pragma mark - Encoding
+
+void StrokeStream::writeVarint(std::vector<unsigned char> &bytes, unsigned int value)
+{
+    while (value >= 0x80)
+    {
+        bytes.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((unsigned char)value);
+}
+
+void StrokeStream::writeSigned(std::vector<unsigned char> &bytes, int value)
+{
+    //! zigzag, small negative deltas stay small
+    writeVarint(bytes, ((unsigned int)value << 1) ^ (unsigned int)(value >> 31));
+}
+
+bool StrokeStream::readVarint(const std::vector<unsigned char> &bytes, unsigned int &offset, unsigned int &value)
+{
+    value = 0;
+    for (unsigned int shift = 0; shift < 35; shift += 7)
+    {
+        if (offset >= bytes.size())
+        {
+            return false;
+        }
+        unsigned char byte = bytes[offset++];
+        value |= (unsigned int)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool StrokeStream::readSigned(const std::vector<unsigned char> &bytes, unsigned int &offset, int &value)
+{
+    unsigned int zigzag;
+    if (!readVarint(bytes, offset, zigzag))
+    {
+        return false;
+    }
+    value = (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+    return true;
+}
+
+void StrokeStream::writePoint(std::vector<unsigned char> &bytes, const QuantizedPoint &point, const QuantizedPoint &from)
+{
+    writeSigned(bytes, point.x - from.x);
+    writeSigned(bytes, point.y - from.y);
+    writeSigned(bytes, point.width - from.width);
+    writeSigned(bytes, point.pressure - from.pressure);
+    writeSigned(bytes, point.tilt - from.tilt);
+    writeSigned(bytes, point.time - from.time);
+}
+
+bool StrokeStream::readPoint(const std::vector<unsigned char> &bytes, unsigned int &offset, QuantizedPoint &point)
+{
+    //! adds the deltas to point, which holds the previous point or zeros for an absolute one
+    int delta[6];
+    for (unsigned int i = 0; i < 6; ++i)
+    {
+        if (!readSigned(bytes, offset, delta[i]))
+        {
+            return false;
+        }
+    }
+    point.x += delta[0];
+    point.y += delta[1];
+    point.width += delta[2];
+    point.pressure += delta[3];
+    point.tilt += delta[4];
+    point.time += delta[5];
+    return true;
+}
+
+void StrokeStream::strokeBegan(Stroke *stroke, const LinePoint &point)
+{
+    if (transport == NULL)
+    {
+        return;
+    }
+    
+    OutgoingStroke &stream = outgoing[stroke];
+    stroke->retain();
+    stream.key = nextKey++;
+    stream.style = stroke->style;
+    stream.symmetry = stroke->symmetry;
+    stream.first = quantize(point);
+    stream.last = stream.first;
+    stream.pointCount = 0;
+    stream.ended = false;
+    stream.sentBegin = false;
+}
+
+void StrokeStream::strokeMoved(Stroke *stroke, const LinePoint &point)
+{
+    std::map<Stroke *, OutgoingStroke>::iterator it = outgoing.find(stroke);
+    if (it != outgoing.end())
+    {
+        queuePoint(it->second, point);
+    }
+}
+
+void StrokeStream::strokeEnded(Stroke *stroke, const LinePoint &point)
+{
+    std::map<Stroke *, OutgoingStroke>::iterator it = outgoing.find(stroke);
+    if (it != outgoing.end())
+    {
+        queuePoint(it->second, point);
+        it->second.ended = true;
+    }
+}
+
+void StrokeStream::queuePoint(OutgoingStroke &stream, const LinePoint &point)
+{
+    //! deltas between quantized points, rounding never accumulates
+    QuantizedPoint quantized = quantize(point);
+    writePoint(stream.pointBytes, quantized, stream.last);
+    stream.last = quantized;
+    ++stream.pointCount;
+}
+
+void StrokeStream::flush()
+{
+    std::map<Stroke *, OutgoingStroke>::iterator it = outgoing.begin();
+    while (it != outgoing.end())
+    {
+        OutgoingStroke &stream = it->second;
+        if (stream.sentBegin && stream.pointCount == 0 && !stream.ended)
+        {
+            ++it;
+            continue;
+        }
+        
+        std::vector<unsigned char> message;
+        message.reserve(16 + stream.pointBytes.size());
+        writeVarint(message, peerID);
+        writeVarint(message, stream.key);
+        bool symmetric = !stream.sentBegin && StrokeSymmetryCopyCount(stream.symmetry) > 1;
+        message.push_back((unsigned char)((stream.sentBegin ? 0 : kStrokeStreamBegin) | (stream.ended ? kStrokeStreamEnd : 0)
+                                          | (symmetric ? kStrokeStreamSymmetric : 0)));
+        
+        if (!stream.sentBegin)
+        {
+            //! the only absolute point, everything after is a delta to it
+            const ccColor4F &color = stream.style.color;
+            message.push_back((unsigned char)(color.r * 255.0f + 0.5f));
+            message.push_back((unsigned char)(color.g * 255.0f + 0.5f));
+            message.push_back((unsigned char)(color.b * 255.0f + 0.5f));
+            message.push_back((unsigned char)(color.a * 255.0f + 0.5f));
+            message.push_back((unsigned char)(stream.style.opacity * 255.0f + 0.5f));
+            message.push_back((unsigned char)stream.style.blendMode);
+            message.push_back((unsigned char)stream.style.join);
+            writeVarint(message, (unsigned int)(stream.style.miterLimit * 16.0f + 0.5f));
+            message.push_back((unsigned char)(stream.style.pressureOpacity * 255.0f + 0.5f));
+            if (symmetric)
+            {
+                writeVarint(message, stream.symmetry.folds);
+                message.push_back(stream.symmetry.mirror ? 1 : 0);
+                writeSigned(message, (int)floorf(stream.symmetry.center.x * kStrokeStreamPositionSteps + 0.5f));
+                writeSigned(message, (int)floorf(stream.symmetry.center.y * kStrokeStreamPositionSteps + 0.5f));
+            }
+            
+            QuantizedPoint origin = {0, 0, 0, 0, 0, 0};
+            writePoint(message, stream.first, origin);
+            stream.sentBegin = true;
+            ++pointsSent;
+        }
+        
+        writeVarint(message, stream.pointCount);
+        message.insert(message.end(), stream.pointBytes.begin(), stream.pointBytes.end());
+        pointsSent += stream.pointCount;
+        stream.pointBytes.clear();
+        stream.pointCount = 0;
+        
+        transport->send(message);
+        bytesSent += (unsigned int)message.size();
+        
+        if (stream.ended)
+        {
+            it->first->release();
+            outgoing.erase(it++);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+#pragma mark - Decoding
+
+void StrokeStream::receive(CCArray *activeStrokes, std::vector<Stroke *> &endedStrokes)
+{
+    if (transport == NULL)
+    {
+        return;
+    }
+    
+    std::vector<unsigned char> message;
+    while (transport->receive(message))
+    {
+        if (!applyMessage(message, activeStrokes, endedStrokes))
+        {
+            CCLOG("dropping malformed stroke stream message of %u bytes", (unsigned int)message.size());
+        }
+    }
+}
+
+bool StrokeStream::applyMessage(const std::vector<unsigned char> &message, CCArray *activeStrokes, std::vector<Stroke *> &endedStrokes)
+{
+    unsigned int offset = 0;
+    unsigned int sender, key;
+    if (!readVarint(message, offset, sender) || !readVarint(message, offset, key) || offset >= message.size())
+    {
+        return false;
+    }
+    unsigned char flags = message[offset++];
+    RemoteKey remoteKey(sender, key);
+    
+    if (flags & kStrokeStreamBegin)
+    {
+        if (offset + 7 > message.size())
+        {
+            return false;
+        }
+        ccColor4F color = ccc4f(message[offset] / 255.0f, message[offset + 1] / 255.0f, message[offset + 2] / 255.0f, message[offset + 3] / 255.0f);
+        float opacity = message[offset + 4] / 255.0f;
+        unsigned char blendMode = message[offset + 5];
+        unsigned char join = message[offset + 6];
+        offset += 7;
+        unsigned int miterLimit;
+        if (blendMode > kStrokeBlendEraser || join > kStrokeJoinBevel || !readVarint(message, offset, miterLimit) || offset >= message.size())
+        {
+            return false;
+        }
+        float pressureOpacity = message[offset++] / 255.0f;
+        
+        StrokeSymmetry symmetry = StrokeSymmetryNone();
+        if (flags & kStrokeStreamSymmetric)
+        {
+            unsigned int folds;
+            int centerX, centerY;
+            if (!readVarint(message, offset, folds) || folds == 0 || folds > kStrokeSymmetryMaxFolds || offset >= message.size())
+            {
+                return false;
+            }
+            bool mirror = message[offset++] != 0;
+            if (!readSigned(message, offset, centerX) || !readSigned(message, offset, centerY))
+            {
+                return false;
+            }
+            symmetry = StrokeSymmetryMake(folds, mirror, ccp(centerX / kStrokeStreamPositionSteps, centerY / kStrokeStreamPositionSteps));
+        }
+        
+        QuantizedPoint first = {0, 0, 0, 0, 0, 0};
+        if (!readPoint(message, offset, first))
+        {
+            return false;
+        }
+        
+        StrokeStyle style = StrokeStyleMake(color, opacity, (StrokeBlendMode)blendMode);
+        style.join = (StrokeJoin)join;
+        style.miterLimit = miterLimit / 16.0f;
+        style.pressureOpacity = pressureOpacity;
+        Stroke *stroke = Stroke::create(style);
+        stroke->symmetry = symmetry;
+        stroke->peerID = sender;
+        activeStrokes->addObject(stroke);
+        
+        //! the same calls a local touch makes
+        stroke->startNewLineFrom(linePointOf(first));
+        stroke->addPoint(linePointOf(first));
+        
+        //! the peer began again without ending, what it drew so far is committed as it is
+        std::map<RemoteKey, IncomingStroke>::iterator existing = incoming.find(remoteKey);
+        if (existing != incoming.end())
+        {
+            endRemoteStroke(existing->second.stroke, endedStrokes);
+        }
+        IncomingStroke stream;
+        stream.stroke = stroke;
+        stream.stroke->retain();
+        stream.last = first;
+        incoming[remoteKey] = stream;
+    }
+    
+    std::map<RemoteKey, IncomingStroke>::iterator it = incoming.find(remoteKey);
+    if (it == incoming.end())
+    {
+        //! joined after the stroke began, its points mean nothing without the start
+        return true;
+    }
+    
+    unsigned int count;
+    if (!readVarint(message, offset, count))
+    {
+        return false;
+    }
+    
+    IncomingStroke &stream = it->second;
+    Stroke *stroke = stream.stroke;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        if (!readPoint(message, offset, stream.last))
+        {
+            return false;
+        }
+        
+        //! a stroke already ended here, for example on GL context loss, takes no more points
+        if (stroke->isEnded())
+        {
+            continue;
+        }
+        if ((flags & kStrokeStreamEnd) && i == count - 1)
+        {
+            stroke->endLineAt(linePointOf(stream.last));
+            endedStrokes.push_back(stroke);
+        }
+        else
+        {
+            stroke->addPoint(linePointOf(stream.last));
+        }
+    }
+    
+    if (flags & kStrokeStreamEnd)
+    {
+        //! an end without points leaves the stroke at its last one
+        endRemoteStroke(stroke, endedStrokes);
+        incoming.erase(it);
+    }
+    return true;
+}
+
+void StrokeStream::endRemoteStrokes(std::vector<Stroke *> &endedStrokes)
+{
+    for (std::map<RemoteKey, IncomingStroke>::iterator it = incoming.begin(); it != incoming.end(); ++it)
+    {
+        endRemoteStroke(it->second.stroke, endedStrokes);
+    }
+    incoming.clear();
+}
+
+void StrokeStream::endRemoteStroke(Stroke *stroke, std::vector<Stroke *> &endedStrokes)
+{
+    if (!stroke->isEnded() && stroke->hasPoints())
+    {
+        stroke->endLineAt(stroke->getLastPoint());
+        endedStrokes.push_back(stroke);
+    }
+    stroke->release();
+}
@@ -0,0 +1,175 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_STREAM_H_
+#define _STROKE_STREAM_H_
+
+#include "cocos2d.h"
+#include "Stroke.h"
+#include <deque>
+#include <map>
+#include <vector>
+#include <pthread.h>
+
+USING_NS_CC;
+
+/**
+ Carries stroke stream messages between collaborators.
+
+ send() is called on the main thread, receive() is polled once per frame on the main
+ thread and has to hand out whole messages in the order they were sent.
+ */
+class StrokeTransport
+{
+public:
+    virtual ~StrokeTransport() {}
+
+    virtual void send(const std::vector<unsigned char> &message) = 0;
+    //! next received message, false if there is none
+    virtual bool receive(std::vector<unsigned char> &message) = 0;
+};
+
+//! in process transport, whatever is sent on one end is received on the other
+class LoopbackTransport : public StrokeTransport
+{
+public:
+    LoopbackTransport();
+    virtual ~LoopbackTransport();
+
+    //! pairs both ends, a transport connected to itself receives its own messages. Earlier peers of either are disconnected
+    static void connect(LoopbackTransport *a, LoopbackTransport *b);
+    //! unpairs this end and its peer, neither sends to the other anymore
+    void disconnect();
+
+    virtual void send(const std::vector<unsigned char> &message);
+    virtual bool receive(std::vector<unsigned char> &message);
+
+private:
+    LoopbackTransport *peer;
+    std::deque<std::vector<unsigned char> > inbox;
+    pthread_mutex_t inboxMutex;
+};
+
+/**
+ Streams strokes while they are drawn and rebuilds the strokes of other collaborators.
+
+ Points are quantized to 1/8 point and widths to 1/16, then sent together with
+ pressure, tilt and time as zigzag varint deltas to the previous point. Each of the
+ six deltas takes a byte up to +-63 steps, so a point takes 6 bytes, 7 or 8 when it
+ moved 8 points or more along x or y, and more only after a pause of 64 ms or a jump
+ in width, pressure or tilt. Points added during a frame go out as one message per
+ stroke on flush().
+
+ Message: sender peer id, stroke key, flags, [style, symmetry if it has copies and first
+ point if begun], point count, point deltas. Remote strokes are fed with the same calls local touches make,
+ so they are smoothed and tessellated by the same code.
+ */
+class StrokeStream
+{
+public:
+    StrokeStream();
+    ~StrokeStream();
+
+    //! not retained, 0 disables streaming. Strokes still being sent over the old one stop being streamed
+    void setTransport(StrokeTransport *aTransport);
+    StrokeTransport *getTransport() const;
+    //! identifies this collaborator in sent messages, must not be 0
+    void setPeerID(unsigned int aPeerID);
+    unsigned int getPeerID() const;
+
+    void strokeBegan(Stroke *stroke, const LinePoint &point);
+    void strokeMoved(Stroke *stroke, const LinePoint &point);
+    void strokeEnded(Stroke *stroke, const LinePoint &point);
+    //! sends the points queued since the last flush
+    void flush();
+
+    /**
+     Applies every received message. Strokes begun by a peer are appended to
+     activeStrokes, strokes a peer has ended are appended to endedStrokes so they can be
+     committed like local ones.
+     */
+    void receive(CCArray *activeStrokes, std::vector<Stroke *> &endedStrokes);
+    //! ends the remote strokes still being drawn, for example when the connection is lost
+    void endRemoteStrokes(std::vector<Stroke *> &endedStrokes);
+
+    unsigned int getBytesSent() const;
+    unsigned int getPointsSent() const;
+
+private:
+    typedef struct _QuantizedPoint {
+        int x;
+        int y;
+        int width;
+        int pressure;
+        int tilt;
+        int time;
+    } QuantizedPoint;
+
+    typedef struct _OutgoingStroke {
+        unsigned int key;
+        StrokeStyle style;
+        StrokeSymmetry symmetry;
+        QuantizedPoint first;
+        QuantizedPoint last;
+        std::vector<unsigned char> pointBytes;
+        unsigned int pointCount;
+        bool ended;
+        bool sentBegin;
+    } OutgoingStroke;
+
+    typedef struct _IncomingStroke {
+        Stroke *stroke;
+        QuantizedPoint last;
+    } IncomingStroke;
+
+    typedef std::pair<unsigned int, unsigned int> RemoteKey;
+
+    static QuantizedPoint quantize(const LinePoint &point);
+    static LinePoint linePointOf(const QuantizedPoint &point);
+    static void writePoint(std::vector<unsigned char> &bytes, const QuantizedPoint &point, const QuantizedPoint &from);
+    static bool readPoint(const std::vector<unsigned char> &bytes, unsigned int &offset, QuantizedPoint &point);
+
+    static void writeVarint(std::vector<unsigned char> &bytes, unsigned int value);
+    static void writeSigned(std::vector<unsigned char> &bytes, int value);
+    static bool readVarint(const std::vector<unsigned char> &bytes, unsigned int &offset, unsigned int &value);
+    static bool readSigned(const std::vector<unsigned char> &bytes, unsigned int &offset, int &value);
+
+    void queuePoint(OutgoingStroke &outgoing, const LinePoint &point);
+    bool applyMessage(const std::vector<unsigned char> &message, CCArray *activeStrokes, std::vector<Stroke *> &endedStrokes);
+    //! ends a remote stroke at its last point unless it is ended already, and releases it
+    void endRemoteStroke(Stroke *stroke, std::vector<Stroke *> &endedStrokes);
+
+    StrokeTransport *transport;
+    unsigned int peerID;
+    unsigned int nextKey;
+    //! strokes are retained while they are in either map
+    std::map<Stroke *, OutgoingStroke> outgoing;
+    std::map<RemoteKey, IncomingStroke> incoming;
+
+    unsigned int bytesSent;
+    unsigned int pointsSent;
+};
+
+#endif // _STROKE_STREAM_H_
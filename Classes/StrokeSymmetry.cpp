@@ -0,0 +1,81 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeSymmetry.h"
+
+StrokeSymmetry StrokeSymmetryNone()
+{
+    return StrokeSymmetryMake(1, false, CCPointZero);
+}
+
+StrokeSymmetry StrokeSymmetryMake(unsigned int folds, bool mirror, CCPoint center)
+{
+    StrokeSymmetry symmetry;
+    symmetry.folds = MIN(MAX(folds, 1u), (unsigned int)kStrokeSymmetryMaxFolds);
+    symmetry.mirror = mirror;
+    symmetry.center = center;
+    return symmetry;
+}
+
+bool StrokeSymmetryEqual(const StrokeSymmetry &a, const StrokeSymmetry &b)
+{
+    if (StrokeSymmetryCopyCount(a) == 1 && StrokeSymmetryCopyCount(b) == 1)
+    {
+        //! the center doesn't matter without copies
+        return true;
+    }
+    return a.folds == b.folds && a.mirror == b.mirror && a.center.equals(b.center);
+}
+
+unsigned int StrokeSymmetryCopyCount(const StrokeSymmetry &symmetry)
+{
+    return symmetry.folds * (symmetry.mirror ? 2 : 1);
+}
+
+CCAffineTransform StrokeSymmetryTransform(const StrokeSymmetry &symmetry, unsigned int copy)
+{
+    //! center + rotation * mirror * (point - center)
+    unsigned int fold = symmetry.mirror ? copy / 2 : copy;
+    float mirrorX = symmetry.mirror && copy % 2 == 1 ? -1.0f : 1.0f;
+    float angle = 2.0f * (float)M_PI * fold / symmetry.folds;
+    float cosine = cosf(angle), sine = sinf(angle);
+    float a = cosine * mirrorX, b = sine * mirrorX, c = -sine, d = cosine;
+    const CCPoint &center = symmetry.center;
+    return CCAffineTransformMake(a, b, c, d, center.x - (a * center.x + c * center.y), center.y - (b * center.x + d * center.y));
+}
+
+CCRect StrokeSymmetryBounds(const StrokeSymmetry &symmetry, const CCRect &rect)
+{
+    float minX = rect.getMinX(), maxX = rect.getMaxX();
+    float minY = rect.getMinY(), maxY = rect.getMaxY();
+    for (unsigned int copy = 1; copy < StrokeSymmetryCopyCount(symmetry); ++copy)
+    {
+        CCRect copyRect = CCRectApplyAffineTransform(rect, StrokeSymmetryTransform(symmetry, copy));
+        minX = MIN(minX, copyRect.getMinX());
+        maxX = MAX(maxX, copyRect.getMaxX());
+        minY = MIN(minY, copyRect.getMinY());
+        maxY = MAX(maxY, copyRect.getMaxY());
+    }
+    return CCRectMake(minX, minY, maxX - minX, maxY - minY);
+}
@@ -0,0 +1,63 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_SYMMETRY_H_
+#define _STROKE_SYMMETRY_H_
+
+#include "cocos2d.h"
+
+USING_NS_CC;
+
+//! more copies than anyone draws with, bounds what a stream message may ask for
+#define kStrokeSymmetryMaxFolds 64
+
+/**
+ Radial and mirror symmetry of a stroke: copies rotated evenly around center, each one
+ mirrored across its axis as well for a kaleidoscope.
+
+ A stroke is tessellated once, its vertices are submitted again under the transform of
+ every further copy.
+ */
+typedef struct _StrokeSymmetry {
+    //! copies around center, 1 draws the stroke once
+    unsigned int folds;
+    //! adds a copy of each fold mirrored across the line through center, vertical for the first fold
+    bool mirror;
+    CCPoint center;
+} StrokeSymmetry;
+
+//! the stroke alone
+StrokeSymmetry StrokeSymmetryNone();
+//! folds is clamped to 1 ... kStrokeSymmetryMaxFolds
+StrokeSymmetry StrokeSymmetryMake(unsigned int folds, bool mirror, CCPoint center);
+bool StrokeSymmetryEqual(const StrokeSymmetry &a, const StrokeSymmetry &b);
+//! folds, twice as many when mirrored
+unsigned int StrokeSymmetryCopyCount(const StrokeSymmetry &symmetry);
+//! transform of one copy, copy 0 is the stroke as drawn
+CCAffineTransform StrokeSymmetryTransform(const StrokeSymmetry &symmetry, unsigned int copy);
+//! covers rect and all of its copies
+CCRect StrokeSymmetryBounds(const StrokeSymmetry &symmetry, const CCRect &rect);
+
+#endif // _STROKE_SYMMETRY_H_
@@ -0,0 +1,667 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeTessellator.h"
+#include "StrokeGeometry.h"
+
+LinePoint LinePointMake(CCPoint pos, float width)
+{
+    LinePoint point;
+    point.pos = pos;
+    point.width = width;
+    point.pressure = 0xff;
+    point.tilt = 0;
+    point.time = 0;
+    return point;
+}
+
+StrokeQuality StrokeQualityDefault()
+{
+    StrokeQuality quality;
+    quality.sampleSpacing = 2.0f;
+    quality.minSpanSamples = 32;
+    quality.maxSpanSamples = 128;
+    quality.capDirections = kStrokeCapDirections;
+    quality.minInputDistance = kStrokeMinInputDistance;
+    return quality;
+}
+
+StrokeTessellator::StrokeTessellator()
+: ended(false)
+, finished(false)
+, stencilRef(0)
+, stencil(NULL)
+, maxWidth(0)
+, overdraw(3.0f)
+, quality(StrokeQualityDefault())
+, touchID(-1)
+, symmetry(StrokeSymmetryNone())
+, startTime(0)
+{
+    line.connectingLine = false;
+    line.prevSegmentLengthSQ = 0;
+    line.finishingLine = false;
+}
+
+StrokeTessellator::~StrokeTessellator()
+{
+}
+
+bool StrokeTessellator::initWithStyle(const StrokeStyle &aStyle)
+{
+    style = aStyle;
+    return true;
+}
+
+bool StrokeTessellator::initWithPoints(const StrokeStyle &aStyle, const std::vector<LinePoint> &linePoints)
+{
+    if (!initWithStyle(aStyle))
+    {
+        return false;
+    }
+    if (!linePoints.empty())
+    {
+        startNewLineFrom(linePoints.front());
+        for (unsigned int i = 1; i + 1 < linePoints.size(); ++i)
+        {
+            addPoint(linePoints[i]);
+        }
+        endLineAt(linePoints.back());
+    }
+    return true;
+}
+
+#pragma mark - Handling points
+void StrokeTessellator::startNewLineFrom(const LinePoint &newPoint)
+{
+    line.connectingLine = false;
+    addPoint(newPoint);
+}
+
+void StrokeTessellator::endLineAt(const LinePoint &aEndPoint)
+{
+    addPoint(aEndPoint);
+    line.finishingLine = true;
+    ended = true;
+}
+
+void StrokeTessellator::addPoint(const LinePoint &newPoint)
+{
+    points.push_back(newPoint);
+    
+    const CCPoint &pos = newPoint.pos;
+    if (inputPoints.empty())
+    {
+        boundsMin = boundsMax = pos;
+        maxWidth = newPoint.width;
+    }
+    else
+    {
+        boundsMin = ccp(MIN(boundsMin.x, pos.x), MIN(boundsMin.y, pos.y));
+        boundsMax = ccp(MAX(boundsMax.x, pos.x), MAX(boundsMax.y, pos.y));
+        maxWidth = MAX(maxWidth, newPoint.width);
+    }
+    inputPoints.push_back(newPoint);
+}
+
+LinePoint StrokeTessellator::pointForSample(const StylusSample &sample, float lineWidth, float pressureWidth, float tiltWidth) const
+{
+    float pressure = clampf(sample.pressure, 0.0f, 1.0f);
+    float tilt = clampf(sample.tilt, 0.0f, (float)M_PI_2) / (float)M_PI_2;
+    float width = lineWidth * (1.0f - pressureWidth * (1.0f - pressure)) * (1.0f + tiltWidth * tilt);
+    
+    LinePoint point = LinePointMake(sample.location, width);
+    point.pressure = (GLubyte)(pressure * 255.0f + 0.5f);
+    point.tilt = (GLubyte)(tilt * 255.0f + 0.5f);
+    double milliseconds = (sample.timestamp - startTime) * 1000.0;
+    point.time = (GLushort)MAX(0.0, MIN(milliseconds + 0.5, 65535.0));
+    return point;
+}
+
+bool StrokeTessellator::hasPoints() const
+{
+    return !points.empty();
+}
+
+CCPoint StrokeTessellator::getLastPosition() const
+{
+    return points.back().pos;
+}
+
+const LinePoint &StrokeTessellator::getLastPoint() const
+{
+    return points.back();
+}
+
+const std::vector<LinePoint> &StrokeTessellator::getInputPoints() const
+{
+    return inputPoints;
+}
+
+bool StrokeTessellator::isEnded() const
+{
+    return ended;
+}
+
+bool StrokeTessellator::isFinished() const
+{
+    return finished && backlogRuns.empty();
+}
+
+#pragma mark - Drawing
+
+StrokeBatchState StrokeTessellator::batchStateIn(StrokeBatch *batch)
+{
+    //! one value for the whole stroke, its later spans never blend over its earlier ones
+    if (batch->styleNeedsIsolation(style) && (stencilRef == 0 || stencil != batch->getStencil()))
+    {
+        releaseStencilRef();
+        stencil = batch->getStencil();
+        stencilRef = stencil->acquireRef();
+    }
+    return batch->stateForStyle(style, stencilRef);
+}
+
+void StrokeTessellator::releaseStencilRef()
+{
+    if (stencil != NULL)
+    {
+        stencil->releaseRef(stencilRef);
+    }
+    stencil = NULL;
+    stencilRef = 0;
+}
+
+void StrokeTessellator::tessellate(StrokeBatch *batch, unsigned int maxSpans)
+{
+    //! we need to leave last 2 points for next draw
+    if (points.size() > 2)
+    {
+        //! a burst after a hitch: the newest spans are drawn now, the older ones later as a line of their own
+        if (maxSpans > 0 && points.size() - 2 > maxSpans)
+        {
+            unsigned int split = (unsigned int)points.size() - maxSpans;
+            backlogRuns.push_back(std::vector<LinePoint>(points.begin(), points.begin() + split));
+            points.erase(points.begin(), points.begin() + split - 2);
+            line.connectingLine = false;
+        }
+        
+        //! copies may land on the canvas where the stroke itself is culled
+        const CCRect *cullRect = StrokeSymmetryCopyCount(symmetry) > 1 ? NULL : batch->getCullRect();
+        if (cullRect != NULL && !getBounds().intersectsRect(*cullRect))
+        {
+            //! nothing drawn so far can be visible, no need to look at the spans
+            line.connectingLine = false;
+        }
+        else
+        {
+            smoothedPoints.clear();
+            for (unsigned int i = 2; i < points.size(); ++i)
+            {
+                if (cullRect != NULL && !spanIntersectsRect(points[i - 2], points[i - 1], points[i], *cullRect))
+                {
+                    //! whatever follows starts a new line, it must not connect to corners left behind
+                    drawSmoothedRun(batch, false);
+                    line.connectingLine = false;
+                    continue;
+                }
+                smoothSpan(points[i - 2], points[i - 1], points[i], smoothedPoints, quality);
+            }
+            drawSmoothedRun(batch, true);
+        }
+        
+        points.erase(points.begin(), points.end() - 2);
+    }
+    if (ended)
+    {
+        finished = true;
+    }
+}
+
+bool StrokeTessellator::tessellateBacklog(StrokeBatch *batch)
+{
+    if (backlogRuns.empty())
+    {
+        return false;
+    }
+    
+    //! starts and ends with a cap where the live line left off and picked up again, whose state stays as it is
+    LineState liveLine = line;
+    line.connectingLine = false;
+    line.finishingLine = true;
+    smoothPolyline(backlogRuns.front(), smoothedPoints, quality);
+    drawSmoothedRun(batch, true);
+    line = liveLine;
+    
+    backlogRuns.pop_front();
+    return !backlogRuns.empty();
+}
+
+void StrokeTessellator::rewind()
+{
+    points = inputPoints;
+    backlogRuns.clear();
+    smoothedPoints.clear();
+    line.connectingLine = false;
+    line.finishingLine = ended;
+    finished = false;
+}
+
+bool StrokeTessellator::hasBacklog() const
+{
+    return !backlogRuns.empty();
+}
+
+void StrokeTessellator::drawSmoothedRun(StrokeBatch *batch, bool lastRun)
+{
+    if (smoothedPoints.size() > 1)
+    {
+        //! only the run reaching the last point gets the end cap
+        bool finishing = line.finishingLine;
+        line.finishingLine = finishing && lastRun;
+        batch->beginRun(batch->stateForStyle(style, stencilRef));
+        drawLines(smoothedPoints, batch);
+        if (!lastRun)
+        {
+            line.finishingLine = finishing;
+        }
+    }
+    smoothedPoints.clear();
+}
+
+float StrokeInkMargin(const StrokeStyle &style, float width, float overdraw)
+{
+    float halfWidth = width / 2;
+    if (style.join == kStrokeJoinMiter)
+    {
+        halfWidth *= MAX(1.0f, style.miterLimit);
+    }
+    return halfWidth + overdraw;
+}
+
+float StrokeTessellator::inkMargin(float width) const
+{
+    return StrokeInkMargin(style, width, overdraw);
+}
+
+bool StrokeTessellator::spanIntersectsRect(const LinePoint &prev2, const LinePoint &prev1, const LinePoint &cur, const CCRect &rect) const
+{
+    //! the curve stays within the hull of its control points, the two midpoints and prev1
+    CCPoint midPoint1 = ccpMult(ccpAdd(prev1.pos, prev2.pos), 0.5f);
+    CCPoint midPoint2 = ccpMult(ccpAdd(cur.pos, prev1.pos), 0.5f);
+    float margin = inkMargin(MAX(prev1.width, MAX(prev2.width, cur.width)));
+    
+    return MAX(MAX(midPoint1.x, midPoint2.x), prev1.pos.x) + margin >= rect.getMinX()
+        && MIN(MIN(midPoint1.x, midPoint2.x), prev1.pos.x) - margin <= rect.getMaxX()
+        && MAX(MAX(midPoint1.y, midPoint2.y), prev1.pos.y) + margin >= rect.getMinY()
+        && MIN(MIN(midPoint1.y, midPoint2.y), prev1.pos.y) - margin <= rect.getMaxY();
+}
+
+ccColor4F StrokeTessellator::inkAt(const ccColor4F &fullColor, const LinePoint &point) const
+{
+    //! premultiplied, fading scales all four channels
+    float fade = 1.0f - style.pressureOpacity * (1.0f - point.pressure / 255.0f);
+    return ccc4f(fullColor.r * fade, fullColor.g * fade, fullColor.b * fade, fullColor.a * fade);
+}
+
+CCRect StrokeTessellator::getBounds() const
+{
+    if (inputPoints.empty())
+    {
+        return CCRectZero;
+    }
+    float margin = inkMargin(maxWidth);
+    return CCRectMake(boundsMin.x - margin, boundsMin.y - margin, boundsMax.x - boundsMin.x + 2 * margin, boundsMax.y - boundsMin.y + 2 * margin);
+}
+
+void StrokeTessellator::tessellateSmoothed(const std::vector<LinePoint> &linePoints, StrokeBatch *batch)
+{
+    if (linePoints.size() > 1)
+    {
+        line.connectingLine = false;
+        line.finishingLine = true;
+        batch->beginRun(batch->stateForStyle(style, stencilRef));
+        drawLines(linePoints, batch);
+    }
+    finished = true;
+}
+
+#define ADD_TRIANGLE(V, I, A, CA, B, CB, C, CC, Z) \
+    V[I].pos = A, V[I].z = Z, V[I++].color = CA, \
+    V[I].pos = B, V[I].z = Z, V[I++].color = CB, \
+    V[I].pos = C, V[I].z = Z, V[I++].color = CC
+
+bool StrokeIsSharpTurn(const CCPoint &fromPerpendicular, const CCPoint &toPerpendicular, float halfWidth, float shorterLengthSQ)
+{
+    //! halfWidth * tan(turn / 2) > length, squared to stay clear of roots
+    float cross = ccpCross(fromPerpendicular, toPerpendicular);
+    float dot = ccpDot(fromPerpendicular, toPerpendicular);
+    return halfWidth * halfWidth * cross * cross > (1.0f + dot) * (1.0f + dot) * shorterLengthSQ;
+}
+
+void StrokeTessellator::drawLines(const std::vector<LinePoint> &linePoints, StrokeBatch *batch)
+{
+    ccColor4F fullColor = batch->inkColorForStyle(style);
+    //! vertex colors are premultiplied, faded out means all zero
+    ccColor4F fadeOutColor = ccc4f(0, 0, 0, 0);
+    //! ink follows the pressure only when the style asks for it, the common case keeps one color
+    bool pressureInk = style.pressureOpacity > 0.0f;
+
+    std::vector<LineVertex> &vertices = batch->getVertices();
+    unsigned int numberOfSegments = (unsigned int)linePoints.size() - 1;
+    unsigned int firstVertex = (unsigned int)vertices.size();
+    vertices.resize(firstVertex + numberOfSegments * 6);
+    overdrawVertices.resize(numberOfSegments * 12);
+    LineVertex *lineVertices = &vertices[firstVertex];
+    LineVertex *fadeVertices = &overdrawVertices[0];
+
+    CCPoint prevPoint = linePoints[0].pos;
+    float prevValue = linePoints[0].width;
+    float curValue;
+    ccColor4F prevColor = pressureInk ? inkAt(fullColor, linePoints[0]) : fullColor;
+    ccColor4F curColor = fullColor;
+    int index = 0;
+    int overdrawIndex = 0;
+    joinVertices.clear();
+    joinOverdrawVertices.clear();
+    for (unsigned int i = 1; i < linePoints.size(); ++i)
+    {
+        const LinePoint &pointValue = linePoints[i];
+        CCPoint curPoint = pointValue.pos;
+        curValue = pointValue.width;
+
+        //! equal points, skip them, tiny segments too unless the line ends there
+        float segmentLengthSQ = ccpLengthSQ(ccpSub(curPoint, prevPoint));
+        if (segmentLengthSQ < 0.0001f * 0.0001f
+            || (segmentLengthSQ < kStrokeMinSegmentLength * kStrokeMinSegmentLength && i < linePoints.size() - 1))
+        {
+            continue;
+        }
+
+        if (pressureInk)
+        {
+            curColor = inkAt(fullColor, pointValue);
+        }
+
+        CCPoint perpendicular = StrokeGeometryCore::perpendicular(prevPoint, curPoint);
+        CCPoint A = ccpAdd(prevPoint, ccpMult(perpendicular, prevValue / 2));
+        CCPoint B = ccpSub(prevPoint, ccpMult(perpendicular, prevValue / 2));
+        CCPoint C = ccpAdd(curPoint, ccpMult(perpendicular, curValue / 2));
+        CCPoint D = ccpSub(curPoint, ccpMult(perpendicular, curValue / 2));
+
+        //! continuing line, sharp turns get their own corners and a join instead
+        bool continuing = line.connectingLine || index > 0;
+        bool sharpTurn = continuing && StrokeIsSharpTurn(line.prevPerpendicular, perpendicular, prevValue / 2, MIN(segmentLengthSQ, line.prevSegmentLengthSQ));
+        if (sharpTurn)
+        {
+            addJoin(prevPoint, prevValue / 2, line.prevPerpendicular, perpendicular, prevColor);
+        }
+        else if (continuing)
+        {
+            A = line.prevC;
+            B = line.prevD;
+        }
+        else
+        {
+            //! circle at start of line, revert direction
+            circlesPoints.push_back(pointValue);
+            circlesPoints.push_back(linePoints[i - 1]);
+        }
+        line.prevPerpendicular = perpendicular;
+        line.prevSegmentLengthSQ = segmentLengthSQ;
+
+        ADD_TRIANGLE(lineVertices, index, A, prevColor, B, prevColor, C, curColor, 1.0f);
+        ADD_TRIANGLE(lineVertices, index, B, prevColor, C, curColor, D, curColor, 1.0f);
+
+        line.prevD = D;
+        line.prevC = C;
+        if (line.finishingLine && (i == linePoints.size() - 1))
+        {
+            circlesPoints.push_back(linePoints[i - 1]);
+            circlesPoints.push_back(pointValue);
+            line.finishingLine = false;
+        }
+        prevPoint = curPoint;
+        prevValue = curValue;
+
+        //! Add overdraw
+        CCPoint F = ccpAdd(A, ccpMult(perpendicular, overdraw));
+        CCPoint G = ccpAdd(C, ccpMult(perpendicular, overdraw));
+        CCPoint H = ccpSub(B, ccpMult(perpendicular, overdraw));
+        CCPoint I = ccpSub(D, ccpMult(perpendicular, overdraw));
+
+        //! end vertices of last line are the start of this one, also for the overdraw
+        if (continuing && !sharpTurn)
+        {
+            F = line.prevG;
+            H = line.prevI;
+        }
+
+        line.prevG = G;
+        line.prevI = I;
+
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, F, fadeOutColor, A, prevColor, G, fadeOutColor, 2.0f);
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, A, prevColor, G, fadeOutColor, C, curColor, 2.0f);
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, B, prevColor, H, fadeOutColor, D, curColor, 2.0f);
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, H, fadeOutColor, D, curColor, I, fadeOutColor, 2.0f);
+        prevColor = curColor;
+    }
+
+    vertices.resize(firstVertex + index);
+    overdrawVertices.resize(overdrawIndex);
+    vertices.insert(vertices.end(), joinVertices.begin(), joinVertices.end());
+
+    if (index > 0)
+    {
+        line.connectingLine = true;
+    }
+
+    //! solid parts go first so the faded edges never stencil out the ink of the same stroke
+    for (unsigned int i = 0; i < circlesPoints.size() / 2; ++i)
+    {
+        const LinePoint &prevCircle = circlesPoints[i * 2];
+        const LinePoint &curCircle = circlesPoints[i * 2 + 1];
+        CCPoint dirVector = StrokeGeometryCore::direction(prevCircle.pos, curCircle.pos);
+
+        this->fillLineEndPointAt(vertices, curCircle.pos, dirVector, curCircle.width * kStrokeCapRadius, pressureInk ? inkAt(fullColor, curCircle) : fullColor);
+    }
+    circlesPoints.clear();
+
+    //! without a fringe its triangles would all be slivers
+    if (overdraw > 0.0f)
+    {
+        vertices.insert(vertices.end(), overdrawVertices.begin(), overdrawVertices.end());
+        vertices.insert(vertices.end(), joinOverdrawVertices.begin(), joinOverdrawVertices.end());
+    }
+}
+
+void StrokeTessellator::addJoin(CCPoint center, float halfWidth, CCPoint fromPerpendicular, CCPoint toPerpendicular, ccColor4F color)
+{
+    ccColor4F fadeOutColor = ccc4f(0, 0, 0, 0);
+
+    //! the inner side is covered by both segments overlapping, only the outer side has a gap to fill
+    float cross = ccpCross(fromPerpendicular, toPerpendicular);
+    float side = cross > 0.0f ? -1.0f : 1.0f;
+    CCPoint fromDir = ccpMult(fromPerpendicular, side);
+    CCPoint toDir = ccpMult(toPerpendicular, side);
+    CCPoint fromCorner = ccpAdd(center, ccpMult(fromDir, halfWidth));
+    CCPoint toCorner = ccpAdd(center, ccpMult(toDir, halfWidth));
+    CCPoint fromFade = ccpAdd(fromCorner, ccpMult(fromDir, overdraw));
+    CCPoint toFade = ccpAdd(toCorner, ccpMult(toDir, overdraw));
+
+    StrokeJoin join = style.join;
+    CCPoint miter, miterFromFade, miterToFade;
+    if (join == kStrokeJoinMiter)
+    {
+        CCPoint bisector = StrokeGeometryCore::direction(CCPointZero, ccpAdd(fromDir, toDir));
+        float cosHalfTurn = ccpDot(bisector, fromDir);
+        if (cosHalfTurn * style.miterLimit < 1.0f)
+        {
+            join = kStrokeJoinBevel;
+        }
+        else
+        {
+            miter = ccpAdd(center, ccpMult(bisector, halfWidth / cosHalfTurn));
+            miterFromFade = ccpAdd(miter, ccpMult(fromDir, overdraw));
+            miterToFade = ccpAdd(miter, ccpMult(toDir, overdraw));
+        }
+    }
+    //! turning right back, a bevel would have no area
+    if (join == kStrokeJoinBevel && fabsf(cross) < 0.001f)
+    {
+        return;
+    }
+
+    unsigned int firstVertex = (unsigned int)joinVertices.size();
+    unsigned int firstOverdraw = (unsigned int)joinOverdrawVertices.size();
+    joinVertices.resize(firstVertex + kStrokeMaxJoinTriangles * 3);
+    joinOverdrawVertices.resize(firstOverdraw + kStrokeMaxJoinTriangles * 6);
+    LineVertex *solidVertices = &joinVertices[firstVertex];
+    LineVertex *fadeVertices = &joinOverdrawVertices[firstOverdraw];
+    int index = 0;
+    int overdrawIndex = 0;
+
+    if (join == kStrokeJoinMiter)
+    {
+        ADD_TRIANGLE(solidVertices, index, center, color, fromCorner, color, miter, color, 1.0f);
+        ADD_TRIANGLE(solidVertices, index, center, color, miter, color, toCorner, color, 1.0f);
+
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, fromCorner, color, fromFade, fadeOutColor, miter, color, 2.0f);
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, miter, color, fromFade, fadeOutColor, miterFromFade, fadeOutColor, 2.0f);
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, miter, color, miterToFade, fadeOutColor, toCorner, color, 2.0f);
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, toCorner, color, miterToFade, fadeOutColor, toFade, fadeOutColor, 2.0f);
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, miter, color, miterFromFade, fadeOutColor, miterToFade, fadeOutColor, 2.0f);
+    }
+    else if (join == kStrokeJoinBevel)
+    {
+        ADD_TRIANGLE(solidVertices, index, center, color, fromCorner, color, toCorner, color, 1.0f);
+
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, fromCorner, color, fromFade, fadeOutColor, toCorner, color, 2.0f);
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, toCorner, color, fromFade, fadeOutColor, toFade, fadeOutColor, 2.0f);
+    }
+    else
+    {
+        //! arc from one corner to the other, turned a fixed step at a time
+        float turn = acosf(clampf(ccpDot(fromDir, toDir), -1.0f, 1.0f));
+        int steps = MIN(kStrokeMaxJoinTriangles, MAX(1, (int)ceilf(turn / kStrokeRoundJoinStep)));
+        float stepAngle = (cross > 0.0f ? turn : -turn) / steps;
+        float cosStep = cosf(stepAngle);
+        float sinStep = sinf(stepAngle);
+
+        CCPoint prevDir = fromDir;
+        CCPoint prevCorner = fromCorner;
+        CCPoint prevFade = fromFade;
+        for (int i = 1; i <= steps; ++i)
+        {
+            CCPoint dir = (i == steps) ? toDir : ccp(prevDir.x * cosStep - prevDir.y * sinStep, prevDir.x * sinStep + prevDir.y * cosStep);
+            CCPoint corner = ccpAdd(center, ccpMult(dir, halfWidth));
+            CCPoint fade = ccpAdd(corner, ccpMult(dir, overdraw));
+
+            ADD_TRIANGLE(solidVertices, index, center, color, prevCorner, color, corner, color, 1.0f);
+            ADD_TRIANGLE(fadeVertices, overdrawIndex, prevCorner, color, prevFade, fadeOutColor, corner, color, 2.0f);
+            ADD_TRIANGLE(fadeVertices, overdrawIndex, corner, color, prevFade, fadeOutColor, fade, fadeOutColor, 2.0f);
+
+            prevDir = dir;
+            prevCorner = corner;
+            prevFade = fade;
+        }
+    }
+
+    joinVertices.resize(firstVertex + index);
+    joinOverdrawVertices.resize(firstOverdraw + overdrawIndex);
+}
+
+void StrokeTessellator::fillLineEndPointAt(std::vector<LineVertex> &vertices, CCPoint center, CCPoint aLineDir, float radius, ccColor4F color)
+{
+    const unsigned int numberOfSegments = MIN(kStrokeCapDirections, MAX(2u, quality.capDirections));
+    ccColor4F fadeOutColor = ccc4f(0, 0, 0, 0);
+
+    //! half a circle starting at the perpendicular, turned to cover the end of the line
+    CCPoint directions[kStrokeCapDirections];
+    StrokeGeometryCore::capDirections(aLineDir, numberOfSegments, directions);
+
+    unsigned int firstVertex = (unsigned int)vertices.size();
+    unsigned int firstOverdraw = (unsigned int)overdrawVertices.size();
+    vertices.resize(firstVertex + (numberOfSegments - 1) * 3);
+    overdrawVertices.resize(firstOverdraw + (numberOfSegments - 1) * 6);
+    LineVertex *capVertices = &vertices[firstVertex];
+    LineVertex *fadeVertices = &overdrawVertices[firstOverdraw];
+
+    //! the fan starts on the rim, a first triangle from the center would have no area
+    CCPoint prevPoint = ccp(center.x + radius * directions[0].x, center.y + radius * directions[0].y);
+    CCPoint prevDir = directions[0];
+    int index = 0;
+    int overdrawIndex = 0;
+    for (unsigned int i = 1; i < numberOfSegments; ++i)
+    {
+        const CCPoint &dir = directions[i];
+        CCPoint curPoint = ccp(center.x + radius * dir.x, center.y + radius * dir.y);
+        ADD_TRIANGLE(capVertices, index, center, color, prevPoint, color, curPoint, color, 1.0f);
+
+        //! add overdraw
+        CCPoint prevOverdraw = ccpAdd(prevPoint, ccpMult(prevDir, overdraw));
+        CCPoint curOverdraw = ccpAdd(curPoint, ccpMult(dir, overdraw));
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, prevOverdraw, fadeOutColor, prevPoint, color, curOverdraw, fadeOutColor, 2.0f);
+        ADD_TRIANGLE(fadeVertices, overdrawIndex, prevPoint, color, curPoint, color, curOverdraw, fadeOutColor, 2.0f);
+
+        prevPoint = curPoint;
+        prevDir = dir;
+    }
+}
+
+//! halfway between a and b in every channel
+static LinePoint midLinePoint(const LinePoint &a, const LinePoint &b)
+{
+    LinePoint mid;
+    mid.pos = ccpMult(ccpAdd(a.pos, b.pos), 0.5f);
+    mid.width = (a.width + b.width) * 0.5f;
+    mid.pressure = (GLubyte)((a.pressure + b.pressure + 1) / 2);
+    mid.tilt = (GLubyte)((a.tilt + b.tilt + 1) / 2);
+    mid.time = (GLushort)((a.time + b.time + 1) / 2);
+    return mid;
+}
+
+void StrokeTessellator::smoothSpan(const LinePoint &prev2, const LinePoint &prev1, const LinePoint &cur, std::vector<LinePoint> &smoothed,
+                        const StrokeQuality &quality)
+{
+    LinePoint start = midLinePoint(prev2, prev1);
+    LinePoint end = midLinePoint(prev1, cur);
+
+    float distance = ccpDistance(start.pos, end.pos);
+    int numberOfSegments = (int)MIN((float)quality.maxSpanSamples, MAX(floorf(distance / quality.sampleSpacing), (float)quality.minSpanSamples));
+
+    StrokeGeometryCore::sampleQuadratic(start, prev1, end, numberOfSegments, smoothed);
+
+    smoothed.push_back(end);
+}
+
+void StrokeTessellator::smoothPolyline(const std::vector<LinePoint> &linePoints, std::vector<LinePoint> &smoothed, const StrokeQuality &quality)
+{
+    smoothed.clear();
+    for (unsigned int i = 2; i < linePoints.size(); ++i)
+    {
+        smoothSpan(linePoints[i - 2], linePoints[i - 1], linePoints[i], smoothed, quality);
+    }
+}
+
@@ -0,0 +1,228 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_TESSELLATOR_H_
+#define _STROKE_TESSELLATOR_H_
+
+#include "cocos2d.h"
+#include "StrokeBatch.h"
+#include <deque>
+#include <vector>
+
+USING_NS_CC;
+
+/**
+ one input sample, 16 bytes so four share a cache line and the smoothing loops touch no more lines than before.
+ The tessellator reads pos, width and pressure only. pointForSample() folds pressure and tilt into
+ width, pressure also fades the color as far as the style's pressureOpacity asks. tilt and time are
+ carried along with the stroke and the stream for whatever needs the raw pen data, nothing draws them.
+ */
+typedef struct _LinePoint {
+    CCPoint pos;
+    float width;
+    //! 0 no pressure to 255 full, input without a pressure sensor reports full
+    GLubyte pressure;
+    //! pen angle from upright, 0 upright to 255 lying flat
+    GLubyte tilt;
+    //! milliseconds since the stroke began, stays at the maximum after about a minute
+    GLushort time;
+} LinePoint;
+
+typedef char LinePointSizeCheck[sizeof(LinePoint) == 16 ? 1 : -1];
+
+//! full pressure, upright, at the start of the stroke
+LinePoint LinePointMake(CCPoint pos, float width);
+
+//! one reading of a finger or pen, touches report full pressure and no tilt
+typedef struct _StylusSample {
+    int touchID;
+    //! in GL coordinates
+    CCPoint location;
+    //! 0 to 1
+    float pressure;
+    //! angle from upright in radians, 0 to M_PI_2
+    float tilt;
+    //! input clock in seconds, only differences matter
+    double timestamp;
+} StylusSample;
+
+//! input closer than this to the last point of a stroke is dropped
+#define kStrokeMinInputDistance 1.5f
+//! segments shorter than this are merged into the next one, they would only add sliver triangles
+#define kStrokeMinSegmentLength 0.25f
+//! turn covered by one triangle of a round join
+#define kStrokeRoundJoinStep ((float)M_PI / 16)
+//! most triangles a join adds, a round join turning all the way back
+#define kStrokeMaxJoinTriangles 16
+//! directions around the half circle of a round cap, ends included
+#define kStrokeCapDirections 32
+//! radius of the round caps in multiples of the width at the end
+#define kStrokeCapRadius 0.4f
+
+//! how finely a stroke is sampled and tessellated, traded for speed by StrokeQualityGovernor
+typedef struct _StrokeQuality {
+    //! points of the curve through each input span, one every sampleSpacing clamped to minSpanSamples..maxSpanSamples
+    float sampleSpacing;
+    unsigned int minSpanSamples;
+    unsigned int maxSpanSamples;
+    //! directions around the half circle of a round cap, at most kStrokeCapDirections
+    unsigned int capDirections;
+    //! input closer than this to the last point of a stroke is dropped
+    float minInputDistance;
+} StrokeQuality;
+
+//! the quality strokes are drawn with unless told otherwise, replays and committed strokes use it
+StrokeQuality StrokeQualityDefault();
+
+//! true when the inner corners shared by both segments would lie beyond the shorter one, folding the quads over
+bool StrokeIsSharpTurn(const CCPoint &fromPerpendicular, const CCPoint &toPerpendicular, float halfWidth, float shorterLengthSQ);
+
+//! how far ink of a point of width drawn with style reaches from it, caps, miter tips and overdraw included
+float StrokeInkMargin(const StrokeStyle &style, float width, float overdraw);
+
+/**
+ The geometry of a single line: its style, the input points not yet smoothed and the
+ state needed to connect the geometry emitted in consecutive frames.
+
+ A plain object without reference counting, so worker threads can tessellate with one
+ of their own. Stroke adds what the scene needs to keep one around.
+ */
+class StrokeTessellator
+{
+private:
+    //! draws smoothedPoints as one connected run and empties it
+    void drawSmoothedRun(StrokeBatch *batch, bool lastRun);
+    //! how far ink reaches from a point of width, caps, joins and overdraw included
+    float inkMargin(float width) const;
+    bool spanIntersectsRect(const LinePoint &prev2, const LinePoint &prev1, const LinePoint &cur, const CCRect &rect) const;
+    //! fullColor faded by the pressure at point as far as the style's pressureOpacity asks
+    ccColor4F inkAt(const ccColor4F &fullColor, const LinePoint &point) const;
+    void drawLines(const std::vector<LinePoint> &linePoints, StrokeBatch *batch);
+    //! fills the outer side of a sharp turn at center with the style's join
+    void addJoin(CCPoint center, float halfWidth, CCPoint fromPerpendicular, CCPoint toPerpendicular, ccColor4F color);
+    void fillLineEndPointAt(std::vector<LineVertex> &vertices, CCPoint center, CCPoint aLineDir, float radius, ccColor4F color);
+
+    std::vector<LinePoint> points;
+    std::vector<LinePoint> inputPoints;
+    std::vector<LinePoint> smoothedPoints;
+    std::vector<LinePoint> circlesPoints;
+    std::vector<LineVertex> overdrawVertices;
+    std::vector<LineVertex> joinVertices;
+    std::vector<LineVertex> joinOverdrawVertices;
+    //! input points of spans deferred by tessellate(), oldest first
+    std::deque<std::vector<LinePoint> > backlogRuns;
+
+    //! what connects the geometry of one drawLines call to the next
+    typedef struct _LineState {
+        bool connectingLine;
+        CCPoint prevC;
+        CCPoint prevD;
+        CCPoint prevG;
+        CCPoint prevI;
+        //! last segment drawn, decides how the next one joins it
+        CCPoint prevPerpendicular;
+        float prevSegmentLengthSQ;
+        bool finishingLine;
+    } LineState;
+    LineState line;
+    bool ended;
+    bool finished;
+    //! held from stencil until the stroke is finished, 0 while the stroke has none
+    GLint stencilRef;
+    StrokeStencil *stencil;
+    //! running bounds of the input points
+    CCPoint boundsMin;
+    CCPoint boundsMax;
+    float maxWidth;
+
+public:
+    StrokeTessellator();
+    virtual ~StrokeTessellator();
+
+    bool initWithStyle(const StrokeStyle &aStyle);
+    //! fed with a recorded point sequence again as a whole line, ready to be tessellated in one go
+    bool initWithPoints(const StrokeStyle &aStyle, const std::vector<LinePoint> &linePoints);
+
+    void startNewLineFrom(const LinePoint &newPoint);
+    void endLineAt(const LinePoint &aEndPoint);
+    void addPoint(const LinePoint &newPoint);
+    /**
+     point record of sample, lineWidth drawn at full pressure upright. pressureWidth is the part
+     of it following the pressure, tiltWidth the extra width of a pen lying flat in multiples of it.
+     */
+    LinePoint pointForSample(const StylusSample &sample, float lineWidth, float pressureWidth, float tiltWidth) const;
+
+    bool hasPoints() const;
+    CCPoint getLastPosition() const;
+    const LinePoint &getLastPoint() const;
+    //! every point added so far, what a replay needs to reproduce the stroke
+    const std::vector<LinePoint> &getInputPoints() const;
+    //! area all ink of the stroke so far lies in
+    CCRect getBounds() const;
+    bool isEnded() const;
+    //! ended and all of its geometry has been emitted, deferred runs included
+    bool isFinished() const;
+
+    /**
+     state the stroke's triangles are batched under. An isolated stroke takes a stencil value from
+     the batch's stencil here and keeps it over all its frames, drawing into a canvas asks for the
+     state before tessellating. Without it the triangles aren't isolated, as meshes need.
+     */
+    StrokeBatchState batchStateIn(StrokeBatch *batch);
+    //! hands the stencil value back once the stroke is finished or leaves the canvas it was drawn on
+    void releaseStencilRef();
+    /**
+     smooths the points added since the last call and appends the resulting triangles to batch,
+     spans outside its cull rect are skipped. With more than maxSpans new spans only the newest
+     maxSpans are drawn, the rest is kept for tessellateBacklog().
+     */
+    void tessellate(StrokeBatch *batch, unsigned int maxSpans = 0);
+    //! draws the oldest deferred run, true if there are more
+    bool tessellateBacklog(StrokeBatch *batch);
+    //! forgets the geometry emitted so far, the next tessellate() draws all input points again as a new line
+    void rewind();
+    bool hasBacklog() const;
+    //! appends an already smoothed polyline as a complete line with both caps
+    void tessellateSmoothed(const std::vector<LinePoint> &linePoints, StrokeBatch *batch);
+
+    //! quadratic curve through the midpoints around prev1, as sampled while drawing
+    static void smoothSpan(const LinePoint &prev2, const LinePoint &prev1, const LinePoint &cur, std::vector<LinePoint> &smoothed,
+                           const StrokeQuality &quality = StrokeQualityDefault());
+    //! the whole smoothed line for a recorded point sequence
+    static void smoothPolyline(const std::vector<LinePoint> &linePoints, std::vector<LinePoint> &smoothed,
+                               const StrokeQuality &quality = StrokeQualityDefault());
+
+    StrokeStyle style;
+    //! width of the fading fringe, 0 leaves the edges aliased and emits no fringe triangles
+    float overdraw;
+    StrokeQuality quality;
+    int touchID;
+    //! copies drawn along with the stroke, StrokeSymmetryNone() for none
+    StrokeSymmetry symmetry;
+    //! input clock reading of the first point in seconds, LinePoint::time counts from it
+    double startTime;
+};
+
+#endif // _STROKE_TESSELLATOR_H_
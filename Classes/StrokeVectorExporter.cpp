@@ -0,0 +1,741 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "StrokeVectorExporter.h"
+#include "StrokeSimplifier.h"
+#include <limits.h>
+#include <unistd.h>
+#include <map>
+
+//! chunks built ahead of the writer per worker, bounds the text in memory
+#define kMaxChunksAheadPerWorker 4
+//! PDF objects written before the layers: catalog, pages, page, its content, the content's length, resources
+#define kPDFPageContentObject 4
+#define kPDFResourcesObject 6
+#define kPDFFirstLayerObject 7
+
+//! straight color and alpha the ink of style is drawn with, see StrokeBatch::inkColorForStyle
+static ccColor4F vectorInk(const StrokeStyle &style, const ccColor4F &paperColor)
+{
+    ccColor4F ink = style.color;
+    if (style.blendMode == kStrokeBlendEraser)
+    {
+        ink = paperColor;
+    }
+    ink.a *= style.opacity;
+    return ink;
+}
+
+//! PDF graphics state of alpha and blend mode, also its name
+static unsigned int vectorState(float alpha, bool multiply)
+{
+    return (unsigned int)(clampf(alpha, 0.0f, 1.0f) * 1000.0f + 0.5f) * 2 + (multiply ? 1 : 0);
+}
+
+//! two decimals at most, 12.50 is 12.5 and 3.00 is 3
+static void appendNumber(std::string &text, float value)
+{
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "%.2f", value);
+    while (length > 0 && buffer[length - 1] == '0')
+    {
+        --length;
+    }
+    if (length > 0 && buffer[length - 1] == '.')
+    {
+        --length;
+    }
+    if (length == 2 && buffer[0] == '-' && buffer[1] == '0')
+    {
+        text += '0';
+        return;
+    }
+    text.append(buffer, length);
+}
+
+static void appendFormat(std::string &text, const char *format, unsigned int value)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), format, value);
+    text += buffer;
+}
+
+StrokeVectorExporter::StrokeVectorExporter()
+: threadCount(1)
+, strokesPerChunk(64)
+, format(kStrokeVectorSVG)
+, writerStarted(false)
+, nextChunk(0)
+, chunksWritten(0)
+, failed(false)
+, writeDone(false)
+, file(NULL)
+, bytesWritten(0)
+, layerStreamStart(0)
+, succeeded(false)
+, running(false)
+, finished(false)
+, updateScheduled(false)
+, callbackTarget(NULL)
+, callbackSelector(NULL)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount = cores > 0 ? (unsigned int)cores : 1;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&condition, NULL);
+}
+
+StrokeVectorExporter::~StrokeVectorExporter()
+{
+    CC_SAFE_RELEASE(callbackTarget);
+    for (unsigned int i = 0; i < chunks.size(); ++i)
+    {
+        delete chunks[i].text;
+    }
+    pthread_cond_destroy(&condition);
+    pthread_mutex_destroy(&mutex);
+}
+
+StrokeVectorExporter *StrokeVectorExporter::create(const char *aPath, StrokeVectorFormat aFormat, CCSize aCanvasSize, ccColor4F aPaperColor)
+{
+    StrokeVectorExporter *pRet = new StrokeVectorExporter();
+    if (pRet && pRet->initWithPath(aPath, aFormat, aCanvasSize, aPaperColor))
+    {
+        pRet->autorelease();
+        return pRet;
+    }
+    CC_SAFE_DELETE(pRet);
+    return NULL;
+}
+
+bool StrokeVectorExporter::initWithPath(const char *aPath, StrokeVectorFormat aFormat, CCSize aCanvasSize, ccColor4F aPaperColor)
+{
+    if (aPath == NULL || aCanvasSize.width <= 0 || aCanvasSize.height <= 0)
+    {
+        return false;
+    }
+    path = aPath;
+    format = aFormat;
+    canvasSize = aCanvasSize;
+    paperColor = aPaperColor;
+    return true;
+}
+
+void StrokeVectorExporter::addLayer(unsigned int layerID, float opacity, CanvasLayerBlendMode blendMode)
+{
+    Layer layer;
+    layer.layerID = layerID;
+    layer.opacity = opacity;
+    layer.blendMode = blendMode;
+    layers.push_back(layer);
+}
+
+void StrokeVectorExporter::setCompletionCallback(CCObject *target, SEL_CallFuncO selector)
+{
+    CC_SAFE_RETAIN(target);
+    CC_SAFE_RELEASE(callbackTarget);
+    callbackTarget = target;
+    callbackSelector = selector;
+}
+
+bool StrokeVectorExporter::isFinished() const
+{
+    return finished;
+}
+
+bool StrokeVectorExporter::isSucceeded() const
+{
+    return succeeded;
+}
+
+const std::string &StrokeVectorExporter::getPath() const
+{
+    return path;
+}
+
+float StrokeVectorExporter::getProgress() const
+{
+    pthread_mutex_lock(&mutex);
+    float progress = chunks.empty() ? (writeDone ? 1.0f : 0.0f) : (float)chunksWritten / chunks.size();
+    pthread_mutex_unlock(&mutex);
+    return progress;
+}
+
+void StrokeVectorExporter::copyJobs(const StrokeIndex &index)
+{
+    std::map<unsigned int, unsigned int> layerForID;
+    for (unsigned int i = 0; i < layers.size(); ++i)
+    {
+        layerForID[layers[i].layerID] = i;
+    }
+    
+    //! ids ascending are in drawing order, bucketed by layer they stay so
+    std::vector<std::vector<const StrokeRecord *> > layerRecords(layers.size());
+    for (unsigned int strokeID = 1; strokeID <= index.getLastStrokeID(); ++strokeID)
+    {
+        const StrokeRecord *record = index.recordForID(strokeID);
+        if (record == NULL)
+        {
+            continue;
+        }
+        std::map<unsigned int, unsigned int>::const_iterator layer = layerForID.find(record->layerID);
+        if (layer != layerForID.end())
+        {
+            layerRecords[layer->second].push_back(record);
+        }
+    }
+    
+    jobs.clear();
+    chunks.clear();
+    for (unsigned int layer = 0; layer < layerRecords.size(); ++layer)
+    {
+        const std::vector<const StrokeRecord *> &records = layerRecords[layer];
+        for (unsigned int i = 0; i < records.size(); ++i)
+        {
+            const StrokeRecord &record = *records[i];
+            jobs.push_back(Job());
+            Job &job = jobs.back();
+            job.style = record.style;
+            job.symmetry = record.symmetry;
+            job.smoothed = !record.levels.empty() && !record.levels[0].empty();
+            job.points = StrokeRecordOutline(record);
+            job.fill = record.fill;
+            job.fillScale = record.fillScale;
+            
+            if (i % strokesPerChunk == 0)
+            {
+                Chunk chunk;
+                chunk.firstJob = (unsigned int)jobs.size() - 1;
+                chunk.layer = layer;
+                chunk.text = NULL;
+                chunks.push_back(chunk);
+            }
+            chunks.back().endJob = (unsigned int)jobs.size();
+        }
+    }
+}
+
+bool StrokeVectorExporter::startThreads(const StrokeIndex &index)
+{
+    if (running || finished)
+    {
+        return false;
+    }
+    strokesPerChunk = MAX(strokesPerChunk, 1u);
+    copyJobs(index);
+    
+    if (pthread_create(&writer, NULL, &StrokeVectorExporter::writerEntry, this) != 0)
+    {
+        CCLOG("StrokeVectorExporter: could not start writer thread");
+        return false;
+    }
+    writerStarted = true;
+    //! more workers than chunks would only wait
+    unsigned int workerCount = MIN(MAX(threadCount, 1u), (unsigned int)chunks.size());
+    for (unsigned int i = 0; i < workerCount; ++i)
+    {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, &StrokeVectorExporter::workerEntry, this) != 0)
+        {
+            break;
+        }
+        workers.push_back(worker);
+    }
+    
+    running = true;
+    retain();
+    return true;
+}
+
+void StrokeVectorExporter::start(const StrokeIndex &index)
+{
+    if (startThreads(index))
+    {
+        updateScheduled = true;
+        CCDirector::sharedDirector()->getScheduler()->scheduleUpdateForTarget(this, 0, false);
+    }
+}
+
+void StrokeVectorExporter::start(const StrokeIndex &index, FrameScheduler *scheduler)
+{
+    if (startThreads(index))
+    {
+        scheduler->addTask(this, frametask_selector(StrokeVectorExporter::pollStep), kFrameTaskExport);
+    }
+}
+
+bool StrokeVectorExporter::exportNow(const StrokeIndex &index)
+{
+    if (!startThreads(index))
+    {
+        return false;
+    }
+    join();
+    release();
+    return succeeded;
+}
+
+void StrokeVectorExporter::update(float dt)
+{
+    pollStep();
+}
+
+FrameTaskStatus StrokeVectorExporter::pollStep()
+{
+    pthread_mutex_lock(&mutex);
+    bool done = writeDone;
+    pthread_mutex_unlock(&mutex);
+    if (!done)
+    {
+        return kFrameTaskWait;
+    }
+    
+    join();
+    if (updateScheduled)
+    {
+        CCDirector::sharedDirector()->getScheduler()->unscheduleUpdateForTarget(this);
+    }
+    if (callbackTarget && callbackSelector)
+    {
+        (callbackTarget->*callbackSelector)(this);
+    }
+    release();
+    return kFrameTaskDone;
+}
+
+void StrokeVectorExporter::join()
+{
+    pthread_join(writer, NULL);
+    for (unsigned int i = 0; i < workers.size(); ++i)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    workers.clear();
+    writerStarted = false;
+    running = false;
+    finished = true;
+}
+
+void *StrokeVectorExporter::workerEntry(void *exporter)
+{
+    ((StrokeVectorExporter *)exporter)->work();
+    return NULL;
+}
+
+void *StrokeVectorExporter::writerEntry(void *exporter)
+{
+    ((StrokeVectorExporter *)exporter)->write();
+    return NULL;
+}
+
+void StrokeVectorExporter::work()
+{
+    StrokeOutlinePath outline;
+    std::vector<LinePoint> smoothed;
+    unsigned int maxAhead = kMaxChunksAheadPerWorker * MAX(threadCount, 1u);
+    pthread_mutex_lock(&mutex);
+    while (true)
+    {
+        while (nextChunk < chunks.size() && nextChunk >= chunksWritten + maxAhead && !failed)
+        {
+            pthread_cond_wait(&condition, &mutex);
+        }
+        if (nextChunk >= chunks.size() || failed)
+        {
+            break;
+        }
+        //! every chunk is taken by exactly one worker, it has the chunk and its jobs to itself until the text is handed over
+        Chunk &chunk = chunks[nextChunk++];
+        pthread_mutex_unlock(&mutex);
+        
+        std::string *text = buildChunk(chunk, outline, smoothed);
+        
+        pthread_mutex_lock(&mutex);
+        chunk.text = text;
+        pthread_cond_broadcast(&condition);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+std::string *StrokeVectorExporter::buildChunk(Chunk &chunk, StrokeOutlinePath &outline, std::vector<LinePoint> &smoothed)
+{
+    std::vector<LinePoint> simplified;
+    std::string *text = new std::string();
+    for (unsigned int i = chunk.firstJob; i < chunk.endJob; ++i)
+    {
+        Job &job = jobs[i];
+        outline.points.clear();
+        outline.contourStarts.clear();
+        if (!job.fill.empty())
+        {
+            StrokeOutline::addFill(job.fill, job.fillScale, outline);
+        }
+        else if (job.smoothed)
+        {
+            StrokeOutline::addStroke(job.points, job.style, outline);
+        }
+        else
+        {
+            //! what the curve worker would have made level 0 from, simplified as much
+            StrokeTessellator::smoothPolyline(job.points, smoothed);
+            StrokeSimplifier::simplify(smoothed, StrokeSimplifier::toleranceForLevel(0), simplified);
+            StrokeOutline::addStroke(simplified, job.style, outline);
+        }
+        StrokeOutline::addSymmetryCopies(job.symmetry, outline);
+        appendPath(outline, job.style, *text, chunk.states);
+        
+        //! the copies go as the file grows
+        std::vector<LinePoint>().swap(job.points);
+        std::vector<CanvasFillSpan>().swap(job.fill);
+    }
+    return text;
+}
+
+void StrokeVectorExporter::appendPath(const StrokeOutlinePath &outline, const StrokeStyle &style, std::string &text, std::set<unsigned int> &states)
+{
+    ccColor4F ink = vectorInk(style, paperColor);
+    if (outline.contourStarts.empty() || ink.a <= 0.0f)
+    {
+        return;
+    }
+    bool multiply = style.blendMode == kStrokeBlendMultiply;
+    const std::vector<CCPoint> &points = outline.points;
+    unsigned int contourCount = (unsigned int)outline.contourStarts.size();
+    
+    if (format == kStrokeVectorSVG)
+    {
+        char color[16];
+        snprintf(color, sizeof(color), "#%02x%02x%02x", (unsigned int)(ink.r * 255.0f + 0.5f), (unsigned int)(ink.g * 255.0f + 0.5f),
+                 (unsigned int)(ink.b * 255.0f + 0.5f));
+        text += "<path fill=\"";
+        text += color;
+        if (ink.a < 1.0f)
+        {
+            text += "\" fill-opacity=\"";
+            appendNumber(text, ink.a);
+        }
+        if (multiply)
+        {
+            text += "\" style=\"mix-blend-mode:multiply";
+        }
+        text += "\" d=\"";
+        //! y down in SVG, every number after a moveto is a lineto
+        for (unsigned int contour = 0; contour < contourCount; ++contour)
+        {
+            unsigned int end = contour + 1 < contourCount ? outline.contourStarts[contour + 1] : (unsigned int)points.size();
+            text += 'M';
+            for (unsigned int i = outline.contourStarts[contour]; i < end; ++i)
+            {
+                if (i > outline.contourStarts[contour])
+                {
+                    text += ' ';
+                }
+                appendNumber(text, points[i].x);
+                text += ' ';
+                appendNumber(text, canvasSize.height - points[i].y);
+            }
+            text += 'Z';
+        }
+        text += "\"/>\n";
+        return;
+    }
+    
+    //! PDF has y up like GL, the nonzero rule is f
+    bool ownState = ink.a < 1.0f || multiply;
+    if (ownState)
+    {
+        unsigned int state = vectorState(ink.a, multiply);
+        states.insert(state);
+        appendFormat(text, "q /G%u gs\n", state);
+    }
+    appendNumber(text, ink.r);
+    text += ' ';
+    appendNumber(text, ink.g);
+    text += ' ';
+    appendNumber(text, ink.b);
+    text += " rg\n";
+    for (unsigned int contour = 0; contour < contourCount; ++contour)
+    {
+        unsigned int end = contour + 1 < contourCount ? outline.contourStarts[contour + 1] : (unsigned int)points.size();
+        for (unsigned int i = outline.contourStarts[contour]; i < end; ++i)
+        {
+            appendNumber(text, points[i].x);
+            text += ' ';
+            appendNumber(text, points[i].y);
+            text += i == outline.contourStarts[contour] ? " m\n" : " l\n";
+        }
+        text += "h\n";
+    }
+    text += ownState ? "f Q\n" : "f\n";
+}
+
+bool StrokeVectorExporter::writeText(const std::string &text)
+{
+    if (file == NULL || fwrite(text.data(), 1, text.size(), file) != text.size())
+    {
+        return false;
+    }
+    bytesWritten += text.size();
+    return true;
+}
+
+void StrokeVectorExporter::write()
+{
+    file = fopen(path.c_str(), "wb");
+    bool ok = file != NULL && writeHeader();
+    
+    unsigned int openLayer = UINT_MAX;
+    for (unsigned int i = 0; i < chunks.size(); ++i)
+    {
+        pthread_mutex_lock(&mutex);
+        while (chunks[i].text == NULL && !failed)
+        {
+            pthread_cond_wait(&condition, &mutex);
+        }
+        std::string *text = chunks[i].text;
+        chunks[i].text = NULL;
+        pthread_mutex_unlock(&mutex);
+        if (text == NULL)
+        {
+            break;
+        }
+        
+        const Chunk &chunk = chunks[i];
+        if (ok && chunk.layer != openLayer)
+        {
+            ok = (openLayer == UINT_MAX || endLayer()) && beginLayer(chunk.layer);
+            openLayer = chunk.layer;
+        }
+        usedStates.insert(chunk.states.begin(), chunk.states.end());
+        ok = ok && writeText(*text);
+        delete text;
+        
+        pthread_mutex_lock(&mutex);
+        ++chunksWritten;
+        //! after a failure the workers stop instead of building what can't be written
+        failed = !ok;
+        pthread_cond_broadcast(&condition);
+        pthread_mutex_unlock(&mutex);
+    }
+    
+    ok = ok && (openLayer == UINT_MAX || endLayer()) && writeTrailer();
+    if (file != NULL)
+    {
+        ok = fclose(file) == 0 && ok;
+        file = NULL;
+    }
+    
+    pthread_mutex_lock(&mutex);
+    succeeded = ok;
+    writeDone = true;
+    pthread_cond_broadcast(&condition);
+    pthread_mutex_unlock(&mutex);
+}
+
+bool StrokeVectorExporter::writeHeader()
+{
+    std::string text;
+    if (format == kStrokeVectorSVG)
+    {
+        text += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" width=\"";
+        appendNumber(text, canvasSize.width);
+        text += "\" height=\"";
+        appendNumber(text, canvasSize.height);
+        text += "\" viewBox=\"0 0 ";
+        appendNumber(text, canvasSize.width);
+        text += ' ';
+        appendNumber(text, canvasSize.height);
+        text += "\">\n";
+        if (paperColor.a > 0.0f)
+        {
+            char color[16];
+            snprintf(color, sizeof(color), "#%02x%02x%02x", (unsigned int)(paperColor.r * 255.0f + 0.5f), (unsigned int)(paperColor.g * 255.0f + 0.5f),
+                     (unsigned int)(paperColor.b * 255.0f + 0.5f));
+            text += "<rect width=\"100%\" height=\"100%\" fill=\"";
+            text += color;
+            if (paperColor.a < 1.0f)
+            {
+                text += "\" fill-opacity=\"";
+                appendNumber(text, paperColor.a);
+            }
+            text += "\"/>\n";
+        }
+        return writeText(text);
+    }
+    
+    //! the page and what it refers to are written around the layers, their numbers are fixed up front
+    text += "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n";
+    objectOffsets.assign(kPDFFirstLayerObject, 0);
+    objectOffsets[1] = bytesWritten + text.size();
+    text += "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n";
+    objectOffsets[2] = bytesWritten + text.size();
+    text += "2 0 obj\n<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n";
+    objectOffsets[3] = bytesWritten + text.size();
+    text += "3 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [0 0 ";
+    appendNumber(text, canvasSize.width);
+    text += ' ';
+    appendNumber(text, canvasSize.height);
+    appendFormat(text, "] /Contents %u 0 R", kPDFPageContentObject);
+    appendFormat(text, " /Resources %u 0 R >>\nendobj\n", kPDFResourcesObject);
+    layerObjects.assign(layers.size(), 0);
+    return writeText(text);
+}
+
+bool StrokeVectorExporter::beginLayer(unsigned int layer)
+{
+    const Layer &info = layers[layer];
+    std::string text;
+    if (format == kStrokeVectorSVG)
+    {
+        text += "<g";
+        if (info.opacity < 1.0f)
+        {
+            text += " opacity=\"";
+            appendNumber(text, info.opacity);
+            text += '"';
+        }
+        if (info.blendMode == kCanvasLayerBlendMultiply)
+        {
+            text += " style=\"mix-blend-mode:multiply\"";
+        }
+        text += ">\n";
+        return writeText(text);
+    }
+    
+    //! a transparency group, so the layer's opacity applies to the layer composed and not to each stroke
+    unsigned int object = (unsigned int)objectOffsets.size();
+    layerObjects[layer] = object;
+    objectOffsets.push_back(bytesWritten);
+    appendFormat(text, "%u 0 obj\n<< /Type /XObject /Subtype /Form /BBox [0 0 ", object);
+    appendNumber(text, canvasSize.width);
+    text += ' ';
+    appendNumber(text, canvasSize.height);
+    appendFormat(text, "] /Group << /S /Transparency >> /Resources %u 0 R", kPDFResourcesObject);
+    appendFormat(text, " /Length %u 0 R >>\nstream\n", object + 1);
+    bool ok = writeText(text);
+    layerStreamStart = bytesWritten;
+    return ok;
+}
+
+bool StrokeVectorExporter::endLayer()
+{
+    if (format == kStrokeVectorSVG)
+    {
+        return writeText("</g>\n");
+    }
+    
+    unsigned int lengthObject = (unsigned int)objectOffsets.size();
+    std::string text = "endstream\nendobj\n";
+    unsigned long streamLength = bytesWritten - layerStreamStart;
+    objectOffsets.push_back(bytesWritten + text.size());
+    appendFormat(text, "%u 0 obj\n", lengthObject);
+    appendFormat(text, "%u\nendobj\n", (unsigned int)streamLength);
+    return writeText(text);
+}
+
+bool StrokeVectorExporter::writeTrailer()
+{
+    if (format == kStrokeVectorSVG)
+    {
+        return writeText("</svg>\n");
+    }
+    
+    //! the page: paper, then each layer's form under its opacity and blend mode
+    std::string content;
+    if (paperColor.a > 0.0f)
+    {
+        if (paperColor.a < 1.0f)
+        {
+            unsigned int state = vectorState(paperColor.a, false);
+            usedStates.insert(state);
+            appendFormat(content, "/G%u gs\n", state);
+        }
+        appendNumber(content, paperColor.r);
+        content += ' ';
+        appendNumber(content, paperColor.g);
+        content += ' ';
+        appendNumber(content, paperColor.b);
+        content += " rg\n0 0 ";
+        appendNumber(content, canvasSize.width);
+        content += ' ';
+        appendNumber(content, canvasSize.height);
+        content += " re\nf\n";
+    }
+    for (unsigned int i = 0; i < layers.size(); ++i)
+    {
+        if (layerObjects[i] == 0)
+        {
+            continue;
+        }
+        unsigned int state = vectorState(layers[i].opacity, layers[i].blendMode == kCanvasLayerBlendMultiply);
+        usedStates.insert(state);
+        appendFormat(content, "q /G%u gs ", state);
+        appendFormat(content, "/L%u Do Q\n", i);
+    }
+    
+    std::string text;
+    objectOffsets[kPDFPageContentObject] = bytesWritten;
+    appendFormat(text, "%u 0 obj\n", kPDFPageContentObject);
+    appendFormat(text, "<< /Length %u >>\nstream\n", (unsigned int)content.size());
+    text += content;
+    text += "endstream\nendobj\n";
+    objectOffsets[kPDFPageContentObject + 1] = bytesWritten + text.size();
+    appendFormat(text, "%u 0 obj\n", kPDFPageContentObject + 1);
+    appendFormat(text, "%u\nendobj\n", (unsigned int)content.size());
+    
+    objectOffsets[kPDFResourcesObject] = bytesWritten + text.size();
+    appendFormat(text, "%u 0 obj\n<< /ExtGState <<", kPDFResourcesObject);
+    for (std::set<unsigned int>::const_iterator state = usedStates.begin(); state != usedStates.end(); ++state)
+    {
+        appendFormat(text, " /G%u << /ca ", *state);
+        appendNumber(text, (*state / 2) / 1000.0f);
+        text += " /CA ";
+        appendNumber(text, (*state / 2) / 1000.0f);
+        text += (*state & 1) ? " /BM /Multiply >>" : " /BM /Normal >>";
+    }
+    text += " >> /XObject <<";
+    for (unsigned int i = 0; i < layers.size(); ++i)
+    {
+        if (layerObjects[i] != 0)
+        {
+            appendFormat(text, " /L%u", i);
+            appendFormat(text, " %u 0 R", layerObjects[i]);
+        }
+    }
+    text += " >> >>\nendobj\n";
+    
+    unsigned long xrefOffset = bytesWritten + text.size();
+    appendFormat(text, "xref\n0 %u\n0000000000 65535 f \n", (unsigned int)objectOffsets.size());
+    for (unsigned int i = 1; i < objectOffsets.size(); ++i)
+    {
+        char entry[32];
+        snprintf(entry, sizeof(entry), "%010lu 00000 n \n", objectOffsets[i]);
+        text += entry;
+    }
+    appendFormat(text, "trailer\n<< /Size %u /Root 1 0 R >>\n", (unsigned int)objectOffsets.size());
+    char startXref[48];
+    snprintf(startXref, sizeof(startXref), "startxref\n%lu\n%%%%EOF\n", xrefOffset);
+    text += startXref;
+    return writeText(text);
+}
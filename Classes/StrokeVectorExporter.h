@@ -0,0 +1,181 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STROKE_VECTOR_EXPORTER_H_
+#define _STROKE_VECTOR_EXPORTER_H_
+
+#include "cocos2d.h"
+#include "CanvasLayerStack.h"
+#include "FrameScheduler.h"
+#include "StrokeIndex.h"
+#include "StrokeOutline.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <set>
+#include <string>
+#include <vector>
+
+USING_NS_CC;
+
+typedef enum {
+    kStrokeVectorSVG,
+    //! one page of the canvas size, a point per PDF unit
+    kStrokeVectorPDF
+} StrokeVectorFormat;
+
+/**
+ Saves the committed strokes as filled outlines, see StrokeOutline.
+
+ start() copies the strokes of the added layers out of the stroke index, so drawing can
+ go on right away. The strokes are cut into chunks in drawing order, worker threads turn
+ chunks into path data in parallel and a writer thread streams them into the file in
+ order. Workers stay at most a few chunks ahead of the writer, only those are ever held
+ as text. Each layer is a group with its opacity and blend mode, each stroke one path of
+ its ink color, with all of its symmetry copies.
+
+ Vector ink is solid: the anti aliasing fringe and the fading by pen pressure are left
+ out, feathered fill edges are cut halfway. The eraser paints the paper color, on layers
+ above the paper as well.
+ */
+class StrokeVectorExporter : public CCObject
+{
+public:
+    StrokeVectorExporter();
+    virtual ~StrokeVectorExporter();
+
+    //! paperColor fills the page below all layers
+    static StrokeVectorExporter *create(const char *aPath, StrokeVectorFormat aFormat, CCSize aCanvasSize, ccColor4F aPaperColor);
+    bool initWithPath(const char *aPath, StrokeVectorFormat aFormat, CCSize aCanvasSize, ccColor4F aPaperColor);
+
+    //! layers to export, bottom to top, strokes of any other layer are left out
+    void addLayer(unsigned int layerID, float opacity, CanvasLayerBlendMode blendMode);
+    //! selector is called with this exporter once the file is complete or failed
+    void setCompletionCallback(CCObject *target, SEL_CallFuncO selector);
+    //! copies the strokes out of index and polls the threads every frame
+    void start(const StrokeIndex &index);
+    //! polls the threads as export tasks of scheduler
+    void start(const StrokeIndex &index, FrameScheduler *scheduler);
+    //! writes the file before returning, for tools without a run loop, no callback
+    bool exportNow(const StrokeIndex &index);
+
+    virtual void update(float dt);
+    //! finishes once the file is written
+    FrameTaskStatus pollStep();
+
+    bool isFinished() const;
+    bool isSucceeded() const;
+    const std::string &getPath() const;
+    //! fraction of strokes written
+    float getProgress() const;
+
+    //! outline workers, defaults to the number of cores
+    unsigned int threadCount;
+    //! strokes a worker takes at once
+    unsigned int strokesPerChunk;
+
+private:
+    typedef struct _Layer {
+        unsigned int layerID;
+        float opacity;
+        CanvasLayerBlendMode blendMode;
+    } Layer;
+
+    //! what the outline of one committed stroke or fill needs
+    typedef struct _Job {
+        StrokeStyle style;
+        StrokeSymmetry symmetry;
+        //! level 0 of the stroke, or its input points while those have not been smoothed
+        std::vector<LinePoint> points;
+        bool smoothed;
+        std::vector<CanvasFillSpan> fill;
+        float fillScale;
+    } Job;
+
+    typedef struct _Chunk {
+        unsigned int firstJob;
+        unsigned int endJob;
+        //! index into layers, a chunk never spans two
+        unsigned int layer;
+        //! path data of the chunk's jobs, NULL until a worker built it
+        std::string *text;
+        //! PDF graphics states the text refers to
+        std::set<unsigned int> states;
+    } Chunk;
+
+    static void *workerEntry(void *exporter);
+    static void *writerEntry(void *exporter);
+    bool startThreads(const StrokeIndex &index);
+    void copyJobs(const StrokeIndex &index);
+    void work();
+    void write();
+    //! path data of the chunk's jobs, fills in its states
+    std::string *buildChunk(Chunk &chunk, StrokeOutlinePath &outline, std::vector<LinePoint> &smoothed);
+    void appendPath(const StrokeOutlinePath &outline, const StrokeStyle &style, std::string &text, std::set<unsigned int> &states);
+    bool writeText(const std::string &text);
+    //! the document around the layers, for PDF the page objects and the cross reference table
+    bool writeHeader();
+    bool beginLayer(unsigned int layer);
+    bool endLayer();
+    bool writeTrailer();
+    void join();
+
+    std::string path;
+    StrokeVectorFormat format;
+    CCSize canvasSize;
+    ccColor4F paperColor;
+    std::vector<Layer> layers;
+    std::vector<Job> jobs;
+    std::vector<Chunk> chunks;
+
+    std::vector<pthread_t> workers;
+    pthread_t writer;
+    bool writerStarted;
+    mutable pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    unsigned int nextChunk;
+    unsigned int chunksWritten;
+    bool failed;
+    bool writeDone;
+
+    //! touched by the writer thread only
+    FILE *file;
+    unsigned long bytesWritten;
+    std::vector<unsigned long> objectOffsets;
+    //! PDF form object of each layer written, 0 for layers without strokes
+    std::vector<unsigned int> layerObjects;
+    unsigned long layerStreamStart;
+    std::set<unsigned int> usedStates;
+
+    bool succeeded;
+    bool running;
+    bool finished;
+    //! the director's scheduler calls update() instead of a FrameScheduler calling pollStep()
+    bool updateScheduled;
+
+    CCObject *callbackTarget;
+    SEL_CallFuncO callbackSelector;
+};
+
+#endif // _STROKE_VECTOR_EXPORTER_H_
@@ -0,0 +1,144 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "SyntheticStylus.h"
+
+SyntheticStylus::SyntheticStylus()
+: strokeCount(6)
+, strokeDuration(1.5f)
+, strokePause(0.25f)
+, sampleRate(120.0f)
+, layer(NULL)
+, startTime(0)
+, clock(0)
+, nextStroke(0)
+, nextSample(0)
+, running(false)
+, finished(false)
+{
+}
+
+SyntheticStylus::~SyntheticStylus()
+{
+    CC_SAFE_RELEASE(layer);
+}
+
+SyntheticStylus *SyntheticStylus::create(PaintLayer *aLayer)
+{
+    SyntheticStylus *pRet = new SyntheticStylus();
+    if (pRet && pRet->initWithLayer(aLayer))
+    {
+        pRet->autorelease();
+        return pRet;
+    }
+    CC_SAFE_DELETE(pRet);
+    return NULL;
+}
+
+bool SyntheticStylus::initWithLayer(PaintLayer *aLayer)
+{
+    if (aLayer == NULL)
+    {
+        return false;
+    }
+    layer = aLayer;
+    layer->retain();
+    return true;
+}
+
+void SyntheticStylus::start()
+{
+    if (running || finished)
+    {
+        return;
+    }
+    running = true;
+    startTime = PaintLayer::inputClock();
+    retain();
+    CCDirector::sharedDirector()->getScheduler()->scheduleUpdateForTarget(this, 0, false);
+}
+
+bool SyntheticStylus::isFinished() const
+{
+    return finished;
+}
+
+StylusSample SyntheticStylus::sampleAt(unsigned int stroke, float phase) const
+{
+    CCSize size = layer->getContentSize();
+    float band = size.height / (strokeCount + 1);
+    float angle = phase * 2.0f * (float)M_PI;
+    
+    StylusSample sample;
+    sample.touchID = kSyntheticStylusTouchID;
+    sample.location = ccp(size.width * (0.1f + 0.8f * phase), band * (stroke + 1) + band * 0.35f * sinf(angle * (1 + stroke % 3)));
+    //! pressure swings down to almost nothing and back, tilt leans the pen over and up again
+    sample.pressure = 0.55f + 0.45f * sinf(angle * 1.5f + stroke);
+    sample.tilt = (float)M_PI_2 * 0.8f * fabsf(sinf(angle * 0.5f + stroke * 0.7f));
+    sample.timestamp = startTime + stroke * (strokeDuration + strokePause) + phase * strokeDuration;
+    return sample;
+}
+
+void SyntheticStylus::update(float dt)
+{
+    clock += dt;
+    
+    unsigned int samplesPerStroke = MAX(2, (unsigned int)(strokeDuration * sampleRate));
+    while (nextStroke < strokeCount)
+    {
+        float phase = (float)nextSample / (samplesPerStroke - 1);
+        StylusSample sample = sampleAt(nextStroke, phase);
+        if (sample.timestamp - startTime > clock)
+        {
+            break;
+        }
+        
+        if (nextSample == 0)
+        {
+            layer->stylusBegan(sample);
+        }
+        else if (nextSample == samplesPerStroke - 1)
+        {
+            layer->stylusEnded(sample);
+        }
+        else
+        {
+            layer->stylusMoved(sample);
+        }
+        
+        if (++nextSample == samplesPerStroke)
+        {
+            nextSample = 0;
+            ++nextStroke;
+        }
+    }
+    
+    if (nextStroke == strokeCount)
+    {
+        CCDirector::sharedDirector()->getScheduler()->unscheduleUpdateForTarget(this);
+        running = false;
+        finished = true;
+        release();
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _SYNTHETIC_STYLUS_H_
+#define _SYNTHETIC_STYLUS_H_
+
+#include "cocos2d.h"
+#include "PaintLayer.h"
+
+USING_NS_CC;
+
+//! touch id of the generated pen, real touches count from 0
+#define kSyntheticStylusTouchID -2
+
+/**
+ Draws generated pen strokes into a PaintLayer, for platforms without pen input.
+
+ Strokes are waves across the canvas, one band each, sampled at a fixed rate like a
+ pen digitizer with pressure and tilt swinging over their whole range. Samples are
+ handed over in frame sized bursts through PaintLayer::stylusBegan/Moved/Ended, the
+ same path touches take. The sequence is the same on every run.
+ */
+class SyntheticStylus : public CCObject
+{
+public:
+    SyntheticStylus();
+    virtual ~SyntheticStylus();
+
+    static SyntheticStylus *create(PaintLayer *aLayer);
+    bool initWithLayer(PaintLayer *aLayer);
+
+    //! keeps itself alive until the last stroke has ended
+    void start();
+    bool isFinished() const;
+
+    virtual void update(float dt);
+
+    unsigned int strokeCount;
+    //! seconds one stroke takes to draw
+    float strokeDuration;
+    //! seconds between strokes
+    float strokePause;
+    //! samples per second while the pen is down
+    float sampleRate;
+
+private:
+    //! sample of stroke at phase 0 to 1
+    StylusSample sampleAt(unsigned int stroke, float phase) const;
+
+    PaintLayer *layer;
+    //! PaintLayer::inputClock() at start(), sample timestamps count from it like those of touches
+    double startTime;
+    //! seconds since start()
+    double clock;
+    //! stroke and sample to emit next
+    unsigned int nextStroke;
+    unsigned int nextSample;
+    bool running;
+    bool finished;
+};
+
+#endif // _SYNTHETIC_STYLUS_H_
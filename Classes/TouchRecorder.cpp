@@ -0,0 +1,201 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "TouchRecorder.h"
+#include <unistd.h>
+
+//! how often the writer wakes up, in microseconds
+#define kTouchRecorderFlushInterval 100000
+
+TouchRecorder::TouchRecorder()
+: writeIndex(0)
+, readIndex(0)
+, stopRequested(false)
+, recording(false)
+, file(NULL)
+, previousTimestamp(0)
+, writeFailed(false)
+, recordedEvents(0)
+, droppedEvents(0)
+{
+}
+
+TouchRecorder::~TouchRecorder()
+{
+    stop();
+}
+
+bool TouchRecorder::start(const char *path, const TouchTraceHeader &header)
+{
+    if (recording || path == NULL)
+    {
+        return false;
+    }
+    
+    file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        CCLOG("TouchRecorder: could not create %s", path);
+        return false;
+    }
+    encoded.clear();
+    TouchTrace::encodeHeader(encoded, header);
+    if (fwrite(&encoded[0], 1, encoded.size(), file) != encoded.size())
+    {
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    
+    ring.resize(kTouchRecorderCapacity);
+    writeIndex = 0;
+    readIndex = 0;
+    stopRequested = false;
+    previousTimestamp = header.startTime;
+    writeFailed = false;
+    recordedEvents = 0;
+    droppedEvents = 0;
+    
+    if (pthread_create(&writeThread, NULL, &TouchRecorder::writeThreadEntry, this) != 0)
+    {
+        CCLOG("TouchRecorder: could not start writer thread");
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    recording = true;
+    return true;
+}
+
+void TouchRecorder::stop()
+{
+    if (!recording)
+    {
+        return;
+    }
+    recording = false;
+    stopRequested = true;
+    pthread_join(writeThread, NULL);
+    
+    if (fclose(file) != 0 || writeFailed)
+    {
+        CCLOG("TouchRecorder: trace is incomplete, writing failed");
+    }
+    file = NULL;
+    if (droppedEvents > 0)
+    {
+        CCLOG("TouchRecorder: dropped %u of %u events, the writer fell behind", droppedEvents, recordedEvents + droppedEvents);
+    }
+    //! the ring is only needed while recording
+    std::vector<TouchTraceEvent>().swap(ring);
+}
+
+bool TouchRecorder::isRecording() const
+{
+    return recording;
+}
+
+unsigned int TouchRecorder::getRecordedEvents() const
+{
+    return recordedEvents;
+}
+
+unsigned int TouchRecorder::getDroppedEvents() const
+{
+    return droppedEvents;
+}
+
+void TouchRecorder::record(TouchTraceEventType type, const StylusSample &sample)
+{
+    if (!recording)
+    {
+        return;
+    }
+    
+    unsigned int write = writeIndex;
+    if (write - readIndex >= kTouchRecorderCapacity)
+    {
+        ++droppedEvents;
+        return;
+    }
+    
+    TouchTraceEvent &event = ring[write & (kTouchRecorderCapacity - 1)];
+    event.type = type;
+    event.touchID = sample.touchID;
+    event.location = sample.location;
+    event.pressure = (GLubyte)(clampf(sample.pressure, 0.0f, 1.0f) * 255.0f + 0.5f);
+    event.tilt = (GLubyte)(clampf(sample.tilt, 0.0f, (float)M_PI_2) / (float)M_PI_2 * 255.0f + 0.5f);
+    //! input timestamps are TouchTraceNow() in seconds, exact to the nanosecond for months of uptime
+    event.timestamp = (unsigned long long)(sample.timestamp * 1000000000.0 + 0.5);
+    
+    //! the slot has to be complete before the writer can see it
+    __sync_synchronize();
+    writeIndex = write + 1;
+    ++recordedEvents;
+}
+
+void *TouchRecorder::writeThreadEntry(void *recorder)
+{
+    ((TouchRecorder *)recorder)->writeLoop();
+    return NULL;
+}
+
+void TouchRecorder::writeLoop()
+{
+    while (!stopRequested)
+    {
+        drain();
+        usleep(kTouchRecorderFlushInterval);
+    }
+    //! stop() has cleared the flag record() checks before asking, nothing arrives after this
+    drain();
+}
+
+bool TouchRecorder::drain()
+{
+    unsigned int write = writeIndex;
+    __sync_synchronize();
+    unsigned int read = readIndex;
+    if (read == write)
+    {
+        return true;
+    }
+    
+    encoded.clear();
+    for (; read != write; ++read)
+    {
+        const TouchTraceEvent &event = ring[read & (kTouchRecorderCapacity - 1)];
+        TouchTrace::encodeEvent(encoded, event, previousTimestamp);
+        previousTimestamp = MAX(previousTimestamp, event.timestamp);
+    }
+    //! done reading the slots before handing them back
+    __sync_synchronize();
+    readIndex = write;
+    
+    if (!writeFailed)
+    {
+        writeFailed = fwrite(&encoded[0], 1, encoded.size(), file) != encoded.size() || fflush(file) != 0;
+    }
+    return !writeFailed;
+}
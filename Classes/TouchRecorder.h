@@ -0,0 +1,93 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _TOUCH_RECORDER_H_
+#define _TOUCH_RECORDER_H_
+
+#include "cocos2d.h"
+#include "StrokeTessellator.h"
+#include "TouchTrace.h"
+#include <stdio.h>
+#include <vector>
+#include <pthread.h>
+
+USING_NS_CC;
+
+//! events the ring holds, a power of two; at 240 events a second that is 17 seconds of slack
+#define kTouchRecorderCapacity 4096
+
+/**
+ Records the input stream to a TouchTrace file while the app runs.
+
+ record() is called on the main thread from the input handlers and only copies the
+ event into a single producer single consumer ring, no lock and no allocation. A
+ writer thread wakes a few times a second, encodes what has arrived and appends it to
+ the file, so a crash loses at most the last fraction of a second. When the writer
+ falls behind far enough for the ring to fill up, events are dropped and counted
+ rather than stalling input.
+
+ Not recording, record() is a single flag test.
+ */
+class TouchRecorder
+{
+public:
+    TouchRecorder();
+    ~TouchRecorder();
+
+    //! starts a new trace at path, false if the file can't be created or a recording is running
+    bool start(const char *path, const TouchTraceHeader &header);
+    //! writes out what is left and closes the file, returns when it is on disk
+    void stop();
+    bool isRecording() const;
+
+    void record(TouchTraceEventType type, const StylusSample &sample);
+
+    unsigned int getRecordedEvents() const;
+    //! events lost to a full ring since start
+    unsigned int getDroppedEvents() const;
+
+private:
+    static void *writeThreadEntry(void *recorder);
+    void writeLoop();
+    //! encodes and appends the events between readIndex and writeIndex, on the writer thread
+    bool drain();
+
+    std::vector<TouchTraceEvent> ring;
+    //! only record() advances writeIndex, only the writer advances readIndex
+    volatile unsigned int writeIndex;
+    volatile unsigned int readIndex;
+    volatile bool stopRequested;
+
+    bool recording;
+    FILE *file;
+    pthread_t writeThread;
+    unsigned long long previousTimestamp;
+    std::vector<unsigned char> encoded;
+    bool writeFailed;
+    unsigned int recordedEvents;
+    unsigned int droppedEvents;
+};
+
+#endif // _TOUCH_RECORDER_H_
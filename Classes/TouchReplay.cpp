@@ -0,0 +1,137 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "TouchReplay.h"
+
+TouchReplay::TouchReplay()
+: layer(NULL)
+, timing(kTouchReplayOriginalTiming)
+, clock(0)
+, nextEvent(0)
+, running(false)
+, finished(false)
+{
+}
+
+TouchReplay::~TouchReplay()
+{
+    CC_SAFE_RELEASE(layer);
+}
+
+TouchReplay *TouchReplay::create(PaintLayer *aLayer, const TouchTrace &aTrace)
+{
+    TouchReplay *pRet = new TouchReplay();
+    if (pRet && pRet->initWithLayer(aLayer, aTrace))
+    {
+        pRet->autorelease();
+        return pRet;
+    }
+    CC_SAFE_DELETE(pRet);
+    return NULL;
+}
+
+bool TouchReplay::initWithLayer(PaintLayer *aLayer, const TouchTrace &aTrace)
+{
+    if (aLayer == NULL)
+    {
+        return false;
+    }
+    layer = aLayer;
+    layer->retain();
+    trace = aTrace;
+    return true;
+}
+
+void TouchReplay::start(TouchReplayTiming aTiming)
+{
+    if (running || finished)
+    {
+        return;
+    }
+    timing = aTiming;
+    
+    const TouchTraceHeader &header = trace.header;
+    layer->lineWidth = header.lineWidth;
+    layer->pressureWidth = header.pressureWidth;
+    layer->tiltWidth = header.tiltWidth;
+    layer->strokeStyle = header.style;
+    
+    running = true;
+    retain();
+    CCDirector::sharedDirector()->getScheduler()->scheduleUpdateForTarget(this, 0, false);
+}
+
+bool TouchReplay::isFinished() const
+{
+    return finished;
+}
+
+double TouchReplay::getReplayedSeconds() const
+{
+    if (nextEvent == 0)
+    {
+        return 0;
+    }
+    return (trace.events[nextEvent - 1].timestamp - trace.events[0].timestamp) / 1000000000.0;
+}
+
+void TouchReplay::update(float dt)
+{
+    clock += dt;
+    
+    const std::vector<TouchTraceEvent> &events = trace.events;
+    while (nextEvent < events.size())
+    {
+        const TouchTraceEvent &event = events[nextEvent];
+        if (timing == kTouchReplayOriginalTiming && (event.timestamp - events[0].timestamp) / 1000000000.0 > clock)
+        {
+            break;
+        }
+        
+        StylusSample sample;
+        sample.touchID = event.touchID;
+        sample.location = event.location;
+        sample.pressure = event.pressure / 255.0f;
+        sample.tilt = event.tilt / 255.0f * (float)M_PI_2;
+        //! the recorded clock, so the strokes' point times come out as they were
+        sample.timestamp = event.timestamp / 1000000000.0;
+        
+        switch (event.type)
+        {
+            case kTouchTraceBegan: layer->stylusBegan(sample); break;
+            case kTouchTraceMoved: layer->stylusMoved(sample); break;
+            case kTouchTraceEnded: layer->stylusEnded(sample); break;
+            case kTouchTraceCancelled: layer->stylusCancelled(sample); break;
+        }
+        ++nextEvent;
+    }
+    
+    if (nextEvent == events.size())
+    {
+        CCDirector::sharedDirector()->getScheduler()->unscheduleUpdateForTarget(this);
+        running = false;
+        finished = true;
+        release();
+    }
+}
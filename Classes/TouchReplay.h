@@ -0,0 +1,73 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _TOUCH_REPLAY_H_
+#define _TOUCH_REPLAY_H_
+
+#include "cocos2d.h"
+#include "PaintLayer.h"
+#include "TouchTrace.h"
+
+USING_NS_CC;
+
+typedef enum {
+    //! events reach the layer in the frame they did when recorded
+    kTouchReplayOriginalTiming,
+    //! every event in the next frame, one burst exercising the deferred paths
+    kTouchReplayAsFastAsPossible
+} TouchReplayTiming;
+
+/**
+ Feeds a recorded trace back into a PaintLayer through its stylus entry points, with
+ the line width and style it was recorded with.
+ */
+class TouchReplay : public CCObject
+{
+public:
+    TouchReplay();
+    virtual ~TouchReplay();
+
+    static TouchReplay *create(PaintLayer *aLayer, const TouchTrace &aTrace);
+    bool initWithLayer(PaintLayer *aLayer, const TouchTrace &aTrace);
+
+    //! keeps itself alive until the last event has been fed
+    void start(TouchReplayTiming aTiming);
+    bool isFinished() const;
+    //! seconds from the first event to the last one fed
+    double getReplayedSeconds() const;
+
+    virtual void update(float dt);
+
+private:
+    PaintLayer *layer;
+    TouchTrace trace;
+    TouchReplayTiming timing;
+    double clock;
+    unsigned int nextEvent;
+    bool running;
+    bool finished;
+};
+
+#endif // _TOUCH_REPLAY_H_
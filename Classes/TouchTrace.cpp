@@ -0,0 +1,271 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "TouchTrace.h"
+#include <string.h>
+#include <time.h>
+#if (CC_TARGET_PLATFORM == CC_PLATFORM_IOS)
+#include <mach/mach_time.h>
+#endif
+
+#define kTouchTraceMagic    "PTRC"
+#define kTouchTraceVersion  1
+
+unsigned long long TouchTraceNow()
+{
+#if (CC_TARGET_PLATFORM == CC_PLATFORM_IOS)
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+    {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+}
+
+#pragma mark - Encoding
+
+static void writeVarint(std::vector<unsigned char> &bytes, unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        bytes.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((unsigned char)value);
+}
+
+static void writeFloat(std::vector<unsigned char> &bytes, float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        bytes.push_back((unsigned char)(bits >> (i * 8)));
+    }
+}
+
+static bool readVarint(const std::vector<unsigned char> &bytes, unsigned int &offset, unsigned long long &value)
+{
+    value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7)
+    {
+        if (offset >= bytes.size())
+        {
+            return false;
+        }
+        unsigned char byte = bytes[offset++];
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool readFloat(const std::vector<unsigned char> &bytes, unsigned int &offset, float &value)
+{
+    if (offset + 4 > bytes.size())
+    {
+        return false;
+    }
+    unsigned int bits = 0;
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        bits |= (unsigned int)bytes[offset++] << (i * 8);
+    }
+    memcpy(&value, &bits, sizeof(value));
+    return true;
+}
+
+TouchTraceHeader TouchTrace::headerMake(CCSize canvasSize, float lineWidth, const StrokeStyle &style)
+{
+    TouchTraceHeader header;
+    header.canvasSize = canvasSize;
+    header.lineWidth = lineWidth;
+    header.pressureWidth = 0;
+    header.tiltWidth = 0;
+    header.overdraw = 3.0f;
+    header.style = style;
+    header.startTime = 0;
+    return header;
+}
+
+void TouchTrace::encodeHeader(std::vector<unsigned char> &bytes, const TouchTraceHeader &header)
+{
+    bytes.insert(bytes.end(), kTouchTraceMagic, kTouchTraceMagic + 4);
+    bytes.push_back(kTouchTraceVersion);
+    writeFloat(bytes, header.canvasSize.width);
+    writeFloat(bytes, header.canvasSize.height);
+    writeFloat(bytes, header.lineWidth);
+    writeFloat(bytes, header.pressureWidth);
+    writeFloat(bytes, header.tiltWidth);
+    writeFloat(bytes, header.overdraw);
+    
+    const StrokeStyle &style = header.style;
+    writeFloat(bytes, style.color.r);
+    writeFloat(bytes, style.color.g);
+    writeFloat(bytes, style.color.b);
+    writeFloat(bytes, style.color.a);
+    writeFloat(bytes, style.opacity);
+    bytes.push_back((unsigned char)style.blendMode);
+    bytes.push_back((unsigned char)style.join);
+    writeFloat(bytes, style.miterLimit);
+    writeFloat(bytes, style.pressureOpacity);
+    
+    writeVarint(bytes, header.startTime);
+}
+
+void TouchTrace::encodeEvent(std::vector<unsigned char> &bytes, const TouchTraceEvent &event, unsigned long long previousTimestamp)
+{
+    bytes.push_back((unsigned char)event.type);
+    //! zigzag, synthetic input uses negative ids
+    writeVarint(bytes, ((unsigned int)event.touchID << 1) ^ (unsigned int)(event.touchID >> 31));
+    //! events are recorded in order, a clock going backwards is stored as no time passing
+    writeVarint(bytes, event.timestamp > previousTimestamp ? event.timestamp - previousTimestamp : 0);
+    writeFloat(bytes, event.location.x);
+    writeFloat(bytes, event.location.y);
+    bytes.push_back(event.pressure);
+    bytes.push_back(event.tilt);
+}
+
+#pragma mark - Decoding
+
+bool TouchTrace::decodeHeader(const std::vector<unsigned char> &bytes, unsigned int &offset, TouchTraceHeader &header)
+{
+    if (bytes.size() < offset + 5 || memcmp(&bytes[offset], kTouchTraceMagic, 4) != 0 || bytes[offset + 4] != kTouchTraceVersion)
+    {
+        return false;
+    }
+    offset += 5;
+    
+    StrokeStyle &style = header.style;
+    if (!readFloat(bytes, offset, header.canvasSize.width) || !readFloat(bytes, offset, header.canvasSize.height)
+        || !readFloat(bytes, offset, header.lineWidth) || !readFloat(bytes, offset, header.pressureWidth)
+        || !readFloat(bytes, offset, header.tiltWidth) || !readFloat(bytes, offset, header.overdraw)
+        || !readFloat(bytes, offset, style.color.r) || !readFloat(bytes, offset, style.color.g)
+        || !readFloat(bytes, offset, style.color.b) || !readFloat(bytes, offset, style.color.a)
+        || !readFloat(bytes, offset, style.opacity) || offset + 2 > bytes.size())
+    {
+        return false;
+    }
+    unsigned char blendMode = bytes[offset++];
+    unsigned char join = bytes[offset++];
+    if (blendMode > kStrokeBlendEraser || join > kStrokeJoinBevel)
+    {
+        return false;
+    }
+    style.blendMode = (StrokeBlendMode)blendMode;
+    style.join = (StrokeJoin)join;
+    return readFloat(bytes, offset, style.miterLimit) && readFloat(bytes, offset, style.pressureOpacity)
+        && readVarint(bytes, offset, header.startTime);
+}
+
+bool TouchTrace::decodeEvent(const std::vector<unsigned char> &bytes, unsigned int &offset, unsigned long long previousTimestamp, TouchTraceEvent &event)
+{
+    if (offset >= bytes.size() || bytes[offset] > kTouchTraceCancelled)
+    {
+        return false;
+    }
+    event.type = (TouchTraceEventType)bytes[offset++];
+    
+    unsigned long long touchID, delta;
+    if (!readVarint(bytes, offset, touchID) || !readVarint(bytes, offset, delta)
+        || !readFloat(bytes, offset, event.location.x) || !readFloat(bytes, offset, event.location.y)
+        || offset + 2 > bytes.size())
+    {
+        return false;
+    }
+    event.touchID = (int)((unsigned int)touchID >> 1) ^ -(int)(touchID & 1);
+    event.timestamp = previousTimestamp + delta;
+    event.pressure = bytes[offset++];
+    event.tilt = bytes[offset++];
+    return true;
+}
+
+#pragma mark - Files
+
+bool TouchTrace::load(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    std::vector<unsigned char> bytes;
+    unsigned char buffer[64 * 1024];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        bytes.insert(bytes.end(), buffer, buffer + read);
+    }
+    fclose(file);
+    
+    unsigned int offset = 0;
+    if (!decodeHeader(bytes, offset, header))
+    {
+        return false;
+    }
+    
+    events.clear();
+    unsigned long long previousTimestamp = header.startTime;
+    TouchTraceEvent event;
+    while (offset < bytes.size())
+    {
+        //! a recording cut off mid event keeps everything before it
+        if (!decodeEvent(bytes, offset, previousTimestamp, event))
+        {
+            CCLOG("TouchTrace: %s is cut off after %u events", path, (unsigned int)events.size());
+            break;
+        }
+        events.push_back(event);
+        previousTimestamp = event.timestamp;
+    }
+    return true;
+}
+
+bool TouchTrace::save(const char *path) const
+{
+    std::vector<unsigned char> bytes;
+    encodeHeader(bytes, header);
+    unsigned long long previousTimestamp = header.startTime;
+    for (unsigned int i = 0; i < events.size(); ++i)
+    {
+        encodeEvent(bytes, events[i], previousTimestamp);
+        previousTimestamp = MAX(previousTimestamp, events[i].timestamp);
+    }
+    
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    bool ok = fwrite(&bytes[0], 1, bytes.size(), file) == bytes.size();
+    return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,102 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _TOUCH_TRACE_H_
+#define _TOUCH_TRACE_H_
+
+#include "cocos2d.h"
+#include "StrokeBatch.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+USING_NS_CC;
+
+typedef enum {
+    kTouchTraceBegan,
+    kTouchTraceMoved,
+    kTouchTraceEnded,
+    kTouchTraceCancelled
+} TouchTraceEventType;
+
+//! one touch or pen event as it reached the canvas
+typedef struct _TouchTraceEvent {
+    TouchTraceEventType type;
+    int touchID;
+    //! in GL coordinates, kept exactly
+    CCPoint location;
+    //! 0 no pressure to 255 full
+    GLubyte pressure;
+    //! 0 upright to 255 lying flat
+    GLubyte tilt;
+    //! monotonic clock in nanoseconds, see TouchTraceNow()
+    unsigned long long timestamp;
+} TouchTraceEvent;
+
+//! what the canvas was drawing with when the trace started, a replay needs it to draw the same
+typedef struct _TouchTraceHeader {
+    CCSize canvasSize;
+    float lineWidth;
+    float pressureWidth;
+    float tiltWidth;
+    float overdraw;
+    StrokeStyle style;
+    //! timestamp the first event's is stored relative to
+    unsigned long long startTime;
+} TouchTraceHeader;
+
+//! monotonic clock in nanoseconds, unaffected by changes to the wall clock
+unsigned long long TouchTraceNow();
+
+/**
+ A recorded input stream and its file format.
+
+ The file is a header followed by events until the end of the file, so it can be
+ written while recording and a cut off file still loads up to its last whole event.
+ Little endian throughout. Per event: type byte, zigzag varint touch id, varint
+ nanoseconds since the previous event, both coordinates as raw floats, pressure and
+ tilt bytes. Positions are stored exactly, a replay must see the same input the
+ field did; the timestamps make up most of the redundancy and those are deltas.
+ */
+class TouchTrace
+{
+public:
+    TouchTraceHeader header;
+    std::vector<TouchTraceEvent> events;
+
+    bool load(const char *path);
+    bool save(const char *path) const;
+
+    //! canvas size and the style every stroke is drawn with
+    static TouchTraceHeader headerMake(CCSize canvasSize, float lineWidth, const StrokeStyle &style);
+
+    static void encodeHeader(std::vector<unsigned char> &bytes, const TouchTraceHeader &header);
+    //! previousTimestamp is the timestamp of the event before, or the header's start time
+    static void encodeEvent(std::vector<unsigned char> &bytes, const TouchTraceEvent &event, unsigned long long previousTimestamp);
+    static bool decodeHeader(const std::vector<unsigned char> &bytes, unsigned int &offset, TouchTraceHeader &header);
+    static bool decodeEvent(const std::vector<unsigned char> &bytes, unsigned int &offset, unsigned long long previousTimestamp, TouchTraceEvent &event);
+};
+
+#endif // _TOUCH_TRACE_H_
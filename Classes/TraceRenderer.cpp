@@ -0,0 +1,346 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "TraceRenderer.h"
+#include "PngStreamWriter.h"
+#include <algorithm>
+#include <string.h>
+
+static double secondsSince(unsigned long long start)
+{
+    return (TouchTraceNow() - start) / 1000000000.0;
+}
+
+static bool strokeBatchOrder(const std::pair<StrokeBatchState, StrokeTessellator *> &a, const std::pair<StrokeBatchState, StrokeTessellator *> &b)
+{
+    return StrokeBatch::stateLess(a.first, b.first);
+}
+
+TraceRenderer::TraceRenderer()
+: resolutionScale(1.0f)
+, frameInterval(1.0 / 60)
+, liveSpanLimit(16)
+, trace(NULL)
+, nextEvent(0)
+, frameEnd(0)
+, frameLength(0)
+, overdraw(3.0f)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+TraceRenderer::~TraceRenderer()
+{
+    releaseStrokes();
+}
+
+const TraceRenderStats &TraceRenderer::getStats() const
+{
+    return stats;
+}
+
+const StrokeRasterizer &TraceRenderer::getRasterizer() const
+{
+    return rasterizer;
+}
+
+StrokeRasterizer &TraceRenderer::getRasterizer()
+{
+    return rasterizer;
+}
+
+void TraceRenderer::releaseStrokes()
+{
+    for (unsigned int i = 0; i < activeStrokes.size(); ++i)
+    {
+        activeStrokes[i]->releaseStencilRef();
+        delete activeStrokes[i];
+    }
+    activeStrokes.clear();
+}
+
+bool TraceRenderer::render(const TouchTrace &aTrace)
+{
+    unsigned long long renderStart = TouchTraceNow();
+    if (!begin(aTrace))
+    {
+        return false;
+    }
+    while (!isFinished())
+    {
+        renderFrame();
+    }
+    stats.totalSeconds = secondsSince(renderStart);
+    return true;
+}
+
+bool TraceRenderer::begin(const TouchTrace &aTrace)
+{
+    memset(&stats, 0, sizeof(stats));
+    releaseStrokes();
+    trace = NULL;
+    
+    header = aTrace.header;
+    if (!rasterizer.init(header.canvasSize, resolutionScale))
+    {
+        return false;
+    }
+    rasterizer.clear(batch.getPaperColor());
+    batch.setCullRect(CCRectMake(0, 0, header.canvasSize.width, header.canvasSize.height));
+    //! as CanvasConfigOverdraw widens it, never narrower than a canvas pixel
+    overdraw = MAX(header.overdraw, 1.0f / resolutionScale);
+    
+    trace = &aTrace;
+    stats.events = (unsigned int)trace->events.size();
+    nextEvent = 0;
+    frameEnd = 0;
+    frameLength = (unsigned long long)(frameInterval * 1000000000.0);
+    return true;
+}
+
+bool TraceRenderer::isFinished() const
+{
+    return trace == NULL || (nextEvent >= trace->events.size() && activeStrokes.empty());
+}
+
+bool TraceRenderer::isIdle() const
+{
+    return activeStrokes.empty();
+}
+
+double TraceRenderer::getTime() const
+{
+    return frameEnd > header.startTime ? (frameEnd - header.startTime) / 1000000000.0 : 0.0;
+}
+
+double TraceRenderer::getNextEventTime() const
+{
+    if (trace == NULL || nextEvent >= trace->events.size())
+    {
+        return getTime();
+    }
+    return (trace->events[nextEvent].timestamp - header.startTime) / 1000000000.0;
+}
+
+TraceRenderPosition TraceRenderer::getPosition() const
+{
+    CCAssert(isIdle(), "replay position taken mid stroke");
+    TraceRenderPosition position;
+    position.nextEvent = nextEvent;
+    position.frameEnd = frameEnd;
+    return position;
+}
+
+void TraceRenderer::setPosition(const TraceRenderPosition &position)
+{
+    releaseStrokes();
+    nextEvent = position.nextEvent;
+    frameEnd = position.frameEnd;
+    //! strokes after position are isolated by stencil values no mark on the canvas can have then
+    rasterizer.clearStencil();
+    batch.getStencil()->reset();
+}
+
+void TraceRenderer::skipIdleTime()
+{
+    //! nothing happens until the next event, no frames to draw in between
+    if (activeStrokes.empty() && nextEvent < trace->events.size() && trace->events[nextEvent].timestamp >= frameEnd)
+    {
+        frameEnd = trace->events[nextEvent].timestamp + frameLength;
+    }
+}
+
+void TraceRenderer::renderUntil(double seconds)
+{
+    unsigned long long until = header.startTime + (unsigned long long)(MAX(seconds, 0.0) * 1000000000.0);
+    while (!isFinished())
+    {
+        skipIdleTime();
+        if (frameEnd - frameLength >= until)
+        {
+            return;
+        }
+        renderFrame();
+    }
+}
+
+void TraceRenderer::renderFrame()
+{
+    if (isFinished())
+    {
+        return;
+    }
+    skipIdleTime();
+    
+    const std::vector<TouchTraceEvent> &events = trace->events;
+    unsigned long long frameStart = TouchTraceNow();
+    while (nextEvent < events.size() && events[nextEvent].timestamp < frameEnd)
+    {
+        applyEvent(events[nextEvent++]);
+    }
+    //! a trace cut off mid stroke ends it where it stopped
+    if (nextEvent == events.size())
+    {
+        endActiveStrokes();
+    }
+    drawFrame();
+    
+    stats.worstFrameSeconds = MAX(stats.worstFrameSeconds, secondsSince(frameStart));
+    ++stats.frames;
+    frameEnd += frameLength;
+}
+
+StrokeTessellator *TraceRenderer::activeStrokeForTouch(int touchID)
+{
+    for (unsigned int i = 0; i < activeStrokes.size(); ++i)
+    {
+        if (activeStrokes[i]->touchID == touchID && !activeStrokes[i]->isEnded())
+        {
+            return activeStrokes[i];
+        }
+    }
+    return NULL;
+}
+
+void TraceRenderer::applyEvent(const TouchTraceEvent &event)
+{
+    //! the PaintLayer stylus entry points, minus the stroke stream and committing
+    StylusSample sample;
+    sample.touchID = event.touchID;
+    sample.location = event.location;
+    sample.pressure = event.pressure / 255.0f;
+    sample.tilt = event.tilt / 255.0f * (float)M_PI_2;
+    sample.timestamp = (event.timestamp - header.startTime) / 1000000000.0;
+    
+    StrokeTessellator *stroke = activeStrokeForTouch(event.touchID);
+    if (event.type == kTouchTraceBegan)
+    {
+        //! a plain tessellator, renderers run on threads of their own
+        stroke = new StrokeTessellator();
+        stroke->initWithStyle(header.style);
+        stroke->touchID = event.touchID;
+        stroke->overdraw = overdraw;
+        stroke->startTime = sample.timestamp;
+        activeStrokes.push_back(stroke);
+        
+        LinePoint point = stroke->pointForSample(sample, header.lineWidth, header.pressureWidth, header.tiltWidth);
+        stroke->startNewLineFrom(point);
+        stroke->addPoint(point);
+        stats.points += 2;
+        ++stats.strokes;
+    }
+    else if (stroke != NULL && event.type == kTouchTraceMoved)
+    {
+        if (ccpLength(ccpSub(stroke->getLastPosition(), sample.location)) >= kStrokeMinInputDistance)
+        {
+            stroke->addPoint(stroke->pointForSample(sample, header.lineWidth, header.pressureWidth, header.tiltWidth));
+            ++stats.points;
+        }
+    }
+    else if (stroke != NULL)
+    {
+        stroke->endLineAt(stroke->pointForSample(sample, header.lineWidth, header.pressureWidth, header.tiltWidth));
+        ++stats.points;
+    }
+}
+
+void TraceRenderer::endActiveStrokes()
+{
+    for (unsigned int i = 0; i < activeStrokes.size(); ++i)
+    {
+        StrokeTessellator *stroke = activeStrokes[i];
+        if (!stroke->isEnded())
+        {
+            stroke->endLineAt(stroke->getLastPoint());
+        }
+    }
+}
+
+void TraceRenderer::drawFrame()
+{
+    //! same order PaintLayer::drawLiveStrokes draws in
+    std::vector<std::pair<StrokeBatchState, StrokeTessellator *> > strokes;
+    strokes.reserve(activeStrokes.size());
+    for (unsigned int i = 0; i < activeStrokes.size(); ++i)
+    {
+        strokes.push_back(std::make_pair(activeStrokes[i]->batchStateIn(&batch), activeStrokes[i]));
+    }
+    std::stable_sort(strokes.begin(), strokes.end(), strokeBatchOrder);
+    
+    unsigned long long start = TouchTraceNow();
+    for (unsigned int i = 0; i < strokes.size(); ++i)
+    {
+        strokes[i].second->tessellate(&batch, liveSpanLimit);
+    }
+    unsigned int vertexCount = (unsigned int)batch.getVertices().size();
+    stats.tessellateSeconds += secondsSince(start);
+    
+    start = TouchTraceNow();
+    batch.flush(&rasterizer);
+    stats.rasterSeconds += secondsSince(start);
+    
+    for (unsigned int i = 0; i < strokes.size(); ++i)
+    {
+        StrokeTessellator *stroke = strokes[i].second;
+        while (stroke->hasBacklog())
+        {
+            start = TouchTraceNow();
+            stroke->tessellateBacklog(&batch);
+            vertexCount += (unsigned int)batch.getVertices().size();
+            stats.tessellateSeconds += secondsSince(start);
+            
+            start = TouchTraceNow();
+            batch.flush(&rasterizer);
+            stats.rasterSeconds += secondsSince(start);
+        }
+    }
+    stats.vertices += vertexCount;
+    
+    for (int i = (int)activeStrokes.size() - 1; i >= 0; --i)
+    {
+        if (activeStrokes[i]->isFinished())
+        {
+            activeStrokes[i]->releaseStencilRef();
+            delete activeStrokes[i];
+            activeStrokes.erase(activeStrokes.begin() + i);
+        }
+    }
+}
+
+bool TraceRenderer::writePNG(const char *path) const
+{
+    PngStreamWriter writer;
+    if (!writer.open(path, rasterizer.getWidth(), rasterizer.getHeight()))
+    {
+        return false;
+    }
+    for (unsigned int y = 0; y < rasterizer.getHeight(); ++y)
+    {
+        if (!writer.writeRow(rasterizer.rowFromTop(y)))
+        {
+            break;
+        }
+    }
+    return writer.close();
+}
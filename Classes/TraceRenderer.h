@@ -0,0 +1,131 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _TRACE_RENDERER_H_
+#define _TRACE_RENDERER_H_
+
+#include "cocos2d.h"
+#include "StrokeTessellator.h"
+#include "StrokeBatch.h"
+#include "StrokeRasterizer.h"
+#include "TouchTrace.h"
+#include <vector>
+
+USING_NS_CC;
+
+//! what replaying one trace took, times are wall clock on the rendering thread
+typedef struct _TraceRenderStats {
+    unsigned int events;
+    unsigned int strokes;
+    unsigned int points;
+    unsigned int frames;
+    unsigned int vertices;
+    double tessellateSeconds;
+    double rasterSeconds;
+    double worstFrameSeconds;
+    double totalSeconds;
+} TraceRenderStats;
+
+//! where a replay stands between strokes, with the canvas it is all it needs to go on
+typedef struct _TraceRenderPosition {
+    unsigned int nextEvent;
+    unsigned long long frameEnd;
+} TraceRenderPosition;
+
+/**
+ Replays a recorded trace through the stroke pipeline without GL.
+
+ Events are grouped into frames by their timestamps the way they would have reached
+ PaintLayer, the live strokes are tessellated into a StrokeBatch frame by frame with
+ the same span limit, and the batch is flushed into a StrokeRasterizer instead of the
+ canvas render texture. Deferred spans are drawn right after each frame, offline there
+ is no frame budget to wait for.
+
+ render() replays a whole trace. begin() and renderUntil() replay it piecewise, and
+ between strokes the replay can be moved to a position taken earlier, see
+ TraceTimeLapse.
+
+ Uses no cocos2d singletons, one renderer per thread can run at the same time.
+ */
+class TraceRenderer
+{
+public:
+    TraceRenderer();
+    ~TraceRenderer();
+
+    bool render(const TouchTrace &trace);
+    bool writePNG(const char *path) const;
+
+    //! starts replaying trace on a blank canvas, trace must outlive the replay
+    bool begin(const TouchTrace &trace);
+    //! draws the next frame
+    void renderFrame();
+    //! draws every frame starting before seconds after the trace's start
+    void renderUntil(double seconds);
+    bool isFinished() const;
+    //! no stroke being drawn, the position and the canvas are all of the replay's state
+    bool isIdle() const;
+    //! seconds after the trace's start the frames drawn so far reach
+    double getTime() const;
+    //! seconds after the trace's start of the next event not applied yet, getTime() once all are
+    double getNextEventTime() const;
+    //! only valid while idle
+    TraceRenderPosition getPosition() const;
+    //! continues from a position taken while idle, the caller puts the canvas of then back into getRasterizer()
+    void setPosition(const TraceRenderPosition &position);
+
+    const TraceRenderStats &getStats() const;
+    const StrokeRasterizer &getRasterizer() const;
+    StrokeRasterizer &getRasterizer();
+
+    //! canvas pixels per point
+    float resolutionScale;
+    //! seconds of trace time per frame
+    double frameInterval;
+    //! see PaintLayer::liveSpanLimit
+    unsigned int liveSpanLimit;
+
+private:
+    StrokeTessellator *activeStrokeForTouch(int touchID);
+    //! moves the next frame to the next event when there is nothing to draw until then
+    void skipIdleTime();
+    void applyEvent(const TouchTraceEvent &event);
+    void drawFrame();
+    void endActiveStrokes();
+    void releaseStrokes();
+
+    const TouchTrace *trace;
+    TouchTraceHeader header;
+    unsigned int nextEvent;
+    unsigned long long frameEnd;
+    unsigned long long frameLength;
+    float overdraw;
+    std::vector<StrokeTessellator *> activeStrokes;
+    StrokeBatch batch;
+    StrokeRasterizer rasterizer;
+    TraceRenderStats stats;
+};
+
+#endif // _TRACE_RENDERER_H_
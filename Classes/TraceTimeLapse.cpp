@@ -0,0 +1,218 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "TraceTimeLapse.h"
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+static bool writeAll(int fd, const unsigned char *bytes, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+TraceTimeLapse::TraceTimeLapse()
+: keyframeInterval(10.0)
+, trace(NULL)
+, duration(0)
+{
+}
+
+TraceTimeLapse::~TraceTimeLapse()
+{
+    clearKeyframes();
+}
+
+void TraceTimeLapse::clearKeyframes()
+{
+    for (unsigned int i = 0; i < keyframes.size(); ++i)
+    {
+        delete keyframes[i];
+    }
+    keyframes.clear();
+}
+
+bool TraceTimeLapse::build(const TouchTrace &aTrace)
+{
+    clearKeyframes();
+    trace = NULL;
+    duration = 0;
+    if (!renderer.begin(aTrace))
+    {
+        return false;
+    }
+    trace = &aTrace;
+    
+    double nextKeyframe = keyframeInterval;
+    while (!renderer.isFinished())
+    {
+        renderer.renderFrame();
+        //! mid stroke the replay has strokes half drawn, between them the canvas is all there is
+        if (renderer.isIdle() && renderer.getTime() >= nextKeyframe)
+        {
+            addKeyframe();
+            nextKeyframe = renderer.getTime() + keyframeInterval;
+        }
+    }
+    duration = renderer.getTime();
+    return true;
+}
+
+void TraceTimeLapse::addKeyframe()
+{
+    const StrokeRasterizer &rasterizer = renderer.getRasterizer();
+    Keyframe *keyframe = new Keyframe();
+    keyframe->time = renderer.getTime();
+    keyframe->position = renderer.getPosition();
+    keyframe->canvas.store(rasterizer.getPixels(), rasterizer.getWidth(), rasterizer.getHeight());
+    keyframes.push_back(keyframe);
+}
+
+int TraceTimeLapse::keyframeBefore(double seconds) const
+{
+    int first = 0;
+    int last = (int)keyframes.size();
+    //! upper bound, first keyframe after seconds
+    while (first < last)
+    {
+        int middle = (first + last) / 2;
+        if (seconds < keyframes[middle]->time)
+        {
+            last = middle;
+        }
+        else
+        {
+            first = middle + 1;
+        }
+    }
+    return first - 1;
+}
+
+void TraceTimeLapse::seek(double seconds)
+{
+    if (trace == NULL)
+    {
+        return;
+    }
+    
+    int keyframe = keyframeBefore(seconds);
+    bool keyframeAhead = keyframe >= 0 && keyframes[keyframe]->time > renderer.getTime();
+    if (seconds < renderer.getTime() || keyframeAhead)
+    {
+        if (keyframe < 0)
+        {
+            renderer.begin(*trace);
+        }
+        else
+        {
+            const Keyframe *start = keyframes[keyframe];
+            renderer.setPosition(start->position);
+            start->canvas.decode(renderer.getRasterizer().getPixels());
+        }
+    }
+    renderer.renderUntil(seconds);
+}
+
+double TraceTimeLapse::getTime() const
+{
+    return renderer.getTime();
+}
+
+double TraceTimeLapse::getDuration() const
+{
+    return duration;
+}
+
+const StrokeRasterizer &TraceTimeLapse::getRasterizer() const
+{
+    return renderer.getRasterizer();
+}
+
+unsigned int TraceTimeLapse::getKeyframeCount() const
+{
+    return (unsigned int)keyframes.size();
+}
+
+unsigned int TraceTimeLapse::getKeyframeBytes() const
+{
+    unsigned int bytes = 0;
+    for (unsigned int i = 0; i < keyframes.size(); ++i)
+    {
+        bytes += keyframes[i]->canvas.getStoredBytes();
+    }
+    return bytes;
+}
+
+bool TraceTimeLapse::writeFrames(int fd, double from, double speed, double fps)
+{
+    if (trace == NULL || speed <= 0 || fps <= 0)
+    {
+        return false;
+    }
+    
+    const StrokeRasterizer &rasterizer = renderer.getRasterizer();
+    unsigned int rowLength = rasterizer.getWidth() * 4;
+    std::vector<unsigned char> frame(rowLength * rasterizer.getHeight());
+    double step = speed / fps;
+    double skipped = 0;
+    for (unsigned int i = 0; ; ++i)
+    {
+        double time = from + i * step + skipped;
+        seek(time);
+        for (unsigned int y = 0; y < rasterizer.getHeight(); ++y)
+        {
+            memcpy(&frame[y * rowLength], rasterizer.rowFromTop(y), rowLength);
+        }
+        if (!writeAll(fd, &frame[0], frame.size()))
+        {
+            return false;
+        }
+        if (time >= duration)
+        {
+            return true;
+        }
+        
+        //! the next frame shows the next stroke starting
+        double nextEvent = renderer.getNextEventTime();
+        if (renderer.isIdle() && nextEvent > time + step)
+        {
+            skipped += floor((nextEvent - time) / step) * step;
+        }
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ * Smooth drawing: http://merowing.info
+ *
+ * Copyright (c) 2012 Krzysztof Zabłocki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _TRACE_TIME_LAPSE_H_
+#define _TRACE_TIME_LAPSE_H_
+
+#include "cocos2d.h"
+#include "CanvasTileStore.h"
+#include "TouchTrace.h"
+#include "TraceRenderer.h"
+#include <vector>
+
+USING_NS_CC;
+
+/**
+ Plays a recorded session back as a time-lapse and scrubs it to any point in time.
+
+ build() replays the trace once and keeps a keyframe every keyframeInterval seconds of
+ trace time, taken at the first pause between strokes after it: the canvas compressed
+ by a CanvasTileStore and where the replay stood. The keyframes are sorted by time, so
+ seek() finds the last one before the target by binary search and replays only the
+ events after it. Seeking forward past no keyframe just replays on.
+ */
+class TraceTimeLapse
+{
+public:
+    TraceTimeLapse();
+    ~TraceTimeLapse();
+
+    //! replays trace taking keyframes, trace must outlive the time-lapse
+    bool build(const TouchTrace &trace);
+    //! seconds from the trace's start to the last frame drawn
+    double getDuration() const;
+    //! draws the canvas as it was seconds after the trace's start
+    void seek(double seconds);
+    double getTime() const;
+    const StrokeRasterizer &getRasterizer() const;
+
+    /**
+     writes frames from seconds on to fd as raw RGBA, top row first, with nothing in
+     between, speed seconds of trace time per second at fps frames per second. Pauses
+     longer than a frame are cut to one. False if fd stopped taking them.
+     */
+    bool writeFrames(int fd, double from, double speed, double fps);
+
+    unsigned int getKeyframeCount() const;
+    //! RAM the compressed keyframe canvases take
+    unsigned int getKeyframeBytes() const;
+
+    //! configure before build(), see TraceRenderer
+    TraceRenderer renderer;
+    //! seconds of trace time at least between keyframes
+    double keyframeInterval;
+
+private:
+    typedef struct _Keyframe {
+        double time;
+        TraceRenderPosition position;
+        CanvasTileStore canvas;
+    } Keyframe;
+
+    void clearKeyframes();
+    void addKeyframe();
+    //! index of the last keyframe at or before seconds, -1 if none
+    int keyframeBefore(double seconds) const;
+
+    const TouchTrace *trace;
+    std::vector<Keyframe *> keyframes;
+    double duration;
+};
+
+#endif // _TRACE_TIME_LAPSE_H_
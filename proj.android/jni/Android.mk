@@ -8,7 +8,37 @@ LOCAL_MODULE_FILENAME := libcocos2dcpp
 
 LOCAL_SRC_FILES := hellocpp/main.cpp \
                    ../../Classes/AppDelegate.cpp \
-                   ../../Classes/HelloWorldScene.cpp
+                   ../../Classes/PaintLayer.cpp \
+                   ../../Classes/Stroke.cpp \
+                   ../../Classes/StrokeBatch.cpp \
+                   ../../Classes/StrokeIndex.cpp \
+                   ../../Classes/StrokeSimplifier.cpp \
+                   ../../Classes/StrokeMeshCache.cpp \
+                   ../../Classes/PngStreamWriter.cpp \
+                   ../../Classes/CanvasExporter.cpp \
+                   ../../Classes/CanvasConfig.cpp \
+                   ../../Classes/StrokeStream.cpp \
+                   ../../Classes/StrokeGeometry.cpp \
+                   ../../Classes/FrameScheduler.cpp \
+                   ../../Classes/SyntheticStylus.cpp \
+                   ../../Classes/StrokeRasterizer.cpp \
+                   ../../Classes/TouchTrace.cpp \
+                   ../../Classes/TraceRenderer.cpp \
+                   ../../Classes/TouchRecorder.cpp \
+                   ../../Classes/TouchReplay.cpp \
+                   ../../Classes/StrokeCurveFitter.cpp \
+                   ../../Classes/StrokeCurveWorker.cpp \
+                   ../../Classes/CanvasLayerStack.cpp \
+                   ../../Classes/CanvasFill.cpp \
+                   ../../Classes/StrokeSymmetry.cpp \
+                   ../../Classes/CanvasTileStore.cpp \
+                   ../../Classes/TraceTimeLapse.cpp \
+                   ../../Classes/StrokeOutline.cpp \
+                   ../../Classes/StrokeVectorExporter.cpp \
+                   ../../Classes/StrokeQualityGovernor.cpp \
+                   ../../Classes/StrokeBulkLoader.cpp \
+                   ../../Classes/CanvasMipPyramid.cpp \
+                   ../../Classes/StrokeTessellator.cpp
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../Classes
 
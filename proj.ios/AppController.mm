@@ -3,6 +3,7 @@
 #import "cocos2d.h"
 #import "AppDelegate.h"
 #import "RootViewController.h"
+#import "PaintLayer.h"
 
 @implementation AppController
 
@@ -100,6 +101,13 @@ static AppDelegate s_sharedApplication;
     /*
      Free up as much memory as possible by purging cached data objects that can be recreated (or reloaded from disk) later.
      */
+    cocos2d::CCScene *scene = cocos2d::CCDirector::sharedDirector()->getRunningScene();
+    PaintLayer *layer = scene != NULL ? (PaintLayer *)scene->getChildByTag(kPaintLayerTag) : NULL;
+    if (layer != NULL)
+    {
+        // inactive layers are drawn again from their strokes when needed
+        layer->purgeIdleLayers();
+    }
 }
 
 
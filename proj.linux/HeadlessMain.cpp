@@ -0,0 +1,237 @@
+#include "../Classes/StrokeGeometry.h"
+#include "../Classes/TouchTrace.h"
+#include "../Classes/TraceRenderer.h"
+#include "../Classes/TraceTimeLapse.h"
+#include "cocos2d.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+USING_NS_CC;
+
+// renders recorded touch traces without a window, one trace per worker at a time
+
+typedef struct _TraceJob {
+    std::string path;
+    std::string imagePath;
+    TraceRenderStats stats;
+    bool loaded;
+    bool rendered;
+    bool imageWritten;
+} TraceJob;
+
+typedef struct _JobQueue {
+    std::vector<TraceJob> jobs;
+    unsigned int next;
+    pthread_mutex_t mutex;
+    float scale;
+    bool writeImages;
+} JobQueue;
+
+static void *renderWorker(void *argument)
+{
+    JobQueue *queue = (JobQueue *)argument;
+    TraceRenderer renderer;
+    renderer.resolutionScale = queue->scale;
+    while (true)
+    {
+        pthread_mutex_lock(&queue->mutex);
+        unsigned int index = queue->next++;
+        pthread_mutex_unlock(&queue->mutex);
+        if (index >= queue->jobs.size())
+        {
+            return NULL;
+        }
+
+        // every job is touched by exactly one worker
+        TraceJob &job = queue->jobs[index];
+        TouchTrace trace;
+        job.loaded = trace.load(job.path.c_str());
+        job.rendered = job.loaded && renderer.render(trace);
+        if (job.rendered)
+        {
+            job.stats = renderer.getStats();
+            job.imageWritten = !queue->writeImages || renderer.writePNG(job.imagePath.c_str());
+        }
+    }
+}
+
+static std::string imagePathFor(const std::string &tracePath, const std::string &outputDirectory)
+{
+    std::string name = tracePath.substr(tracePath.find_last_of('/') + 1);
+    std::string::size_type dot = name.find_last_of('.');
+    if (dot != std::string::npos && dot > 0)
+    {
+        name = name.substr(0, dot);
+    }
+    std::string directory = outputDirectory.empty() ? tracePath.substr(0, tracePath.find_last_of('/') + 1) : outputDirectory + "/";
+    return directory + name + ".png";
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-j jobs] [-o directory] [-s scale] [-n] trace...\n"
+                    "       %s -v fd [-x speed] [-r fps] [-a seconds] [-s scale] trace\n"
+                    "       %s -g\n"
+                    "  -j  traces rendered at once, defaults to the number of cores\n"
+                    "  -o  where images go, defaults to next to each trace\n"
+                    "  -s  canvas pixels per point, defaults to 1\n"
+                    "  -n  no images, timing only\n"
+                    "  -v  time-lapse of the trace as raw RGBA frames to file descriptor fd\n"
+                    "  -x  seconds of the trace per second of time-lapse, defaults to 10\n"
+                    "  -r  frames per second of time-lapse, defaults to 30\n"
+                    "  -a  seconds into the trace the time-lapse starts at, defaults to 0\n"
+                    "  -g  check the stroke geometry policy against float and exit\n", program, program, program);
+}
+
+// e.g. PaintingHeadless -v 3 session.trace 3>&1 >/dev/null | ffmpeg -f rawvideo -pix_fmt rgba -s WxH -r 30 -i - out.mp4
+static int writeTimeLapse(const char *path, int fd, float scale, double speed, double fps, double from)
+{
+    TouchTrace trace;
+    if (!trace.load(path))
+    {
+        fprintf(stderr, "%s: not a readable trace\n", path);
+        return 1;
+    }
+    TraceTimeLapse timeLapse;
+    timeLapse.renderer.resolutionScale = scale;
+    if (!timeLapse.build(trace))
+    {
+        fprintf(stderr, "%s: could not render\n", path);
+        return 1;
+    }
+    const StrokeRasterizer &rasterizer = timeLapse.getRasterizer();
+    fprintf(stderr, "%s: %ux%u rgba at %g fps, %.3f s of trace, %u keyframes in %u bytes\n", path, rasterizer.getWidth(), rasterizer.getHeight(),
+            fps, timeLapse.getDuration(), timeLapse.getKeyframeCount(), timeLapse.getKeyframeBytes());
+
+    // an encoder that quits early shows up as a failed write, not a signal
+    signal(SIGPIPE, SIG_IGN);
+    if (!timeLapse.writeFrames(fd, from, speed, fps))
+    {
+        fprintf(stderr, "%s: could not write frames\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+// the build's STROKE_GEOMETRY_POLICY against float, fails when it is off by more than the tolerance
+static int checkGeometry()
+{
+    StrokeGeometryErrors errors;
+    bool passed = StrokeGeometrySelfCheck(errors);
+    printf("stroke geometry policy %d, worst error in points: offsets %f, caps %f, curves %f, tolerance %f\n",
+           STROKE_GEOMETRY_POLICY, errors.perpendicular, errors.cap, errors.curve, kStrokeGeometryTolerance);
+    return passed ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int threadCount = cores > 0 ? (unsigned int)cores : 1;
+    std::string outputDirectory;
+    JobQueue queue;
+    queue.next = 0;
+    queue.scale = 1.0f;
+    queue.writeImages = true;
+    int videoFD = -1;
+    double speed = 10.0;
+    double fps = 30.0;
+    double from = 0.0;
+
+    int option;
+    while ((option = getopt(argc, argv, "j:o:s:nv:x:r:a:gh")) != -1)
+    {
+        switch (option)
+        {
+            case 'j': threadCount = (unsigned int)MAX(1, atoi(optarg)); break;
+            case 'o': outputDirectory = optarg; break;
+            case 's': queue.scale = (float)atof(optarg); break;
+            case 'n': queue.writeImages = false; break;
+            case 'v': videoFD = atoi(optarg); break;
+            case 'x': speed = atof(optarg); break;
+            case 'r': fps = atof(optarg); break;
+            case 'a': from = atof(optarg); break;
+            case 'g': return checkGeometry();
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind >= argc || queue.scale <= 0 || speed <= 0 || fps <= 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (videoFD >= 0)
+    {
+        if (optind + 1 != argc)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        return writeTimeLapse(argv[optind], videoFD, queue.scale, speed, fps, from);
+    }
+
+    for (int i = optind; i < argc; ++i)
+    {
+        TraceJob job;
+        job.path = argv[i];
+        job.imagePath = imagePathFor(job.path, outputDirectory);
+        memset(&job.stats, 0, sizeof(job.stats));
+        job.loaded = job.rendered = job.imageWritten = false;
+        queue.jobs.push_back(job);
+    }
+
+    pthread_mutex_init(&queue.mutex, NULL);
+    threadCount = MIN(threadCount, (unsigned int)queue.jobs.size());
+    std::vector<pthread_t> threads(threadCount);
+    unsigned long long start = TouchTraceNow();
+    unsigned int started = 0;
+    for (; started < threadCount; ++started)
+    {
+        if (pthread_create(&threads[started], NULL, renderWorker, &queue) != 0)
+        {
+            break;
+        }
+    }
+    if (started == 0)
+    {
+        // no threads to be had, render on this one
+        renderWorker(&queue);
+    }
+    for (unsigned int i = 0; i < started; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    double wallSeconds = (TouchTraceNow() - start) / 1000000000.0;
+    pthread_mutex_destroy(&queue.mutex);
+
+    // tab separated, one line per trace in the order given, so runs can be diffed
+    printf("trace\tevents\tstrokes\tpoints\tframes\tvertices\ttessellate_ms\traster_ms\tworst_frame_ms\ttotal_ms\n");
+    int failures = 0;
+    double cpuSeconds = 0;
+    for (unsigned int i = 0; i < queue.jobs.size(); ++i)
+    {
+        const TraceJob &job = queue.jobs[i];
+        if (!job.rendered || !job.imageWritten)
+        {
+            fprintf(stderr, "%s: %s\n", job.path.c_str(), !job.loaded ? "not a readable trace" : !job.rendered ? "could not render" : "could not write image");
+            ++failures;
+            if (!job.rendered)
+            {
+                continue;
+            }
+        }
+        const TraceRenderStats &stats = job.stats;
+        printf("%s\t%u\t%u\t%u\t%u\t%u\t%.3f\t%.3f\t%.3f\t%.3f\n", job.path.c_str(), stats.events, stats.strokes, stats.points,
+               stats.frames, stats.vertices, stats.tessellateSeconds * 1000.0, stats.rasterSeconds * 1000.0,
+               stats.worstFrameSeconds * 1000.0, stats.totalSeconds * 1000.0);
+        cpuSeconds += stats.totalSeconds;
+    }
+    fprintf(stderr, "%u traces on %u threads in %.3f s, %.3f s of rendering\n", (unsigned int)queue.jobs.size(), MAX(started, 1u), wallSeconds, cpuSeconds);
+    return failures > 0 ? 1 : 0;
+}
@@ -57,3 +57,6 @@ check_make_result
 
 make DEBUG=1
 check_make_result
+
+make -f Makefile.headless DEBUG=1
+check_make_result